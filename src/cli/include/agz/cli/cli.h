@@ -15,6 +15,19 @@ struct Params
 {
     std::string scene_description;
     std::string scene_filename;
+
+    // non-empty when converting a mesh file instead of rendering
+    std::string convert_mesh_input;
+    std::string convert_mesh_output;
+
+    // non-empty when converting a volume file instead of rendering
+    std::string convert_volume_format;
+    std::string convert_volume_input;
+    std::string convert_volume_output;
+
+    // non-empty when converting an image file instead of rendering
+    std::string convert_texture_input;
+    std::string convert_texture_output;
 };
 
 /*
@@ -23,5 +36,18 @@ struct Params
         -d only: load scene desc from SceneDescriptionFilename
         -s only: use SceneDescription as scene desc and assume that it's loaded from './scene.txt'
         -d and -s: use SceneDescription as scene desc and assume that it's loaded from SceneDescriptionFilename
+
+    --convert-mesh InputMeshFilename,OutputMeshFilename
+
+        convert an OBJ/STL mesh file to indexed binary mesh (.agzm) and exit
+
+    --convert-volume Format,InputVolumeFilename,OutputVolumeFilename
+
+        convert a binary volume file to sparse bricked volume (.agzv) and exit.
+        Format is one of { real, spec, gray8, rgb8 }
+
+    --convert-texture InputImageFilename,OutputTextureFilename
+
+        convert an image file to tiled texture with mip levels (.agzt) and exit
 */
 std::optional<Params> parse_opts(int argc, char *argv[]);
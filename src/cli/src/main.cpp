@@ -1,4 +1,5 @@
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <optional>
 #include <string>
@@ -8,15 +9,123 @@
 #include <agz/factory/factory.h>
 #include <agz/tracer/tracer.h>
 
+#include <agz/utility/image.h>
 #include <agz/utility/misc.h>
 #include <agz/utility/string.h>
 
+void convert_mesh(const std::string &input, const std::string &output)
+{
+    using namespace agz::tracer;
+
+    AGZ_INFO("load mesh from {}", input);
+    const auto triangles = agz::mesh::load_from_file(input);
+    AGZ_INFO("triangle count: {}", triangles.size());
+
+    factory::save_indexed_mesh(output, triangles.data(), triangles.size());
+
+    // the bvh is built from the quantized triangles read back from the saved
+    // file with default parameters of triangle_bvh, so that it matches the
+    // bvh triangle_bvh would build
+
+    const auto decoded_triangles = factory::load_indexed_mesh(output);
+    if(!decoded_triangles.empty())
+    {
+        AGZ_INFO("build triangle bvh");
+        const auto bvh = serialize_triangle_bvh(
+            decoded_triangles, TriangleBVHParams::from_quality(
+                TriangleBVHParams::Quality::Medium));
+
+        factory::save_indexed_mesh(
+            output, triangles.data(), triangles.size(),
+            bvh.data(), bvh.size());
+    }
+
+    const factory::IndexedMeshFile file(output);
+    AGZ_INFO("save indexed mesh to {}: {} vertices, {} triangles, "
+             "{} bytes of bvh",
+             output, file.vertex_count(), file.triangle_count(),
+             file.bvh_size());
+}
+
+void convert_volume(
+    const std::string &format, const std::string &input, const std::string &output)
+{
+    using namespace agz::tracer;
+
+    AGZ_INFO("load volume from {}", input);
+    std::ifstream fin(input, std::ios::in | std::ios::binary);
+    if(!fin)
+        throw std::runtime_error("failed to open file: " + input);
+
+    // the input is converted slab by slab and bricks filled with zero texels
+    // are elided while reading
+
+    auto convert = [&](const auto &volume, auto save)
+    {
+        save(output, *volume);
+
+        AGZ_INFO("save sparse volume to {}: {} of {} bricks stored",
+                 output, volume->stored_brick_count(),
+                 volume->brick_count().product());
+    };
+
+    if(format == "real")
+        convert(texture3d_load::load_real_sparse_from_binary(fin), texture3d_load::save_real_to_sparse);
+    else if(format == "spec")
+        convert(texture3d_load::load_spec_sparse_from_binary(fin), texture3d_load::save_spec_to_sparse);
+    else if(format == "gray8")
+        convert(texture3d_load::load_uint8_sparse_from_binary(fin), texture3d_load::save_uint8_to_sparse);
+    else if(format == "rgb8")
+        convert(texture3d_load::load_uint24_sparse_from_binary(fin), texture3d_load::save_uint24_to_sparse);
+    else
+        throw std::runtime_error("unknown volume format: " + format);
+}
+
+void convert_texture(const std::string &input, const std::string &output)
+{
+    using namespace agz::tracer;
+
+    AGZ_INFO("load image from {}", input);
+    const auto image = agz::img::load_rgb_from_file(input);
+    if(!image.is_available())
+        throw std::runtime_error("failed to load image from " + input);
+
+    texture2d_load::save_tiled_texture(output, image);
+
+    const auto source = texture2d_load::load_tiled_texture(output);
+    AGZ_INFO("save tiled texture to {}: {}x{}, {} levels",
+             output, source->width(0), source->height(0),
+             source->level_count());
+}
+
 void run(int argc, char *argv[])
 {
     auto params = parse_opts(argc, argv);
     if(!params)
         return;
 
+    if(!params->convert_mesh_input.empty())
+    {
+        convert_mesh(params->convert_mesh_input, params->convert_mesh_output);
+        return;
+    }
+
+    if(!params->convert_volume_input.empty())
+    {
+        convert_volume(
+            params->convert_volume_format,
+            params->convert_volume_input,
+            params->convert_volume_output);
+        return;
+    }
+
+    if(!params->convert_texture_input.empty())
+    {
+        convert_texture(
+            params->convert_texture_input, params->convert_texture_output);
+        return;
+    }
+
 #ifdef USE_EMBREE
         AGZ_INFO("initializing embree device");
         agz::tracer::init_embree_device();
@@ -9,6 +9,9 @@ std::optional<Params> parse_opts(int argc, char *argv[])
     opts.add_options("")
         ("s,scene", "scene description", cxxopts::value<std::string>())
         ("d,scene-filename", "scene description filename", cxxopts::value<std::string>())
+        ("convert-mesh", "convert mesh file to indexed binary mesh: input,output", cxxopts::value<std::vector<std::string>>())
+        ("convert-volume", "convert binary volume file to sparse volume: format,input,output", cxxopts::value<std::vector<std::string>>())
+        ("convert-texture", "convert image file to tiled texture: input,output", cxxopts::value<std::vector<std::string>>())
         ("h,help", "help information");
     auto parse_result = opts.parse(argc, argv);
 
@@ -20,6 +23,37 @@ std::optional<Params> parse_opts(int argc, char *argv[])
 
     Params ret;
 
+    if(parse_result.count("convert-mesh"))
+    {
+        const auto filenames = parse_result["convert-mesh"].as<std::vector<std::string>>();
+        if(filenames.size() != 2)
+            throw ParamParsingException("--convert-mesh expects input,output");
+        ret.convert_mesh_input  = filenames[0];
+        ret.convert_mesh_output = filenames[1];
+        return ret;
+    }
+
+    if(parse_result.count("convert-volume"))
+    {
+        const auto args = parse_result["convert-volume"].as<std::vector<std::string>>();
+        if(args.size() != 3)
+            throw ParamParsingException("--convert-volume expects format,input,output");
+        ret.convert_volume_format = args[0];
+        ret.convert_volume_input  = args[1];
+        ret.convert_volume_output = args[2];
+        return ret;
+    }
+
+    if(parse_result.count("convert-texture"))
+    {
+        const auto filenames = parse_result["convert-texture"].as<std::vector<std::string>>();
+        if(filenames.size() != 2)
+            throw ParamParsingException("--convert-texture expects input,output");
+        ret.convert_texture_input  = filenames[0];
+        ret.convert_texture_output = filenames[1];
+        return ret;
+    }
+
     const bool has_scene_content  = parse_result.count("scene") != 0;
     const bool has_scene_filename = parse_result.count("scene-filename") != 0;
 
@@ -92,7 +92,8 @@ private:
 
     void set_display_image(const Image2D<Spectrum> &img);
 
-    void launch_renderer(bool enable_preview);
+    void launch_renderer(
+        bool enable_preview, RC<const ReprojectionHistory> history = nullptr);
 
     // renderer
 
@@ -41,17 +41,32 @@ public:
 
     void start();
 
+    /**
+     * @brief set samples reprojected from a previous view
+     *
+     * must be called before start. history is displayed until a pixel receives
+     * full-resolution samples, and then fades out as more samples arrive.
+     * pixels with zero history weight have no history
+     */
+    void set_history(Image2D<Spectrum> value, Image2D<real> weight);
+
     int get_tasks(int expected_task_count, std::vector<Task> &tasks);
 
     void merge_tasks(int task_count, Task *tasks);
 
     Image2D<Spectrum> get_image() const;
 
+    /**
+     * @brief get current image and equivalent sample count of each pixel
+     */
+    void get_weighted_image(
+        Image2D<Spectrum> &image, Image2D<real> &weight) const;
+
     Vec2i get_resolution() const noexcept;
 
 private:
 
-    Image2D<Spectrum> compute_image() const;
+    Image2D<Spectrum> compute_image(Image2D<real> *out_weight = nullptr) const;
 
     // assert lock_shared(es_mutex)
     void merge_single_task(const Task &task);
@@ -74,6 +89,11 @@ private:
     Image2D<real>     weight_;
     Image2D<int>      pixel_size_;
 
+    // reprojected history. not modified after start
+
+    Image2D<Spectrum> history_value_;
+    Image2D<real>     history_weight_;
+
     // task queue
 
     std::mutex queue_mutex_;
@@ -16,10 +16,14 @@ public:
 
     ~PerPixelRenderer();
 
+    void enable_reprojection(RC<const ReprojectionHistory> history) override;
+
     Image2D<Spectrum> start() override;
 
     Image2D<Spectrum> get_image() const override;
 
+    RC<const ReprojectionHistory> get_reprojection_history() const override;
+
 protected:
 
     void stop_rendering();
@@ -36,6 +40,13 @@ private:
 
     Image2D<Spectrum> do_fast_rendering();
 
+    // trace g-buffer rows until all rows are taken. the worker finishing
+    // the last row seeds framebuffer with reprojected history and starts it
+    void exec_gbuffer_tasks();
+
+    // seed framebuffer with reprojected history
+    void do_reprojection();
+
     void exec_fast_render_task(
         Image2D<Spectrum> &target, const Vec2i &beg, const Vec2i &end,
         tracer::Sampler &sampler);
@@ -55,6 +66,14 @@ private:
 
     Framebuffer framebuffer_;
 
+    bool enable_reprojection_;
+    RC<const ReprojectionHistory> history_;
+    GBuffer gbuffer_;
+
+    std::atomic<int> next_gbuffer_row_;
+    std::atomic<int> finished_gbuffer_row_count_;
+    std::atomic<bool> gbuffer_ready_;
+
     std::atomic<bool> stop_rendering_;
     std::vector<std::thread> threads_;
 
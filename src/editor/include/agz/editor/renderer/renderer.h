@@ -3,6 +3,7 @@
 #include <QObject>
 
 #include <agz/editor/renderer/framebuffer.h>
+#include <agz/editor/renderer/reprojection.h>
 
 AGZ_EDITOR_BEGIN
 
@@ -17,6 +18,14 @@ public:
 
     virtual ~Renderer() = default;
 
+    /**
+     * @brief reuse samples of a previous view. called before start
+     *
+     * history may be nullptr, in which case only the current view is
+     * prepared for being reused by later renderers
+     */
+    virtual void enable_reprojection(RC<const ReprojectionHistory> history) { }
+
     /**
      * @brief called before start rendering
      *
@@ -28,6 +37,17 @@ public:
      * @brief get current rendered image
      */
     virtual Image2D<Spectrum> get_image() const = 0;
+
+    /**
+     * @brief get current image for reprojecting into following views
+     *
+     * returns nullptr when reprojection is not enabled or not supported, or
+     * when the current view is not prepared yet
+     */
+    virtual RC<const ReprojectionHistory> get_reprojection_history() const
+    {
+        return nullptr;
+    }
 };
 
 AGZ_EDITOR_END
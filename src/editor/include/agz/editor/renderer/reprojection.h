@@ -0,0 +1,53 @@
+#pragma once
+
+#include <agz/editor/common.h>
+#include <agz/tracer/core/camera.h>
+#include <agz/tracer/core/scene.h>
+
+AGZ_EDITOR_BEGIN
+
+/**
+ * @brief first hits of rays through pixel centers
+ *
+ * normal is zero for pixels whose rays hit nothing
+ */
+struct GBuffer
+{
+    Image2D<tracer::FVec3> position;
+    Image2D<tracer::FVec3> normal;
+};
+
+/**
+ * @brief image of a previous view that can be reprojected into a new view
+ */
+struct ReprojectionHistory
+{
+    RC<const tracer::Camera> camera;
+
+    Image2D<Spectrum> image;
+
+    // equivalent sample count of each pixel in image
+    Image2D<real> weight;
+
+    GBuffer gbuffer;
+};
+
+/**
+ * @brief trace rays through pixel centers of row y and record their first hits
+ *
+ * gbuffer must have been allocated with the film resolution
+ */
+void render_gbuffer_row(const tracer::Scene &scene, int y, GBuffer &gbuffer);
+
+/**
+ * @brief reproject history into a view with given g-buffer
+ *
+ * a pixel reuses the history pixel its first hit is projected to, when the
+ * first hit of that history pixel is close to it and has a similar normal.
+ * accepted pixels have non-zero weight, which is clamped to max_weight
+ */
+void reproject_history(
+    const ReprojectionHistory &history, const GBuffer &gbuffer, real max_weight,
+    Image2D<Spectrum> &value, Image2D<real> &weight);
+
+AGZ_EDITOR_END
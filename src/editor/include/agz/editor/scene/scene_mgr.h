@@ -78,6 +78,11 @@ private:
     SceneManagerWidget *ui_ = nullptr;
 
     RC<tracer::Aggregate> aggregate_;
+
+    // whether entities are added/removed/reordered since last aggregate
+    // building. otherwise only entity objects are replaced, and the
+    // aggregate can be refitted
+    bool is_entity_list_dirty_ = true;
 };
 
 AGZ_EDITOR_END
@@ -103,6 +103,10 @@ void Editor::on_change_camera()
     if(!scene_)
         return;
 
+    RC<const ReprojectionHistory> history;
+    if(renderer_ && global_setting_->reprojection->isChecked())
+        history = renderer_->get_reprojection_history();
+
     std::thread destroy_renderer_thread([renderer = std::move(renderer_)] { });
     destroy_renderer_thread.detach();
     
@@ -110,7 +114,7 @@ void Editor::on_change_camera()
     auto camera = preview_window_->create_camera();
     scene_->set_camera(camera);
 
-    launch_renderer(true);
+    launch_renderer(true, std::move(history));
 }
 
 void Editor::on_change_aggregate()
@@ -510,7 +514,8 @@ void Editor::set_display_image(const Image2D<Spectrum> &img)
     preview_window_->set_preview_image(img);
 }
 
-void Editor::launch_renderer(bool enable_preview)
+void Editor::launch_renderer(
+    bool enable_preview, RC<const ReprojectionHistory> history)
 {
     update_display_timer_->stop();
 
@@ -534,6 +539,9 @@ void Editor::launch_renderer(bool enable_preview)
     renderer_ = renderer_panel_->create_renderer(
         scene_, { film_width, film_height }, enable_preview);
 
+    if(global_setting_->reprojection->isChecked())
+        renderer_->enable_reprojection(std::move(history));
+
     if(enable_preview)
         set_display_image(renderer_->start());
     else
@@ -5,6 +5,13 @@
 
 AGZ_EDITOR_BEGIN
 
+namespace
+{
+    // history is ignored after a pixel receives this number of samples
+    constexpr real HISTORY_FADE_WEIGHT = 32;
+
+} // namespace anonymous
+
 Framebuffer::Framebuffer(
     int width, int height, int task_grid_size, int init_pixel_size)
     : width_(width), height_(height),
@@ -26,6 +33,16 @@ Framebuffer::~Framebuffer()
         output_updater_thread_.join();
 }
 
+void Framebuffer::set_history(Image2D<Spectrum> value, Image2D<real> weight)
+{
+    assert(!output_updater_thread_.joinable());
+    assert(value.width() == width_ && value.height() == height_);
+    assert(weight.width() == width_ && weight.height() == height_);
+
+    history_value_  = std::move(value);
+    history_weight_ = std::move(weight);
+}
+
 void Framebuffer::start()
 {
     output_updater_thread_ = std::thread([this]
@@ -146,21 +163,33 @@ Image2D<Spectrum> Framebuffer::get_image() const
     return {};
 }
 
+void Framebuffer::get_weighted_image(
+    Image2D<Spectrum> &image, Image2D<real> &weight) const
+{
+    image = compute_image(&weight);
+}
+
 Vec2i Framebuffer::get_resolution() const noexcept
 {
     return { width_, height_ };
 }
 
-Image2D<Spectrum> Framebuffer::compute_image() const
+Image2D<Spectrum> Framebuffer::compute_image(Image2D<real> *out_weight) const
 {
     Image2D<Spectrum> value;
     Image2D<real>     weight;
+    Image2D<int>      pixel_size;
     {
         std::lock_guard lk(es_mutex_);
         value  = value_;
         weight = weight_;
+        if(out_weight || history_weight_.is_available())
+            pixel_size = pixel_size_;
     }
 
+    if(out_weight)
+        *out_weight = Image2D<real>(value.height(), value.width());
+
     Image2D<Spectrum> image(value.height(), value.width());
     for(int y = 0; y < image.height(); ++y)
     {
@@ -170,10 +199,36 @@ Image2D<Spectrum> Framebuffer::compute_image() const
         for(int x = 0; x < image.width(); ++x)
         {
             const real w = weight(y, x);
-            if(w <= 0)
-                return {};
+            const real hw = history_weight_.is_available() ?
+                            history_weight_(y, x) : real(0);
+
+            if(hw <= 0)
+            {
+                if(w <= 0)
+                    return {};
+
+                image(y, x) = value(y, x) / w;
+                if(out_weight)
+                    (*out_weight)(y, x) = pixel_size(y, x) == 1 ? w : real(0);
+                continue;
+            }
+
+            // low-resolution samples are worse than history
+
+            if(pixel_size(y, x) != 1)
+            {
+                image(y, x) = history_value_(y, x);
+                if(out_weight)
+                    (*out_weight)(y, x) = hw;
+                continue;
+            }
 
-            image(y, x) = value(y, x) / w;
+            const real hw_eff = hw * (std::max)(
+                real(0), 1 - w / HISTORY_FADE_WEIGHT);
+            image(y, x) = (value(y, x) + hw_eff * history_value_(y, x))
+                        / (w + hw_eff);
+            if(out_weight)
+                (*out_weight)(y, x) = w + hw_eff;
         }
     }
 
@@ -22,7 +22,12 @@ PerPixelRenderer::PerPixelRenderer(
     fast_resolution_       = fast_resolution;
     fast_task_grid_size_   = fast_task_grid_size;
     scene_                 = std::move(scene);
+    enable_reprojection_   = false;
     stop_rendering_        = false;
+
+    next_gbuffer_row_           = 0;
+    finished_gbuffer_row_count_ = 0;
+    gbuffer_ready_              = false;
 }
 
 PerPixelRenderer::~PerPixelRenderer()
@@ -30,10 +35,20 @@ PerPixelRenderer::~PerPixelRenderer()
     assert(threads_.empty());
 }
 
+void PerPixelRenderer::enable_reprojection(
+    RC<const ReprojectionHistory> history)
+{
+    enable_reprojection_ = true;
+    history_             = std::move(history);
+}
+
 Image2D<Spectrum> PerPixelRenderer::start()
 {
     auto render_func = [this](tracer::Sampler *sampler)
     {
+        if(enable_reprojection_)
+            exec_gbuffer_tasks();
+
         std::vector<Framebuffer::Task> tasks;
 
         for(;;)
@@ -51,7 +66,18 @@ Image2D<Spectrum> PerPixelRenderer::start()
         }
     };
 
-    auto ret = do_fast_rendering();
+    const auto ret = do_fast_rendering();
+
+    // g-buffer is traced by render workers, and framebuffer is started after
+    // it is seeded with reprojected history
+
+    if(enable_reprojection_)
+    {
+        gbuffer_.position = Image2D<tracer::FVec3>(
+            framebuffer_height_, framebuffer_width_);
+        gbuffer_.normal = Image2D<tracer::FVec3>(
+            framebuffer_height_, framebuffer_width_);
+    }
 
     const int worker_count = thread::actual_worker_count(worker_count_);
 
@@ -66,7 +92,8 @@ Image2D<Spectrum> PerPixelRenderer::start()
         threads_.emplace_back(render_func, sampler);
     }
 
-    framebuffer_.start();
+    if(!enable_reprojection_)
+        framebuffer_.start();
 
     return ret;
 }
@@ -76,6 +103,21 @@ Image2D<Spectrum> PerPixelRenderer::get_image() const
     return framebuffer_.get_image();
 }
 
+RC<const ReprojectionHistory> PerPixelRenderer::get_reprojection_history() const
+{
+    if(!enable_reprojection_ || !gbuffer_ready_)
+        return nullptr;
+
+    auto ret = newRC<ReprojectionHistory>();
+    framebuffer_.get_weighted_image(ret->image, ret->weight);
+    if(!ret->image.is_available())
+        return nullptr;
+
+    ret->camera  = scene_->get_shared_camera();
+    ret->gbuffer = gbuffer_;
+    return ret;
+}
+
 void PerPixelRenderer::stop_rendering()
 {
     stop_rendering_ = true;
@@ -171,6 +213,44 @@ Image2D<Spectrum> PerPixelRenderer::do_fast_rendering()
     return small_target;
 }
 
+void PerPixelRenderer::exec_gbuffer_tasks()
+{
+    for(;;)
+    {
+        if(stop_rendering_)
+            return;
+
+        const int y = next_gbuffer_row_++;
+        if(y >= framebuffer_height_)
+            return;
+
+        render_gbuffer_row(*scene_, y, gbuffer_);
+
+        if(++finished_gbuffer_row_count_ == framebuffer_height_)
+        {
+            if(history_)
+                do_reprojection();
+            history_.reset();
+
+            framebuffer_.start();
+            gbuffer_ready_ = true;
+        }
+    }
+}
+
+void PerPixelRenderer::do_reprojection()
+{
+    // history is only a rough initial guess of the new view, and must not
+    // dominate samples of the new view for long
+    constexpr real MAX_HISTORY_WEIGHT = 16;
+
+    Image2D<Spectrum> value;
+    Image2D<real> weight;
+    reproject_history(*history_, gbuffer_, MAX_HISTORY_WEIGHT, value, weight);
+
+    framebuffer_.set_history(std::move(value), std::move(weight));
+}
+
 void PerPixelRenderer::exec_fast_render_task(
     Image2D<Spectrum> &target, const Vec2i &beg, const Vec2i &end,
     tracer::Sampler &sampler)
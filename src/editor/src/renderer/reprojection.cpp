@@ -0,0 +1,111 @@
+#include <agz/editor/renderer/reprojection.h>
+#include <agz/tracer/core/intersection.h>
+
+AGZ_EDITOR_BEGIN
+
+namespace
+{
+    // max distance between first hits of a pixel and its history pixel,
+    // relative to the distance from the first hit to the camera
+    constexpr real MAX_RELATIVE_POSITION_ERROR = real(0.02);
+
+    // min cosine between normals of a pixel and its history pixel
+    constexpr real MIN_NORMAL_COSINE = real(0.9);
+
+    // aperture sample at the center of the lens
+    constexpr tracer::Sample2 CENTER_APERTURE_SAMPLE = { real(0.5), real(0.5) };
+
+} // namespace anonymous
+
+void render_gbuffer_row(const tracer::Scene &scene, int y, GBuffer &gbuffer)
+{
+    using namespace tracer;
+
+    const int width  = gbuffer.normal.width();
+    const int height = gbuffer.normal.height();
+
+    const Camera *camera = scene.get_camera();
+
+    for(int x = 0; x < width; ++x)
+    {
+        const Vec2 film_coord = {
+            (x + real(0.5)) / width,
+            (y + real(0.5)) / height
+        };
+
+        const auto cam_ray = camera->sample_we(
+            film_coord, CENTER_APERTURE_SAMPLE);
+        const Ray ray(cam_ray.pos_on_cam, cam_ray.pos_to_out);
+
+        EntityIntersection inct;
+        if(!scene.closest_intersection(ray, &inct))
+        {
+            gbuffer.normal(y, x) = FVec3(0);
+            continue;
+        }
+
+        gbuffer.position(y, x) = inct.pos;
+        gbuffer.normal(y, x)   = inct.geometry_coord.z;
+    }
+}
+
+void reproject_history(
+    const ReprojectionHistory &history, const GBuffer &gbuffer, real max_weight,
+    Image2D<Spectrum> &value, Image2D<real> &weight)
+{
+    using namespace tracer;
+
+    const int width  = gbuffer.normal.width();
+    const int height = gbuffer.normal.height();
+
+    const int history_width  = history.gbuffer.normal.width();
+    const int history_height = history.gbuffer.normal.height();
+
+    value  = Image2D<Spectrum>(height, width);
+    weight = Image2D<real>(height, width);
+
+    for(int y = 0; y < height; ++y)
+    {
+        for(int x = 0; x < width; ++x)
+        {
+            const FVec3 &nor = gbuffer.normal(y, x);
+            if(nor.length_square() <= 0)
+                continue;
+            const FVec3 &pos = gbuffer.position(y, x);
+
+            // project first hit onto film of history camera
+
+            const auto cam_wi = history.camera->sample_wi(
+                pos, CENTER_APERTURE_SAMPLE);
+            if(cam_wi.pdf <= 0)
+                continue;
+
+            const int hx = static_cast<int>(
+                std::floor(cam_wi.film_coord.x * history_width));
+            const int hy = static_cast<int>(
+                std::floor(cam_wi.film_coord.y * history_height));
+            if(hx < 0 || hx >= history_width || hy < 0 || hy >= history_height)
+                continue;
+
+            // reject disoccluded pixels
+
+            const FVec3 &history_nor = history.gbuffer.normal(hy, hx);
+            if(dot(history_nor, nor) < MIN_NORMAL_COSINE)
+                continue;
+
+            const real max_error = MAX_RELATIVE_POSITION_ERROR
+                                 * distance(pos, cam_wi.pos_on_cam);
+            if(distance(history.gbuffer.position(hy, hx), pos) > max_error)
+                continue;
+
+            const real history_weight = history.weight(hy, hx);
+            if(history_weight <= 0)
+                continue;
+
+            value(y, x)  = history.image(hy, hx);
+            weight(y, x) = (std::min)(history_weight, max_weight);
+        }
+    }
+}
+
+AGZ_EDITOR_END
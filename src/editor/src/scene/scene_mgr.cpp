@@ -107,7 +107,15 @@ RC<tracer::Aggregate> SceneManager::update_tracer_aggregate(
         entity_arr.push_back(ent);
         entities.push_back(ent);
     }
-    aggregate_->build(entity_arr);
+
+    if(is_entity_list_dirty_)
+    {
+        aggregate_->build(entity_arr);
+        is_entity_list_dirty_ = false;
+    }
+    else
+        aggregate_->refit(entity_arr);
+
     return aggregate_;
 }
 
@@ -197,6 +205,7 @@ void SceneManager::remove_selected_entity()
     preview_window_->remove_mesh(it->second->mesh_id);
 
     name2record_.erase(it);
+    is_entity_list_dirty_ = true;
     delete ui_->name_list->takeItem(ui_->name_list->row(item));
 
     emit change_scene();
@@ -222,6 +231,7 @@ void SceneManager::rename_selected_entity()
     name2record_.erase(it);
 
     name2record_[new_name] = std::move(rcd);
+    is_entity_list_dirty_ = true;
 }
 
 void SceneManager::selected_entity_changed()
@@ -299,6 +309,7 @@ void SceneManager::add_record(const ::QString &name, EntityPanel *entity_panel)
 
     Record record = { final_name, entity_panel, mesh_id };
     name2record_[final_name] = newBox<Record>(record);
+    is_entity_list_dirty_ = true;
 
     // add entity widget to editor
 
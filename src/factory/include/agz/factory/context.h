@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <map>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -10,6 +11,12 @@
 #include <agz/utility/misc.h>
 #include <agz/utility/string.h>
 
+AGZ_TRACER_BEGIN
+
+class UntransformedTriangleBVH;
+
+AGZ_TRACER_END
+
 AGZ_TRACER_FACTORY_BEGIN
 
 #define AGZ_FACTORY_WORKING_DIR_PATH_NAME "${working-directory}"
@@ -117,6 +124,20 @@ public:
     const PathMapper *path_mapper;
     const ConfigGroup *reference_root;
 
+    // mesh filename, quality, sah bin count, sah all axes,
+    // leaf size threshold, max leaf size, layout
+    using SharedTriangleBVHKey = std::tuple<
+        std::string, int, int, bool, int, int, int>;
+
+    /**
+     * @brief local-space triangle bvhs shared by instances of the same mesh
+     *
+     * shared by all triangle bvh creators. the table lives as long as the
+     * context, which is created for building one scene
+     */
+    std::map<SharedTriangleBVHKey, RC<const UntransformedTriangleBVH>>
+        shared_triangle_bvhs;
+
     template<typename T>
     Factory<T> &factory() noexcept;
 
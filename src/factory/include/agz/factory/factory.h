@@ -3,5 +3,7 @@
 #include <agz/factory/context.h>
 #include <agz/factory/utility/bin_mesh.h>
 #include <agz/factory/utility/config_cvt.h>
+#include <agz/factory/utility/indexed_mesh.h>
 #include <agz/factory/utility/render_session.h>
+#include <agz/factory/utility/texture2d_loader.h>
 #include <agz/factory/utility/texture3d_loader.h>
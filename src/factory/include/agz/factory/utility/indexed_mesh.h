@@ -0,0 +1,124 @@
+#pragma once
+
+#include <agz/tracer/common.h>
+#include <agz/tracer/utility/mapped_file.h>
+#include <agz/utility/mesh.h>
+
+AGZ_TRACER_FACTORY_BEGIN
+
+/**
+ * @brief indexed binary mesh file (.agzm)
+ *
+ * all fields are little-endian. file layout:
+ *
+ *  header
+ *  positions: float[3]    * vertex_count
+ *  normals:   int16_t[2]  * vertex_count, octahedral encoding (optional)
+ *  uvs:       uint16_t[2] * vertex_count, quantized in [uv_low, uv_high] (optional)
+ *  indices:   uint32_t[3] * triangle_count
+ *  bvh:       serialized native bvh, see serialize_triangle_bvh (optional)
+ *
+ * each section starts at an offset recorded in the header and aligned to
+ * INDEXED_MESH_ALIGNMENT bytes
+ */
+struct IndexedMeshHeader
+{
+    static constexpr uint32_t HAS_NORMAL = 1 << 0;
+    static constexpr uint32_t HAS_UV     = 1 << 1;
+    static constexpr uint32_t HAS_BVH    = 1 << 2;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t endian_tag;
+    uint32_t flags;
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+    uint32_t reserved;
+
+    float uv_low[2];
+    float uv_high[2];
+
+    uint64_t position_offset;
+    uint64_t normal_offset;
+    uint64_t uv_offset;
+    uint64_t index_offset;
+    uint64_t bvh_offset;
+    uint64_t bvh_size;
+};
+
+constexpr char     INDEXED_MESH_MAGIC[8]    = { 'A', 'G', 'Z', 'M', 'E', 'S', 'H', '\0' };
+constexpr uint32_t INDEXED_MESH_VERSION     = 1;
+constexpr uint32_t INDEXED_MESH_ENDIAN_TAG  = 0x01020304;
+constexpr size_t   INDEXED_MESH_ALIGNMENT   = 64;
+
+/**
+ * @brief memory mapped indexed mesh file
+ *
+ * vertex data are decoded from the mapped pages on access.
+ * throws std::runtime_error when the file is invalid
+ */
+class IndexedMeshFile : public misc::uncopyable_t
+{
+    MappedFile file_;
+
+    const IndexedMeshHeader *header_ = nullptr;
+
+    const float    *positions_ = nullptr;
+    const int16_t  *normals_   = nullptr;
+    const uint16_t *uvs_       = nullptr;
+    const uint32_t *indices_   = nullptr;
+
+    const unsigned char *bvh_ = nullptr;
+
+public:
+
+    explicit IndexedMeshFile(const std::string &filename);
+
+    uint32_t vertex_count() const noexcept;
+
+    uint32_t triangle_count() const noexcept;
+
+    bool has_normal() const noexcept;
+
+    bool has_uv() const noexcept;
+
+    Vec3 position(uint32_t vertex_index) const noexcept;
+
+    /** @brief assert(has_normal()) */
+    Vec3 normal(uint32_t vertex_index) const noexcept;
+
+    /** @brief returns (0, 0) when !has_uv() */
+    Vec2 uv(uint32_t vertex_index) const noexcept;
+
+    /** @brief 3 * triangle_count() vertex indices */
+    const uint32_t *indices() const noexcept;
+
+    /** @brief precomputed bvh data. nullptr when absent */
+    const unsigned char *bvh_data() const noexcept;
+
+    /** @brief byte size of precomputed bvh data */
+    size_t bvh_size() const noexcept;
+
+    /**
+     * @brief expand to non-indexed triangles
+     *
+     * face normals are used when the file contains no vertex normal
+     */
+    std::vector<mesh::triangle_t> to_triangles() const;
+};
+
+std::vector<mesh::triangle_t> load_indexed_mesh(const std::string &filename);
+
+/**
+ * @brief save triangles as indexed mesh
+ *
+ * identical vertices are merged, normals and uvs are quantized
+ *
+ * @param bvh_data optional precomputed bvh. can be nullptr
+ */
+void save_indexed_mesh(
+    const std::string &filename,
+    const mesh::triangle_t *triangles, size_t triangle_count,
+    const void *bvh_data = nullptr, size_t bvh_size = 0);
+
+AGZ_TRACER_FACTORY_END
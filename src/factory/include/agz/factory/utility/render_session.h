@@ -25,6 +25,9 @@ public:
 
         real eps = real(3e-4);
 
+        // memory budget of global texture cache in MB. <= 0 means unchanged
+        int texture_cache_budget = 0;
+
         RC<Camera>                     camera;
         RC<FilmFilter>                 film_filter;
         RC<Renderer>                   renderer;
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <agz/factory/context.h>
+#include <agz/tracer/utility/texture_cache.h>
+
+AGZ_TRACER_BEGIN
+
+namespace texture2d_load
+{
+
+    /**
+     * @brief tiled texture file (.agzt)
+     *
+     * all fields are little-endian. file layout:
+     *
+     *  header
+     *  tiles of level 0, ..., tiles of level (level_count - 1)
+     *
+     * level 0 has size width x height, and each following level halves the
+     * size of its previous level, rounding up, until 1 x 1. tiles of each
+     * level are stored in row-major order. each tile contains
+     * TextureCache::TILE_SIZE^2 rgb8 texels in row-major order, where texels
+     * outside the level are clamped to the level border.
+     *
+     * tile data starts at data_offset, which is aligned to
+     * TILED_TEXTURE_ALIGNMENT bytes. tiles are read through a memory mapped
+     * file when they are paged into the texture cache
+     */
+    struct TiledTextureHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t endian_tag;
+        uint32_t tile_size;
+
+        int32_t width;
+        int32_t height;
+        int32_t level_count;
+
+        uint64_t data_offset;
+    };
+
+    constexpr char     TILED_TEXTURE_MAGIC[8]   = { 'A', 'G', 'Z', 'T', 'E', 'X', '\0', '\0' };
+    constexpr uint32_t TILED_TEXTURE_VERSION    = 1;
+    constexpr uint32_t TILED_TEXTURE_ENDIAN_TAG = 0x01020304;
+    constexpr size_t   TILED_TEXTURE_ALIGNMENT  = 64;
+
+    /**
+     * @brief open tiled texture file as tile source of texture cache
+     *
+     * only the header is read. throws when the file is invalid
+     */
+    RC<const TextureTileSource> load_tiled_texture(const std::string &filename);
+
+    /**
+     * @brief save image with its box filtered mip levels to tiled texture file
+     */
+    void save_tiled_texture(
+        const std::string &filename, const Image2D<math::color3b> &image);
+
+} // namespace texture2d_load
+
+AGZ_TRACER_END
@@ -3,12 +3,114 @@
 #include <fstream>
 
 #include <agz/factory/context.h>
+#include <agz/tracer/utility/sparse_volume.h>
 
 AGZ_TRACER_BEGIN
 
 namespace texture3d_load
 {
 
+    /**
+     * @brief sparse bricked volume file (.agzv)
+     *
+     * all fields are little-endian. file layout:
+     *
+     *  header
+     *  brick index: uint32_t * brick_count.x * brick_count.y * brick_count.z
+     *  brick data:  texel * SparseVolume::BRICK_TEXEL_COUNT * stored_brick_count
+     *
+     * each section starts at an offset recorded in the header and aligned to
+     * SPARSE_VOLUME_ALIGNMENT bytes. brick data is used in place through a
+     * memory mapped file when loaded
+     */
+    struct SparseVolumeHeader
+    {
+        static constexpr uint32_t FORMAT_REAL  = 0;
+        static constexpr uint32_t FORMAT_SPEC  = 1;
+        static constexpr uint32_t FORMAT_GRAY8 = 2;
+        static constexpr uint32_t FORMAT_RGB8  = 3;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t endian_tag;
+        uint32_t texel_format;
+        uint32_t brick_size;
+
+        int32_t width;
+        int32_t height;
+        int32_t depth;
+        uint32_t stored_brick_count;
+
+        // background texel, padded with zeros
+        unsigned char background[16];
+
+        uint64_t index_offset;
+        uint64_t data_offset;
+    };
+
+    constexpr char     SPARSE_VOLUME_MAGIC[8]   = { 'A', 'G', 'Z', 'V', 'O', 'L', '\0', '\0' };
+    constexpr uint32_t SPARSE_VOLUME_VERSION    = 1;
+    constexpr uint32_t SPARSE_VOLUME_ENDIAN_TAG = 0x01020304;
+    constexpr size_t   SPARSE_VOLUME_ALIGNMENT  = 64;
+
+    /**
+     * @brief load sparse volume file
+     *
+     * throws when the file is invalid or its texel format is not real
+     */
+    RC<const SparseVolume<real>> load_real_from_sparse(const std::string &filename);
+
+    /**
+     * @brief load sparse volume file
+     *
+     * throws when the file is invalid or its texel format is not spec
+     */
+    RC<const SparseVolume<Spectrum>> load_spec_from_sparse(const std::string &filename);
+
+    /**
+     * @brief load sparse volume file
+     *
+     * throws when the file is invalid or its texel format is not gray8
+     */
+    RC<const SparseVolume<uint8_t>> load_uint8_from_sparse(const std::string &filename);
+
+    /**
+     * @brief load sparse volume file
+     *
+     * throws when the file is invalid or its texel format is not rgb8
+     */
+    RC<const SparseVolume<math::color3b>> load_uint24_from_sparse(const std::string &filename);
+
+    /**
+     * @brief convert vol data in binary file to sparse volume
+     *
+     * the file format is the same as load_real_from_binary. texels are read
+     * BRICK_SIZE z-slices at a time and bricks of zero texels are elided
+     * while reading, so the dense volume is never held in memory as a whole
+     */
+    RC<const SparseVolume<real>> load_real_sparse_from_binary(std::ifstream &fin);
+
+    /**
+     * @brief convert vol data in binary file to sparse volume
+     *
+     * see load_real_sparse_from_binary
+     */
+    RC<const SparseVolume<Spectrum>> load_spec_sparse_from_binary(std::ifstream &fin);
+
+    /**
+     * @brief convert vol data in binary file to sparse volume
+     *
+     * see load_real_sparse_from_binary
+     */
+    RC<const SparseVolume<uint8_t>> load_uint8_sparse_from_binary(std::ifstream &fin);
+
+    /**
+     * @brief convert vol data in binary file to sparse volume
+     *
+     * see load_real_sparse_from_binary
+     */
+    RC<const SparseVolume<math::color3b>> load_uint24_sparse_from_binary(std::ifstream &fin);
+
     /**
      * @brief load vol data from ascii file
      *
@@ -181,6 +283,30 @@ namespace texture3d_load
     void save_uint24_to_binary(
         const std::string &filename, const Vec3i &size, const math::color3b *data);
 
+    /**
+     * @brief save sparse volume to sparse volume file
+     */
+    void save_real_to_sparse(
+        const std::string &filename, const SparseVolume<real> &volume);
+
+    /**
+     * @brief save sparse volume to sparse volume file
+     */
+    void save_spec_to_sparse(
+        const std::string &filename, const SparseVolume<Spectrum> &volume);
+
+    /**
+     * @brief save sparse volume to sparse volume file
+     */
+    void save_uint8_to_sparse(
+        const std::string &filename, const SparseVolume<uint8_t> &volume);
+
+    /**
+     * @brief save sparse volume to sparse volume file
+     */
+    void save_uint24_to_sparse(
+        const std::string &filename, const SparseVolume<math::color3b> &volume);
+
 } // namespace texture3d_load
 
 AGZ_TRACER_END
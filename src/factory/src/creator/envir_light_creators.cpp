@@ -23,8 +23,11 @@ namespace envir_light
             const bool no_importance_sampling = params.child_int_or(
                 "no_importance_sampling", 0) != 0;
             const real power = params.child_real_or("power", -1);
+            const bool product_sampling = params.child_int_or(
+                "product_sampling", 0) != 0;
             return create_ibl_light(
-                std::move(tex), no_importance_sampling, power);
+                std::move(tex), no_importance_sampling, power,
+                product_sampling);
         }
     };
 
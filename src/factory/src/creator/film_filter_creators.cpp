@@ -19,7 +19,9 @@ namespace film_filter
             const ConfigGroup &params, CreatingContext &context) const override
         {
             const real radius = params.child_real("radius");
-            return create_box_filter(radius);
+            const bool importance_sampling =
+                params.child_int_or("importance_sampling", 0) != 0;
+            return create_box_filter(radius, importance_sampling);
         }
     };
 
@@ -37,7 +39,9 @@ namespace film_filter
         {
             const real radius = params.child_real("radius");
             const real alpha = params.child_real("alpha");
-            return create_gaussian_filter(radius, alpha);
+            const bool importance_sampling =
+                params.child_int_or("importance_sampling", 0) != 0;
+            return create_gaussian_filter(radius, alpha, importance_sampling);
         }
     };
 
@@ -1,5 +1,6 @@
 #include <agz/factory/creator/geometry_creators.h>
 #include <agz/factory/utility/bin_mesh.h>
+#include <agz/factory/utility/indexed_mesh.h>
 #include <agz/tracer/create/geometry.h>
 #include <agz/tracer/utility/logger.h>
 
@@ -7,14 +8,113 @@ AGZ_TRACER_FACTORY_BEGIN
 
 namespace geometry
 {
+    /**
+     * @brief load triangles from mesh file
+     *
+     * prebuilt is filled with the precomputed bvh of indexed mesh files
+     */
     std::vector<mesh::triangle_t> load_triangle_mesh_from_file(
-        const std::string &filename)
+        const std::string &filename, PrebuiltTriangleBVH *prebuilt = nullptr)
     {
+        if(stdstr::ends_with(filename, ".agzm"))
+        {
+            auto file = newRC<const IndexedMeshFile>(filename);
+            if(prebuilt && file->bvh_data())
+                *prebuilt = { file, file->bvh_data(), file->bvh_size() };
+            return file->to_triangles();
+        }
         if(stdstr::ends_with(filename, ".bm"))
             return load_bin_mesh(filename);
         return mesh::load_from_file(filename);
     }
-    
+
+    TriangleBVHParams parse_triangle_bvh_params(
+        const ConfigGroup &params, CreatingContext &context)
+    {
+        const std::string quality_str = params.child_str_or("bvh_quality", "medium");
+
+        TriangleBVHParams::Quality quality;
+        if(quality_str == "fast")
+            quality = TriangleBVHParams::Quality::Fast;
+        else if(quality_str == "medium")
+            quality = TriangleBVHParams::Quality::Medium;
+        else if(quality_str == "high")
+            quality = TriangleBVHParams::Quality::High;
+        else
+            throw CreatingObjectException("unknown bvh quality: " + quality_str);
+
+        auto ret = TriangleBVHParams::from_quality(quality);
+
+        const std::string layout_str = params.child_str_or("bvh_layout", "auto");
+        if(layout_str == "auto")
+            ret.layout = TriangleBVHParams::Layout::Auto;
+        else if(layout_str == "binary")
+            ret.layout = TriangleBVHParams::Layout::Binary;
+        else if(layout_str == "bvh4")
+            ret.layout = TriangleBVHParams::Layout::BVH4;
+        else if(layout_str == "bvh8")
+            ret.layout = TriangleBVHParams::Layout::BVH8;
+        else
+            throw CreatingObjectException("unknown bvh layout: " + layout_str);
+
+        ret.sah_bin_count = params.child_int_or("bvh_bin_count",     ret.sah_bin_count);
+        ret.max_leaf_size = params.child_int_or("bvh_max_leaf_size", ret.max_leaf_size);
+        ret.worker_count  = params.child_int_or("bvh_worker_count",  ret.worker_count);
+
+        const std::string cache_dir = params.child_str_or("bvh_cache_dir", "");
+        if(!cache_dir.empty())
+            ret.cache_directory = context.path_mapper->map(cache_dir);
+
+        return ret;
+    }
+
+    /**
+     * @brief create an instance of the local-space triangle bvh of a mesh
+     *
+     * bvhs are identified by mesh filename and build parameters, and shared
+     * through the creating context
+     */
+    RC<Geometry> create_shared_triangle_bvh_instance(
+        CreatingContext &context,
+        const std::string &filename,
+        const TriangleBVHParams &bvh_params,
+        const FTransform3 &local_to_world)
+    {
+        const CreatingContext::SharedTriangleBVHKey key = {
+            filename,
+            static_cast<int>(bvh_params.quality),
+            bvh_params.sah_bin_count,
+            bvh_params.sah_all_axes,
+            bvh_params.leaf_size_threshold,
+            bvh_params.max_leaf_size,
+            static_cast<int>(bvh_params.layout)
+        };
+
+        auto &shared_bvhs = context.shared_triangle_bvhs;
+
+        RC<const UntransformedTriangleBVH> bvh;
+        if(auto it = shared_bvhs.find(key); it != shared_bvhs.end())
+        {
+            AGZ_INFO("reuse shared mesh bvh of {}", filename);
+            bvh = it->second;
+        }
+        else
+        {
+            TriangleBVHParams mesh_params = bvh_params;
+
+            AGZ_INFO("load mesh from {}", filename);
+            auto build_triangles = load_triangle_mesh_from_file(
+                filename, &mesh_params.prebuilt);
+            AGZ_INFO("triangle count: {}", build_triangles.size());
+
+            bvh = create_untransformed_triangle_bvh(
+                std::move(build_triangles), mesh_params);
+            shared_bvhs[key] = bvh;
+        }
+
+        return create_triangle_bvh_instance(std::move(bvh), local_to_world);
+    }
+
     class DiskCreator : public Creator<Geometry>
     {
     public:
@@ -156,13 +256,33 @@ namespace geometry
         {
             const auto local_to_world = params.child_transform3("transform");
             const auto filename = context.path_mapper->map(params.child_str("filename"));
+            const auto bvh_params = parse_triangle_bvh_params(params, context);
+
+            if(params.child_int_or("instanced", 0))
+            {
+                return create_shared_triangle_bvh_instance(
+                    context, filename, bvh_params, local_to_world);
+            }
+
+            TriangleBVHParams mesh_params = bvh_params;
 
             AGZ_INFO("load mesh from {}", filename);
-            auto build_triangles = load_triangle_mesh_from_file(filename);
+            auto build_triangles = load_triangle_mesh_from_file(
+                filename, &mesh_params.prebuilt);
             AGZ_INFO("triangle count: {}", build_triangles.size());
 
+            // prebuilt bvh is in local space, so the mesh is not transformed
+            // into world space but used as an instance
+            if(mesh_params.prebuilt.data)
+            {
+                return create_triangle_bvh_instance(
+                    create_untransformed_triangle_bvh(
+                        std::move(build_triangles), mesh_params),
+                    local_to_world);
+            }
+
             return create_triangle_bvh_noembree(
-                std::move(build_triangles), local_to_world);
+                std::move(build_triangles), local_to_world, mesh_params);
         }
     };
 
@@ -181,12 +301,20 @@ namespace geometry
         {
             const auto local_to_world = params.child_transform3("transform");
             const auto filename = context.path_mapper->map(params.child_str("filename"));
+            const auto bvh_params = parse_triangle_bvh_params(params, context);
+
+            if(params.child_int_or("instanced", 0))
+            {
+                return create_shared_triangle_bvh_instance(
+                    context, filename, bvh_params, local_to_world);
+            }
 
             AGZ_INFO("load mesh from {}", filename);
             auto build_triangles = load_triangle_mesh_from_file(filename);
             AGZ_INFO("triangle count: {}", build_triangles.size());
 
-            return create_triangle_bvh_embree(std::move(build_triangles), local_to_world);
+            return create_triangle_bvh_embree(
+                std::move(build_triangles), local_to_world, bvh_params);
         }
     };
 
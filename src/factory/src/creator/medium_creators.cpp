@@ -29,9 +29,28 @@ namespace medium
             const int max_scat_count = params.child_int_or(
                 "max_scattering_count", (std::numeric_limits<int>::max)());
 
+            HeterogeneousTrackingParams tracking_params;
+            tracking_params.majorant_grid_res = params.child_int_or(
+                "majorant_grid_res", tracking_params.majorant_grid_res);
+            tracking_params.report_cost = params.child_int_or(
+                "report_cost", 0) != 0;
+
+            const std::string tr_estimator = params.child_str_or(
+                "tr_estimator", "ratio");
+            if(tr_estimator == "ratio")
+                tracking_params.ratio_tracking = true;
+            else if(tr_estimator == "delta")
+                tracking_params.ratio_tracking = false;
+            else
+            {
+                throw CreatingObjectException(
+                    "unknown transmittance estimator: " + tr_estimator);
+            }
+
             return create_heterogeneous_medium(
                 local_to_world, std::move(density),
-                std::move(albedo), std::move(g), max_scat_count);
+                std::move(albedo), std::move(g), max_scat_count,
+                tracking_params);
         }
     };
 
@@ -94,16 +94,19 @@ namespace post_processor
         RC<PostProcessor> create(
             const ConfigGroup &params, CreatingContext &context) const override
         {
-            std::string albedo_filename, normal_filename;
+            std::string albedo_filename, normal_filename, sample_count_filename;
 
             if(auto node = params.find_child("albedo"))
                 albedo_filename = context.path_mapper->map(node->as_value().as_str());
             if(auto node = params.find_child("normal"))
                 normal_filename = context.path_mapper->map(node->as_value().as_str());
+            if(auto node = params.find_child("sample_count"))
+                sample_count_filename = context.path_mapper->map(node->as_value().as_str());
             
             return create_saving_gbuffer_to_png(
                 std::move(albedo_filename),
-                std::move(normal_filename));
+                std::move(normal_filename),
+                std::move(sample_count_filename));
         }
     };
 
@@ -6,6 +6,38 @@ AGZ_TRACER_FACTORY_BEGIN
 namespace renderer
 {
 
+    AdaptiveSamplingParams parse_adaptive_sampling_params(
+        const ConfigGroup &params)
+    {
+        AdaptiveSamplingParams ret;
+        ret.enabled = params.child_int_or("adaptive", 0) != 0;
+
+        ret.error_threshold = params.child_real_or(
+            "adaptive_error", ret.error_threshold);
+        ret.batch_spp = params.child_int_or(
+            "adaptive_batch_spp", ret.batch_spp);
+        ret.max_spp = params.child_int_or(
+            "adaptive_max_spp", ret.max_spp);
+        ret.budget_spp = params.child_int_or(
+            "adaptive_budget_spp", ret.budget_spp);
+        ret.time_limit = params.child_real_or(
+            "adaptive_time_limit", ret.time_limit);
+
+        return ret;
+    }
+
+    SamplerType parse_sampler_type(const ConfigGroup &params)
+    {
+        const std::string sampler = params.child_str_or("sampler", "native");
+        if(sampler == "native")
+            return SamplerType::Native;
+        if(sampler == "sobol")
+            return SamplerType::Sobol;
+        if(sampler == "pmj02")
+            return SamplerType::PMJ02;
+        throw CreatingObjectException("unknown sampler type: " + sampler);
+    }
+
     class AORendererCreator : public Creator<Renderer>
     {
     public:
@@ -39,6 +71,10 @@ namespace renderer
 
             ao_params.spp = params.child_int("spp");
 
+            ao_params.adaptive = parse_adaptive_sampling_params(params);
+
+            ao_params.sampler = parse_sampler_type(params);
+
             return create_ao_renderer(ao_params);
         }
     };
@@ -108,6 +144,8 @@ namespace renderer
             renderer_params.forward_spp            =
                 params.child_int("forward_spp");
 
+            renderer_params.sampler = parse_sampler_type(params);
+
             return create_adjoint_pt_renderer(renderer_params);
         }
     };
@@ -145,11 +183,41 @@ namespace renderer
             pt_params.cont_prob         = cont_prob;
             pt_params.use_mis           = use_mis;
             pt_params.specular_depth    = specular_depth;
+            pt_params.adaptive          = parse_adaptive_sampling_params(params);
+            pt_params.sampler           = parse_sampler_type(params);
 
             return create_pt_renderer(pt_params);
         }
     };
 
+    class WavefrontPathTracingRendererCreator : public Creator<Renderer>
+    {
+    public:
+
+        std::string name() const override
+        {
+            return "wavefront_pt";
+        }
+
+        RC<Renderer> create(
+            const ConfigGroup &params, CreatingContext &context) const override
+        {
+            WavefrontPTRendererParams wpt_params;
+            wpt_params.worker_count   = params.child_int_or("worker_count", 0);
+            wpt_params.task_grid_size = params.child_int_or("task_grid_size", 32);
+            wpt_params.spp            = params.child_int("spp");
+            wpt_params.min_depth      = params.child_int_or("min_depth", 5);
+            wpt_params.max_depth      = params.child_int_or("max_depth", 10);
+            wpt_params.cont_prob      = params.child_real_or("cont_prob", real(0.9));
+            wpt_params.specular_depth = params.child_int_or("specular_depth", 20);
+            wpt_params.batch_size     = params.child_int_or("batch_size", 4096);
+            wpt_params.adaptive       = parse_adaptive_sampling_params(params);
+            wpt_params.sampler        = parse_sampler_type(params);
+
+            return create_wavefront_pt_renderer(wpt_params);
+        }
+    };
+
     class PSSMLTPTCreator : public Creator<Renderer>
     {
     public:
@@ -228,10 +296,41 @@ namespace renderer
 
             p.grid_accel_resolution = params.child_int_or("grid_res", 64);
 
+            p.sampler = parse_sampler_type(params);
+
             return create_sppm_renderer(p);
         }
     };
 
+    class VCMRendererCreator : public Creator<Renderer>
+    {
+    public:
+
+        std::string name() const override
+        {
+            return "vcm";
+        }
+
+        std::shared_ptr<Renderer> create(
+            const ConfigGroup &params, CreatingContext &context) const override
+        {
+            VCMRendererParams p;
+
+            p.worker_count    = params.child_int_or("worker_count", 0);
+            p.task_grid_size  = params.child_int_or("task_grid_size", 32);
+            p.iteration_count = params.child_int("iteration_count");
+
+            p.init_radius  = params.child_real_or("init_radius", -1);
+            p.radius_alpha = params.child_real_or("alpha", real(0.75));
+
+            p.min_depth = params.child_int_or("min_depth", 5);
+            p.max_depth = params.child_int_or("max_depth", 10);
+            p.cont_prob = params.child_real_or("cont_prob", real(0.9));
+
+            return create_vcm_renderer(p);
+        }
+    };
+
 } // namespace renderer
 
 void initialize_renderer_factory(Factory<Renderer> &factory)
@@ -241,7 +340,9 @@ void initialize_renderer_factory(Factory<Renderer> &factory)
     factory.add_creator(newBox<renderer::PathTracingRendererCreator>());
     factory.add_creator(newBox<renderer::PSSMLTPTCreator>());
     factory.add_creator(newBox<renderer::SPPMRendererCreator>());
+    factory.add_creator(newBox<renderer::VCMRendererCreator>());
     factory.add_creator(newBox<renderer::VolBDPTRendererCreator>());
+    factory.add_creator(newBox<renderer::WavefrontPathTracingRendererCreator>());
 }
 
 AGZ_TRACER_FACTORY_END
@@ -55,6 +55,16 @@ namespace scene
             else
                 scene_params.aggregate = create_native_aggregate();
 
+            const std::string light_sampler = params.child_str_or(
+                "light_sampler", "power");
+            if(light_sampler == "power")
+                scene_params.light_sampler = DefaultSceneParams::LightSampler::Power;
+            else if(light_sampler == "bvh")
+                scene_params.light_sampler = DefaultSceneParams::LightSampler::BVH;
+            else
+                throw CreatingObjectException(
+                    "unknown light sampler type: " + light_sampler);
+
             std::vector<RC<const Entity>> const_entities;
             const_entities.reserve(scene_params.entities.size());
             for(auto ent : scene_params.entities)
@@ -1,4 +1,5 @@
 #include <agz/factory/creator/texture2d_creators.h>
+#include <agz/factory/utility/texture2d_loader.h>
 #include <agz/tracer/create/texture2d.h>
 #include <agz/utility/image.h>
 
@@ -109,6 +110,28 @@ namespace texture
         mutable std::map<std::string, RC<const Image2D<math::color3b>>>
             filename2data_;
 
+        mutable std::map<std::string, RC<const TextureTileSource>>
+            filename2tiles_;
+
+        RC<Texture2D> create_tiled(
+            const Texture2DCommonParams &common_params,
+            const std::string &filename, const std::string &sample,
+            const std::string &filter) const
+        {
+            RC<const TextureTileSource> source;
+            if(auto it = filename2tiles_.find(filename);
+               it != filename2tiles_.end())
+                source = it->second;
+            else
+            {
+                source = texture2d_load::load_tiled_texture(filename);
+                filename2tiles_[filename] = source;
+            }
+
+            return create_cached_image_texture(
+                common_params, std::move(source), sample, filter);
+        }
+
     public:
 
         std::string name() const override
@@ -124,6 +147,13 @@ namespace texture
                 context.path_mapper->map(params.child_str("filename"));
             const auto sample =
                 params.child_str_or("sample", "linear");
+            const auto filter =
+                params.child_str_or("filter", "none");
+            const real max_anisotropy =
+                params.child_real_or("max_anisotropy", 8);
+
+            if(stdstr::ends_with(filename, ".agzt"))
+                return create_tiled(common_params, filename, sample, filter);
 
             RC<const Image2D<math::color3b>> data;
             if(auto it = filename2data_.find(filename);
@@ -140,7 +170,8 @@ namespace texture
                 filename2data_[filename] = data;
             }
 
-            return create_image_texture(common_params, std::move(data), sample);
+            return create_image_texture(
+                common_params, std::move(data), sample, filter, max_anisotropy);
         }
     };
 
@@ -147,6 +147,47 @@ namespace
                     "unknown image3d format: " + format);
             }
 
+            if(params.find_child("sparse_filename"))
+            {
+                const std::string filename = context.path_mapper->map(
+                    params.child_str("sparse_filename"));
+
+                if(format == "real")
+                {
+                    return create_image3d(
+                        common_params,
+                        texture3d_load::load_real_from_sparse(filename),
+                        use_linear_sampler);
+                }
+
+                if(format == "spec")
+                {
+                    return create_image3d(
+                        common_params,
+                        texture3d_load::load_spec_from_sparse(filename),
+                        use_linear_sampler);
+                }
+
+                if(format == "gray8")
+                {
+                    return create_image3d(
+                        common_params,
+                        texture3d_load::load_uint8_from_sparse(filename),
+                        use_linear_sampler);
+                }
+
+                if(format == "rgb8")
+                {
+                    return create_image3d(
+                        common_params,
+                        texture3d_load::load_uint24_from_sparse(filename),
+                        use_linear_sampler);
+                }
+
+                throw ObjectConstructionException(
+                    "unknown image3d format: " + format);
+            }
+
             if(params.find_child("image_filenames"))
             {
                 const auto &arr = params.child_array("image_filenames");
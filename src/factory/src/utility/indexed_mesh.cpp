@@ -0,0 +1,453 @@
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#include <agz/factory/utility/indexed_mesh.h>
+
+AGZ_TRACER_FACTORY_BEGIN
+
+namespace
+{
+
+    struct QuantizedVertex
+    {
+        float position[3];
+        int16_t normal[2];
+        uint16_t uv[2];
+
+        bool operator==(const QuantizedVertex &rhs) const noexcept
+        {
+            return std::memcmp(this, &rhs, sizeof(QuantizedVertex)) == 0;
+        }
+    };
+
+    static_assert(sizeof(QuantizedVertex) == 20);
+
+    struct QuantizedVertexHasher
+    {
+        size_t operator()(const QuantizedVertex &v) const noexcept
+        {
+            uint32_t words[5];
+            std::memcpy(words, &v, sizeof(words));
+
+            size_t ret = 0;
+            for(uint32_t w : words)
+                ret ^= std::hash<uint32_t>()(w) + 0x9e3779b9 + (ret << 6) + (ret >> 2);
+            return ret;
+        }
+    };
+
+    int16_t quantize_snorm(float v) noexcept
+    {
+        v = math::clamp(v, -1.0f, 1.0f);
+        return static_cast<int16_t>(std::round(v * 32767));
+    }
+
+    float dequantize_snorm(int16_t v) noexcept
+    {
+        return math::clamp(v / 32767.0f, -1.0f, 1.0f);
+    }
+
+    void encode_octahedral(const Vec3 &n, int16_t out[2]) noexcept
+    {
+        const float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if(sum <= 0)
+        {
+            out[0] = out[1] = 0;
+            return;
+        }
+
+        float x = n.x / sum, y = n.y / sum;
+        if(n.z < 0)
+        {
+            const float ox = (1 - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+            const float oy = (1 - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+            x = ox;
+            y = oy;
+        }
+
+        out[0] = quantize_snorm(x);
+        out[1] = quantize_snorm(y);
+    }
+
+    Vec3 decode_octahedral(const int16_t in[2]) noexcept
+    {
+        Vec3 n(dequantize_snorm(in[0]), dequantize_snorm(in[1]), 0);
+        n.z = 1 - std::abs(n.x) - std::abs(n.y);
+
+        const float t = (std::max)(-n.z, 0.0f);
+        n.x += n.x >= 0 ? -t : t;
+        n.y += n.y >= 0 ? -t : t;
+
+        return n.normalize();
+    }
+
+    uint16_t quantize_unorm(float v, float low, float high) noexcept
+    {
+        if(high <= low)
+            return 0;
+        const float t = math::clamp((v - low) / (high - low), 0.0f, 1.0f);
+        return static_cast<uint16_t>(std::round(t * 65535));
+    }
+
+    float dequantize_unorm(uint16_t v, float low, float high) noexcept
+    {
+        return low + (high - low) * (v / 65535.0f);
+    }
+
+    uint64_t align_offset(uint64_t offset) noexcept
+    {
+        return (offset + INDEXED_MESH_ALIGNMENT - 1)
+             / INDEXED_MESH_ALIGNMENT * INDEXED_MESH_ALIGNMENT;
+    }
+
+    bool is_little_endian() noexcept
+    {
+        const uint32_t v = 1;
+        unsigned char c;
+        std::memcpy(&c, &v, 1);
+        return c == 1;
+    }
+
+} // namespace anonymous
+
+IndexedMeshFile::IndexedMeshFile(const std::string &filename)
+    : file_(filename)
+{
+    const unsigned char *data = file_.data();
+    const uint64_t size = file_.size();
+
+    if(size < sizeof(IndexedMeshHeader))
+        throw std::runtime_error("invalid indexed mesh file: " + filename);
+
+    header_ = reinterpret_cast<const IndexedMeshHeader*>(data);
+
+    if(std::memcmp(header_->magic, INDEXED_MESH_MAGIC, sizeof(INDEXED_MESH_MAGIC)))
+        throw std::runtime_error("invalid indexed mesh file: " + filename);
+
+    if(header_->endian_tag != INDEXED_MESH_ENDIAN_TAG)
+    {
+        throw std::runtime_error(
+            "unsupported endianness of indexed mesh file: " + filename);
+    }
+
+    if(header_->version != INDEXED_MESH_VERSION)
+    {
+        throw std::runtime_error(
+            "unsupported indexed mesh version " +
+            std::to_string(header_->version) + " in " + filename);
+    }
+
+    const uint64_t vtx_cnt = header_->vertex_count;
+    const uint64_t tri_cnt = header_->triangle_count;
+
+    auto check_section = [&](uint64_t offset, uint64_t byte_size)
+    {
+        if(offset % 4 || offset > size || byte_size > size - offset)
+        {
+            throw std::runtime_error(
+                "corrupted indexed mesh file: " + filename);
+        }
+        return data + offset;
+    };
+
+    positions_ = reinterpret_cast<const float*>(check_section(
+        header_->position_offset, vtx_cnt * 3 * sizeof(float)));
+
+    if(header_->flags & IndexedMeshHeader::HAS_NORMAL)
+    {
+        normals_ = reinterpret_cast<const int16_t*>(check_section(
+            header_->normal_offset, vtx_cnt * 2 * sizeof(int16_t)));
+    }
+
+    if(header_->flags & IndexedMeshHeader::HAS_UV)
+    {
+        uvs_ = reinterpret_cast<const uint16_t*>(check_section(
+            header_->uv_offset, vtx_cnt * 2 * sizeof(uint16_t)));
+    }
+
+    indices_ = reinterpret_cast<const uint32_t*>(check_section(
+        header_->index_offset, tri_cnt * 3 * sizeof(uint32_t)));
+
+    if(header_->flags & IndexedMeshHeader::HAS_BVH)
+        bvh_ = check_section(header_->bvh_offset, header_->bvh_size);
+
+    for(uint64_t i = 0; i < 3 * tri_cnt; ++i)
+    {
+        if(indices_[i] >= vtx_cnt)
+        {
+            throw std::runtime_error(
+                "vertex index out of range in indexed mesh file: " + filename);
+        }
+    }
+}
+
+uint32_t IndexedMeshFile::vertex_count() const noexcept
+{
+    return header_->vertex_count;
+}
+
+uint32_t IndexedMeshFile::triangle_count() const noexcept
+{
+    return header_->triangle_count;
+}
+
+bool IndexedMeshFile::has_normal() const noexcept
+{
+    return normals_ != nullptr;
+}
+
+bool IndexedMeshFile::has_uv() const noexcept
+{
+    return uvs_ != nullptr;
+}
+
+Vec3 IndexedMeshFile::position(uint32_t vertex_index) const noexcept
+{
+    const float *p = positions_ + 3 * vertex_index;
+    return Vec3(p[0], p[1], p[2]);
+}
+
+Vec3 IndexedMeshFile::normal(uint32_t vertex_index) const noexcept
+{
+    assert(normals_);
+    return decode_octahedral(normals_ + 2 * vertex_index);
+}
+
+Vec2 IndexedMeshFile::uv(uint32_t vertex_index) const noexcept
+{
+    if(!uvs_)
+        return Vec2(0, 0);
+    const uint16_t *t = uvs_ + 2 * vertex_index;
+    return Vec2(
+        dequantize_unorm(t[0], header_->uv_low[0], header_->uv_high[0]),
+        dequantize_unorm(t[1], header_->uv_low[1], header_->uv_high[1]));
+}
+
+const uint32_t *IndexedMeshFile::indices() const noexcept
+{
+    return indices_;
+}
+
+const unsigned char *IndexedMeshFile::bvh_data() const noexcept
+{
+    return bvh_;
+}
+
+size_t IndexedMeshFile::bvh_size() const noexcept
+{
+    return bvh_ ? static_cast<size_t>(header_->bvh_size) : 0;
+}
+
+std::vector<mesh::triangle_t> IndexedMeshFile::to_triangles() const
+{
+    std::vector<mesh::triangle_t> ret(triangle_count());
+
+    for(uint32_t i = 0; i < triangle_count(); ++i)
+    {
+        auto &tri = ret[i];
+        for(int j = 0; j < 3; ++j)
+        {
+            const uint32_t vi = indices_[3 * i + j];
+            tri.vertices[j].position  = position(vi);
+            tri.vertices[j].tex_coord = uv(vi);
+        }
+
+        if(normals_)
+        {
+            for(int j = 0; j < 3; ++j)
+                tri.vertices[j].normal = normal(indices_[3 * i + j]);
+        }
+        else
+        {
+            const Vec3 nor = cross(
+                tri.vertices[1].position - tri.vertices[0].position,
+                tri.vertices[2].position - tri.vertices[0].position).normalize();
+            for(int j = 0; j < 3; ++j)
+                tri.vertices[j].normal = nor;
+        }
+    }
+
+    return ret;
+}
+
+std::vector<mesh::triangle_t> load_indexed_mesh(const std::string &filename)
+{
+    const IndexedMeshFile file(filename);
+    return file.to_triangles();
+}
+
+void save_indexed_mesh(
+    const std::string &filename,
+    const mesh::triangle_t *triangles, size_t triangle_count,
+    const void *bvh_data, size_t bvh_size)
+{
+    if(!is_little_endian())
+    {
+        throw std::runtime_error(
+            "indexed mesh can only be saved on little-endian machines");
+    }
+
+    if(triangle_count > std::numeric_limits<uint32_t>::max() / 3)
+        throw std::runtime_error("too many triangles to save: " + filename);
+
+    // uv range
+
+    float uv_low[2]  = { 0, 0 };
+    float uv_high[2] = { 0, 0 };
+    bool has_uv = false;
+
+    if(triangle_count)
+    {
+        uv_low[0] = uv_high[0] = triangles[0].vertices[0].tex_coord.x;
+        uv_low[1] = uv_high[1] = triangles[0].vertices[0].tex_coord.y;
+    }
+
+    for(size_t i = 0; i < triangle_count; ++i)
+    {
+        for(auto &v : triangles[i].vertices)
+        {
+            uv_low[0]  = (std::min)(uv_low[0],  v.tex_coord.x);
+            uv_low[1]  = (std::min)(uv_low[1],  v.tex_coord.y);
+            uv_high[0] = (std::max)(uv_high[0], v.tex_coord.x);
+            uv_high[1] = (std::max)(uv_high[1], v.tex_coord.y);
+            has_uv |= v.tex_coord.x != 0 || v.tex_coord.y != 0;
+        }
+    }
+
+    // merge identical quantized vertices
+
+    std::vector<QuantizedVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::unordered_map<QuantizedVertex, uint32_t, QuantizedVertexHasher> vtx2idx;
+
+    indices.reserve(3 * triangle_count);
+    for(size_t i = 0; i < triangle_count; ++i)
+    {
+        for(auto &v : triangles[i].vertices)
+        {
+            QuantizedVertex qv;
+            qv.position[0] = v.position.x;
+            qv.position[1] = v.position.y;
+            qv.position[2] = v.position.z;
+            encode_octahedral(v.normal, qv.normal);
+            qv.uv[0] = has_uv ? quantize_unorm(v.tex_coord.x, uv_low[0], uv_high[0]) : 0;
+            qv.uv[1] = has_uv ? quantize_unorm(v.tex_coord.y, uv_low[1], uv_high[1]) : 0;
+
+            const auto it = vtx2idx.find(qv);
+            if(it != vtx2idx.end())
+            {
+                indices.push_back(it->second);
+                continue;
+            }
+
+            const uint32_t idx = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(qv);
+            vtx2idx.insert({ qv, idx });
+            indices.push_back(idx);
+        }
+    }
+
+    // fill header
+
+    IndexedMeshHeader header = {};
+    std::memcpy(header.magic, INDEXED_MESH_MAGIC, sizeof(INDEXED_MESH_MAGIC));
+    header.version        = INDEXED_MESH_VERSION;
+    header.endian_tag     = INDEXED_MESH_ENDIAN_TAG;
+    header.flags          = IndexedMeshHeader::HAS_NORMAL;
+    header.vertex_count   = static_cast<uint32_t>(vertices.size());
+    header.triangle_count = static_cast<uint32_t>(triangle_count);
+
+    if(has_uv)
+    {
+        header.flags |= IndexedMeshHeader::HAS_UV;
+        header.uv_low[0]  = uv_low[0];
+        header.uv_low[1]  = uv_low[1];
+        header.uv_high[0] = uv_high[0];
+        header.uv_high[1] = uv_high[1];
+    }
+
+    if(bvh_data && bvh_size)
+        header.flags |= IndexedMeshHeader::HAS_BVH;
+
+    const uint64_t vtx_cnt = vertices.size();
+
+    uint64_t offset = align_offset(sizeof(IndexedMeshHeader));
+    header.position_offset = offset;
+    offset = align_offset(offset + vtx_cnt * 3 * sizeof(float));
+
+    header.normal_offset = offset;
+    offset = align_offset(offset + vtx_cnt * 2 * sizeof(int16_t));
+
+    if(has_uv)
+    {
+        header.uv_offset = offset;
+        offset = align_offset(offset + vtx_cnt * 2 * sizeof(uint16_t));
+    }
+
+    header.index_offset = offset;
+    offset = align_offset(offset + indices.size() * sizeof(uint32_t));
+
+    if(header.flags & IndexedMeshHeader::HAS_BVH)
+    {
+        header.bvh_offset = offset;
+        header.bvh_size   = bvh_size;
+    }
+
+    // write sections
+
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    if(!fout)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    uint64_t written = 0;
+    auto write = [&](uint64_t section_offset, const void *data, uint64_t byte_size)
+    {
+        assert(section_offset >= written);
+        static const char zeros[INDEXED_MESH_ALIGNMENT] = { 0 };
+        fout.write(zeros, static_cast<std::streamsize>(section_offset - written));
+        fout.write(static_cast<const char*>(data),
+                   static_cast<std::streamsize>(byte_size));
+        written = section_offset + byte_size;
+    };
+
+    write(0, &header, sizeof(header));
+
+    {
+        std::vector<float> positions(3 * vtx_cnt);
+        for(size_t i = 0; i < vertices.size(); ++i)
+            std::memcpy(&positions[3 * i], vertices[i].position, 3 * sizeof(float));
+        write(header.position_offset, positions.data(), positions.size() * sizeof(float));
+    }
+
+    {
+        std::vector<int16_t> normals(2 * vtx_cnt);
+        for(size_t i = 0; i < vertices.size(); ++i)
+        {
+            normals[2 * i]     = vertices[i].normal[0];
+            normals[2 * i + 1] = vertices[i].normal[1];
+        }
+        write(header.normal_offset, normals.data(), normals.size() * sizeof(int16_t));
+    }
+
+    if(has_uv)
+    {
+        std::vector<uint16_t> uvs(2 * vtx_cnt);
+        for(size_t i = 0; i < vertices.size(); ++i)
+        {
+            uvs[2 * i]     = vertices[i].uv[0];
+            uvs[2 * i + 1] = vertices[i].uv[1];
+        }
+        write(header.uv_offset, uvs.data(), uvs.size() * sizeof(uint16_t));
+    }
+
+    write(header.index_offset, indices.data(), indices.size() * sizeof(uint32_t));
+
+    if(header.flags & IndexedMeshHeader::HAS_BVH)
+        write(header.bvh_offset, bvh_data, bvh_size);
+
+    if(!fout)
+        throw std::runtime_error("failed to write indexed mesh to " + filename);
+}
+
+AGZ_TRACER_FACTORY_END
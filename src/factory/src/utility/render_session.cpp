@@ -4,6 +4,7 @@
 #include <agz/factory/factory.h>
 #include <agz/tracer/create/film_filter.h>
 #include <agz/tracer/utility/logger.h>
+#include <agz/tracer/utility/texture_cache.h>
 
 #include <agz/utility/string.h>
 
@@ -62,6 +63,9 @@ namespace
         if(auto node = rendering_config.find_child_value("eps"))
             settings->eps = node->as_real();
 
+        settings->texture_cache_budget =
+            rendering_config.child_int_or("texture_cache_budget", 0);
+
         return settings;
     }
 }
@@ -79,6 +83,13 @@ void RenderSession::execute()
 
     set_eps(render_settings->eps);
 
+    auto &texture_cache = TextureCache::instance();
+    if(render_settings->texture_cache_budget > 0)
+    {
+        texture_cache.set_budget(
+            size_t(render_settings->texture_cache_budget) << 20);
+    }
+
     scene->set_camera(render_settings->camera);
     scene->start_rendering();
 
@@ -89,6 +100,19 @@ void RenderSession::execute()
     RenderTarget render_target = render_settings->renderer->render(
         filter_applier, *scene, *render_settings->reporter);
 
+    const TextureCacheStatistics cache_stats = texture_cache.statistics();
+    if(cache_stats.miss_count)
+    {
+        AGZ_INFO(
+            "texture cache: {} local hits, {} shared hits, {} misses, "
+            "{} evictions, resident {:.1f} MB (peak {:.1f} MB, budget {:.1f} MB)",
+            cache_stats.local_hit_count, cache_stats.shared_hit_count,
+            cache_stats.miss_count, cache_stats.evicted_count,
+            cache_stats.resident_bytes      / (1024.0 * 1024.0),
+            cache_stats.peak_resident_bytes / (1024.0 * 1024.0),
+            cache_stats.budget_bytes        / (1024.0 * 1024.0));
+    }
+
     AGZ_INFO("running post processors");
 
     for(auto &p : render_settings->post_processors)
@@ -0,0 +1,266 @@
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#include <agz/factory/utility/texture2d_loader.h>
+#include <agz/tracer/utility/mapped_file.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+    using namespace texture2d_load;
+
+    constexpr int TILE_SIZE = TextureCache::TILE_SIZE;
+
+    int tile_count(int size) noexcept
+    {
+        return (size + TILE_SIZE - 1) / TILE_SIZE;
+    }
+
+    // sizes of the full mip chain down to 1 x 1
+    std::vector<Vec2i> compute_level_sizes(int width, int height)
+    {
+        std::vector<Vec2i> ret = { { width, height } };
+        while(ret.back().x > 1 || ret.back().y > 1)
+        {
+            const Vec2i &last = ret.back();
+            ret.push_back({
+                (std::max)(1, (last.x + 1) / 2),
+                (std::max)(1, (last.y + 1) / 2) });
+        }
+        return ret;
+    }
+
+    // box filtered level with half resolution
+    Image2D<math::color3b> downsample(const Image2D<math::color3b> &src)
+    {
+        const int src_w = src.width(), src_h = src.height();
+        const int w = (std::max)(1, (src_w + 1) / 2);
+        const int h = (std::max)(1, (src_h + 1) / 2);
+
+        Image2D<math::color3b> ret(h, w);
+        for(int y = 0; y < h; ++y)
+        {
+            const int y0 = (std::min)(2 * y,     src_h - 1);
+            const int y1 = (std::min)(2 * y + 1, src_h - 1);
+
+            for(int x = 0; x < w; ++x)
+            {
+                const int x0 = (std::min)(2 * x,     src_w - 1);
+                const int x1 = (std::min)(2 * x + 1, src_w - 1);
+
+                const math::color3b &a = src(y0, x0), &b = src(y0, x1);
+                const math::color3b &c = src(y1, x0), &d = src(y1, x1);
+
+                auto avg = [](int i, int j, int k, int l)
+                {
+                    return static_cast<uint8_t>((i + j + k + l + 2) / 4);
+                };
+
+                ret(y, x) = math::color3b(
+                    avg(a.r, b.r, c.r, d.r),
+                    avg(a.g, b.g, c.g, d.g),
+                    avg(a.b, b.b, c.b, d.b));
+            }
+        }
+
+        return ret;
+    }
+
+    class MappedTileSource : public TextureTileSource
+    {
+        RC<MappedFile> file_;
+
+        std::vector<Vec2i> level_sizes_;
+
+        // byte offset of the first tile of each level
+        std::vector<uint64_t> level_offsets_;
+
+    public:
+
+        MappedTileSource(
+            RC<MappedFile> file, std::vector<Vec2i> level_sizes,
+            std::vector<uint64_t> level_offsets)
+            : file_(std::move(file)),
+              level_sizes_(std::move(level_sizes)),
+              level_offsets_(std::move(level_offsets))
+        {
+
+        }
+
+        int level_count() const noexcept override
+        {
+            return static_cast<int>(level_sizes_.size());
+        }
+
+        int width(int level) const noexcept override
+        {
+            return level_sizes_[level].x;
+        }
+
+        int height(int level) const noexcept override
+        {
+            return level_sizes_[level].y;
+        }
+
+        void load_tile(
+            int level, int tile_x, int tile_y,
+            math::color3b *texels) const override
+        {
+            const uint64_t tile_idx =
+                uint64_t(tile_y) * tile_count(level_sizes_[level].x) + tile_x;
+            const uint64_t offset =
+                level_offsets_[level] + tile_idx * TextureCache::TILE_BYTES;
+            std::memcpy(texels, file_->data() + offset, TextureCache::TILE_BYTES);
+        }
+    };
+
+} // namespace anonymous
+
+namespace texture2d_load
+{
+
+RC<const TextureTileSource> load_tiled_texture(const std::string &filename)
+{
+    auto file = newRC<MappedFile>(filename);
+
+    const unsigned char *data = file->data();
+    const uint64_t size = file->size();
+
+    if(size < sizeof(TiledTextureHeader))
+    {
+        throw ObjectConstructionException(
+            "invalid tiled texture file: " + filename);
+    }
+
+    TiledTextureHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    if(std::memcmp(header.magic, TILED_TEXTURE_MAGIC, sizeof(TILED_TEXTURE_MAGIC)))
+    {
+        throw ObjectConstructionException(
+            "invalid tiled texture file: " + filename);
+    }
+
+    if(header.endian_tag != TILED_TEXTURE_ENDIAN_TAG)
+    {
+        throw ObjectConstructionException(
+            "unsupported endianness of tiled texture file: " + filename);
+    }
+
+    if(header.version != TILED_TEXTURE_VERSION)
+    {
+        throw ObjectConstructionException(
+            "unsupported tiled texture version " +
+            std::to_string(header.version) + " in " + filename);
+    }
+
+    if(header.tile_size != uint32_t(TILE_SIZE) ||
+       header.width <= 0 || header.height <= 0)
+    {
+        throw ObjectConstructionException(
+            "corrupted tiled texture file: " + filename);
+    }
+
+    auto level_sizes = compute_level_sizes(header.width, header.height);
+    if(header.level_count != static_cast<int32_t>(level_sizes.size()))
+    {
+        throw ObjectConstructionException(
+            "corrupted tiled texture file: " + filename);
+    }
+
+    std::vector<uint64_t> level_offsets;
+    uint64_t offset = header.data_offset;
+    for(auto &s : level_sizes)
+    {
+        level_offsets.push_back(offset);
+        offset += uint64_t(tile_count(s.x)) * tile_count(s.y)
+                * TextureCache::TILE_BYTES;
+    }
+
+    if(header.data_offset > size || offset > size)
+    {
+        throw ObjectConstructionException(
+            "corrupted tiled texture file: " + filename);
+    }
+
+    return newRC<MappedTileSource>(
+        std::move(file), std::move(level_sizes), std::move(level_offsets));
+}
+
+void save_tiled_texture(
+    const std::string &filename, const Image2D<math::color3b> &image)
+{
+    const uint32_t endian_probe = 1;
+    unsigned char first_byte;
+    std::memcpy(&first_byte, &endian_probe, 1);
+    if(first_byte != 1)
+    {
+        throw std::runtime_error(
+            "tiled texture can only be saved on little-endian machines");
+    }
+
+    if(!image.is_available())
+        throw std::runtime_error("saving empty image to " + filename);
+
+    const auto level_sizes = compute_level_sizes(image.width(), image.height());
+
+    TiledTextureHeader header = {};
+    std::memcpy(header.magic, TILED_TEXTURE_MAGIC, sizeof(TILED_TEXTURE_MAGIC));
+    header.version     = TILED_TEXTURE_VERSION;
+    header.endian_tag  = TILED_TEXTURE_ENDIAN_TAG;
+    header.tile_size   = TILE_SIZE;
+    header.width       = image.width();
+    header.height      = image.height();
+    header.level_count = static_cast<int32_t>(level_sizes.size());
+    header.data_offset = (sizeof(TiledTextureHeader) + TILED_TEXTURE_ALIGNMENT - 1)
+                       / TILED_TEXTURE_ALIGNMENT * TILED_TEXTURE_ALIGNMENT;
+
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    if(!fout)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    static const char zeros[TILED_TEXTURE_ALIGNMENT] = { 0 };
+    fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    fout.write(zeros, static_cast<std::streamsize>(
+        header.data_offset - sizeof(header)));
+
+    std::vector<math::color3b> tile(TextureCache::TILE_TEXEL_COUNT);
+
+    Image2D<math::color3b> level = image;
+    for(size_t i = 0; i < level_sizes.size(); ++i)
+    {
+        if(i > 0)
+            level = downsample(level);
+
+        const int w = level.width(), h = level.height();
+        assert(w == level_sizes[i].x && h == level_sizes[i].y);
+
+        for(int ty = 0; ty < tile_count(h); ++ty)
+        {
+            for(int tx = 0; tx < tile_count(w); ++tx)
+            {
+                for(int ly = 0, j = 0; ly < TILE_SIZE; ++ly)
+                {
+                    const int y = (std::min)(ty * TILE_SIZE + ly, h - 1);
+                    for(int lx = 0; lx < TILE_SIZE; ++lx, ++j)
+                    {
+                        const int x = (std::min)(tx * TILE_SIZE + lx, w - 1);
+                        tile[j] = level(y, x);
+                    }
+                }
+
+                fout.write(reinterpret_cast<const char*>(tile.data()),
+                           static_cast<std::streamsize>(TextureCache::TILE_BYTES));
+            }
+        }
+    }
+
+    if(!fout)
+        throw std::runtime_error("failed to write tiled texture to " + filename);
+}
+
+} // namespace texture2d_load
+
+AGZ_TRACER_END
@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cstring>
+
 #include <agz/factory/context.h>
 #include <agz/factory/utility/texture3d_loader.h>
+#include <agz/tracer/utility/mapped_file.h>
 #include <agz/utility/image.h>
 #include <agz/utility/misc.h>
 
@@ -22,19 +26,280 @@ namespace
 
         texture::texture3d_t<Texel> data(depth, height, width);
 
-        for(int32_t z = 0; z < depth; ++z)
+        // texels are stored contiguously in z-y-x order
+
+        const std::streamsize byte_size = std::streamsize(sizeof(Texel))
+                                        * width * height * depth;
+        fin.read(reinterpret_cast<char *>(data.raw_data()), byte_size);
+        if(!fin)
+        {
+            throw ObjectConstructionException(
+                "failed to read texel data from file");
+        }
+
+        return data;
+    }
+
+    template<typename Texel>
+    RC<const SparseVolume<Texel>> load_sparse_from_binary(std::ifstream &fin)
+    {
+        using Volume = SparseVolume<Texel>;
+        constexpr int B = Volume::BRICK_SIZE;
+
+        int32_t width, height, depth;
+        fin.read(reinterpret_cast<char *>(&width), sizeof(width));
+        fin.read(reinterpret_cast<char *>(&height), sizeof(height));
+        fin.read(reinterpret_cast<char *>(&depth), sizeof(depth));
+        if(!fin)
+        {
+            throw ObjectConstructionException(
+                "failed to read width/height/depth from file");
+        }
+
+        if(width <= 0 || height <= 0 || depth <= 0)
         {
-            for(int32_t y = 0; y < height; ++y)
+            throw ObjectConstructionException(
+                "invalid width/height/depth in file");
+        }
+
+        const Vec3i size(width, height, depth);
+        const Vec3i brick_count = Volume::compute_brick_count(size);
+        const Texel background = Texel();
+
+        std::vector<uint32_t> brick_index(
+            size_t(brick_count.x) * brick_count.y * brick_count.z);
+        std::vector<Texel> brick_data;
+
+        // read BRICK_SIZE z-slices at a time and convert them to a row of
+        // bricks before reading the next slab, so that the dense volume is
+        // never held in memory as a whole
+
+        const size_t slice_texel_count = size_t(width) * height;
+        std::vector<Texel> slab(slice_texel_count * B);
+        std::vector<Texel> brick(Volume::BRICK_TEXEL_COUNT);
+
+        size_t brick_idx = 0;
+        for(int bz = 0; bz < brick_count.z; ++bz)
+        {
+            const int slab_depth = (std::min)(B, depth - bz * B);
+            const std::streamsize byte_size = std::streamsize(sizeof(Texel))
+                                            * slice_texel_count * slab_depth;
+            fin.read(reinterpret_cast<char *>(slab.data()), byte_size);
+            if(!fin)
+            {
+                throw ObjectConstructionException(
+                    "failed to read texel data from file");
+            }
+
+            for(int by = 0; by < brick_count.y; ++by)
             {
-                for(int32_t x = 0; x < width; ++x)
+                for(int bx = 0; bx < brick_count.x; ++bx, ++brick_idx)
                 {
-                    fin.read(
-                        reinterpret_cast<char *>(&data(z, y, x)), sizeof(Texel));
+                    bool empty = true;
+
+                    for(int lz = 0, i = 0; lz < B; ++lz)
+                    {
+                        for(int ly = 0; ly < B; ++ly)
+                        {
+                            for(int lx = 0; lx < B; ++lx, ++i)
+                            {
+                                const int y = by * B + ly;
+                                const int x = bx * B + lx;
+
+                                if(lz < slab_depth && y < height && x < width)
+                                {
+                                    brick[i] = slab[
+                                        (size_t(lz) * height + y) * width + x];
+                                }
+                                else
+                                    brick[i] = background;
+
+                                empty &= std::memcmp(
+                                    &brick[i], &background, sizeof(Texel)) == 0;
+                            }
+                        }
+                    }
+
+                    if(empty)
+                    {
+                        brick_index[brick_idx] = Volume::EMPTY_BRICK;
+                        continue;
+                    }
+
+                    brick_index[brick_idx] = static_cast<uint32_t>(
+                        brick_data.size() / Volume::BRICK_TEXEL_COUNT);
+                    brick_data.insert(
+                        brick_data.end(), brick.begin(), brick.end());
                 }
             }
         }
 
-        return data;
+        return newRC<Volume>(
+            size, background, std::move(brick_index), std::move(brick_data));
+    }
+
+    template<typename Texel>
+    RC<const SparseVolume<Texel>> load_from_sparse(
+        const std::string &filename, uint32_t texel_format)
+    {
+        using namespace texture3d_load;
+        using Volume = SparseVolume<Texel>;
+
+        auto file = newRC<MappedFile>(filename);
+
+        const unsigned char *data = file->data();
+        const uint64_t size = file->size();
+
+        if(size < sizeof(SparseVolumeHeader))
+        {
+            throw ObjectConstructionException(
+                "invalid sparse volume file: " + filename);
+        }
+
+        SparseVolumeHeader header;
+        std::memcpy(&header, data, sizeof(header));
+
+        if(std::memcmp(header.magic, SPARSE_VOLUME_MAGIC, sizeof(SPARSE_VOLUME_MAGIC)))
+        {
+            throw ObjectConstructionException(
+                "invalid sparse volume file: " + filename);
+        }
+
+        if(header.endian_tag != SPARSE_VOLUME_ENDIAN_TAG)
+        {
+            throw ObjectConstructionException(
+                "unsupported endianness of sparse volume file: " + filename);
+        }
+
+        if(header.version != SPARSE_VOLUME_VERSION)
+        {
+            throw ObjectConstructionException(
+                "unsupported sparse volume version " +
+                std::to_string(header.version) + " in " + filename);
+        }
+
+        if(header.texel_format != texel_format)
+        {
+            throw ObjectConstructionException(
+                "unmatched texel format of sparse volume file: " + filename);
+        }
+
+        if(header.brick_size != uint32_t(Volume::BRICK_SIZE) ||
+           header.width <= 0 || header.height <= 0 || header.depth <= 0)
+        {
+            throw ObjectConstructionException(
+                "corrupted sparse volume file: " + filename);
+        }
+
+        const Vec3i volume_size(header.width, header.height, header.depth);
+        const Vec3i brick_count = Volume::compute_brick_count(volume_size);
+
+        const uint64_t index_count =
+            uint64_t(brick_count.x) * brick_count.y * brick_count.z;
+        const uint64_t stored_cnt = header.stored_brick_count;
+
+        auto check_section = [&](uint64_t offset, uint64_t byte_size)
+        {
+            if(offset % 4 || offset > size || byte_size > size - offset)
+            {
+                throw ObjectConstructionException(
+                    "corrupted sparse volume file: " + filename);
+            }
+            return data + offset;
+        };
+
+        const uint32_t *brick_index = reinterpret_cast<const uint32_t*>(
+            check_section(header.index_offset, index_count * sizeof(uint32_t)));
+
+        const Texel *brick_data = reinterpret_cast<const Texel*>(
+            check_section(
+                header.data_offset,
+                stored_cnt * Volume::BRICK_TEXEL_COUNT * sizeof(Texel)));
+
+        for(uint64_t i = 0; i < index_count; ++i)
+        {
+            if(brick_index[i] != Volume::EMPTY_BRICK && brick_index[i] >= stored_cnt)
+            {
+                throw ObjectConstructionException(
+                    "brick index out of range in sparse volume file: " + filename);
+            }
+        }
+
+        Texel background;
+        std::memcpy(&background, header.background, sizeof(Texel));
+
+        return newRC<Volume>(
+            volume_size, background, brick_index, brick_data,
+            static_cast<size_t>(stored_cnt), std::move(file));
+    }
+
+    template<typename Texel>
+    void save_to_sparse(
+        const std::string &filename, const SparseVolume<Texel> &volume,
+        uint32_t texel_format)
+    {
+        using namespace texture3d_load;
+        using Volume = SparseVolume<Texel>;
+
+        static_assert(sizeof(Texel) <= sizeof(SparseVolumeHeader::background));
+
+        const uint32_t endian_probe = 1;
+        unsigned char first_byte;
+        std::memcpy(&first_byte, &endian_probe, 1);
+        if(first_byte != 1)
+        {
+            throw std::runtime_error(
+                "sparse volume can only be saved on little-endian machines");
+        }
+
+        auto align_offset = [](uint64_t offset)
+        {
+            return (offset + SPARSE_VOLUME_ALIGNMENT - 1)
+                 / SPARSE_VOLUME_ALIGNMENT * SPARSE_VOLUME_ALIGNMENT;
+        };
+
+        const Vec3i &brick_count = volume.brick_count();
+        const uint64_t index_count =
+            uint64_t(brick_count.x) * brick_count.y * brick_count.z;
+        const uint64_t data_size = uint64_t(volume.stored_brick_count())
+                                 * Volume::BRICK_TEXEL_COUNT * sizeof(Texel);
+
+        SparseVolumeHeader header = {};
+        std::memcpy(header.magic, SPARSE_VOLUME_MAGIC, sizeof(SPARSE_VOLUME_MAGIC));
+        header.version            = SPARSE_VOLUME_VERSION;
+        header.endian_tag         = SPARSE_VOLUME_ENDIAN_TAG;
+        header.texel_format       = texel_format;
+        header.brick_size         = Volume::BRICK_SIZE;
+        header.width              = volume.width();
+        header.height             = volume.height();
+        header.depth              = volume.depth();
+        header.stored_brick_count = static_cast<uint32_t>(volume.stored_brick_count());
+        std::memcpy(header.background, &volume.background(), sizeof(Texel));
+
+        header.index_offset = align_offset(sizeof(SparseVolumeHeader));
+        header.data_offset  = align_offset(
+            header.index_offset + index_count * sizeof(uint32_t));
+
+        std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+        if(!fout)
+            throw std::runtime_error("failed to open file: " + filename);
+
+        uint64_t written = 0;
+        auto write = [&](uint64_t section_offset, const void *data, uint64_t byte_size)
+        {
+            static const char zeros[SPARSE_VOLUME_ALIGNMENT] = { 0 };
+            fout.write(zeros, static_cast<std::streamsize>(section_offset - written));
+            fout.write(static_cast<const char*>(data),
+                       static_cast<std::streamsize>(byte_size));
+            written = section_offset + byte_size;
+        };
+
+        write(0, &header, sizeof(header));
+        write(header.index_offset, volume.brick_index(), index_count * sizeof(uint32_t));
+        write(header.data_offset, volume.brick_data(), data_size);
+
+        if(!fout)
+            throw std::runtime_error("failed to write sparse volume to " + filename);
     }
 
     template<typename Texel, typename Func>
@@ -316,6 +581,70 @@ void save_uint24_to_binary(
         reinterpret_cast<const char *>(data), size.product() * sizeof(math::color3b));
 }
 
+RC<const SparseVolume<real>> load_real_sparse_from_binary(std::ifstream &fin)
+{
+    return load_sparse_from_binary<real>(fin);
+}
+
+RC<const SparseVolume<Spectrum>> load_spec_sparse_from_binary(std::ifstream &fin)
+{
+    return load_sparse_from_binary<Spectrum>(fin);
+}
+
+RC<const SparseVolume<uint8_t>> load_uint8_sparse_from_binary(std::ifstream &fin)
+{
+    return load_sparse_from_binary<uint8_t>(fin);
+}
+
+RC<const SparseVolume<math::color3b>> load_uint24_sparse_from_binary(std::ifstream &fin)
+{
+    return load_sparse_from_binary<math::color3b>(fin);
+}
+
+RC<const SparseVolume<real>> load_real_from_sparse(const std::string &filename)
+{
+    return load_from_sparse<real>(filename, SparseVolumeHeader::FORMAT_REAL);
+}
+
+RC<const SparseVolume<Spectrum>> load_spec_from_sparse(const std::string &filename)
+{
+    return load_from_sparse<Spectrum>(filename, SparseVolumeHeader::FORMAT_SPEC);
+}
+
+RC<const SparseVolume<uint8_t>> load_uint8_from_sparse(const std::string &filename)
+{
+    return load_from_sparse<uint8_t>(filename, SparseVolumeHeader::FORMAT_GRAY8);
+}
+
+RC<const SparseVolume<math::color3b>> load_uint24_from_sparse(const std::string &filename)
+{
+    return load_from_sparse<math::color3b>(filename, SparseVolumeHeader::FORMAT_RGB8);
+}
+
+void save_real_to_sparse(
+    const std::string &filename, const SparseVolume<real> &volume)
+{
+    save_to_sparse(filename, volume, SparseVolumeHeader::FORMAT_REAL);
+}
+
+void save_spec_to_sparse(
+    const std::string &filename, const SparseVolume<Spectrum> &volume)
+{
+    save_to_sparse(filename, volume, SparseVolumeHeader::FORMAT_SPEC);
+}
+
+void save_uint8_to_sparse(
+    const std::string &filename, const SparseVolume<uint8_t> &volume)
+{
+    save_to_sparse(filename, volume, SparseVolumeHeader::FORMAT_GRAY8);
+}
+
+void save_uint24_to_sparse(
+    const std::string &filename, const SparseVolume<math::color3b> &volume)
+{
+    save_to_sparse(filename, volume, SparseVolumeHeader::FORMAT_RGB8);
+}
+
 } // namespace texture3d_load
 
 AGZ_TRACER_END
@@ -14,10 +14,13 @@ public:
 
     using Clock = std::chrono::steady_clock;
 
-    explicit GUIProgressReporter(Clock::duration update_preview_interval);
+    GUIProgressReporter(
+        Clock::duration update_preview_interval, int preview_max_size);
 
     bool need_image_preview() const noexcept override;
 
+    int preview_max_size() const noexcept override;
+
     void progress(double percent, const PreviewFunc &get_image_preview) override;
 
     void message(const std::string &msg) override;
@@ -39,6 +42,8 @@ private:
     Clock::duration update_preview_interval_;
     Clock::time_point last_update_preview_time_;
 
+    int preview_max_size_;
+
     std::mutex preview_image_mutex_;
     agz::tracer::Image2D<agz::tracer::Spectrum> preview_image_;
 
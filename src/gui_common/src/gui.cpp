@@ -215,9 +215,19 @@ void GUI::start_rendering(const std::string &input_filename)
     render_session_ = create_render_session(
         scene, rendering_config, render_context_->context);
 
+    if(const int budget = render_session_.render_settings->texture_cache_budget;
+       budget > 0)
+    {
+        agz::tracer::TextureCache::instance().set_budget(size_t(budget) << 20);
+    }
+
+    // previews are never displayed larger than the screen
+
+    const QRect screen_rect = QApplication::desktop()->screenGeometry(this);
     reporter_ = std::make_shared<GUIProgressReporter>(
         std::chrono::duration_cast<GUIProgressReporter::Clock::duration>(
-            std::chrono::milliseconds(500)));
+            std::chrono::milliseconds(500)),
+        (std::max)(screen_rect.width(), screen_rect.height()));
     render_session_.render_settings->reporter = reporter_;
 
     agz::tracer::FilmFilterApplier film_filter_applier(
@@ -3,9 +3,11 @@
 #include <agz/gui_common/reporter.h>
 #include <agz/tracer/tracer.h>
 
-GUIProgressReporter::GUIProgressReporter(Clock::duration update_preview_interval)
+GUIProgressReporter::GUIProgressReporter(
+    Clock::duration update_preview_interval, int preview_max_size)
     : update_preview_interval_(update_preview_interval),
-      last_update_preview_time_(Clock::now())
+      last_update_preview_time_(Clock::now()),
+      preview_max_size_(preview_max_size)
 {
 
 }
@@ -15,6 +17,11 @@ bool GUIProgressReporter::need_image_preview() const noexcept
     return true;
 }
 
+int GUIProgressReporter::preview_max_size() const noexcept
+{
+    return preview_max_size_;
+}
+
 void GUIProgressReporter::progress(
     double percent, const PreviewFunc &get_image_preview)
 {
@@ -266,6 +266,15 @@ public:
     bool between(real t) const noexcept;
 };
 
+/**
+ * @brief auxiliary rays offset by one pixel in x/y direction on the film
+ */
+struct RayDifferential
+{
+    FVec3 o_dx, d_dx;
+    FVec3 o_dy, d_dy;
+};
+
 class AABB
 {
 public:
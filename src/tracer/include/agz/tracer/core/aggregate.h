@@ -26,6 +26,17 @@ public:
      */
     virtual void build(const std::vector<RC<const Entity>> &entities) = 0;
 
+    /**
+     * @brief update the data structure after entities are moved or replaced
+     *
+     * entities[i] replaces the i-th entity passed to the last build. the
+     * default implementation rebuilds the data structure
+     */
+    virtual void refit(const std::vector<RC<const Entity>> &entities)
+    {
+        build(entities);
+    }
+
     /**
      * @brief test whether an intersection exists
      */
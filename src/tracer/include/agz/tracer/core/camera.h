@@ -119,6 +119,21 @@ public:
     virtual CameraSampleWeResult sample_we(
         const Vec2 &film_coord, const Sample2 &aperture_sam) const noexcept = 0;
 
+    /**
+     * @brief differentials of the ray generated by sample_we
+     *
+     * the auxiliary rays are generated at film_coord + (pixel_size.x, 0) and
+     * film_coord + (0, pixel_size.y) with the same aperture sample
+     *
+     * @return false when ray differentials are not supported
+     */
+    virtual bool sample_we_differential(
+        const Vec2 &film_coord, const Vec2 &pixel_size,
+        const Sample2 &aperture_sam, RayDifferential *differential) const noexcept
+    {
+        return false;
+    }
+
     /**
      * @brief eval we(pos_on_cam -> pos_to_out)
      */
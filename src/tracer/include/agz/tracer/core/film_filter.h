@@ -24,6 +24,20 @@ public:
      * @brief eval function value
      */
     virtual real eval(real x, real y) const noexcept = 0;
+
+    /**
+     * @brief sample an offset to pixel center with pdf proportional to eval
+     */
+    virtual Vec2 sample(const Sample2 &sam) const noexcept = 0;
+
+    /**
+     * @brief should camera samples be drawn with filter importance sampling
+     *
+     * if true, each camera sample is offset from its pixel center by sample()
+     * and contributes only to that pixel with unit weight, instead of being
+     * splatted into all pixels within radius()
+     */
+    virtual bool importance_sampling() const noexcept = 0;
 };
 
 AGZ_TRACER_END
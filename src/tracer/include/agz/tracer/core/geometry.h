@@ -31,6 +31,35 @@ public:
     virtual bool closest_intersection(
         const Ray &r, GeometryIntersection *inct) const noexcept = 0;
 
+    /**
+     * @brief uniformly select one of all intersections with given ray
+     *
+     * the default implementation finds intersections one by one with
+     * closest_intersection
+     *
+     * @param r ray
+     * @param u uniform sample used for the selection
+     * @param inct selected intersection. only be modified when returning non-zero
+     *
+     * @return number of intersections
+     */
+    virtual int random_intersection(
+        const Ray &r, real u, GeometryIntersection *inct) const noexcept
+    {
+        IntersectionReservoir reservoir(u);
+
+        Ray rest = r;
+        GeometryIntersection new_inct;
+        while(rest.t_min < rest.t_max && closest_intersection(rest, &new_inct))
+        {
+            if(reservoir.add())
+                *inct = new_inct;
+            rest.t_min = new_inct.t + EPS();
+        }
+
+        return reservoir.count();
+    }
+
     /**
      * @brief aabb in world space
      */
@@ -37,6 +37,10 @@ struct GeometryIntersection : SurfacePoint
 {
     real t = -1;
     FVec3 wr;
+
+    // partial derivatives of pos w.r.t. uv. zero when unavailable
+    FVec3 dpdu;
+    FVec3 dpdv;
 };
 
 /**
@@ -63,8 +67,74 @@ struct EntityIntersection : GeometryIntersection
     {
         return dot(d, geometry_coord.z) >= 0 ? medium_out : medium_in;
     }
+
+    // uv derivatives w.r.t. film pixels. zero when unavailable,
+    // in which case textures are point sampled
+    Vec2 duvdx;
+    Vec2 duvdy;
+
+    /**
+     * @brief compute duvdx/duvdy from differentials of the intersected ray
+     *
+     * the auxiliary rays are intersected with the tangent plane at pos
+     */
+    void compute_uv_differential(const RayDifferential &diff) noexcept;
 };
 
+inline void EntityIntersection::compute_uv_differential(
+    const RayDifferential &diff) noexcept
+{
+    duvdx = duvdy = Vec2();
+
+    if(!dpdu && !dpdv)
+        return;
+
+    const FVec3 &nor = geometry_coord.z;
+    const real plane_d = dot(nor, pos);
+
+    const real dx_cos = dot(nor, diff.d_dx);
+    const real dy_cos = dot(nor, diff.d_dy);
+    if(!dx_cos || !dy_cos)
+        return;
+
+    const real tx = (plane_d - dot(nor, diff.o_dx)) / dx_cos;
+    const real ty = (plane_d - dot(nor, diff.o_dy)) / dy_cos;
+    if(!std::isfinite(tx) || !std::isfinite(ty))
+        return;
+
+    const FVec3 dpdx = diff.o_dx + tx * diff.d_dx - pos;
+    const FVec3 dpdy = diff.o_dy + ty * diff.d_dy - pos;
+
+    // solve the overdetermined system dpdx = dpdu * dudx + dpdv * dvdx
+    // in the two axes where the normal has smaller components
+
+    int i0, i1;
+    if(std::abs(nor.x) > std::abs(nor.y) && std::abs(nor.x) > std::abs(nor.z))
+        i0 = 1, i1 = 2;
+    else if(std::abs(nor.y) > std::abs(nor.z))
+        i0 = 0, i1 = 2;
+    else
+        i0 = 0, i1 = 1;
+
+    const real a00 = dpdu[i0], a01 = dpdv[i0];
+    const real a10 = dpdu[i1], a11 = dpdv[i1];
+    const real det = a00 * a11 - a01 * a10;
+    if(std::abs(det) < real(1e-10))
+        return;
+    const real inv_det = 1 / det;
+
+    auto solve = [&](const FVec3 &b)
+    {
+        const Vec2 ret(
+            (a11 * b[i0] - a01 * b[i1]) * inv_det,
+            (a00 * b[i1] - a10 * b[i0]) * inv_det);
+        return std::isfinite(ret.x) && std::isfinite(ret.y) ? ret : Vec2();
+    };
+
+    duvdx = solve(dpdx);
+    duvdy = solve(dpdy);
+}
+
 /**
  * @brief scattering point in participating medium
  */
@@ -92,4 +162,51 @@ struct ShadingPoint
     const BSSRDF *bssrdf = nullptr;
 };
 
+/**
+ * @brief uniformly select one of a stream of intersections with one sample
+ *
+ * the k-th added intersection replaces the selected one with probability
+ * 1/k. the sample is rescaled after each decision
+ */
+class IntersectionReservoir
+{
+    real u_;
+    int count_ = 0;
+
+public:
+
+    explicit IntersectionReservoir(real u) noexcept
+        : u_(u)
+    {
+        
+    }
+
+    /**
+     * @brief add an intersection
+     *
+     * @return whether the added intersection becomes the selected one
+     */
+    bool add() noexcept
+    {
+        constexpr real ONE_MINUS = real(1) - std::numeric_limits<real>::epsilon();
+
+        const real p = real(1) / ++count_;
+        if(u_ < p)
+        {
+            u_ = (std::min)(u_ / p, ONE_MINUS);
+            return true;
+        }
+        u_ = (std::min)((u_ - p) / (1 - p), ONE_MINUS);
+        return false;
+    }
+
+    /**
+     * @brief number of added intersections
+     */
+    int count() const noexcept
+    {
+        return count_;
+    }
+};
+
 AGZ_TRACER_END
@@ -104,10 +104,24 @@ struct LightEmitPosResult
  */
 class Light
 {
+    int index_ = -1;
+
 public:
 
     virtual ~Light() = default;
 
+    /**
+     * @brief dense index of this light in the scene
+     *
+     * assigned by Scene::start_rendering. -1 before that
+     */
+    int index() const noexcept { return index_; }
+
+    /**
+     * @brief set dense index. called by scene
+     */
+    void set_index(int index) noexcept { index_ = index; }
+
     /**
      * @brief is this an area light
      */
@@ -181,6 +195,13 @@ public:
         const FVec3 &ref,
         const FVec3 &pos,
         const FVec3 &nor) const noexcept = 0;
+
+    /**
+     * @brief bounding box of emitting surface
+     *
+     * used for building spatial light hierarchy
+     */
+    virtual AABB world_bound() const noexcept = 0;
 };
 
 /**
@@ -215,6 +236,28 @@ public:
     virtual real pdf(
         const FVec3 &ref, const FVec3 &ref_to_light) const noexcept = 0;
 
+    /**
+     * @brief sample wi at a surface point with given geometry normal
+     *
+     * light sources may take the cosine factor at ref into account.
+     * default to sample(ref, sam)
+     */
+    virtual LightSampleResult sample_with_normal(
+        const FVec3 &ref, const FVec3 &nor, const Sample5 &sam) const noexcept
+    {
+        return sample(ref, sam);
+    }
+
+    /**
+     * @brief pdf of sample_with_normal (w.r.t. solid angle)
+     */
+    virtual real pdf_with_normal(
+        const FVec3 &ref, const FVec3 &nor,
+        const FVec3 &ref_to_light) const noexcept
+    {
+        return pdf(ref, ref_to_light);
+    }
+
     /**
      * @brief find the emitting pos according to ref point and emitting dir
      *
@@ -68,6 +68,9 @@ struct RenderTarget
     Image2D<Vec3>     normal;
     Image2D<real>     denoise;
 
+    // samples taken in each pixel. only available with adaptive sampling
+    Image2D<real>     sample_count;
+
     RenderTarget() = default;
 
     bool is_valid() const noexcept;
@@ -90,6 +93,7 @@ public:
         Rect2i pixel_range_;
         Vec2i grid_size_;
         RC<const FilmFilter> film_filter_;
+        bool importance_sampling_;
 
         Rect2i sample_pixels_;
         Rect2 sample_pixel_bound_;
@@ -136,6 +140,24 @@ public:
          */
         void apply(real px, real py, const TexelTypes&...texels) noexcept;
 
+        /**
+         * @brief pixel coordinate of a camera sample taken for pixel (x, y)
+         *
+         * with filter importance sampling, the offset to the pixel center is
+         * sampled from the filter. otherwise the sample is uniform in the pixel
+         */
+        Vec2 sample_pixel(int x, int y, const Sample2 &sam) const noexcept;
+
+        /**
+         * @brief add a camera sample taken for pixel (x, y) at (px, py)
+         *
+         * with filter importance sampling, the sample contributes only to
+         * (x, y) with unit weight. otherwise it is the same as apply(px, py)
+         */
+        void apply_pixel_sample(
+            int x, int y, real px, real py,
+            const TexelTypes&...texels) noexcept;
+
         /**
          * @brief is the given pixel coordinate in non-zero sample bounds
          */
@@ -271,6 +293,8 @@ inline bool RenderTarget::is_valid() const noexcept
         return false;
     if(denoise.is_available() && denoise.size() != image.size())
         return false;
+    if(sample_count.is_available() && sample_count.size() != image.size())
+        return false;
     return true;
 }
 
@@ -357,6 +381,7 @@ FilmFilterApplier::FilmGrid<TexelTypes...>::FilmGrid(
     const Rect2i &pixel_range, RC<const FilmFilter> film_filter)
     : film_filter_(std::move(film_filter))
 {
+    importance_sampling_ = film_filter_->importance_sampling();
     set_pixel_range(pixel_range);
 }
 
@@ -370,9 +395,13 @@ void FilmFilterApplier::FilmGrid<TexelTypes...>::set_pixel_range(
 
     resize_grid<0, TexelTypes...>(grid_size_.x, grid_size_.y);
 
+    // with filter importance sampling, samples of a pixel never contribute to
+    // other pixels. so the grid only needs samples of its own pixels
+
     const real radius = film_filter_->radius();
 
-    sample_pixels_ = sample_bound_of(radius, pixel_range);
+    sample_pixels_ = importance_sampling_ ?
+                     pixel_range : sample_bound_of(radius, pixel_range);
 
     sample_pixel_bound_.low.x  = static_cast<real>(sample_pixels_.low.x);
     sample_pixel_bound_.low.y  = static_cast<real>(sample_pixels_.low.y);
@@ -394,6 +423,31 @@ void FilmFilterApplier::FilmGrid<TexelTypes...>::apply(
     });
 }
 
+template<typename...TexelTypes>
+Vec2 FilmFilterApplier::FilmGrid<TexelTypes...>::sample_pixel(
+    int x, int y, const Sample2 &sam) const noexcept
+{
+    if(importance_sampling_)
+    {
+        const Vec2 offset = film_filter_->sample(sam);
+        return { x + real(0.5) + offset.x, y + real(0.5) + offset.y };
+    }
+    return { x + sam.u, y + sam.v };
+}
+
+template<typename...TexelTypes>
+void FilmFilterApplier::FilmGrid<TexelTypes...>::apply_pixel_sample(
+    int x, int y, real px, real py, const TexelTypes&...texels) noexcept
+{
+    if(importance_sampling_)
+    {
+        apply_aux<0>(x - pixel_range_.low.x,
+                     y - pixel_range_.low.y, 1, texels...);
+        return;
+    }
+    apply(px, py, texels...);
+}
+
 template<typename...TexelTypes>
 bool FilmFilterApplier::FilmGrid<TexelTypes...>::in_sample_pixel_bound(
     real px, real py)
@@ -24,6 +24,17 @@ public:
 
     virtual bool need_image_preview() const noexcept = 0;
 
+    /**
+     * @brief max(width, height) of previewing images
+     *
+     * renderers may downsample previewing images to this size.
+     * non-positive value means full resolution
+     */
+    virtual int preview_max_size() const noexcept
+    {
+        return 0;
+    }
+
     /**
      * @brief report the progress data
      * 
@@ -15,6 +15,14 @@ public:
 
     virtual ~Sampler() = default;
 
+    /**
+     * @brief start the sample_index-th sample of given stream (e.g. a pixel)
+     *
+     * following calls of sampleN generate dimensions of this sample in order.
+     * samplers whose values do not depend on (stream, sample_index) ignore it
+     */
+    virtual void start_sample(uint32_t stream, uint32_t sample_index) { }
+
     virtual Sample1 sample1() = 0;
     virtual Sample2 sample2() = 0;
     virtual Sample3 sample3() = 0;
@@ -120,4 +128,239 @@ inline Sample5 NativeSampler::sample5()
     return { u, v, w, r, s };
 }
 
+/**
+ * @brief sampler used by renderers
+ *
+ * Native: independent uniform random numbers
+ * Sobol:  owen-scrambled 4d sobol points, padded with
+ *         independently scrambled and shuffled 4d points
+ * PMJ02:  owen-scrambled (0, 2)-sequence points, which share the
+ *         stratification of pmj02 points, padded as 2d pairs
+ *
+ * Sobol and PMJ02 depend only on seed, stream, sample index and dimension
+ */
+enum class SamplerType
+{
+    Native,
+    Sobol,
+    PMJ02
+};
+
+/**
+ * @brief hash-based owen-scrambled low-discrepancy sampler
+ *
+ * see 'Practical Hash-based Owen Scrambling' (Burley 2020)
+ */
+class LowDiscrepancySampler : public Sampler
+{
+public:
+
+    LowDiscrepancySampler(SamplerType type, uint32_t seed) noexcept;
+
+    void start_sample(uint32_t stream, uint32_t sample_index) override;
+
+    Sample1 sample1() override;
+    Sample2 sample2() override;
+    Sample3 sample3() override;
+    Sample4 sample4() override;
+    Sample5 sample5() override;
+
+private:
+
+    static uint32_t hash(uint32_t x) noexcept;
+
+    static uint32_t hash_combine(uint32_t seed, uint32_t v) noexcept;
+
+    static uint32_t reverse_bits(uint32_t x) noexcept;
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) noexcept;
+
+    static uint32_t sobol(uint32_t index, int dim) noexcept;
+
+    static real to_real(uint32_t x) noexcept;
+
+    // fill dims [0, N) of a new packet of sobol dimensions
+    template<int N>
+    void next_packet(real *output) noexcept;
+
+    bool is_sobol_;
+    uint32_t seed_;
+
+    uint32_t stream_seed_;
+    uint32_t sample_index_;
+    uint32_t packet_index_;
+};
+
+inline LowDiscrepancySampler::LowDiscrepancySampler(
+    SamplerType type, uint32_t seed) noexcept
+    : is_sobol_(type == SamplerType::Sobol), seed_(hash(seed))
+{
+    assert(type != SamplerType::Native);
+    start_sample(0, 0);
+}
+
+inline void LowDiscrepancySampler::start_sample(
+    uint32_t stream, uint32_t sample_index)
+{
+    stream_seed_  = hash_combine(seed_, stream);
+    sample_index_ = sample_index;
+    packet_index_ = 0;
+}
+
+inline Sample1 LowDiscrepancySampler::sample1()
+{
+    real x;
+    next_packet<1>(&x);
+    return { x };
+}
+
+inline Sample2 LowDiscrepancySampler::sample2()
+{
+    real x[2];
+    next_packet<2>(x);
+    return { x[0], x[1] };
+}
+
+inline Sample3 LowDiscrepancySampler::sample3()
+{
+    real x[3];
+    if(is_sobol_)
+        next_packet<3>(x);
+    else
+    {
+        next_packet<2>(x);
+        next_packet<1>(x + 2);
+    }
+    return { x[0], x[1], x[2] };
+}
+
+inline Sample4 LowDiscrepancySampler::sample4()
+{
+    real x[4];
+    if(is_sobol_)
+        next_packet<4>(x);
+    else
+    {
+        next_packet<2>(x);
+        next_packet<2>(x + 2);
+    }
+    return { x[0], x[1], x[2], x[3] };
+}
+
+inline Sample5 LowDiscrepancySampler::sample5()
+{
+    real x[5];
+    if(is_sobol_)
+        next_packet<4>(x);
+    else
+    {
+        next_packet<2>(x);
+        next_packet<2>(x + 2);
+    }
+    next_packet<1>(x + 4);
+    return { x[0], x[1], x[2], x[3], x[4] };
+}
+
+inline uint32_t LowDiscrepancySampler::hash(uint32_t x) noexcept
+{
+    // finalizer of murmur3
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t LowDiscrepancySampler::hash_combine(
+    uint32_t seed, uint32_t v) noexcept
+{
+    return seed ^ (hash(v) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+inline uint32_t LowDiscrepancySampler::reverse_bits(uint32_t x) noexcept
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+inline uint32_t LowDiscrepancySampler::nested_uniform_scramble(
+    uint32_t x, uint32_t seed) noexcept
+{
+    // laine-karras permutation applied to reversed bits
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+inline uint32_t LowDiscrepancySampler::sobol(uint32_t index, int dim) noexcept
+{
+    // direction numbers of the first 4 sobol dimensions, generated with
+    // primitive polynomials 1, x + 1, x^2 + x + 1, x^3 + x + 1
+
+    struct Directions
+    {
+        uint32_t v[4][32];
+
+        constexpr Directions() : v()
+        {
+            for(int i = 0; i < 32; ++i)
+                v[0][i] = 0x80000000u >> i;
+
+            v[1][0] = 0x80000000u;
+            for(int i = 1; i < 32; ++i)
+                v[1][i] = v[1][i - 1] ^ (v[1][i - 1] >> 1);
+
+            v[2][0] = 0x80000000u;
+            v[2][1] = 0xc0000000u;
+            for(int i = 2; i < 32; ++i)
+                v[2][i] = v[2][i - 1] ^ v[2][i - 2] ^ (v[2][i - 2] >> 2);
+
+            v[3][0] = 0x80000000u;
+            v[3][1] = 0xc0000000u;
+            v[3][2] = 0x20000000u;
+            for(int i = 3; i < 32; ++i)
+                v[3][i] = v[3][i - 2] ^ v[3][i - 3] ^ (v[3][i - 3] >> 3);
+        }
+    };
+
+    static constexpr Directions directions;
+
+    uint32_t ret = 0;
+    for(int bit = 0; index; ++bit, index >>= 1)
+    {
+        if(index & 1)
+            ret ^= directions.v[dim][bit];
+    }
+    return ret;
+}
+
+inline real LowDiscrepancySampler::to_real(uint32_t x) noexcept
+{
+    // keep 24 bits so that the result is strictly less than 1
+    return static_cast<real>(x >> 8) * real(1.0 / (1 << 24));
+}
+
+template<int N>
+void LowDiscrepancySampler::next_packet(real *output) noexcept
+{
+    static_assert(1 <= N && N <= 4);
+
+    const uint32_t packet_seed = hash_combine(stream_seed_, packet_index_++);
+    const uint32_t index = nested_uniform_scramble(sample_index_, packet_seed);
+
+    for(int i = 0; i < N; ++i)
+    {
+        const uint32_t dim_seed = hash_combine(packet_seed, uint32_t(i));
+        output[i] = to_real(nested_uniform_scramble(sobol(index, i), dim_seed));
+    }
+}
+
 AGZ_TRACER_END
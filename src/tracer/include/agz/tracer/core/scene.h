@@ -54,7 +54,11 @@ public:
     /** @brief get current active camera */
     virtual RC<const Camera> get_shared_camera() const noexcept = 0;
 
-    /** @brief get all light sources */
+    /**
+     * @brief get all light sources
+     *
+     * lights()[i]->index() == i after start_rendering is called
+     */
     virtual misc::span<const Light* const> lights() const noexcept = 0;
 
     /** @brief get environment light */
@@ -71,6 +75,44 @@ public:
      */
     virtual real light_pdf(const Light *light) const noexcept = 0;
 
+    /**
+     * @brief pdf of sample_light
+     *
+     * @param light_index index of light, i.e. light->index()
+     */
+    virtual real light_pdf_by_index(int light_index) const noexcept = 0;
+
+    /**
+     * @brief sample a light source for illuminating ref
+     *
+     * may be different from sample_light(sam) when the light selection
+     * depends on the reference point
+     */
+    virtual SceneSampleLightResult sample_light(
+        const FVec3 &ref, const Sample1 &sam) const noexcept = 0;
+
+    /**
+     * @brief pdf of sample_light(ref, sam)
+     */
+    virtual real light_pdf(
+        const Light *light, const FVec3 &ref) const noexcept = 0;
+
+    /**
+     * @brief pdf of sample_light(ref, sam)
+     *
+     * @param light_index index of light, i.e. light->index()
+     */
+    virtual real light_pdf_by_index(
+        int light_index, const FVec3 &ref) const noexcept = 0;
+
+    /**
+     * @brief does sample_light(ref, sam) depend on the reference point
+     *
+     * when it does, direct illumination should be estimated by selecting
+     * lights with sample_light(ref, sam) rather than iterating all lights
+     */
+    virtual bool is_light_sampling_spatial() const noexcept = 0;
+
     /** @brief is there an intersection with given ray */
     virtual bool has_intersection(const Ray &r) const noexcept = 0;
 
@@ -64,6 +64,9 @@ protected:
 
     real inv_gamma_ = 1;
 
+    // whether sample_spectrum_filtered_impl uses uv derivatives
+    bool filtered_ = false;
+
     static real wrap_clamp(real x) noexcept
     {
         return math::clamp<real>(x, 0, 1);
@@ -123,6 +126,26 @@ protected:
         return sample_spectrum_impl(uv).r;
     }
 
+    /**
+     * @brief filtered lookup with uv derivatives in texture space
+     *
+     * only called when filtered_ is set
+     */
+    virtual FSpectrum sample_spectrum_filtered_impl(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept
+    {
+        return sample_spectrum_impl(uv);
+    }
+
+    void apply_inv_gamma(FSpectrum &value) const noexcept
+    {
+        if(inv_gamma_ != 1)
+        {
+            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
+                value[i] = std::pow(value[i], inv_gamma_);
+        }
+    }
+
 public:
 
     virtual ~Texture2D() = default;
@@ -158,6 +181,40 @@ public:
         return ret;
     }
 
+    /**
+     * @brief sample spectrum value at uv with uv derivatives w.r.t. film pixels
+     *
+     * the derivatives are ignored by textures without filtered lookups.
+     * zero derivatives mean point sampling
+     */
+    FSpectrum sample_spectrum(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept
+    {
+        if(!filtered_ || (!duvdx && !duvdy))
+            return sample_spectrum(uv);
+
+        const Vec2 uv1 = transform_.apply_to_point(uv);
+        const real u = wrapper_u_(uv1.x);
+        const real v = wrapper_v_(uv1.y);
+        const Vec2 duvdx1 = transform_.apply_to_vector(duvdx);
+        const Vec2 duvdy1 = transform_.apply_to_vector(duvdy);
+
+        FSpectrum ret = sample_spectrum_filtered_impl({ u, v }, duvdx1, duvdy1);
+        apply_inv_gamma(ret);
+        return ret;
+    }
+
+    /**
+     * @brief sample real value at uv with uv derivatives w.r.t. film pixels
+     */
+    real sample_real(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept
+    {
+        if(!filtered_ || (!duvdx && !duvdy))
+            return sample_real(uv);
+        return sample_spectrum(uv, duvdx, duvdy).r;
+    }
+
     virtual int width() const noexcept = 0;
 
     virtual int height() const noexcept = 0;
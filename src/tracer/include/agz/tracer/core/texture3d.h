@@ -1,5 +1,7 @@
 #pragma once
 
+#include <limits>
+
 #include <agz/tracer/common.h>
 #include <agz/tracer/utility/config.h>
 
@@ -55,6 +57,17 @@ protected:
 
     virtual real sample_real_impl(const FVec3 &uvw) const noexcept;
 
+    /**
+     * @brief range of texels which may be accessed when sampling in uvw box
+     *
+     * texels in [beg, end] may be accessed by nearest or linear sampling at
+     * any point in [low, high]. returns false when the range cannot be
+     * bounded, e.g. the box crosses a repeat/mirror boundary
+     */
+    bool texel_range(
+        const FVec3 &low, const FVec3 &high, const Vec3i &size,
+        Vec3i &beg, Vec3i &end) const noexcept;
+
 public:
 
     virtual ~Texture3D() = default;
@@ -84,6 +97,13 @@ public:
      * @brief maximal real value
      */
     virtual real max_real() const noexcept = 0;
+
+    /**
+     * @brief conservative maximal real value in uvw box [low, high]
+     *
+     * defaults to max_real()
+     */
+    virtual real max_real_in(const FVec3 &low, const FVec3 &high) const noexcept;
 };
 
 inline FTransform3 Texture3DCommonParams::full_transform() const
@@ -193,6 +213,56 @@ inline real Texture3D::sample_real_impl(const FVec3 &uvw) const noexcept
     return sample_spectrum_impl(uvw).r;
 }
 
+inline bool Texture3D::texel_range(
+    const FVec3 &low, const FVec3 &high, const Vec3i &size,
+    Vec3i &beg, Vec3i &end) const noexcept
+{
+    FVec3 tlow(std::numeric_limits<real>::infinity());
+    FVec3 thigh(-std::numeric_limits<real>::infinity());
+
+    for(int i = 0; i < 8; ++i)
+    {
+        const FVec3 corner(
+            (i & 1) ? high.x : low.x,
+            (i & 2) ? high.y : low.y,
+            (i & 4) ? high.z : low.z);
+        const FVec3 tcorner = transform_.apply_to_point(corner);
+
+        for(int j = 0; j < 3; ++j)
+        {
+            tlow[j]  = (std::min)(tlow[j],  tcorner[j]);
+            thigh[j] = (std::max)(thigh[j], tcorner[j]);
+        }
+    }
+
+    const WrapFuncPtr wrappers[3] = { wrapper_u_, wrapper_v_, wrapper_w_ };
+
+    for(int j = 0; j < 3; ++j)
+    {
+        if(wrappers[j] == &wrap_clamp)
+        {
+            tlow[j]  = wrap_clamp(tlow[j]);
+            thigh[j] = wrap_clamp(thigh[j]);
+        }
+        else if(tlow[j] < 0 || thigh[j] > 1)
+            return false;
+
+        // one more texel on each side covers both nearest and linear sampling
+
+        const int b = static_cast<int>(std::floor(tlow[j]  * size[j])) - 1;
+        const int e = static_cast<int>(std::floor(thigh[j] * size[j])) + 1;
+        beg[j] = math::clamp(b, 0, size[j] - 1);
+        end[j] = math::clamp(e, 0, size[j] - 1);
+    }
+
+    return true;
+}
+
+inline real Texture3D::max_real_in(const FVec3 &, const FVec3 &) const noexcept
+{
+    return max_real();
+}
+
 inline FSpectrum Texture3D::sample_spectrum(const FVec3 &uvw) const noexcept
 {
     auto tuvw = transform_.apply_to_point(uvw);
@@ -8,7 +8,8 @@ AGZ_TRACER_BEGIN
 RC<EnvirLight> create_ibl_light(
     RC<const Texture2D> tex,
     bool no_importance_sampling = false,
-    real user_specified_power = -1);
+    real user_specified_power = -1,
+    bool product_sampling = false);
 
 RC<EnvirLight> create_native_sky(
     const FSpectrum &top,
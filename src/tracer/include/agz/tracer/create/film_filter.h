@@ -5,9 +5,9 @@
 AGZ_TRACER_BEGIN
 
 RC<FilmFilter> create_box_filter(
-    real radius);
+    real radius, bool importance_sampling = false);
     
 RC<FilmFilter> create_gaussian_filter(
-    real radius, real alpha);
+    real radius, real alpha, bool importance_sampling = false);
 
 AGZ_TRACER_END
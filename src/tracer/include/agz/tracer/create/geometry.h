@@ -27,20 +27,118 @@ RC<Geometry> create_triangle(
     const Vec2 &t_a, const Vec2 &t_b, const Vec2 &t_c,
     const FTransform3 &local_to_world);
 
-RC<Geometry> create_triangle_bvh(
+/**
+ * @brief serialized native bvh stored with a mesh
+ *
+ * see serialize_triangle_bvh
+ */
+struct PrebuiltTriangleBVH
+{
+    // keeps data alive
+    RC<const void> owner;
+
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * @brief building parameters of triangle mesh bvh
+ *
+ * native bvh is built with binned sah. embree only uses 'quality'.
+ */
+struct TriangleBVHParams
+{
+    enum class Quality
+    {
+        Fast,   // sah on the axis with max extent, few bins
+        Medium, // sah on all axes
+        High    // sah on all axes with more bins and smaller leaves
+    };
+
+    /**
+     * @brief memory layout and traversal method of native bvh
+     */
+    enum class Layout
+    {
+        Auto,   // bvh8 when avx is available, otherwise bvh4
+        Binary, // binary bvh with scalar traversal
+        BVH4,   // 4-wide bvh with sse traversal
+        BVH8    // 8-wide bvh with avx traversal. fallback to bvh4 without avx
+    };
+
+    Quality quality = Quality::Medium;
+    Layout  layout  = Layout::Auto;
+
+    int  sah_bin_count = 16;
+    bool sah_all_axes  = true;
+
+    // leaf is always created when triangle count <= leaf_size_threshold,
+    // and is never created when triangle count > max_leaf_size
+    // unless the triangles cannot be divided
+    int leaf_size_threshold = 1;
+    int max_leaf_size       = 8;
+
+    // cost of visiting an interior node relative to a ray-triangle test
+    real traversal_cost = 1;
+
+    int worker_count = 0;
+
+    // directory of persistent native bvh cache. empty for disabling cache.
+    // ignored by embree
+    std::string cache_directory;
+
+    // native bvh used instead of building when it was serialized from the
+    // same triangles with the same parameters. ignored by embree
+    PrebuiltTriangleBVH prebuilt;
+
+    static TriangleBVHParams from_quality(Quality quality) noexcept;
+};
+
+/**
+ * @brief native triangle bvh in local space
+ *
+ * built once and shared by all its instances
+ */
+class UntransformedTriangleBVH;
+
+RC<const UntransformedTriangleBVH> create_untransformed_triangle_bvh(
     std::vector<mesh::triangle_t> build_triangles,
+    const TriangleBVHParams &params = {});
+
+/**
+ * @brief build native bvh of triangles and serialize it
+ *
+ * the result can be used as TriangleBVHParams::prebuilt when building bvh of
+ * the same triangles with the same parameters
+ */
+std::vector<unsigned char> serialize_triangle_bvh(
+    const std::vector<mesh::triangle_t> &triangles,
+    const TriangleBVHParams &params = {});
+
+/**
+ * @brief instance of shared triangle bvh with its own transform
+ */
+RC<Geometry> create_triangle_bvh_instance(
+    RC<const UntransformedTriangleBVH> mesh,
     const FTransform3 &local_to_world);
 
+RC<Geometry> create_triangle_bvh(
+    std::vector<mesh::triangle_t> build_triangles,
+    const FTransform3 &local_to_world,
+    const TriangleBVHParams &params = {});
+
 #ifdef USE_EMBREE
 
 RC<Geometry> create_triangle_bvh_embree(
     std::vector<mesh::triangle_t> build_triangles,
-    const FTransform3 &local_to_world);
+    const FTransform3 &local_to_world,
+    const TriangleBVHParams &params = {});
 
 #endif
 
 RC<Geometry> create_triangle_bvh_noembree(
     std::vector<mesh::triangle_t> build_triangles,
-    const FTransform3 &local_to_world);
+    const FTransform3 &local_to_world,
+    const TriangleBVHParams &params = {});
 
 AGZ_TRACER_END
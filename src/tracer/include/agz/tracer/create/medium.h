@@ -7,12 +7,25 @@
 
 AGZ_TRACER_BEGIN
 
+struct HeterogeneousTrackingParams
+{
+    // resolution of the local majorant grid. 0 means using the global majorant
+    int majorant_grid_res = 16;
+
+    // estimate transmittance with ratio tracking instead of delta tracking
+    bool ratio_tracking = true;
+
+    // log density lookups per ray when the medium is destroyed
+    bool report_cost = false;
+};
+
 RC<Medium> create_heterogeneous_medium(
     const FTransform3 &local_to_world,
     RC<const Texture3D> density,
     RC<const Texture3D> albedo,
     RC<const Texture3D> g,
-    int max_scattering_count);
+    int max_scattering_count,
+    const HeterogeneousTrackingParams &tracking_params = {});
 
 RC<Medium> create_homogeneous_medium(
     const FSpectrum &sigma_a,
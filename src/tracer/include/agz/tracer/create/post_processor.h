@@ -15,7 +15,8 @@ RC<PostProcessor> create_oidn_denoiser(
 
 RC<PostProcessor> create_saving_gbuffer_to_png(
     std::string albedo_filename,
-    std::string normal_filename);
+    std::string normal_filename,
+    std::string sample_count_filename = {});
 
 RC<PostProcessor> create_saving_to_img(
     std::string filename, std::string ext,
@@ -5,6 +5,33 @@
 
 AGZ_TRACER_BEGIN
 
+/**
+ * @brief adaptive sampling of per-pixel renderers (pt, ao)
+ *
+ * after the uniform pass with 'spp' samples per pixel, batches of extra
+ * samples are taken in tiles whose estimated relative error is above
+ * 'error_threshold', until all tiles converge or a budget is reached
+ */
+struct AdaptiveSamplingParams
+{
+    bool enabled = false;
+
+    // relative error (std deviation of the mean / mean luminance) of tile
+    real error_threshold = real(0.01);
+
+    // samples per pixel added to each unconverged tile in one round
+    int batch_spp = 16;
+
+    // max samples per pixel, including the uniform pass
+    int max_spp = 1024;
+
+    // average samples per pixel over the whole image. <= 0 means no limit
+    int budget_spp = 0;
+
+    // rendering time limit in seconds. <= 0 means no limit
+    real time_limit = 0;
+};
+
 // path tracing
 
 struct PTRendererParams
@@ -21,11 +48,41 @@ struct PTRendererParams
     int spp = 1;
 
     int specular_depth = 20;
+
+    AdaptiveSamplingParams adaptive;
+
+    SamplerType sampler = SamplerType::Native;
 };
 
 RC<Renderer> create_pt_renderer(
     const PTRendererParams &params);
 
+// wavefront path tracing
+
+struct WavefrontPTRendererParams
+{
+    int min_depth  = 5;
+    int max_depth  = 10;
+    real cont_prob = real(0.9);
+
+    int worker_count   = 0;
+    int task_grid_size = 32;
+
+    int spp = 1;
+
+    int specular_depth = 20;
+
+    // max number of paths traced together by a thread
+    int batch_size = 4096;
+
+    AdaptiveSamplingParams adaptive;
+
+    SamplerType sampler = SamplerType::Native;
+};
+
+RC<Renderer> create_wavefront_pt_renderer(
+    const WavefrontPTRendererParams &params);
+
 // particle tracing
 
 struct AdjointPTRendererParams
@@ -45,6 +102,8 @@ struct AdjointPTRendererParams
 
     int forward_task_grid_size = 32;
     int forward_spp = 1;
+
+    SamplerType sampler = SamplerType::Native;
 };
 
 RC<Renderer> create_adjoint_pt_renderer(
@@ -65,6 +124,10 @@ struct AORendererParams
     FSpectrum background_color = FSpectrum(0);
 
     int spp = 1;
+
+    AdaptiveSamplingParams adaptive;
+
+    SamplerType sampler = SamplerType::Native;
 };
 
 RC<Renderer> create_ao_renderer(const AORendererParams &params);
@@ -107,10 +170,33 @@ struct SPPMRendererParams
     real update_alpha = real(2) / 3;
 
     int grid_accel_resolution = 64;
+
+    SamplerType sampler = SamplerType::Native;
 };
 
 RC<Renderer> create_sppm_renderer(const SPPMRendererParams &params);
 
+// vcm
+
+struct VCMRendererParams
+{
+    int worker_count   = 0;
+    int task_grid_size = 32;
+
+    int iteration_count = 100;
+
+    // radius of the i-th iteration is init_radius * i^((radius_alpha - 1) / 2)
+    // negative init_radius means world_diagonal / 1000
+    real init_radius  = -1;
+    real radius_alpha = real(0.75);
+
+    int min_depth  = 5;
+    int max_depth  = 10;
+    real cont_prob = real(0.9);
+};
+
+RC<Renderer> create_vcm_renderer(const VCMRendererParams &params);
+
 // pssmlt pt
 
 struct PSSMLTPTRendererParams
@@ -6,9 +6,24 @@ AGZ_TRACER_BEGIN
 
 struct DefaultSceneParams
 {
+    /**
+     * @brief strategy of selecting lights for direct illumination
+     *
+     * Power: select lights in proportion to their power
+     * BVH:   select lights with a light bvh according to estimated contribution
+     *        at the shading point
+     */
+    enum class LightSampler
+    {
+        Power,
+        BVH
+    };
+
     std::vector<RC<Entity>> entities;
     RC<EnvirLight>          envir_light;
     RC<Aggregate>           aggregate;
+
+    LightSampler light_sampler = LightSampler::Power;
 };
 
 RC<Scene> create_default_scene(const DefaultSceneParams &params);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <agz/tracer/core/texture2d.h>
+#include <agz/tracer/utility/texture_cache.h>
 
 AGZ_TRACER_BEGIN
 
@@ -20,8 +21,25 @@ RC<Texture2D> create_hdr_texture(
     const Texture2DCommonParams &common_params,
     RC<const Image2D<math::color3f>> data, const std::string &sampler);
 
+/**
+ * @param filter filtered lookup with ray differentials: none/trilinear/ewa.
+ *  a mip pyramid is built unless it is none
+ * @param max_anisotropy max ratio between the axes of ewa filter ellipse
+ */
 RC<Texture2D> create_image_texture(
     const Texture2DCommonParams &common_params,
-    RC<const Image2D<math::color3b>> data, const std::string &sampler);
+    RC<const Image2D<math::color3b>> data, const std::string &sampler,
+    const std::string &filter = "none", real max_anisotropy = 8);
+
+/**
+ * @brief image texture whose tiles are paged in through the global
+ *  texture cache
+ *
+ * @param filter filtered lookup with mip levels of the source: none/trilinear
+ */
+RC<Texture2D> create_cached_image_texture(
+    const Texture2DCommonParams &common_params,
+    RC<const TextureTileSource> source, const std::string &sampler,
+    const std::string &filter = "none");
 
 AGZ_TRACER_END
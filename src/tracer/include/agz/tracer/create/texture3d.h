@@ -1,6 +1,7 @@
 #pragma once
 
 #include <agz/tracer/core/texture3d.h>
+#include <agz/tracer/utility/sparse_volume.h>
 #include <agz/utility/texture/texture3d.h>
 
 AGZ_TRACER_BEGIN
@@ -29,4 +30,24 @@ RC<Texture3D> create_image3d(
     RC<const Image3D<math::color3b>> data,
     bool use_linear_sampler);
 
+RC<Texture3D> create_image3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseVolume<real>> data,
+    bool use_linear_sampler);
+
+RC<Texture3D> create_image3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseVolume<uint8_t>> data,
+    bool use_linear_sampler);
+
+RC<Texture3D> create_image3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseVolume<Spectrum>> data,
+    bool use_linear_sampler);
+
+RC<Texture3D> create_image3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseVolume<math::color3b>> data,
+    bool use_linear_sampler);
+
 AGZ_TRACER_END
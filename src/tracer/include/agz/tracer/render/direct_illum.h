@@ -35,6 +35,43 @@ FSpectrum mis_sample_envir_light(
     const BSDF *phase_function,
     Sampler &sampler);
 
+/**
+ * @brief compute light sampling part in MIS direct illumination
+ *
+ * the light is selected with probability select_pdf
+ */
+FSpectrum mis_sample_area_light(
+    const Scene &scene,
+    const AreaLight *light,
+    real select_pdf,
+    const EntityIntersection &inct,
+    const ShadingPoint &shd,
+    Sampler &sampler);
+
+FSpectrum mis_sample_area_light(
+    const Scene &scene,
+    const AreaLight *light,
+    real select_pdf,
+    const MediumScattering &scattering,
+    const BSDF *phase_function,
+    Sampler &sampler);
+
+FSpectrum mis_sample_envir_light(
+    const Scene &scene,
+    const EnvirLight *light,
+    real select_pdf,
+    const EntityIntersection &inct,
+    const ShadingPoint &shd,
+    Sampler &sampler);
+
+FSpectrum mis_sample_envir_light(
+    const Scene &scene,
+    const EnvirLight *light,
+    real select_pdf,
+    const MediumScattering &scattering,
+    const BSDF *phase_function,
+    Sampler &sampler);
+
 FSpectrum mis_sample_light(
     const Scene &scene,
     const Light *lht,
@@ -49,10 +86,30 @@ FSpectrum mis_sample_light(
     const BSDF *phase_function,
     Sampler &sampler);
 
+/**
+ * @brief compute light sampling part in MIS direct illumination for all lights in scene
+ *
+ * when scene.is_light_sampling_spatial() is true, one light is selected
+ * with scene.sample_light(pos, sam). otherwise all lights are iterated
+ */
+FSpectrum mis_sample_scene_lights(
+    const Scene &scene,
+    const EntityIntersection &inct,
+    const ShadingPoint &shd,
+    Sampler &sampler);
+
+FSpectrum mis_sample_scene_lights(
+    const Scene &scene,
+    const MediumScattering &scattering,
+    const BSDF *phase_function,
+    Sampler &sampler);
+
 /**
  * @brief compute BSDF sampling part in MIS direct illumination
  *
- * the last 3 parameters are used for receiving the BSDF sampling result
+ * the last 3 parameters are used for receiving the BSDF sampling result.
+ * light selection pdf is accounted when scene.is_light_sampling_spatial() is true,
+ * so it should be paired with mis_sample_scene_lights
  */
 FSpectrum mis_sample_bsdf(
     const Scene &scene,
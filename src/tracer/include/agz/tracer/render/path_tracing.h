@@ -32,15 +32,25 @@ struct AlbedoAOParams
     real max_occlusion_distance = 1;
 };
 
+/**
+ * @brief ray_diff: differentials of camera ray for filtered texture lookups.
+ *  can be nullptr
+ */
 Pixel trace_std(
     const TraceParams &params,
     const Scene &scene, const Ray &ray,
-    Sampler &sampler, Arena &arena);
+    Sampler &sampler, Arena &arena,
+    const RayDifferential *ray_diff = nullptr);
 
+/**
+ * @brief ray_diff: differentials of camera ray for filtered texture lookups.
+ *  can be nullptr
+ */
 Pixel trace_nomis(
     const TraceParams &params,
     const Scene &scene, const Ray &ray,
-    Sampler &sampler, Arena &arena);
+    Sampler &sampler, Arena &arena,
+    const RayDifferential *ray_diff = nullptr);
 
 Pixel trace_ao(
     const AOParams &params,
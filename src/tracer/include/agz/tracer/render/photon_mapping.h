@@ -2,6 +2,7 @@
 
 #include <agz/tracer/render/common.h>
 #include <agz/tracer/utility/hashed_grid_aux.h>
+#include <agz/utility/thread.h>
 
 AGZ_TRACER_RENDER_BEGIN
 
@@ -11,9 +12,13 @@ namespace sppm
 /**
  * standard sppm process contains 4 steps:
  *  1. trace camera rays to create records of visible points
- *  2. build range search ds
- *  3. trace photons to update density estimations of flux at visible points
+ *  2. trace photons into thread-local photon buffers
+ *  3. sort photons by grid cell, then let each visible point gather
+ *     photons in its neighborhood to update density estimations of flux
  *  4. update params at each pixel, and go back to step 1
+ *
+ * each pixel is only updated by the task owning it in step 3,
+ * so no atomic operation is needed when accumulating flux
  */
 
 /**
@@ -36,22 +41,6 @@ struct Pixel
         }
     };
 
-    Pixel() = default;
-
-    Pixel(const Pixel &p) noexcept
-    {
-        vp     = p.vp;
-        radius = p.radius;
-
-        for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-            phi[i] = p.phi[i].load();
-
-        M            = p.M.load();
-        N            = p.N;
-        tau          = p.tau;
-        direct_illum = p.direct_illum;
-    }
-
     // current visible point
 
     VisiblePoint vp;
@@ -60,8 +49,8 @@ struct Pixel
 
     real radius = real(0.1);
 
-    std::atomic<real> phi[SPECTRUM_COMPONENT_COUNT] = { 0 };
-    std::atomic<int>  M = 0;
+    FSpectrum phi;
+    int M = 0;
 
     real N = 0;
     FSpectrum tau;
@@ -71,46 +60,54 @@ struct Pixel
     FSpectrum direct_illum;
 };
 
-class VisiblePointSearcher
+/**
+ * @brief photon record
+ */
+struct Photon
 {
-public:
+    FVec3 pos;
+    FVec3 wr;
+    FSpectrum phi;
+};
 
-    explicit VisiblePointSearcher(
-        const AABB &world_bound,
-        real grid_sidelen,
-        size_t entry_count);
+using PhotonBuffer = std::vector<Photon>;
 
-    /**
-     * @brief clear all vp records
-     */
-    void clear();
+/**
+ * @brief photons sorted by hashed grid cell
+ *
+ * photons in the same entry are stored contiguously
+ */
+class PhotonSearcher
+{
+public:
+
+    PhotonSearcher(const AABB &world_bound, real grid_sidelen);
 
     /**
-     * @brief add a vp record
-     *
-     * parallel 'add_vp' is safe
+     * @brief sort photons in all buffers by grid entries
      */
-    void add_vp(Pixel &pixel, Arena &vp_node_arena);
+    void build(
+        const std::vector<PhotonBuffer> &photon_buffers,
+        int thread_count, thread::thread_group_t &threads);
 
     /**
-     * @brief accumulate photon flux to recorded visible points
+     * @brief accumulate flux of photons within the radius of pixel.vp
      *
-     * parallel 'add_photon' is safe
+     * parallel 'gather' on different pixels is safe
      */
-    void add_photon(const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr);
+    void gather(Pixel &pixel) const;
 
 private:
 
-    struct VPNode
-    {
-        Pixel *pixel = nullptr;
-        VPNode *next = nullptr;
-    };
+    AABB world_bound_;
+    real grid_sidelen_;
 
-    HashedGridAux hashed_grid_aux_;
+    Box<HashedGridAux> hashed_grid_aux_;
 
-    Box<std::atomic<VPNode*>[]> node_entries_;
-    size_t node_entry_count_;
+    // photons in entry i are in
+    // photons_[entry_beg_[i], entry_beg_[i + 1])
+    std::vector<uint32_t> entry_beg_;
+    std::vector<Photon> photons_;
 };
 
 /**
@@ -131,11 +128,11 @@ Pixel::VisiblePoint tracer_vp(
 
 /**
  * trace a photon from light source and
- * accumulate flux at visible points in vp_searcher
+ * append its non-direct hits to photons
  */
 void trace_photon(
     int min_depth, int max_depth, real cont_prob,
-    VisiblePointSearcher &vp_searcher,
+    PhotonBuffer &photons,
     const Scene &scene, Arena &arena, Sampler &sampler);
 
 void update_pixel_params(real alpha, Pixel &pixel);
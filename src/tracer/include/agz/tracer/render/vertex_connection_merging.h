@@ -2,6 +2,8 @@
 
 #include <agz/tracer/core/light.h>
 #include <agz/tracer/render/common.h>
+#include <agz/tracer/utility/hashed_grid_aux.h>
+#include <agz/utility/thread.h>
 
 AGZ_TRACER_RENDER_BEGIN
 
@@ -27,27 +29,77 @@ VCM Algo:
     interface:
 
         VCMRangeSearchAccelerator
-            add_light_vertex
+            build
             find_in_neighborhood
         vcm_trace_light_subpath
         vcm_trace_eye_subpath
+
+mis weights are evaluated recursively with dVCM/dVC/dVM as described in
+'Light Transport Simulation with Vertex Connection and Merging'
+(Georgiev et al. 2012) and its reference implementation.
+
+participating media only attenuate radiance along path segments.
+scattering inside media is not sampled.
 */
 
+/**
+ * @brief tracing params shared by all iterations
+ */
+struct TraceParams
+{
+    int min_depth  = 5;
+    int max_depth  = 10;
+    real cont_prob = real(0.9);
+};
+
+/**
+ * @brief params depending on current merging radius
+ */
+struct IterationParams
+{
+    real radius = 0;
+
+    // number of light subpaths in this iteration
+    real light_path_count = 0;
+
+    // width * height of the film
+    real pixel_count = 0;
+
+    // 1 / (pi * r^2 * light_path_count)
+    real vm_normalization = 0;
+
+    // mis weight factors of merging/connection
+    real vm_weight = 0;
+    real vc_weight = 0;
+};
+
+IterationParams create_iteration_params(
+    real radius, int light_path_count, int pixel_count) noexcept;
+
+/**
+ * @brief state of a tracing subpath
+ */
 struct RayPayload
 {
+    Ray ray;
+
     Spectrum accu_coef;
     int seg_cnt       = 0;
-    bool on_light     = false;
-    bool all_specular = false;
+    bool all_specular = true;
 
     real dVCM = 0;
     real dVC  = 0;
     real dVM  = 0;
 };
 
+/**
+ * @brief stored light subpath vertex
+ */
 struct Vertex
 {
     Vec3 pos;
+    Vec3 nor;
+    Vec3 wr;
     Spectrum accu_coef;
     int seg_cnt      = 0;
     const BSDF *bsdf = nullptr;
@@ -57,6 +109,123 @@ struct Vertex
     real dVM  = 0;
 };
 
+/**
+ * @brief light tracing contribution to the film
+ */
+struct CameraSplat
+{
+    Vec2 film_coord;
+    Spectrum radiance;
+};
+
+/**
+ * @brief hashed grid of light vertices for range search
+ *
+ * rebuilt in each iteration. cell sidelen is 2 * radius so that a query
+ * visits at most 2x2x2 cells.
+ */
+class VCMRangeSearchAccelerator
+{
+public:
+
+    /**
+     * @brief rebuild the accelerator with given light vertices
+     *
+     * vertices must be kept alive until next building
+     */
+    void build(
+        const Vertex *vertices, size_t vertex_count,
+        const AABB &world_bound, real radius,
+        int thread_count, thread::thread_group_t &threads);
+
+    /**
+     * @brief call func(const Vertex &) for each light vertex
+     *  within the radius of pos
+     */
+    template<typename Func>
+    void find_in_neighborhood(const FVec3 &pos, Func &&func) const;
+
+private:
+
+    Box<HashedGridAux> grid_aux_;
+
+    real radius_  = 0;
+    real radius2_ = 0;
+
+    const Vertex *vertices_ = nullptr;
+
+    // indices of vertices in entry i are in
+    // indices_[entry_beg_[i], entry_beg_[i + 1])
+    std::vector<uint32_t> entry_beg_;
+    std::vector<uint32_t> indices_;
+};
+
+/**
+ * @brief trace a light subpath
+ *
+ * non-specular vertices are appended to light_vertices.
+ * contributions of connecting vertices to camera are appended to splats.
+ */
+void vcm_trace_light_subpath(
+    const TraceParams &trace_params, const IterationParams &iter_params,
+    const Scene &scene, Sampler &sampler, Arena &arena,
+    std::vector<Vertex> &light_vertices, std::vector<CameraSplat> &splats);
+
+/**
+ * @brief trace an eye subpath and evaluate the pixel value
+ *
+ * @param light_subpath vertices of the light subpath used for connection
+ */
+Pixel vcm_trace_eye_subpath(
+    const TraceParams &trace_params, const IterationParams &iter_params,
+    const Scene &scene, const Ray &ray, const FSpectrum &init_coef,
+    const Vertex *light_subpath, int light_vertex_count,
+    const VCMRangeSearchAccelerator &accel,
+    Sampler &sampler, Arena &arena);
+
+template<typename Func>
+void VCMRangeSearchAccelerator::find_in_neighborhood(
+    const FVec3 &pos, Func &&func) const
+{
+    if(!grid_aux_)
+        return;
+
+    // find the 2x2x2 cells overlapping with the query sphere
+
+    const Vec3i grid = grid_aux_->pos_to_grid(pos);
+    const Vec3i grid_lo = grid_aux_->pos_to_grid(pos - FVec3(radius_));
+
+    Vec3i beg;
+    for(int i = 0; i < 3; ++i)
+        beg[i] = grid_lo[i] < grid[i] ? grid[i] - 1 : grid[i];
+
+    for(int z = beg.z; z <= beg.z + 1; ++z)
+    {
+        for(int y = beg.y; y <= beg.y + 1; ++y)
+        {
+            for(int x = beg.x; x <= beg.x + 1; ++x)
+            {
+                const size_t entry = grid_aux_->grid_to_entry({ x, y, z });
+                for(uint32_t i = entry_beg_[entry];
+                    i < entry_beg_[entry + 1]; ++i)
+                {
+                    const Vertex &vtx = vertices_[indices_[i]];
+                    if(distance2(vtx.pos, pos) > radius2_)
+                        continue;
+
+                    // different cells may share the same entry.
+                    // only visit the vertex when visiting its own cell
+                    const Vec3i vtx_grid = grid_aux_->pos_to_grid(vtx.pos);
+                    if(vtx_grid.x != x || vtx_grid.y != y || vtx_grid.z != z)
+                        continue;
+
+                    func(vtx);
+                }
+            }
+        }
+    }
+}
+
 } // namespace vcm
 
 AGZ_TRACER_RENDER_END
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+
+#include <agz/tracer/core/intersection.h>
+#include <agz/tracer/render/path_tracing.h>
+#include <agz/utility/misc.h>
+
+AGZ_TRACER_RENDER_BEGIN
+
+/**
+ * @brief path tracer advancing a batch of paths stage by stage
+ *
+ * path states are stored in SoA arrays. in each bounce, all active paths
+ * go through russian roulette, closest intersection and shading in turn.
+ * paths are sorted by their hit materials before shading, so that paths
+ * sharing materials and textures are shaded together.
+ *
+ * the estimator and the order of sampler calls of each path are the same as
+ * trace_std. so each path gives the same result as trace_std with a sampler
+ * of the same state
+ */
+class WavefrontPathTracer : public misc::uncopyable_t
+{
+public:
+
+    explicit WavefrontPathTracer(const TraceParams &params);
+
+    /**
+     * @brief remove all paths
+     */
+    void clear();
+
+    /**
+     * @brief add a camera path
+     *
+     * @param ray_diff differentials of the camera ray. can be nullptr
+     * @param sampler  sampler used only by this path
+     *
+     * @return index of the new path
+     */
+    int add_path(
+        const Ray &ray, const RayDifferential *ray_diff, Sampler *sampler);
+
+    /**
+     * @brief trace all added paths
+     *
+     * arena is released after each shading stage
+     */
+    void trace(const Scene &scene, Arena &arena);
+
+    int path_count() const noexcept;
+
+    /**
+     * @brief result of the i-th path. available after calling trace
+     */
+    const Pixel &get_pixel(int i) const noexcept;
+
+private:
+
+    // russian roulette and max depth test. fill next_active_
+    void russian_roulette();
+
+    // find closest intersections of active paths. fill hits_
+    void intersect(const Scene &scene);
+
+    // sort hits_ by materials
+    void sort_hits();
+
+    // shade hits_ and sample new rays. fill active_
+    void shade(const Scene &scene, Arena &arena);
+
+    // shade the path at its intersection. returns false if the path ends
+    bool shade_path(const Scene &scene, uint32_t i, Arena &arena);
+
+    TraceParams params_;
+
+    // SoA path states
+
+    std::vector<Ray>                ray_;
+    std::vector<RayDifferential>    ray_diff_;
+    std::vector<char>               has_ray_diff_;
+    std::vector<Sampler*>           sampler_;
+    std::vector<FSpectrum>          coef_;
+    std::vector<int>                depth_;
+    std::vector<int>                specular_depth_;
+    std::vector<int>                scattering_count_;
+    std::vector<EntityIntersection> inct_;
+    std::vector<Pixel>              pixel_;
+
+    // queues of path indices
+
+    std::vector<uint32_t> active_;
+    std::vector<uint32_t> next_active_;
+    std::vector<uint32_t> hits_;
+
+    struct SortKey
+    {
+        const Material *material;
+        uint32_t path;
+    };
+
+    std::vector<SortKey> sort_keys_;
+};
+
+AGZ_TRACER_RENDER_END
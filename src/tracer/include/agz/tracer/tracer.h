@@ -44,8 +44,11 @@
 #include <agz/tracer/utility/config.h>
 #include <agz/tracer/utility/embree.h>
 #include <agz/tracer/utility/logger.h>
+#include <agz/tracer/utility/mapped_file.h>
 #include <agz/tracer/utility/parallel_grid.h>
 #include <agz/tracer/utility/phase_function.h>
+#include <agz/tracer/utility/preview_surface.h>
 #include <agz/tracer/utility/reflection.h>
 #include <agz/tracer/utility/sphere_aux.h>
+#include <agz/tracer/utility/texture_cache.h>
 #include <agz/tracer/utility/triangle_aux.h>
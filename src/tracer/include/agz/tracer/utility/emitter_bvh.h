@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include <agz/tracer/common.h>
+#include <agz/utility/misc.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief bvh for selecting an emitting triangle of a mesh w.r.t. a reference point
+ *
+ * each node stores the bounding box, total area and a two-sided normal cone
+ * of its triangles. triangles are selected by descending the tree with
+ * probabilities proportional to the estimated contribution of subtrees
+ * (area * bound of |cos| / squared distance)
+ */
+class TriangleEmitterBVH : public misc::uncopyable_t
+{
+public:
+
+    struct Triangle
+    {
+        FVec3 a, b_a, c_a;
+    };
+
+    explicit TriangleEmitterBVH(std::vector<Triangle> triangles);
+
+    /**
+     * @brief select a triangle for ref
+     *
+     * @return (triangle index, selection probability)
+     */
+    std::pair<uint32_t, real> sample(const FVec3 &ref, real u) const noexcept;
+
+    /**
+     * @brief selection probability of the triangle containing pos
+     *
+     * when no triangle contains pos exactly (e.g. pos is on a shared edge
+     * and moved by rounding errors), the nearest one within the tolerance
+     * in barycentric coordinates is used
+     *
+     * @param triangle_idx index of the triangle. only modified when non-zero
+     *                     probability is returned
+     */
+    real pdf(
+        const FVec3 &ref, const FVec3 &pos,
+        uint32_t *triangle_idx) const noexcept;
+
+    const Triangle &triangle(uint32_t idx) const noexcept
+    {
+        return triangles_[idx];
+    }
+
+private:
+
+    struct Node
+    {
+        AABB bound;
+
+        // two-sided normal cone
+        FVec3 axis;
+        real cos_angle = 0;
+        real sin_angle = 1;
+
+        real area = 0;
+
+        // right child of interior node, whose left child is the next node.
+        // or triangle index of leaf node
+        uint32_t child_or_triangle = 0;
+        bool is_leaf = false;
+    };
+
+    uint32_t build(
+        uint32_t *indices, uint32_t count, const std::vector<FVec3> &centroids);
+
+    real importance(const Node &node, const FVec3 &ref) const noexcept;
+
+    // how far pos is outside tri in barycentric coordinates. 0 if pos is
+    // exactly inside tri, and infinity if pos is not on the plane of tri
+    real barycentric_violation(
+        const Triangle &tri, const FVec3 &pos) const noexcept;
+
+    std::vector<Triangle> triangles_;
+    std::vector<Node> nodes_;
+
+    // tolerance for locating a point on triangles
+    real tolerance_ = 0;
+};
+
+AGZ_TRACER_END
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include <agz/tracer/common.h>
+#include <agz/utility/misc.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief read-only memory mapped file
+ *
+ * throws std::runtime_error when the file cannot be opened or mapped
+ */
+class MappedFile : public misc::uncopyable_t
+{
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+
+#ifdef _WIN32
+    void *file_handle_    = nullptr;
+    void *mapping_handle_ = nullptr;
+#endif
+
+    void close() noexcept;
+
+public:
+
+    explicit MappedFile(const std::string &filename);
+
+    ~MappedFile();
+
+    const unsigned char *data() const noexcept { return data_; }
+
+    size_t size() const noexcept { return size_; }
+};
+
+AGZ_TRACER_END
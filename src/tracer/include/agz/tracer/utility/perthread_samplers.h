@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include <agz/tracer/core/sampler.h>
 
 AGZ_TRACER_BEGIN
@@ -43,6 +45,35 @@ private:
     SamplerStorage *samplers_;
 };
 
+/**
+ * @brief per-thread samplers of given type
+ *
+ * low-discrepancy samplers of all threads share the seed of parent, as their
+ * values only depend on stream and sample index. so results do not depend
+ * on the thread count
+ */
+class PerThreadSamplers : public misc::uncopyable_t
+{
+public:
+
+    PerThreadSamplers(
+        size_t thread_count, SamplerType type, const NativeSampler &parent);
+
+    Sampler *get_sampler(size_t thread_idx) noexcept;
+
+    Sampler *operator[](size_t thread_idx) noexcept;
+
+private:
+
+    struct alignas(64) LowDiscrepancySamplerStorage
+    {
+        LowDiscrepancySampler sampler;
+    };
+
+    PerThreadNativeSamplers native_samplers_;
+    std::vector<LowDiscrepancySamplerStorage> ld_samplers_;
+};
+
 inline PerThreadNativeSamplers::PerThreadNativeSamplers()
     : count_(0), samplers_(nullptr)
 {
@@ -121,4 +152,33 @@ inline PerThreadNativeSamplers::SamplerStorage::SamplerStorage(
     
 }
 
+inline PerThreadSamplers::PerThreadSamplers(
+    size_t thread_count, SamplerType type, const NativeSampler &parent)
+{
+    if(type == SamplerType::Native)
+    {
+        native_samplers_ = PerThreadNativeSamplers(thread_count, parent);
+        return;
+    }
+
+    ld_samplers_.reserve(thread_count);
+    for(size_t i = 0; i < thread_count; ++i)
+    {
+        ld_samplers_.push_back({ LowDiscrepancySampler(
+            type, static_cast<uint32_t>(parent.get_seed())) });
+    }
+}
+
+inline Sampler *PerThreadSamplers::get_sampler(size_t thread_idx) noexcept
+{
+    if(!ld_samplers_.empty())
+        return &ld_samplers_[thread_idx].sampler;
+    return native_samplers_.get_sampler(thread_idx);
+}
+
+inline Sampler *PerThreadSamplers::operator[](size_t thread_idx) noexcept
+{
+    return get_sampler(thread_idx);
+}
+
 AGZ_TRACER_END
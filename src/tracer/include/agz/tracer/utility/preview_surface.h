@@ -0,0 +1,59 @@
+#pragma once
+
+#include <mutex>
+
+#include <agz/tracer/common.h>
+#include <agz/utility/misc.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief downsampled preview image updated incrementally by render threads
+ *
+ * each preview pixel takes the resolved value of the full-resolution pixel
+ * at the center of its block. render threads call update with the pixels they
+ * have just merged, so a snapshot only copies the small preview image
+ * instead of resolving the whole image buffer.
+ *
+ * all methods are thread-safe
+ */
+class PreviewSurface : public misc::uncopyable_t
+{
+    int width_;
+    int height_;
+    int factor_;
+
+    mutable std::mutex mutex_;
+    Image2D<Spectrum> preview_;
+
+public:
+
+    /**
+     * @param width  width of full-resolution image
+     * @param height height of full-resolution image
+     * @param max_size max(width, height) of preview image.
+     *  non-positive value means no downsampling
+     */
+    PreviewSurface(int width, int height, int max_size);
+
+    /**
+     * @brief resolve value / weight (+ background) of given pixels
+     *
+     * pixel range: [low.x, high.x] * [low.y, high.y]
+     *
+     * these pixels must not be modified by other threads during this call
+     */
+    void update(
+        const Rect2i &pixel_range,
+        const Image2D<Spectrum> &value, const Image2D<real> &weight,
+        const Image2D<Spectrum> *background = nullptr);
+
+    /**
+     * @brief get a copy of the current preview image
+     */
+    Image2D<Spectrum> snapshot() const;
+
+    int downsample_factor() const noexcept { return factor_; }
+};
+
+AGZ_TRACER_END
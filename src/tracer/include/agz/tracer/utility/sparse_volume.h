@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include <agz/tracer/common.h>
+#include <agz/utility/misc.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief 3d texel array stored as BRICK_SIZE^3 bricks
+ *
+ * bricks whose texels all equal the background value are elided and marked
+ * as EMPTY_BRICK in the top-level brick index. texels in a stored brick are
+ * laid out in z-y-x order, and texels outside the volume are filled with the
+ * background value.
+ *
+ * brick data is either owned by the volume or references external memory
+ * (e.g. a memory mapped file) which is kept alive by the volume
+ */
+template<typename Texel>
+class SparseVolume : public misc::uncopyable_t
+{
+public:
+
+    static constexpr int      BRICK_SIZE_LOG2   = 3;
+    static constexpr int      BRICK_SIZE        = 1 << BRICK_SIZE_LOG2;
+    static constexpr int      BRICK_TEXEL_COUNT = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+    static constexpr uint32_t EMPTY_BRICK       = 0xffffffff;
+
+    /**
+     * @brief brick count along each axis of a volume with given size
+     */
+    static Vec3i compute_brick_count(const Vec3i &size) noexcept;
+
+    /**
+     * @brief convert dense texels, eliding bricks equal to background
+     */
+    SparseVolume(const Image3D<Texel> &dense, const Texel &background);
+
+    /**
+     * @brief take ownership of brick index and brick data
+     */
+    SparseVolume(
+        const Vec3i &size, const Texel &background,
+        std::vector<uint32_t> brick_index, std::vector<Texel> brick_data);
+
+    /**
+     * @brief reference external brick index and brick data
+     *
+     * @param storage owner of the referenced memory
+     */
+    SparseVolume(
+        const Vec3i &size, const Texel &background,
+        const uint32_t *brick_index, const Texel *brick_data,
+        size_t stored_brick_count, RC<const void> storage);
+
+    int width() const noexcept { return size_.x; }
+
+    int height() const noexcept { return size_.y; }
+
+    int depth() const noexcept { return size_.z; }
+
+    const Vec3i &brick_count() const noexcept { return brick_count_; }
+
+    size_t stored_brick_count() const noexcept { return stored_brick_count_; }
+
+    const Texel &background() const noexcept { return background_; }
+
+    /**
+     * @brief brick_count().product() entries
+     */
+    const uint32_t *brick_index() const noexcept { return index_; }
+
+    /**
+     * @brief stored_brick_count() * BRICK_TEXEL_COUNT texels
+     */
+    const Texel *brick_data() const noexcept { return data_; }
+
+    /**
+     * @brief texels of given brick. nullptr when the brick is elided
+     */
+    const Texel *brick(int bz, int by, int bx) const noexcept;
+
+    const Texel &at(int z, int y, int x) const noexcept;
+
+private:
+
+    static bool is_same_texel(const Texel &a, const Texel &b) noexcept
+    {
+        return std::memcmp(&a, &b, sizeof(Texel)) == 0;
+    }
+
+    Vec3i size_;
+    Vec3i brick_count_;
+    Texel background_;
+
+    size_t stored_brick_count_ = 0;
+
+    const uint32_t *index_ = nullptr;
+    const Texel    *data_  = nullptr;
+
+    std::vector<uint32_t> owned_index_;
+    std::vector<Texel>    owned_data_;
+    RC<const void>        storage_;
+};
+
+template<typename Texel>
+Vec3i SparseVolume<Texel>::compute_brick_count(const Vec3i &size) noexcept
+{
+    return Vec3i(
+        (size.x + BRICK_SIZE - 1) >> BRICK_SIZE_LOG2,
+        (size.y + BRICK_SIZE - 1) >> BRICK_SIZE_LOG2,
+        (size.z + BRICK_SIZE - 1) >> BRICK_SIZE_LOG2);
+}
+
+template<typename Texel>
+SparseVolume<Texel>::SparseVolume(
+    const Image3D<Texel> &dense, const Texel &background)
+{
+    size_        = Vec3i(dense.width(), dense.height(), dense.depth());
+    brick_count_ = compute_brick_count(size_);
+    background_  = background;
+
+    owned_index_.resize(size_t(brick_count_.x) * brick_count_.y * brick_count_.z);
+
+    std::vector<Texel> brick(BRICK_TEXEL_COUNT);
+
+    for(int bz = 0, brick_idx = 0; bz < brick_count_.z; ++bz)
+    {
+        for(int by = 0; by < brick_count_.y; ++by)
+        {
+            for(int bx = 0; bx < brick_count_.x; ++bx, ++brick_idx)
+            {
+                bool empty = true;
+
+                for(int lz = 0, i = 0; lz < BRICK_SIZE; ++lz)
+                {
+                    for(int ly = 0; ly < BRICK_SIZE; ++ly)
+                    {
+                        for(int lx = 0; lx < BRICK_SIZE; ++lx, ++i)
+                        {
+                            const int z = (bz << BRICK_SIZE_LOG2) + lz;
+                            const int y = (by << BRICK_SIZE_LOG2) + ly;
+                            const int x = (bx << BRICK_SIZE_LOG2) + lx;
+
+                            if(z >= size_.z || y >= size_.y || x >= size_.x)
+                            {
+                                brick[i] = background_;
+                                continue;
+                            }
+
+                            brick[i] = dense(z, y, x);
+                            empty &= is_same_texel(brick[i], background_);
+                        }
+                    }
+                }
+
+                if(empty)
+                {
+                    owned_index_[brick_idx] = EMPTY_BRICK;
+                    continue;
+                }
+
+                owned_index_[brick_idx] = static_cast<uint32_t>(
+                    owned_data_.size() / BRICK_TEXEL_COUNT);
+                owned_data_.insert(owned_data_.end(), brick.begin(), brick.end());
+            }
+        }
+    }
+
+    stored_brick_count_ = owned_data_.size() / BRICK_TEXEL_COUNT;
+
+    index_ = owned_index_.data();
+    data_  = owned_data_.data();
+}
+
+template<typename Texel>
+SparseVolume<Texel>::SparseVolume(
+    const Vec3i &size, const Texel &background,
+    std::vector<uint32_t> brick_index, std::vector<Texel> brick_data)
+{
+    size_        = size;
+    brick_count_ = compute_brick_count(size_);
+    background_  = background;
+
+    owned_index_ = std::move(brick_index);
+    owned_data_  = std::move(brick_data);
+
+    stored_brick_count_ = owned_data_.size() / BRICK_TEXEL_COUNT;
+
+    index_ = owned_index_.data();
+    data_  = owned_data_.data();
+}
+
+template<typename Texel>
+SparseVolume<Texel>::SparseVolume(
+    const Vec3i &size, const Texel &background,
+    const uint32_t *brick_index, const Texel *brick_data,
+    size_t stored_brick_count, RC<const void> storage)
+{
+    size_        = size;
+    brick_count_ = compute_brick_count(size_);
+    background_  = background;
+
+    stored_brick_count_ = stored_brick_count;
+
+    index_   = brick_index;
+    data_    = brick_data;
+    storage_ = std::move(storage);
+}
+
+template<typename Texel>
+const Texel *SparseVolume<Texel>::brick(int bz, int by, int bx) const noexcept
+{
+    const uint32_t idx = index_[(bz * brick_count_.y + by) * brick_count_.x + bx];
+    if(idx == EMPTY_BRICK)
+        return nullptr;
+    return data_ + size_t(idx) * BRICK_TEXEL_COUNT;
+}
+
+template<typename Texel>
+const Texel &SparseVolume<Texel>::at(int z, int y, int x) const noexcept
+{
+    constexpr int MASK = BRICK_SIZE - 1;
+
+    const Texel *b = brick(
+        z >> BRICK_SIZE_LOG2, y >> BRICK_SIZE_LOG2, x >> BRICK_SIZE_LOG2);
+    if(!b)
+        return background_;
+
+    return b[(((z & MASK) << BRICK_SIZE_LOG2) + (y & MASK)) * BRICK_SIZE + (x & MASK)];
+}
+
+AGZ_TRACER_END
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <agz/tracer/common.h>
+#include <agz/utility/misc.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief source of texels of a tiled image texture with mip levels
+ *
+ * each level is split into TextureCache::TILE_SIZE^2 tiles. texels of tiles
+ * are decoded on demand by load_tile, which may be called concurrently
+ */
+class TextureTileSource
+{
+public:
+
+    virtual ~TextureTileSource() = default;
+
+    virtual int level_count() const noexcept = 0;
+
+    virtual int width(int level) const noexcept = 0;
+
+    virtual int height(int level) const noexcept = 0;
+
+    /**
+     * @brief decode texels of given tile in row-major order
+     *
+     * texels outside the level are filled by clamping to the level border
+     */
+    virtual void load_tile(
+        int level, int tile_x, int tile_y, math::color3b *texels) const = 0;
+};
+
+/**
+ * @brief statistics of texture cache
+ *
+ * local hits are flushed from per-thread counters in batches and may lag
+ * behind other values
+ */
+struct TextureCacheStatistics
+{
+    uint64_t local_hit_count  = 0;
+    uint64_t shared_hit_count = 0;
+    uint64_t miss_count       = 0;
+    uint64_t evicted_count    = 0;
+
+    size_t resident_bytes      = 0;
+    size_t peak_resident_bytes = 0;
+    size_t budget_bytes        = 0;
+};
+
+/**
+ * @brief process-wide cache of texture tiles with lru eviction
+ *
+ * tiles are kept in shards, each guarded by a mutex and holding its own lru
+ * list and an equal part of the memory budget. in front of the shards, each
+ * thread keeps a small direct-mapped table of recently used tiles, so that
+ * repeated lookups of the same tiles need no locking.
+ *
+ * tiles in the per-thread tables are shared with the shards and are not
+ * counted in resident_bytes after eviction. they are released when replaced
+ */
+class TextureCache : public misc::uncopyable_t
+{
+public:
+
+    static constexpr int TILE_SIZE_LOG2   = 6;
+    static constexpr int TILE_SIZE        = 1 << TILE_SIZE_LOG2;
+    static constexpr int TILE_TEXEL_COUNT = TILE_SIZE * TILE_SIZE;
+    static constexpr size_t TILE_BYTES    = TILE_TEXEL_COUNT * sizeof(math::color3b);
+
+    static constexpr size_t DEFAULT_BUDGET_BYTES = size_t(1024) << 20;
+
+    using Tile = std::vector<math::color3b>;
+
+    /**
+     * @brief the global texture cache
+     */
+    static TextureCache &instance();
+
+    /**
+     * @brief unique id for tiles of a texture
+     */
+    static uint32_t new_texture_id() noexcept;
+
+    /**
+     * @brief set memory budget and evict tiles exceeding it
+     */
+    void set_budget(size_t budget_bytes);
+
+    /**
+     * @brief texels of given tile, which are loaded from source on miss
+     *
+     * the returned pointer is valid until the next lookup in the same thread
+     */
+    const math::color3b *lookup(
+        uint32_t texture_id, const TextureTileSource &source,
+        int level, int tile_x, int tile_y);
+
+    TextureCacheStatistics statistics() const;
+
+private:
+
+    static constexpr int SHARD_COUNT = 32;
+
+    struct Shard
+    {
+        using LRUList = std::list<std::pair<uint64_t, RC<const Tile>>>;
+
+        std::mutex mutex;
+
+        // most recently used tile at front
+        LRUList lru;
+        std::unordered_map<uint64_t, LRUList::iterator> key2node;
+
+        size_t resident_bytes = 0;
+    };
+
+    TextureCache();
+
+    static uint64_t make_key(
+        uint32_t texture_id, int level, int tile_x, int tile_y) noexcept;
+
+    // evict lru tiles until shard fits its budget. shard must be locked
+    void shrink(Shard &shard);
+
+    RC<const Tile> lookup_shared(
+        uint64_t key, const TextureTileSource &source,
+        int level, int tile_x, int tile_y);
+
+    void add_resident_bytes(size_t bytes) noexcept;
+
+    std::atomic<size_t> shard_budget_;
+
+    Shard shards_[SHARD_COUNT];
+
+    std::atomic<uint64_t> local_hit_count_  = 0;
+    std::atomic<uint64_t> shared_hit_count_ = 0;
+    std::atomic<uint64_t> miss_count_       = 0;
+    std::atomic<uint64_t> evicted_count_    = 0;
+
+    std::atomic<size_t> resident_bytes_      = 0;
+    std::atomic<size_t> peak_resident_bytes_ = 0;
+};
+
+AGZ_TRACER_END
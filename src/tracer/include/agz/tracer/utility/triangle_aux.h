@@ -87,4 +87,180 @@ inline FVec3 dpdu_as_ex(
     return (m11 * inv_det * B_A - m01 * inv_det * C_A).normalize();
 }
 
+/**
+ * @brief partial derivatives of position w.r.t. uv on a triangle
+ *
+ * both are set to zero when the uvs are degenerate
+ */
+inline void triangle_dpduv(
+    const FVec3 &B_A, const FVec3 &C_A,
+    const Vec2 &b_a, const Vec2 &c_a,
+    FVec3 *dpdu, FVec3 *dpdv) noexcept
+{
+    const real det = b_a.x * c_a.y - b_a.y * c_a.x;
+    if(!det)
+    {
+        *dpdu = *dpdv = FVec3();
+        return;
+    }
+    const real inv_det = 1 / det;
+    *dpdu = (c_a.y * inv_det) * B_A - (b_a.y * inv_det) * C_A;
+    *dpdv = (b_a.x * inv_det) * C_A - (c_a.x * inv_det) * B_A;
+}
+
+/**
+ * @brief barycentric coordinate of a point on triangle
+ *
+ * the result is clamped into the triangle
+ */
+inline Vec2 triangle_barycentric(
+    const FVec3 &P_A, const FVec3 &B_A, const FVec3 &C_A) noexcept
+{
+    const real d00 = dot(B_A, B_A), d01 = dot(B_A, C_A), d11 = dot(C_A, C_A);
+    const real d20 = dot(P_A, B_A), d21 = dot(P_A, C_A);
+
+    const real det = d00 * d11 - d01 * d01;
+    if(!det)
+        return Vec2(real(1) / 3, real(1) / 3);
+    const real inv_det = 1 / det;
+
+    real beta  = math::clamp<real>((d11 * d20 - d01 * d21) * inv_det, 0, 1);
+    real gamma = math::clamp<real>((d00 * d21 - d01 * d20) * inv_det, 0, 1);
+    if(beta + gamma > 1)
+    {
+        const real sum = beta + gamma;
+        beta  /= sum;
+        gamma /= sum;
+    }
+
+    return Vec2(beta, gamma);
+}
+
+/*
+ * solid angle sampling of triangles
+ *
+ * sampling is reliable only when the solid angle is neither tiny (precision
+ * of the spherical triangle degrades) nor close to a hemisphere. outside this
+ * range triangles fall back to uniform area sampling
+ */
+
+constexpr real MIN_SPHERICAL_TRIANGLE_SOLID_ANGLE = real(3e-4);
+constexpr real MAX_SPHERICAL_TRIANGLE_SOLID_ANGLE = real(6.22);
+
+/**
+ * @brief solid angle of triangle seen from ref, or 0 when it should not be
+ *        sampled w.r.t. solid angle
+ */
+inline real triangle_sampling_solid_angle(
+    const FVec3 &ref,
+    const FVec3 &A, const FVec3 &B_A, const FVec3 &C_A) noexcept
+{
+    const FVec3 a = A - ref, b = a + B_A, c = a + C_A;
+    const real la = a.length(), lb = b.length(), lc = c.length();
+    if(!la || !lb || !lc)
+        return 0;
+
+    // Van Oosterom and Strackee
+    const FVec3 na = a / la, nb = b / lb, nc = c / lc;
+    const real numer = std::abs(dot(na, cross(nb, nc)));
+    const real denom = 1 + dot(na, nb) + dot(nb, nc) + dot(nc, na);
+    const real solid_angle = std::abs(2 * std::atan2(numer, denom));
+
+    if(solid_angle < MIN_SPHERICAL_TRIANGLE_SOLID_ANGLE ||
+       solid_angle > MAX_SPHERICAL_TRIANGLE_SOLID_ANGLE)
+        return 0;
+    return solid_angle;
+}
+
+/**
+ * @brief uniformly sample a triangle w.r.t. solid angle seen from ref
+ *
+ * see 'Stratified Sampling of Spherical Triangles' (Arvo 1995)
+ *
+ * @param solid_angle non-zero return value of triangle_sampling_solid_angle
+ *
+ * @return barycentric coordinate of the sampled point
+ */
+inline Vec2 sample_triangle_solid_angle(
+    const FVec3 &ref,
+    const FVec3 &A, const FVec3 &B_A, const FVec3 &C_A,
+    real solid_angle, real u, real v) noexcept
+{
+    const FVec3 A_ref = A - ref;
+    const FVec3 a = A_ref.normalize();
+    const FVec3 b = (A_ref + B_A).normalize();
+    const FVec3 c = (A_ref + C_A).normalize();
+
+    // angle between unit vectors without precision loss of acos
+    auto angle_between = [](const FVec3 &x, const FVec3 &y)
+    {
+        if(dot(x, y) < 0)
+            return PI_r - 2 * std::asin((std::min)(real(1), (x + y).length() / 2));
+        return 2 * std::asin((std::min)(real(1), (y - x).length() / 2));
+    };
+
+    const FVec3 n_ab = cross(a, b).normalize();
+    const FVec3 n_ca = cross(c, a).normalize();
+    const real alpha = angle_between(n_ab, -n_ca);
+    const real cos_alpha = std::cos(alpha), sin_alpha = std::sin(alpha);
+
+    // find vertex c' of the sub-triangle with area u * solid_angle
+
+    const real area_pi = PI_r + u * solid_angle;
+    const real sin_phi = std::sin(area_pi) * cos_alpha
+                       - std::cos(area_pi) * sin_alpha;
+    const real cos_phi = std::cos(area_pi) * cos_alpha
+                       + std::sin(area_pi) * sin_alpha;
+
+    const real k1 = cos_phi + cos_alpha;
+    const real k2 = sin_phi - sin_alpha * dot(a, b);
+
+    real cos_bp = (k2 + (k2 * cos_phi - k1 * sin_phi) * cos_alpha)
+                / ((k2 * sin_phi + k1 * cos_phi) * sin_alpha);
+    if(!std::isfinite(cos_bp))
+        cos_bp = 1;
+    cos_bp = math::clamp<real>(cos_bp, -1, 1);
+    const real sin_bp = local_angle::cos_2_sin(cos_bp);
+
+    const FVec3 c_a_perp = c - dot(c, a) * a;
+    const FVec3 cp = c_a_perp.length_square() > 0 ?
+        (cos_bp * a + sin_bp * c_a_perp.normalize()).normalize() : a;
+
+    // sample the arc between b and c'
+
+    const real cos_theta = 1 - v * (1 - dot(cp, b));
+    const real sin_theta = local_angle::cos_2_sin(cos_theta);
+
+    const FVec3 cp_b_perp = cp - dot(cp, b) * b;
+    const FVec3 dir = cp_b_perp.length_square() > 0 ?
+        cos_theta * b + sin_theta * cp_b_perp.normalize() : b;
+
+    // project the direction onto the triangle
+
+    const FVec3 nor = cross(B_A, C_A);
+    const real dir_dot_nor = dot(dir, nor);
+    if(!dir_dot_nor)
+        return Vec2(real(1) / 3, real(1) / 3);
+
+    const real t = dot(A_ref, nor) / dir_dot_nor;
+    return triangle_barycentric(t * dir - A_ref, B_A, C_A);
+}
+
+/**
+ * @brief pdf (w.r.t. surface area) of a point sampled w.r.t. solid angle
+ *
+ * @param solid_angle solid angle of the sampled surface seen from ref
+ */
+inline real solid_angle_sample_area_pdf(
+    const FVec3 &ref, const FVec3 &pos, const FVec3 &nor,
+    real solid_angle) noexcept
+{
+    const FVec3 pos_to_ref = ref - pos;
+    const real dist2 = pos_to_ref.length_square();
+    if(!dist2)
+        return 0;
+    const real abscos = std::abs(dot(nor, pos_to_ref)) / std::sqrt(dist2);
+    return abscos / (solid_angle * dist2);
+}
+
 AGZ_TRACER_END
@@ -39,6 +39,18 @@ namespace
         };
     };
 
+    // refitted bvh is rebuilt when its sah cost exceeds this ratio
+    // of the cost after last build
+    constexpr real REFIT_REBUILD_RATIO = real(1.5);
+
+    real aabb_surface_area(const AABB &bound) noexcept
+    {
+        const FVec3 ext = bound.high - bound.low;
+        if(ext.x < 0 || ext.y < 0 || ext.z < 0)
+            return 0;
+        return 2 * (ext.x * ext.y + ext.y * ext.z + ext.z * ext.x);
+    }
+
 } // namespace anonymous
 
 class EntityBVHEmbree : public Aggregate
@@ -51,12 +63,19 @@ class EntityBVHEmbree : public Aggregate
 
     std::vector<RC<const Entity>> entities_;
 
+    // prims_[i] is entities_[prim_entity_indices_[i]]
+    std::vector<size_t> prim_entity_indices_;
+
     RTCBVH bvh_;
     Node *root_;
 
+    AABB root_bound_;
+    real built_sah_cost_ = 0;
+
     struct BuildingParams
     {
         std::vector<EntityPtr>        &output_prims;
+        std::vector<size_t>           &output_prim_indices;
         std::vector<RC<const Entity>> &all_entities;
     };
 
@@ -122,6 +141,7 @@ class EntityBVHEmbree : public Aggregate
         {
             params.output_prims.push_back(
                 params.all_entities[prims[i].primID].get());
+            params.output_prim_indices.push_back(prims[i].primID);
         }
         const size_t end = params.output_prims.size();
 
@@ -195,6 +215,48 @@ class EntityBVHEmbree : public Aggregate
         return ret;
     }
 
+    // update bounds of children of node and return bound of node
+    AABB refit_aux(Node &node) const noexcept
+    {
+        if(node.is_interior)
+        {
+            node.interior.left_bound  = refit_aux(*node.interior.left);
+            node.interior.right_bound = refit_aux(*node.interior.right);
+
+            AABB ret = node.interior.left_bound;
+            ret |= node.interior.right_bound;
+            return ret;
+        }
+
+        AABB ret;
+        for(size_t i = node.leaf.start; i < node.leaf.end; ++i)
+            ret |= prims_[i]->world_bound();
+        return ret;
+    }
+
+    // sum of child areas weighted by traversal/intersection costs
+    real weighted_area_aux(const Node &node, const AABB &bound) const noexcept
+    {
+        if(node.is_interior)
+        {
+            return aabb_surface_area(bound)
+                 + weighted_area_aux(*node.interior.left, node.interior.left_bound)
+                 + weighted_area_aux(*node.interior.right, node.interior.right_bound);
+        }
+        return aabb_surface_area(bound) * real(node.leaf.end - node.leaf.start);
+    }
+
+    /**
+     * @brief expected cost of tracing a ray hitting the root node
+     */
+    real compute_sah_cost() const noexcept
+    {
+        const real root_area = aabb_surface_area(root_bound_);
+        if(!root_ || root_area <= 0)
+            return 0;
+        return weighted_area_aux(*root_, root_bound_) / root_area;
+    }
+
 public:
 
     explicit EntityBVHEmbree(int max_leaf_size)
@@ -219,7 +281,9 @@ public:
         }
 
         prims_.clear();
+        prim_entity_indices_.clear();
         entities_ = entities;
+        root_bound_ = AABB();
 
         bvh_ = rtcNewBVH(embree_device());
 
@@ -230,6 +294,7 @@ public:
             auto &e = entities_[i];
 
             const auto bbox = e->world_bound();
+            root_bound_ |= bbox;
 
             p.geomID  = static_cast<unsigned>(i);
             p.primID  = static_cast<unsigned>(i);
@@ -242,7 +307,7 @@ public:
         }
 
         BuildingParams building_params = {
-            prims_, entities_
+            prims_, prim_entity_indices_, entities_
         };
 
         RTCBuildArguments args = rtcDefaultBuildArguments();
@@ -267,6 +332,28 @@ public:
         args.userPtr                = &building_params;
 
         root_ = static_cast<Node*>(rtcBuildBVH(&args));
+
+        built_sah_cost_ = compute_sah_cost();
+    }
+
+    void refit(const std::vector<RC<const Entity>> &entities) override
+    {
+        if(!root_ || entities.size() != entities_.size())
+        {
+            build(entities);
+            return;
+        }
+
+        entities_ = entities;
+        for(size_t i = 0; i < prims_.size(); ++i)
+            prims_[i] = entities_[prim_entity_indices_[i]].get();
+
+        root_bound_ = refit_aux(*root_);
+
+        // moved entities may make nodes overlap heavily
+
+        if(compute_sah_cost() > REFIT_REBUILD_RATIO * built_sah_cost_)
+            build(entities);
     }
 
     bool has_intersection(const Ray &r) const noexcept override
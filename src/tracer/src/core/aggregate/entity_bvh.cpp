@@ -1,35 +1,95 @@
 #include <agz/tracer/core/aggregate.h>
 #include <agz/tracer/core/entity.h>
-#include <agz/utility/misc.h>
+#include <agz/tracer/utility/logger.h>
 
 AGZ_TRACER_BEGIN
 
 namespace
 {
-    
-    struct Leaf;
-    struct Interior;
 
-    using Node = misc::variant_t<Leaf, Interior>;
+    constexpr int SAH_BIN_COUNT = 16;
 
-    struct Leaf
-    {
-        AABB bound;
-        size_t start = 0, end = 0;
-    };
+    // relative cost of traversing a node and intersecting an entity
+    constexpr real TRAVERSAL_COST    = real(0.25);
+    constexpr real INTERSECTION_COST = 1;
+
+    // nodes deeper than this are split at median to bound the traversal stack
+    constexpr int MAX_SAH_DEPTH = 32;
+
+    constexpr int TRAVERSAL_STACK_SIZE = 64;
 
-    struct Interior
+    // refitted bvh is rebuilt when its sah cost exceeds this ratio
+    // of the cost after last build
+    constexpr real REFIT_REBUILD_RATIO = real(1.5);
+
+    /**
+     * @brief node of flattened bvh
+     *
+     * the first child of an interior node immediately follows it in the node
+     * array, and second_child_or_first_prim stores index of the second child.
+     * for leaf nodes, it stores index of the first entity.
+     */
+    struct alignas(32) Node
     {
-        AABB bound;
-        size_t left  = 0, right = 0;
+        float low[3];
+        float high[3];
+        uint32_t second_child_or_first_prim;
+        uint16_t prim_count; // 0 for interior nodes
+        uint8_t  split_axis;
+        uint8_t  pad;
     };
 
+    static_assert(sizeof(Node) == 32);
+
     struct EntityRecord
     {
         const Entity *entity = nullptr;
+        uint32_t index = 0;
         AABB bound;
+        FVec3 centroid;
     };
 
+    real aabb_surface_area(const AABB &bound) noexcept
+    {
+        const FVec3 ext = bound.high - bound.low;
+        if(ext.x < 0 || ext.y < 0 || ext.z < 0)
+            return 0;
+        return 2 * (ext.x * ext.y + ext.y * ext.z + ext.z * ext.x);
+    }
+
+    AABB node_bound(const Node &node) noexcept
+    {
+        return {
+            { node.low[0],  node.low[1],  node.low[2]  },
+            { node.high[0], node.high[1], node.high[2] }
+        };
+    }
+
+    void set_node_bound(Node &node, const AABB &bound) noexcept
+    {
+        for(int i = 0; i < 3; ++i)
+        {
+            node.low[i]  = bound.low[i];
+            node.high[i] = bound.high[i];
+        }
+    }
+
+    bool intersect_node(
+        const Node &node, const FVec3 &o, const FVec3 &inv_dir,
+        real t_min, real t_max) noexcept
+    {
+        for(int i = 0; i < 3; ++i)
+        {
+            real n = (node.low[i]  - o[i]) * inv_dir[i];
+            real f = (node.high[i] - o[i]) * inv_dir[i];
+            if(n > f)
+                std::swap(n, f);
+            t_min = (std::max)(t_min, n);
+            t_max = (std::min)(t_max, f);
+        }
+        return t_min <= t_max;
+    }
+
 } // namespace anonymous
 
 class EntityBVH : public Aggregate
@@ -40,135 +100,212 @@ class EntityBVH : public Aggregate
     std::vector<EntityPtr> prims_;
 
     std::vector<RC<const Entity>> entities_;
-    
+
+    // prims_[i] is entities_[prim_entity_indices_[i]]
+    std::vector<uint32_t> prim_entity_indices_;
+
+    real built_sah_cost_ = 0;
+
     int max_leaf_size_ = 5;
 
-    size_t build_aux(EntityRecord *entities, size_t count)
+    void make_leaf(
+        size_t node_idx, const AABB &bound,
+        const EntityRecord *entities, size_t count)
     {
-        assert(count);
+        Node &node = nodes_[node_idx];
+        set_node_bound(node, bound);
+        node.second_child_or_first_prim = static_cast<uint32_t>(prims_.size());
+        node.prim_count = static_cast<uint16_t>(count);
+        node.split_axis = 0;
+        node.pad        = 0;
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            prims_.push_back(entities[i].entity);
+            prim_entity_indices_.push_back(entities[i].index);
+        }
+    }
+
+    /**
+     * @brief expected cost of tracing a ray hitting the root node
+     */
+    real compute_sah_cost() const noexcept
+    {
+        const real root_area = aabb_surface_area(node_bound(nodes_[0]));
+        if(root_area <= 0)
+            return 0;
 
-        if(count <= static_cast<size_t>(max_leaf_size_) || count < 2)
+        real cost = 0;
+        for(auto &node : nodes_)
+        {
+            const real node_cost = node.prim_count ?
+                INTERSECTION_COST * node.prim_count : TRAVERSAL_COST;
+            cost += node_cost * aabb_surface_area(node_bound(node));
+        }
+
+        return cost / root_area;
+    }
+
+    /**
+     * @brief find best sah split
+     *
+     * @return (split axis, split index), or (-1, 0) when no split is better
+     *  than creating a leaf
+     */
+    std::pair<int, size_t> find_sah_split(
+        EntityRecord *entities, size_t count,
+        const AABB &all_bound, const AABB &centroid_bound) const
+    {
+        const real inv_area = 1 / (std::max)(
+            aabb_surface_area(all_bound), EPS());
+
+        real best_cost = INTERSECTION_COST * static_cast<real>(count);
+        int best_axis = -1, best_bin = 0;
+
+        struct Bin
         {
-            const size_t start = prims_.size();
-            const size_t end   = start + count;
-            
             AABB bound;
+            size_t count = 0;
+        };
+
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            const real axis_low = centroid_bound.low[axis];
+            const real axis_len = centroid_bound.high[axis] - axis_low;
+            if(axis_len <= 0)
+                continue;
+            const real bin_scale = SAH_BIN_COUNT / axis_len;
+
+            Bin bins[SAH_BIN_COUNT];
             for(size_t i = 0; i < count; ++i)
             {
-                prims_.push_back(entities[i].entity);
-                bound |= entities[i].bound;
+                const int b = (std::min)(SAH_BIN_COUNT - 1, static_cast<int>(
+                    (entities[i].centroid[axis] - axis_low) * bin_scale));
+                bins[b].bound |= entities[i].bound;
+                ++bins[b].count;
             }
 
-            const size_t ret = nodes_.size();
-            nodes_.emplace_back(Leaf{ bound, start, end });
-            return ret;
-        }
+            // right_area[b]/right_count[b]: bins [b, SAH_BIN_COUNT)
 
-        // find splitting axis
+            real right_area[SAH_BIN_COUNT];
+            size_t right_count[SAH_BIN_COUNT];
+            AABB right_bound;
+            size_t right_sum = 0;
+            for(int b = SAH_BIN_COUNT - 1; b > 0; --b)
+            {
+                right_bound |= bins[b].bound;
+                right_sum   += bins[b].count;
+                right_area[b]  = aabb_surface_area(right_bound);
+                right_count[b] = right_sum;
+            }
 
-        AABB all_bound;
-        for(size_t i = 0; i < count; ++i)
-            all_bound |= entities[i].bound;
-        real split_axis_len = -1;
-        int split_axis = 0;
-        for(int i = 0; i < 3; ++i)
-        {
-            const real axis_len = all_bound.high[i] - all_bound.low[i];
-            if(axis_len > split_axis_len)
+            AABB left_bound;
+            size_t left_sum = 0;
+            for(int b = 1; b < SAH_BIN_COUNT; ++b)
             {
-                split_axis_len = axis_len;
-                split_axis = i;
+                left_bound |= bins[b - 1].bound;
+                left_sum   += bins[b - 1].count;
+                if(!left_sum || !right_count[b])
+                    continue;
+
+                const real cost = TRAVERSAL_COST + INTERSECTION_COST * inv_area *
+                    (aabb_surface_area(left_bound) * left_sum +
+                     right_area[b] * right_count[b]);
+                if(cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin  = b;
+                }
             }
         }
 
-        // sort entities according to centre[split_axis]
+        if(best_axis < 0)
+            return { -1, 0 };
 
-        std::sort(entities, entities + count,
-            [split_axis](const EntityRecord &lhs, const EntityRecord &rhs)
+        const real axis_low = centroid_bound.low[best_axis];
+        const real bin_scale = SAH_BIN_COUNT /
+            (centroid_bound.high[best_axis] - axis_low);
+        EntityRecord *mid = std::partition(
+            entities, entities + count, [&](const EntityRecord &e)
         {
-            const real L = lhs.bound.low[split_axis] +
-                           lhs.bound.high[split_axis];
-            const real R = rhs.bound.low[split_axis] +
-                           rhs.bound.high[split_axis];
-            return L < R;
+            const int b = (std::min)(SAH_BIN_COUNT - 1, static_cast<int>(
+                (e.centroid[best_axis] - axis_low) * bin_scale));
+            return b < best_bin;
         });
 
-        // push back new interior node
-
-        const size_t interior_idx = nodes_.size();
-        nodes_.emplace_back(Interior());
+        return { best_axis, static_cast<size_t>(mid - entities) };
+    }
 
-        // build left & right children
+    void build_aux(EntityRecord *entities, size_t count, int depth)
+    {
+        assert(count);
 
-        const size_t split_idx = count / 2;
-        const size_t left_idx  = build_aux(entities, split_idx);
-        const size_t right_idx = build_aux(
-            entities + split_idx, count - split_idx);
+        const size_t node_idx = nodes_.size();
+        nodes_.emplace_back();
 
-        // fill interior node
+        AABB all_bound, centroid_bound;
+        for(size_t i = 0; i < count; ++i)
+        {
+            all_bound      |= entities[i].bound;
+            centroid_bound |= entities[i].centroid;
+        }
 
-        auto &interior = nodes_[interior_idx].as<Interior>();
-        interior.bound = all_bound;
-        interior.left  = left_idx;
-        interior.right = right_idx;
+        if(count == 1)
+        {
+            make_leaf(node_idx, all_bound, entities, count);
+            return;
+        }
 
-        return interior_idx;
-    }
+        int split_axis = -1;
+        size_t split_idx = 0;
 
-    bool has_intersection_aux(
-        const FVec3 &inv_dir, const Ray &r, const Node &node) const noexcept
-    {
-        if(const Leaf *leaf = node.as_if<Leaf>())
+        if(depth < MAX_SAH_DEPTH)
         {
-            if(!leaf->bound.intersect(r.o, inv_dir, r.t_min, r.t_max))
-                return false;
-            for(size_t i = leaf->start; i < leaf->end; ++i)
-            {
-                if(prims_[i]->has_intersection(r))
-                    return true;
-            }
-            return false;
+            std::tie(split_axis, split_idx) = find_sah_split(
+                entities, count, all_bound, centroid_bound);
         }
 
-        const Interior &interior = node.as<Interior>();
-        if(!interior.bound.intersect(r.o, inv_dir, r.t_min, r.t_max))
-            return false;
+        // leaf is cheaper than any split
 
-        return has_intersection_aux(inv_dir, r, nodes_[interior.left]) ||
-               has_intersection_aux(inv_dir, r, nodes_[interior.right]);
-    }
+        if(split_axis < 0 && count <= static_cast<size_t>(max_leaf_size_))
+        {
+            make_leaf(node_idx, all_bound, entities, count);
+            return;
+        }
 
-    bool closest_intersection_aux(
-        const FVec3 &inv_dir, Ray &r, const Node &node,
-        EntityIntersection *inct) const noexcept
-    {
-        if(const Leaf *leaf = node.as_if<Leaf>())
+        // fall back to median split along the longest centroid axis
+
+        if(split_axis < 0)
         {
-            if(!leaf->bound.intersect(r.o, inv_dir, r.t_min, r.t_max))
-                return false;
-            bool ret = false;
-            for(size_t i = leaf->start; i < leaf->end; ++i)
+            split_axis = 0;
+            for(int i = 1; i < 3; ++i)
             {
-                const EntityPtr ent = prims_[i];
-                if(ent->closest_intersection(r, inct))
-                {
-                    r.t_max = inct->t;
-                    ret = true;
-                }
+                if(centroid_bound.high[i] - centroid_bound.low[i] >
+                   centroid_bound.high[split_axis] - centroid_bound.low[split_axis])
+                    split_axis = i;
             }
-            return ret;
+
+            split_idx = count / 2;
+            std::nth_element(
+                entities, entities + split_idx, entities + count,
+                [split_axis](const EntityRecord &lhs, const EntityRecord &rhs)
+            {
+                return lhs.centroid[split_axis] < rhs.centroid[split_axis];
+            });
         }
 
-        const Interior &interior = node.as<Interior>();
-        if(!interior.bound.intersect(r.o, inv_dir, r.t_min, r.t_max))
-            return false;
+        build_aux(entities, split_idx, depth + 1);
 
-        const bool left  = closest_intersection_aux(
-            inv_dir, r, nodes_[interior.left], inct);
-        const bool right = closest_intersection_aux(
-            inv_dir, r, nodes_[interior.right], inct);
+        const size_t second_idx = nodes_.size();
+        build_aux(entities + split_idx, count - split_idx, depth + 1);
 
-        return left || right;
+        Node &node = nodes_[node_idx];
+        set_node_bound(node, all_bound);
+        node.second_child_or_first_prim = static_cast<uint32_t>(second_idx);
+        node.prim_count = 0;
+        node.split_axis = static_cast<uint8_t>(split_axis);
+        node.pad        = 0;
     }
 
 public:
@@ -176,7 +313,7 @@ public:
     explicit EntityBVH(int max_leaf_size)
     {
         max_leaf_size_ = max_leaf_size;
-        if(max_leaf_size < 1)
+        if(max_leaf_size < 1 || max_leaf_size > 0xffff)
             throw ObjectConstructionException("invalid max_leaf_size value");
     }
 
@@ -184,34 +321,174 @@ public:
     {
         nodes_.clear();
         prims_.clear();
+        prim_entity_indices_.clear();
+        entities_.clear();
 
         if(entities.empty())
-        {
-            nodes_.emplace_back(Leaf{ AABB{ FVec3(0), FVec3(1) }, 0, 0 });
             return;
-        }
 
         std::vector<EntityRecord> records(entities.size());
         prims_.reserve(entities.size());
+        prim_entity_indices_.reserve(entities.size());
+        nodes_.reserve(2 * entities.size());
         for(size_t i = 0; i < entities.size(); ++i)
-            records[i] = { entities[i].get(), entities[i]->world_bound() };
+        {
+            const AABB bound = entities[i]->world_bound();
+            records[i] = {
+                entities[i].get(), static_cast<uint32_t>(i),
+                bound, real(0.5) * (bound.low + bound.high)
+            };
+        }
 
         entities_ = entities;
-        build_aux(records.data(), records.size());
+        build_aux(records.data(), records.size(), 0);
+
+        nodes_.shrink_to_fit();
+        built_sah_cost_ = compute_sah_cost();
+
+        AGZ_INFO("entity bvh: {} entities, {} nodes", prims_.size(), nodes_.size());
+    }
+
+    void refit(const std::vector<RC<const Entity>> &entities) override
+    {
+        if(nodes_.empty() || entities.size() != entities_.size())
+        {
+            build(entities);
+            return;
+        }
+
+        entities_ = entities;
+        for(size_t i = 0; i < prims_.size(); ++i)
+            prims_[i] = entities_[prim_entity_indices_[i]].get();
+
+        // children always follow their parent in nodes_
+
+        for(size_t node_idx = nodes_.size(); node_idx-- > 0;)
+        {
+            Node &node = nodes_[node_idx];
+
+            AABB bound;
+            if(node.prim_count)
+            {
+                const uint32_t end = node.second_child_or_first_prim
+                                   + node.prim_count;
+                for(uint32_t i = node.second_child_or_first_prim; i < end; ++i)
+                    bound |= prims_[i]->world_bound();
+            }
+            else
+            {
+                bound = node_bound(nodes_[node_idx + 1]);
+                bound |= node_bound(nodes_[node.second_child_or_first_prim]);
+            }
+
+            set_node_bound(node, bound);
+        }
+
+        // moved entities may make nodes overlap heavily
+
+        const real sah_cost = compute_sah_cost();
+        if(sah_cost > REFIT_REBUILD_RATIO * built_sah_cost_)
+        {
+            AGZ_INFO("entity bvh: rebuild after refit (sah cost {} -> {})",
+                     built_sah_cost_, sah_cost);
+            build(entities);
+        }
     }
 
     bool has_intersection(const Ray &r) const noexcept override
     {
+        if(nodes_.empty())
+            return false;
+
         const FVec3 inv_dir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
-        return has_intersection_aux(inv_dir, r, nodes_[0]);
+
+        uint32_t stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+
+        while(top)
+        {
+            const uint32_t node_idx = stack[--top];
+            const Node &node = nodes_[node_idx];
+
+            if(!intersect_node(node, r.o, inv_dir, r.t_min, r.t_max))
+                continue;
+
+            if(node.prim_count)
+            {
+                const uint32_t end = node.second_child_or_first_prim
+                                   + node.prim_count;
+                for(uint32_t i = node.second_child_or_first_prim; i < end; ++i)
+                {
+                    if(prims_[i]->has_intersection(r))
+                        return true;
+                }
+                continue;
+            }
+
+            assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+            stack[top++] = node.second_child_or_first_prim;
+            stack[top++] = node_idx + 1;
+        }
+
+        return false;
     }
 
     bool closest_intersection(
         const Ray &r, EntityIntersection *inct) const noexcept override
     {
-        FVec3 inv_dir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
+        if(nodes_.empty())
+            return false;
+
+        const FVec3 inv_dir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
+        const bool dir_is_neg[3] = { inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0 };
+
         Ray ray = r;
-        return closest_intersection_aux(inv_dir, ray, nodes_[0], inct);
+        bool ret = false;
+
+        uint32_t stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+
+        while(top)
+        {
+            const uint32_t node_idx = stack[--top];
+            const Node &node = nodes_[node_idx];
+
+            if(!intersect_node(node, ray.o, inv_dir, ray.t_min, ray.t_max))
+                continue;
+
+            if(node.prim_count)
+            {
+                const uint32_t end = node.second_child_or_first_prim
+                                   + node.prim_count;
+                for(uint32_t i = node.second_child_or_first_prim; i < end; ++i)
+                {
+                    if(prims_[i]->closest_intersection(ray, inct))
+                    {
+                        ray.t_max = inct->t;
+                        ret = true;
+                    }
+                }
+                continue;
+            }
+
+            // visit near child first
+
+            assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+            if(dir_is_neg[node.split_axis])
+            {
+                stack[top++] = node_idx + 1;
+                stack[top++] = node.second_child_or_first_prim;
+            }
+            else
+            {
+                stack[top++] = node.second_child_or_first_prim;
+                stack[top++] = node_idx + 1;
+            }
+        }
+
+        return ret;
     }
 };
 
@@ -93,6 +93,23 @@ public:
             pos_on_cam, pos_to_out, dir_, FSpectrum(1));
     }
 
+    bool sample_we_differential(
+        const Vec2 &film_coord, const Vec2 &pixel_size,
+        const Sample2 &aperture_sam, RayDifferential *differential) const noexcept override
+    {
+        const auto dx = sample_we(
+            { film_coord.x + pixel_size.x, film_coord.y }, aperture_sam);
+        const auto dy = sample_we(
+            { film_coord.x, film_coord.y + pixel_size.y }, aperture_sam);
+
+        differential->o_dx = dx.pos_on_cam;
+        differential->d_dx = dx.pos_to_out;
+        differential->o_dy = dy.pos_on_cam;
+        differential->d_dy = dy.pos_to_out;
+
+        return true;
+    }
+
     CameraEvalWeResult eval_we(
         const FVec3 &pos_on_cam, const FVec3 &pos_to_out) const noexcept override
     {
@@ -89,4 +89,9 @@ real GeometryToDiffuseLight::pdf(
     return area_pdf * area_to_solid_angle_factor;
 }
 
+AABB GeometryToDiffuseLight::world_bound() const noexcept
+{
+    return geometry_->world_bound();
+}
+
 AGZ_TRACER_END
@@ -37,6 +37,8 @@ public:
     real pdf(
         const FVec3 &ref,
         const FVec3 &pos, const FVec3 &nor) const noexcept override;
+
+    AABB world_bound() const noexcept override;
 };
 
 AGZ_TRACER_END
@@ -57,6 +57,22 @@ public:
         return true;
     }
 
+    int random_intersection(
+        const Ray &r, real u, EntityIntersection *inct) const noexcept override
+    {
+        const int count = geometry_->random_intersection(r, u, inct);
+        if(!count)
+            return 0;
+
+        inct->entity     = this;
+        inct->material   = material_.get();
+
+        inct->medium_in  = medium_interface_.in.get();
+        inct->medium_out = medium_interface_.out.get();
+
+        return count;
+    }
+
     AABB world_bound() const noexcept override
     {
         return geometry_->world_bound();
@@ -1,171 +1,501 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <vector>
 
 #include <agz/tracer/core/texture2d.h>
-#include <agz/utility/texture.h>
 #include <agz/utility/thread.h>
 
 AGZ_TRACER_BEGIN
 
 /**
  * @brief helper class for importance sampling of environment light
+ *
+ * each texel of the environment texture is a sampling cell, whose weight is
+ * its luminance (integrated over the bilinear reconstruction footprint)
+ * times its solid angle. cells are selected by descending a pyramid of
+ * summed weights, which costs O(log n) per sample.
+ *
+ * with product sampling, children of nodes in coarse levels are additionally
+ * weighted by the max |cos| between a given normal and their directions
  */
 class EnvironmentLightSampler : public misc::uncopyable_t
 {
-    texture::texture2d_t<real> probs_;
-    math::distribution::alias_sampler_t<real> sampler_;
+    // levels of nodes with at most this resolution store bounding cones
+    static constexpr int PRODUCT_RESOLUTION = 64;
+
+    // min cosine bound, so that no direction has zero probability
+    static constexpr real MIN_COS_BOUND = real(0.01);
+
+    // bounding cone of directions covered by a node
+    struct Cone
+    {
+        FVec3 axis;
+        real cos_angle = -1;
+        real sin_angle = 0;
+    };
+
+    struct Level
+    {
+        int width  = 0;
+        int height = 0;
+
+        std::vector<real> weights;
+
+        // empty when the level is finer than PRODUCT_RESOLUTION
+        std::vector<Cone> cones;
+
+        real weight(int x, int y) const noexcept
+        {
+            return weights[y * width + x];
+        }
+    };
+
+    // levels_[0] contains texel weights. levels_.back() is 1 x 1
+    std::vector<Level> levels_;
+
+    bool product_sampling_ = false;
+
+    // integral of radiance over the sphere
+    FSpectrum radiance_integral_;
+
+    static real solid_angle(real u0, real u1, real v0, real v1) noexcept
+    {
+        return std::abs(2 * PI_r * (u1 - u0)
+                      * (std::cos(PI_r * v0) - std::cos(PI_r * v1)));
+    }
+
+    static FVec3 uv_to_dir(real u, real v) noexcept
+    {
+        const real phi = 2 * PI_r * u, theta = PI_r * v;
+        const real sin_theta = std::sin(theta);
+        return { sin_theta * std::cos(phi),
+                 sin_theta * std::sin(phi),
+                 std::cos(theta) };
+    }
+
+    static real cos_bound(const Cone &cone, const FVec3 &nor) noexcept
+    {
+        // max |cos| between nor and directions in the cone
+
+        const real c = std::abs(dot(nor, cone.axis));
+        if(c >= cone.cos_angle)
+            return 1;
+        const real s = local_angle::cos_2_sin(c);
+        return (std::max)(
+            MIN_COS_BOUND, c * cone.cos_angle + s * cone.sin_angle);
+    }
+
+    // select child 0 with prob w0 / (w0 + w1), and reuse s
+    static int select_child(real w0, real w1, real &s) noexcept
+    {
+        constexpr real ONE_MINUS = real(1) - std::numeric_limits<real>::epsilon();
+
+        const real t = s * (w0 + w1);
+        if(t < w0 || w1 <= 0)
+        {
+            if(w0 > 0)
+                s = (std::min)(t / w0, ONE_MINUS);
+            return 0;
+        }
+        s = (std::min)((t - w0) / w1, ONE_MINUS);
+        return 1;
+    }
+
+    // weight of child (x, y) in level, or 0 when it does not exist
+    real child_weight(
+        const Level &level, int x, int y, const FVec3 *nor) const noexcept
+    {
+        if(x >= level.width || y >= level.height)
+            return 0;
+        const real w = level.weight(x, y);
+        if(nor && !level.cones.empty())
+            return w * cos_bound(level.cones[y * level.width + x], *nor);
+        return w;
+    }
+
+    void build_weights(const Texture2D &tex);
+
+    void build_pyramid();
+
+    void build_cones();
+
+    // probability of selecting texel (x, y)
+    real texel_prob(int x, int y, const FVec3 *nor) const noexcept;
+
+    std::pair<FVec3, real> sample_impl(
+        const FVec3 *nor, const Sample3 &sam) const noexcept;
+
+    real pdf_impl(const FVec3 *nor, const FVec3 &ref_to_light) const noexcept;
 
 public:
 
-    explicit EnvironmentLightSampler(RC<const Texture2D> tex)
+    explicit EnvironmentLightSampler(
+        RC<const Texture2D> tex, bool product_sampling = false)
+    {
+        product_sampling_ = product_sampling;
+
+        build_weights(*tex);
+        build_pyramid();
+        if(product_sampling_)
+            build_cones();
+    }
+
+    /**
+     * @brief integral of radiance over the unit sphere
+     */
+    const FSpectrum &radiance_integral() const noexcept
+    {
+        return radiance_integral_;
+    }
+
+    /**
+     * @brief is cosine product sampling enabled
+     */
+    bool product_sampling() const noexcept
+    {
+        return product_sampling_;
+    }
+
+    // return (ref_to_light, pdf)
+    std::pair<FVec3, real> sample(const Sample3 &sam) const noexcept
+    {
+        return sample_impl(nullptr, sam);
+    }
+
+    /**
+     * @brief sample in proportion to radiance * (bound of |cos(nor, dir)|)
+     *
+     * same as sample(sam) when product sampling is disabled
+     */
+    std::pair<FVec3, real> sample(
+        const FVec3 &nor, const Sample3 &sam) const noexcept
+    {
+        return sample_impl(product_sampling_ ? &nor : nullptr, sam);
+    }
+
+    real pdf(const FVec3 &ref_to_light) const noexcept
+    {
+        return pdf_impl(nullptr, ref_to_light);
+    }
+
+    /**
+     * @brief pdf of sample(nor, sam)
+     */
+    real pdf(const FVec3 &nor, const FVec3 &ref_to_light) const noexcept
     {
-        const int width = tex->width(), height = tex->height();
-        const int new_width  = (std::min)(width, 200);
-        const int new_height = (std::min)(height, 200);
+        return pdf_impl(product_sampling_ ? &nor : nullptr, ref_to_light);
+    }
+};
+
+inline void EnvironmentLightSampler::build_weights(const Texture2D &tex)
+{
+    const int width = tex.width(), height = tex.height();
+
+    // evaluate texel luminance & radiance integral of each row
 
-        // compute energy distribution
+    std::vector<real> lum(size_t(width) * height);
+    std::vector<FSpectrum> row_integrals(height);
 
-        std::atomic<real> lum_sum = 0;
-        probs_.initialize(new_height, new_width);
+    thread::parallel_forrange(0, height, [&](int, int y)
+    {
+        const real v0 = real(y)     / height;
+        const real v1 = real(y + 1) / height;
+        const real texel_solid_angle = solid_angle(0, real(1) / width, v0, v1);
+        const real v = (y + real(0.5)) / height;
 
-        thread::parallel_forrange(0, new_height, [&](int, int y)
+        FSpectrum row_sum;
+        for(int x = 0; x < width; ++x)
         {
-            const real y0 = real(y)     / real(new_height);
-            const real y1 = real(y + 1) / real(new_height);
+            const real u = (x + real(0.5)) / width;
+            const FSpectrum texel = tex.sample_spectrum({ u, v });
 
-            const real y0_src = y0 * height;
-            const real y1_src = y1 * height;
+            lum[size_t(y) * width + x] = (std::max)(real(0), texel.lum());
+            row_sum += texel;
+        }
 
-            const int y_src_beg = (std::max)(0, int(std::floor(y0_src) - 1));
-            const int y_src_lst = (std::min)(height - 1, int(std::floor(y1_src) + 1));
+        row_integrals[y] = texel_solid_angle * row_sum;
+    });
 
-            for(int x = 0; x < new_width; ++x)
-            {
-                const real x0 = real(x)     / new_width;
-                const real x1 = real(x + 1) / new_width;
+    radiance_integral_ = FSpectrum();
+    for(auto &r : row_integrals)
+        radiance_integral_ += r;
 
-                const real x0_src = x0 * width;
-                const real x1_src = x1 * width;
+    // cell weights
+    //
+    // radiance is bilinearly interpolated between texel centers, which
+    // spreads a texel into its neighbours. weights integrate the bilinear
+    // reconstruction over each cell, so that every direction with non-zero
+    // radiance has non-zero pdf
 
-                const int x_src_beg = (std::max)(0, int(std::floor(x0_src) - 1));
-                const int x_src_lst = (std::min)(width - 1, int(std::floor(x1_src) + 1));
+    Level level0;
+    level0.width  = width;
+    level0.height = height;
+    level0.weights.resize(size_t(width) * height);
 
-                real pixel_lum = 0;
-                for(int y_src = y_src_beg; y_src <= y_src_lst; ++y_src)
-                {
-                    for(int x_src = x_src_beg; x_src <= x_src_lst; ++x_src)
-                    {
-                        const real src_u = (real(x_src) + real(0.5)) / real(width);
-                        const real src_v = (real(y_src) + real(0.5)) / real(height);
-                        pixel_lum += tex->sample_spectrum({ src_u, src_v }).lum();
-                    }
-                }
+    auto texel_lum = [&](int x, int y)
+    {
+        x = (x + width) % width;
+        y = math::clamp(y, 0, height - 1);
+        return lum[size_t(y) * width + x];
+    };
 
-                const real delta_area = std::abs(
-                    2 * PI_r * (x1 - x0) * (std::cos(PI_r * y1)
-                  - std::cos(PI_r * y0)));
-                  
-                const real area_lum = pixel_lum * delta_area;
-                probs_(y, x) = area_lum;
-                math::atomic_add(lum_sum, area_lum);
-            }
-        });
+    std::atomic<bool> has_non_zero_weight = false;
 
-        // normalize the energy distribution
+    thread::parallel_forrange(0, height, [&](int, int y)
+    {
+        const real v0 = real(y)     / height;
+        const real v1 = real(y + 1) / height;
+        const real texel_solid_angle = solid_angle(0, real(1) / width, v0, v1);
 
-        if(lum_sum > EPS())
+        bool row_has_non_zero = false;
+        for(int x = 0; x < width; ++x)
         {
-            const real ratio = 1 / lum_sum;
-            for(int y = 0; y < new_height; ++y)
-            {
-                for(int x = 0; x < new_width; ++x)
-                    probs_(y, x) *= ratio;
-            }
+            const real center = texel_lum(x, y);
+            const real edges  = texel_lum(x - 1, y) + texel_lum(x + 1, y)
+                              + texel_lum(x, y - 1) + texel_lum(x, y + 1);
+            const real corners = texel_lum(x - 1, y - 1) + texel_lum(x + 1, y - 1)
+                               + texel_lum(x - 1, y + 1) + texel_lum(x + 1, y + 1);
+
+            const real w = texel_solid_angle
+                         * (36 * center + 6 * edges + corners) / 64;
+            level0.weights[size_t(y) * width + x] = w;
+            row_has_non_zero |= w > 0;
         }
 
-        // linearize the energy distribution
+        if(row_has_non_zero)
+            has_non_zero_weight = true;
+    });
+
+    // fall back to uniform sampling for black environment
 
-        std::vector<real> linear_probs(probs_.size().product());
-        for(int y = 0; y < new_height; ++y)
+    if(!has_non_zero_weight)
+    {
+        for(int y = 0; y < height; ++y)
         {
-            const int y_base = y * new_width;
-            for(int x = 0; x < new_width; ++x)
-            {
-                const int idx = y_base + x;
-                linear_probs[idx] = probs_(y, x);
-            }
+            const real w = solid_angle(
+                0, real(1) / width, real(y) / height, real(y + 1) / height);
+            for(int x = 0; x < width; ++x)
+                level0.weights[size_t(y) * width + x] = w;
         }
+    }
 
-        // construct sampler
+    levels_.clear();
+    levels_.push_back(std::move(level0));
+}
 
-        sampler_.initialize(linear_probs.data(), int(linear_probs.size()));
+inline void EnvironmentLightSampler::build_pyramid()
+{
+    while(levels_.back().width > 1 || levels_.back().height > 1)
+    {
+        const Level &fine = levels_.back();
+
+        Level coarse;
+        coarse.width  = (fine.width  + 1) / 2;
+        coarse.height = (fine.height + 1) / 2;
+        coarse.weights.resize(size_t(coarse.width) * coarse.height);
+
+        thread::parallel_forrange(0, coarse.height, [&](int, int y)
+        {
+            for(int x = 0; x < coarse.width; ++x)
+            {
+                const real w =
+                    (child_weight(fine, 2 * x,     2 * y,     nullptr) +
+                     child_weight(fine, 2 * x + 1, 2 * y,     nullptr)) +
+                    (child_weight(fine, 2 * x,     2 * y + 1, nullptr) +
+                     child_weight(fine, 2 * x + 1, 2 * y + 1, nullptr));
+                coarse.weights[size_t(y) * coarse.width + x] = w;
+            }
+        });
+
+        levels_.push_back(std::move(coarse));
     }
+}
 
-    // return (ref_to_light, pdf)
-    std::pair<FVec3, real> sample(const Sample3 &sam) const
+inline void EnvironmentLightSampler::build_cones()
+{
+    const int width  = levels_[0].width;
+    const int height = levels_[0].height;
+
+    for(size_t k = 0; k < levels_.size(); ++k)
     {
-        const int patch_idx = sampler_.sample(sam.u);
-        const int patch_y = patch_idx / probs_.width();
-        const int patch_x = patch_idx % probs_.width();
-        assert(patch_y < probs_.height());
-        assert(patch_x < probs_.width());
+        Level &level = levels_[k];
+        if((std::max)(level.width, level.height) > PRODUCT_RESOLUTION)
+            continue;
 
-        const real patch_pdf = probs_(patch_y, patch_x);
+        level.cones.resize(size_t(level.width) * level.height);
 
-        const real u0 = real(patch_x)     / real(probs_.width());
-        const real u1 = real(patch_x + 1) / real(probs_.width());
-        const real v0 = real(patch_y)     / real(probs_.height());
-        const real v1 = real(patch_y + 1) / real(probs_.height());
+        for(int y = 0; y < level.height; ++y)
+        {
+            for(int x = 0; x < level.width; ++x)
+            {
+                const real u0 = real(x << k) / width;
+                const real u1 = real((std::min)((x + 1) << k, width)) / width;
+                const real v0 = real(y << k) / height;
+                const real v1 = real((std::min)((y + 1) << k, height)) / height;
 
-        const auto [cvmin, cvmax] = math::minmax(
-            std::cos(PI_r * v1), std::cos(PI_r * v0));
+                Cone &cone = level.cones[y * level.width + x];
 
-        const real cos_theta = cvmin + sam.w * (cvmax - cvmin);
-        const real sin_theta = local_angle::cos_2_sin(cos_theta);
-        const real u         = math::mix(u0, u1, sam.v);
-        const real phi       = 2 * PI_r * u;
+                // wide nodes are bounded by the whole sphere
+                if(u1 - u0 > real(0.25))
+                    continue;
 
-        const FVec3 dir = {
-            sin_theta * std::cos(phi),
-            sin_theta * std::sin(phi),
-            cos_theta
-        };
-        const real in_patch_pdf = 1 / (2 * PI_r * ((u1 - u0) * (cvmax - cvmin)));
+                // bound directions on a grid over the node, with a margin
+                // covering the gaps between grid points
 
-        return { dir, patch_pdf * in_patch_pdf };
+                constexpr int N = 5;
+
+                FVec3 axis;
+                for(int i = 0; i < N; ++i)
+                {
+                    for(int j = 0; j < N; ++j)
+                    {
+                        axis += uv_to_dir(
+                            math::mix(u0, u1, real(j) / (N - 1)),
+                            math::mix(v0, v1, real(i) / (N - 1)));
+                    }
+                }
+                if(axis.length() < real(1e-4))
+                    continue;
+                axis = axis.normalize();
+
+                real max_angle = 0;
+                for(int i = 0; i < N; ++i)
+                {
+                    for(int j = 0; j < N; ++j)
+                    {
+                        const FVec3 dir = uv_to_dir(
+                            math::mix(u0, u1, real(j) / (N - 1)),
+                            math::mix(v0, v1, real(i) / (N - 1)));
+                        max_angle = (std::max)(max_angle, std::acos(
+                            math::clamp<real>(dot(axis, dir), -1, 1)));
+                    }
+                }
+
+                max_angle += (std::max)(
+                    2 * PI_r * (u1 - u0), PI_r * (v1 - v0)) / (N - 1);
+                if(max_angle >= PI_r)
+                    continue;
+
+                cone.axis      = axis;
+                cone.cos_angle = std::cos(max_angle);
+                cone.sin_angle = std::sin(max_angle);
+            }
+        }
     }
+}
 
-    real pdf(const FVec3 &ref_to_light) const
+inline real EnvironmentLightSampler::texel_prob(
+    int x, int y, const FVec3 *nor) const noexcept
+{
+    const real texel_weight = levels_[0].weight(x, y);
+    if(!nor)
+        return texel_weight / levels_.back().weights[0];
+
+    // product weighted branches of coarse levels
+
+    real prob = 1;
+    int k = static_cast<int>(levels_.size()) - 1;
+    for(; k > 0 && !levels_[k - 1].cones.empty(); --k)
     {
-        const FVec3 dir = ref_to_light.normalize();
-        const real cos_theta = local_angle::cos_theta(dir);
-        const real theta = std::acos(cos_theta);
-        const real phi = local_angle::phi(dir);
+        const Level &child = levels_[k - 1];
+        const int px = x >> k, py = y >> k;
+
+        const real sum =
+            (child_weight(child, 2 * px,     2 * py,     nor) +
+             child_weight(child, 2 * px + 1, 2 * py,     nor)) +
+            (child_weight(child, 2 * px,     2 * py + 1, nor) +
+             child_weight(child, 2 * px + 1, 2 * py + 1, nor));
+        if(sum <= 0)
+            return 0;
+
+        prob *= child_weight(child, x >> (k - 1), y >> (k - 1), nor) / sum;
+    }
 
-        const real u = phi / (2 * PI_r);
-        const real v = theta / PI_r;
+    // plain branches of finer levels
 
-        const int patch_x = (std::min)(probs_.width() - 1,
-                                       int(std::floor(u * probs_.width())));
-        const int patch_y = (std::min)(probs_.height() - 1,
-                                       int(std::floor(v * probs_.height())));
+    const real node_weight = levels_[k].weight(x >> k, y >> k);
+    return node_weight > 0 ? prob * texel_weight / node_weight : real(0);
+}
 
-        const real patch_pdf = probs_(patch_y, patch_x);
+inline std::pair<FVec3, real> EnvironmentLightSampler::sample_impl(
+    const FVec3 *nor, const Sample3 &sam) const noexcept
+{
+    // descend from the root, selecting column by u and row by v
+
+    real u = sam.u, v = sam.v;
+    int x = 0, y = 0;
+
+    for(int k = static_cast<int>(levels_.size()) - 1; k > 0; --k)
+    {
+        const Level &child = levels_[k - 1];
 
-        const real u0 = real(patch_x)     / real(probs_.width());
-        const real u1 = real(patch_x + 1) / real(probs_.width());
-        const real v0 = real(patch_y)     / real(probs_.height());
-        const real v1 = real(patch_y + 1) / real(probs_.height());
+        const real w00 = child_weight(child, 2 * x,     2 * y,     nor);
+        const real w10 = child_weight(child, 2 * x + 1, 2 * y,     nor);
+        const real w01 = child_weight(child, 2 * x,     2 * y + 1, nor);
+        const real w11 = child_weight(child, 2 * x + 1, 2 * y + 1, nor);
 
-        const auto [cvmin, cvmax] = math::minmax(
-            std::cos(PI_r * v1), std::cos(PI_r * v0));
-        
-        const real in_patch_pdf = 1 / (2 * PI_r * ((u1 - u0) * (cvmax - cvmin)));
+        const int dx = select_child(w00 + w01, w10 + w11, u);
+        const int dy = dx ? select_child(w10, w11, v)
+                          : select_child(w00, w01, v);
 
-        return patch_pdf * in_patch_pdf;
+        x = 2 * x + dx;
+        y = 2 * y + dy;
     }
-};
+
+    const real prob = texel_prob(x, y, nor);
+    if(prob <= 0)
+        return { FVec3(0, 0, 1), 0 };
+
+    // uniformly sample the solid angle of texel
+
+    const Level &level0 = levels_[0];
+
+    const real u0 = real(x)     / level0.width;
+    const real u1 = real(x + 1) / level0.width;
+    const real v0 = real(y)     / level0.height;
+    const real v1 = real(y + 1) / level0.height;
+
+    const auto [cvmin, cvmax] = math::minmax(
+        std::cos(PI_r * v1), std::cos(PI_r * v0));
+
+    const real cos_theta = cvmin + sam.w * (cvmax - cvmin);
+    const real sin_theta = local_angle::cos_2_sin(cos_theta);
+    const real phi       = 2 * PI_r * math::mix(u0, u1, u);
+
+    const FVec3 dir = {
+        sin_theta * std::cos(phi),
+        sin_theta * std::sin(phi),
+        cos_theta
+    };
+
+    return { dir, prob / solid_angle(u0, u1, v0, v1) };
+}
+
+inline real EnvironmentLightSampler::pdf_impl(
+    const FVec3 *nor, const FVec3 &ref_to_light) const noexcept
+{
+    const FVec3 dir = ref_to_light.normalize();
+    const real cos_theta = local_angle::cos_theta(dir);
+    const real theta = std::acos(math::clamp<real>(cos_theta, -1, 1));
+    const real phi = local_angle::phi(dir);
+
+    const real u = phi / (2 * PI_r);
+    const real v = theta / PI_r;
+
+    const Level &level0 = levels_[0];
+    const int x = math::clamp(
+        static_cast<int>(std::floor(u * level0.width)), 0, level0.width - 1);
+    const int y = math::clamp(
+        static_cast<int>(std::floor(v * level0.height)), 0, level0.height - 1);
+
+    const real u0 = real(x)     / level0.width;
+    const real u1 = real(x + 1) / level0.width;
+    const real v0 = real(y)     / level0.height;
+    const real v1 = real(y + 1) / level0.height;
+
+    return texel_prob(x, y, nor) / solid_angle(u0, u1, v0, v1);
+}
 
 AGZ_TRACER_END
@@ -8,9 +8,11 @@ class BoxFilter : public FilmFilter
     real radius_ = 0;
     real value_  = 1;
 
+    bool importance_sampling_ = false;
+
 public:
 
-    explicit BoxFilter(real radius)
+    BoxFilter(real radius, bool importance_sampling)
     {
         AGZ_HIERARCHY_TRY
 
@@ -19,6 +21,8 @@ public:
             throw ObjectConstructionException("invalid radius");
         value_ = 1 / (4 * radius_ * radius_);
 
+        importance_sampling_ = importance_sampling;
+
         AGZ_HIERARCHY_WRAP("in initializing box filter")
     }
 
@@ -31,12 +35,22 @@ public:
     {
         return value_;
     }
+
+    Vec2 sample(const Sample2 &sam) const noexcept override
+    {
+        return { (2 * sam.u - 1) * radius_, (2 * sam.v - 1) * radius_ };
+    }
+
+    bool importance_sampling() const noexcept override
+    {
+        return importance_sampling_;
+    }
 };
 
 RC<FilmFilter> create_box_filter(
-    real radius)
+    real radius, bool importance_sampling)
 {
-    return newRC<BoxFilter>(radius);
+    return newRC<BoxFilter>(radius, importance_sampling);
 }
 
 AGZ_TRACER_END
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <agz/tracer/common.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief tabulated filter function over [-radius, radius]^2
+ *
+ * the filter is assumed to be symmetric about both axes, so only the quadrant
+ * [0, radius]^2 is stored. each cell holds the function value at its center,
+ * and the table is normalized to unit integral.
+ *
+ * the table is also a piecewise-constant distribution, from which offsets are
+ * sampled with pdf equal to the tabulated value
+ */
+class FilmFilterTable
+{
+public:
+
+    // cells per axis in [0, radius]
+    static constexpr int RESOLUTION = 64;
+
+    /**
+     * @param func non-negative function value at (x, y), where x, y >= 0
+     */
+    template<typename Func>
+    FilmFilterTable(real radius, const Func &func);
+
+    /**
+     * @brief lookup the normalized function value
+     */
+    real eval(real x, real y) const noexcept;
+
+    /**
+     * @brief sample an offset in [-radius, radius]^2 with pdf = eval(offset)
+     */
+    Vec2 sample(const Sample2 &sam) const noexcept;
+
+private:
+
+    // select a cell with given cdf and remap u to a sample in the cell
+    static int select(const real *cdf, real &u) noexcept;
+
+    real radius_        = 0;
+    real cell_size_     = 0;
+    real inv_cell_size_ = 0;
+
+    // RESOLUTION * RESOLUTION values, in row-major order
+    std::vector<real> values_;
+
+    // marginal cdf of rows, RESOLUTION + 1 entries
+    std::vector<real> row_cdf_;
+
+    // conditional cdf of cells in each row, RESOLUTION * (RESOLUTION + 1)
+    std::vector<real> col_cdf_;
+};
+
+template<typename Func>
+FilmFilterTable::FilmFilterTable(real radius, const Func &func)
+    : radius_(radius)
+{
+    cell_size_     = radius / RESOLUTION;
+    inv_cell_size_ = 1 / cell_size_;
+
+    values_.resize(RESOLUTION * RESOLUTION);
+    row_cdf_.resize(RESOLUTION + 1);
+    col_cdf_.resize(RESOLUTION * (RESOLUTION + 1));
+
+    real sum = 0;
+    for(int y = 0; y < RESOLUTION; ++y)
+    {
+        const real cy = (y + real(0.5)) * cell_size_;
+
+        real *col_cdf = &col_cdf_[y * (RESOLUTION + 1)];
+        col_cdf[0] = 0;
+
+        for(int x = 0; x < RESOLUTION; ++x)
+        {
+            const real cx = (x + real(0.5)) * cell_size_;
+            const real value = (std::max)(real(0), real(func(cx, cy)));
+
+            values_[y * RESOLUTION + x] = value;
+            col_cdf[x + 1] = col_cdf[x] + value;
+        }
+
+        row_cdf_[y + 1] = row_cdf_[y] + col_cdf[RESOLUTION];
+        sum += col_cdf[RESOLUTION];
+    }
+
+    // fallback to a box filter when the function vanishes everywhere
+
+    if(sum <= 0)
+    {
+        for(int y = 0; y < RESOLUTION; ++y)
+        {
+            real *col_cdf = &col_cdf_[y * (RESOLUTION + 1)];
+            for(int x = 0; x < RESOLUTION; ++x)
+            {
+                values_[y * RESOLUTION + x] = 1;
+                col_cdf[x + 1] = real(x + 1);
+            }
+            row_cdf_[y + 1] = real((y + 1) * RESOLUTION);
+        }
+        sum = real(RESOLUTION * RESOLUTION);
+    }
+
+    // the table covers a quarter of the filter domain
+
+    const real norm = 1 / (4 * sum * cell_size_ * cell_size_);
+    for(auto &v : values_)
+        v *= norm;
+
+    for(int y = 0; y < RESOLUTION; ++y)
+    {
+        real *col_cdf = &col_cdf_[y * (RESOLUTION + 1)];
+        const real row_sum = col_cdf[RESOLUTION];
+        if(row_sum <= 0)
+            continue;
+        for(int x = 1; x < RESOLUTION; ++x)
+            col_cdf[x] /= row_sum;
+        col_cdf[RESOLUTION] = 1;
+    }
+
+    for(int y = 1; y < RESOLUTION; ++y)
+        row_cdf_[y] /= sum;
+    row_cdf_[RESOLUTION] = 1;
+}
+
+inline real FilmFilterTable::eval(real x, real y) const noexcept
+{
+    x = std::abs(x);
+    y = std::abs(y);
+    if(x > radius_ || y > radius_)
+        return 0;
+
+    const int ix = (std::min)(
+        static_cast<int>(x * inv_cell_size_), RESOLUTION - 1);
+    const int iy = (std::min)(
+        static_cast<int>(y * inv_cell_size_), RESOLUTION - 1);
+    return values_[iy * RESOLUTION + ix];
+}
+
+inline Vec2 FilmFilterTable::sample(const Sample2 &sam) const noexcept
+{
+    // the leading bit of each sample dimension selects the quadrant
+
+    real u = sam.u, v = sam.v;
+
+    const real sign_x = u < real(0.5) ? real(-1) : real(1);
+    u = sign_x < 0 ? 2 * u : 2 * u - 1;
+
+    const real sign_y = v < real(0.5) ? real(-1) : real(1);
+    v = sign_y < 0 ? 2 * v : 2 * v - 1;
+
+    const int y = select(row_cdf_.data(), v);
+    const int x = select(&col_cdf_[y * (RESOLUTION + 1)], u);
+
+    return {
+        sign_x * (x + u) * cell_size_,
+        sign_y * (y + v) * cell_size_
+    };
+}
+
+inline int FilmFilterTable::select(const real *cdf, real &u) noexcept
+{
+    constexpr real ONE_MINUS = real(1) - std::numeric_limits<real>::epsilon();
+
+    u = math::clamp<real>(u, 0, ONE_MINUS);
+
+    // cells with zero probability are never selected, as cdf[i] == cdf[i + 1]
+    const int idx = (std::min)(
+        static_cast<int>(
+            std::upper_bound(cdf + 1, cdf + RESOLUTION + 1, u) - (cdf + 1)),
+        RESOLUTION - 1);
+
+    const real width = cdf[idx + 1] - cdf[idx];
+    u = width > 0 ? math::clamp<real>((u - cdf[idx]) / width, 0, ONE_MINUS)
+                  : real(0.5);
+    return idx;
+}
+
+AGZ_TRACER_END
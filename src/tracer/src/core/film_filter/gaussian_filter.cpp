@@ -1,45 +1,22 @@
-#include <random>
-
 #include <agz/tracer/core/film_filter.h>
 #include <agz/utility/misc.h>
 
+#include "./filter_table.h"
+
 AGZ_TRACER_BEGIN
 
 class GaussianFilter : public FilmFilter
 {
     real radius_ = 0;
-    real alpha_  = 0;
-    real exp_    = 0;
-
-    real norm_factor_ = 1;
-
-    void init_norm_factor()
-    {
-        norm_factor_ = 1;
-
-        std::default_random_engine rng(42);
-        std::uniform_real_distribution<real> dis(-radius_, radius_);
 
-        const real pdf = 1 / (4 * radius_ * radius_);
+    // normalized filter values, precomputed to avoid std::exp in eval
+    Box<FilmFilterTable> table_;
 
-        real sum = 0;
-
-        const int N = 100000;
-        for(int i = 0; i < N; ++i)
-        {
-            const real x = dis(rng);
-            const real y = dis(rng);
-            const real f = eval(x, y);
-            sum += f / pdf;
-        }
-
-        if(sum > 0)
-            norm_factor_ = N / sum;
-    }
+    bool importance_sampling_ = false;
 
 public:
 
-    GaussianFilter(real radius, real alpha)
+    GaussianFilter(real radius, real alpha, bool importance_sampling)
     {
         if(radius <= 0)
             throw ObjectConstructionException(
@@ -50,10 +27,19 @@ public:
                 "invalid alpha value: " + std::to_string(alpha));
 
         radius_ = radius;
-        alpha_  = alpha;
-        exp_    = std::exp(-alpha * radius * radius);
 
-        init_norm_factor();
+        const real expv = std::exp(-alpha * radius * radius);
+        auto gaussian = [&](real d)
+        {
+            return (std::max)(real(0), real(std::exp(-alpha * d * d) - expv));
+        };
+
+        table_ = newBox<FilmFilterTable>(radius, [&](real x, real y)
+        {
+            return gaussian(x) * gaussian(y);
+        });
+
+        importance_sampling_ = importance_sampling;
     }
 
     real radius() const noexcept override
@@ -63,18 +49,24 @@ public:
 
     real eval(real rel_x, real rel_y) const noexcept override
     {
-        static auto gaussian = [](real d, real expv, real alpha)
-        {
-            return (std::max)(real(0), real(std::exp(-alpha * d * d) - expv));
-        };
-        return norm_factor_ * gaussian(rel_x, exp_, alpha_) * gaussian(rel_y, exp_, alpha_);
+        return table_->eval(rel_x, rel_y);
+    }
+
+    Vec2 sample(const Sample2 &sam) const noexcept override
+    {
+        return table_->sample(sam);
+    }
+
+    bool importance_sampling() const noexcept override
+    {
+        return importance_sampling_;
     }
 };
 
 RC<FilmFilter> create_gaussian_filter(
-    real radius, real alpha)
+    real radius, real alpha, bool importance_sampling)
 {
-    return newRC<GaussianFilter>(radius, alpha);
+    return newRC<GaussianFilter>(radius, alpha, importance_sampling);
 }
 
 AGZ_TRACER_END
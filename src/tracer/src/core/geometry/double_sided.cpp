@@ -7,6 +7,16 @@ class DoubleSidedGeometry : public Geometry
 {
     RC<const Geometry> internal_;
 
+    static void flip_backface(GeometryIntersection *inct) noexcept
+    {
+        const bool backface = dot(inct->geometry_coord.z, inct->wr) < 0;
+        if(backface)
+        {
+            inct->geometry_coord = -inct->geometry_coord;
+            inct->user_coord     = -inct->user_coord;
+        }
+    }
+
 public:
 
     explicit DoubleSidedGeometry(RC<const Geometry> internal)
@@ -24,17 +34,19 @@ public:
     {
         if(!internal_->closest_intersection(r, inct))
             return false;
-
-        const bool backface = dot(inct->geometry_coord.z, inct->wr) < 0;
-        if(backface)
-        {
-            inct->geometry_coord = -inct->geometry_coord;
-            inct->user_coord     = -inct->user_coord;
-        }
-
+        flip_backface(inct);
         return true;
     }
 
+    int random_intersection(
+        const Ray &r, real u, GeometryIntersection *inct) const noexcept override
+    {
+        const int count = internal_->random_intersection(r, u, inct);
+        if(count)
+            flip_backface(inct);
+        return count;
+    }
+
     AABB world_bound() const noexcept override
     {
         return internal_->world_bound();
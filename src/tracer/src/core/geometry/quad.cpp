@@ -40,6 +40,7 @@ public:
             inct->user_coord     = inct->geometry_coord;
             inct->wr             = -r.d;
             inct->t              = inct_rcd.t_ray;
+            triangle_dpduv(b_a_, c_a_, t_b_a_, t_c_a_, &inct->dpdu, &inct->dpdv);
             return true;
         }
         
@@ -51,6 +52,7 @@ public:
             inct->user_coord     = inct->geometry_coord;
             inct->wr             = -r.d;
             inct->t              = inct_rcd.t_ray;
+            triangle_dpduv(c_a_, d_a_, t_c_a_, t_d_a_, &inct->dpdu, &inct->dpdv);
             return true;
         }
 
@@ -81,9 +83,63 @@ public:
     {
         const Vec2 bi_coord = math::distribution
                                 ::uniform_on_triangle(sam.u, sam.v);
+
+        *pdf = 1 / surface_area_;
+        return surface_point(sam.w < sample_abc_prob_, bi_coord);
+    }
+
+    SurfacePoint sample(
+        const FVec3 &ref, real *pdf, const Sample3 &sam) const noexcept override
+    {
+        // the quad is sampled as two spherical triangles, which is uniform
+        // w.r.t. the solid angle of the whole quad
+
+        const real solid_angle_abc = triangle_sampling_solid_angle(
+            ref, a_, b_a_, c_a_);
+        const real solid_angle_acd = triangle_sampling_solid_angle(
+            ref, a_, c_a_, d_a_);
+        if(!solid_angle_abc || !solid_angle_acd)
+            return sample(pdf, sam);
+
+        const real solid_angle = solid_angle_abc + solid_angle_acd;
+        const bool abc = sam.w * solid_angle < solid_angle_abc;
+
+        const Vec2 bi_coord = abc ?
+            sample_triangle_solid_angle(
+                ref, a_, b_a_, c_a_, solid_angle_abc, sam.u, sam.v) :
+            sample_triangle_solid_angle(
+                ref, a_, c_a_, d_a_, solid_angle_acd, sam.u, sam.v);
+
+        SurfacePoint spt = surface_point(abc, bi_coord);
+        *pdf = solid_angle_sample_area_pdf(ref, spt.pos, z_, solid_angle);
+        return spt;
+    }
+
+    real pdf(const FVec3 &) const noexcept override
+    {
+        return 1 / surface_area_;
+    }
+
+    real pdf(const FVec3 &ref, const FVec3 &sample) const noexcept override
+    {
+        const real solid_angle_abc = triangle_sampling_solid_angle(
+            ref, a_, b_a_, c_a_);
+        const real solid_angle_acd = triangle_sampling_solid_angle(
+            ref, a_, c_a_, d_a_);
+        if(!solid_angle_abc || !solid_angle_acd)
+            return pdf(sample);
+
+        return solid_angle_sample_area_pdf(
+            ref, sample, z_, solid_angle_abc + solid_angle_acd);
+    }
+
+private:
+
+    SurfacePoint surface_point(bool abc, const Vec2 &bi_coord) const noexcept
+    {
         SurfacePoint spt;
 
-        if(sam.w < sample_abc_prob_)
+        if(abc)
         {
             spt.pos = a_ + bi_coord.x * b_a_ + bi_coord.y * c_a_;
             spt.geometry_coord = FCoord(x_abc_, cross(z_, x_abc_), z_);
@@ -100,27 +156,8 @@ public:
             spt.user_coord = spt.geometry_coord;
         }
 
-        *pdf = 1 / surface_area_;
         return spt;
     }
-
-    SurfacePoint sample(
-        const FVec3 &, real *pdf, const Sample3 &sam) const noexcept override
-    {
-        return sample(pdf, sam);
-    }
-
-    real pdf(const FVec3 &) const noexcept override
-    {
-        return 1 / surface_area_;
-    }
-
-    real pdf(const FVec3 &, const FVec3 &sample) const noexcept override
-    {
-        return pdf(sample);
-    }
-
-private:
     
     FVec3 a_;
     FVec3 b_a_, c_a_, d_a_;
@@ -29,6 +29,24 @@ class TransformWrapper : public Geometry
         world_bound_ |= local_to_world_.apply_to_point({ H.x, H.y, H.z });
     }
 
+    Ray to_local(const Ray &r) const noexcept
+    {
+        return Ray(
+            local_to_world_.apply_inverse_to_point(r.o),
+            local_to_world_.apply_inverse_to_vector(r.d),
+            r.t_min, r.t_max);
+    }
+
+    void to_world(const Ray &r, GeometryIntersection *inct) const noexcept
+    {
+        inct->pos            = local_to_world_.apply_to_point(inct->pos);
+        inct->geometry_coord = local_to_world_.apply_to_coord(inct->geometry_coord);
+        inct->user_coord     = local_to_world_.apply_to_coord(inct->user_coord);
+        inct->wr             = -r.d;
+        inct->dpdu           = local_to_world_.apply_to_vector(inct->dpdu);
+        inct->dpdv           = local_to_world_.apply_to_vector(inct->dpdv);
+    }
+
 public:
 
     TransformWrapper(
@@ -40,33 +58,27 @@ public:
 
     bool has_intersection(const Ray &r) const noexcept override
     {
-        const Ray local_r(
-            local_to_world_.apply_inverse_to_point(r.o),
-            local_to_world_.apply_inverse_to_vector(r.d),
-           r.t_min, r.t_max);
-
-        return internal_->has_intersection(local_r);
+        return internal_->has_intersection(to_local(r));
     }
 
     bool closest_intersection(
         const Ray &r, GeometryIntersection *inct) const noexcept override
     {
-        const Ray local_r(
-            local_to_world_.apply_inverse_to_point(r.o),
-            local_to_world_.apply_inverse_to_vector(r.d),
-            r.t_min, r.t_max);
-
-        if(!internal_->closest_intersection(local_r, inct))
+        if(!internal_->closest_intersection(to_local(r), inct))
             return false;
-
-        inct->pos            = local_to_world_.apply_to_point(inct->pos);
-        inct->geometry_coord = local_to_world_.apply_to_coord(inct->geometry_coord);
-        inct->user_coord     = local_to_world_.apply_to_coord(inct->user_coord);
-        inct->wr             = -r.d;
-
+        to_world(r, inct);
         return true;
     }
 
+    int random_intersection(
+        const Ray &r, real u, GeometryIntersection *inct) const noexcept override
+    {
+        const int count = internal_->random_intersection(to_local(r), u, inct);
+        if(count)
+            to_world(r, inct);
+        return count;
+    }
+
     AABB world_bound() const noexcept override
     {
         return world_bound_;
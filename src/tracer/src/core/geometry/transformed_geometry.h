@@ -61,7 +61,9 @@ inline void TransformedGeometry::to_world(SurfacePoint *spt) const noexcept
 inline void TransformedGeometry::to_world(GeometryIntersection *inct) const noexcept
 {
     to_world(static_cast<SurfacePoint*>(inct));
-    inct->wr = local_to_world_.apply_to_vector(inct->wr);
+    inct->wr   = local_to_world_.apply_to_vector(inct->wr);
+    inct->dpdu = local_to_world_.apply_to_vector(inct->dpdu);
+    inct->dpdv = local_to_world_.apply_to_vector(inct->dpdv);
 }
 
 inline AABB TransformedGeometry::to_world(const AABB &local_aabb) const noexcept
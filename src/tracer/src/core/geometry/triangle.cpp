@@ -45,6 +45,8 @@ public:
         inct->wr             = -local_r.d;
         inct->t              = inct_rcd.t_ray;
 
+        triangle_dpduv(b_a_, c_a_, t_b_a_, t_c_a_, &inct->dpdu, &inct->dpdv);
+
         to_world(inct);
 
         return true;
@@ -74,22 +76,29 @@ public:
         const Vec2 bi_coord = math::distribution
                                 ::uniform_on_triangle(sam.u, sam.v);
 
-        SurfacePoint spt;
-        spt.pos            = a_ + bi_coord.x * b_a_ + bi_coord.y * c_a_;
-        spt.geometry_coord = FCoord(x_, cross(z_, x_), z_);
-        spt.uv             = t_a_ + bi_coord.x * t_b_a_ + bi_coord.y * t_c_a_;
-        spt.user_coord     = spt.geometry_coord;
-
-        to_world(&spt);
-
         *pdf = 1 / surface_area_;
-        return spt;
+        return surface_point(bi_coord);
     }
 
     SurfacePoint sample(
-        const FVec3 &, real *pdf, const Sample3 &sam) const noexcept override
+        const FVec3 &ref, real *pdf, const Sample3 &sam) const noexcept override
     {
-        return sample(pdf, sam);
+        const FVec3 local_ref = local_to_world_.apply_inverse_to_point(ref);
+        const real solid_angle = triangle_sampling_solid_angle(
+            local_ref, a_, b_a_, c_a_);
+        if(!solid_angle)
+            return sample(pdf, sam);
+
+        const Vec2 bi_coord = sample_triangle_solid_angle(
+            local_ref, a_, b_a_, c_a_, solid_angle, sam.u, sam.v);
+        const FVec3 local_pos = a_ + bi_coord.x * b_a_ + bi_coord.y * c_a_;
+
+        // solid angle is invariant under similarity transforms
+        const real ratio2 = local_to_world_ratio_ * local_to_world_ratio_;
+        *pdf = solid_angle_sample_area_pdf(
+            local_ref, local_pos, z_, solid_angle) / ratio2;
+
+        return surface_point(bi_coord);
     }
 
     real pdf(const FVec3 &) const noexcept override
@@ -97,13 +106,34 @@ public:
         return 1 / surface_area_;
     }
 
-    real pdf(const FVec3 &, const FVec3 &sample) const noexcept override
+    real pdf(const FVec3 &ref, const FVec3 &sample) const noexcept override
     {
-        return pdf(sample);
+        const FVec3 local_ref = local_to_world_.apply_inverse_to_point(ref);
+        const real solid_angle = triangle_sampling_solid_angle(
+            local_ref, a_, b_a_, c_a_);
+        if(!solid_angle)
+            return pdf(sample);
+
+        const FVec3 local_pos = local_to_world_.apply_inverse_to_point(sample);
+        const real ratio2 = local_to_world_ratio_ * local_to_world_ratio_;
+        return solid_angle_sample_area_pdf(
+            local_ref, local_pos, z_, solid_angle) / ratio2;
     }
 
 private:
 
+    SurfacePoint surface_point(const Vec2 &bi_coord) const noexcept
+    {
+        SurfacePoint spt;
+        spt.pos            = a_ + bi_coord.x * b_a_ + bi_coord.y * c_a_;
+        spt.geometry_coord = FCoord(x_, cross(z_, x_), z_);
+        spt.uv             = t_a_ + bi_coord.x * t_b_a_ + bi_coord.y * t_c_a_;
+        spt.user_coord     = spt.geometry_coord;
+
+        to_world(&spt);
+        return spt;
+    }
+
     void init_from_params(const Params &params)
     {
         init_transform(params.local_to_world);
@@ -1,15 +1,30 @@
-﻿#include <limits>
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
 #include <queue>
 #include <stack>
+#include <type_traits>
 #include <vector>
 
+#include <agz/tracer/create/geometry.h>
+#include <agz/tracer/utility/emitter_bvh.h>
 #include <agz/tracer/utility/logger.h>
+#include <agz/tracer/utility/mapped_file.h>
+#include <agz/tracer/utility/parallel_grid.h>
 #include <agz/tracer/utility/triangle_aux.h>
 
 #include <agz/utility/mesh.h>
 #include <agz/utility/misc.h>
 
 #include "./transformed_geometry.h"
+#include "./wide_bvh.h"
 
 AGZ_TRACER_BEGIN
 
@@ -110,6 +125,7 @@ namespace
     struct BuildingTriangle
     {
         const mesh::vertex_t *vtx = nullptr;
+        AABB bound;
         Vec3 centroid;
     };
 
@@ -119,9 +135,72 @@ namespace
         uint32_t node_count;
     };
 
-    BuildingResult build_bvh(
-        BuildingTriangle *triangles, uint32_t triangle_count,
-        uint32_t leaf_size_threshold, uint32_t depth_threshold, Arena &arena)
+    real aabb_surface_area(const AABB &bound) noexcept
+    {
+        const FVec3 d = bound.high - bound.low;
+        if(d.x < 0 || d.y < 0 || d.z < 0)
+            return 0;
+        return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // max number of sah bins on each axis
+    constexpr int MAX_SAH_BIN_COUNT = 64;
+
+    // nodes with more triangles are binned with all worker threads
+    constexpr uint32_t PARALLEL_BINNING_THRESHOLD = 1 << 16;
+
+    // triangle count of each parallel binning task
+    constexpr int PARALLEL_BINNING_GRID_SIZE = 1 << 14;
+
+    // nodes with fewer triangles are never divided into more parallel subtrees
+    constexpr uint32_t PARALLEL_SUBTREE_THRESHOLD = 1 << 12;
+
+    struct SAHBin
+    {
+        AABB bound;
+        uint32_t count = 0;
+    };
+
+    // sah bins of all three axes
+    struct SAHBins
+    {
+        SAHBin bins[3][MAX_SAH_BIN_COUNT];
+
+        SAHBins &operator+=(const SAHBins &rhs) noexcept
+        {
+            for(int axis = 0; axis < 3; ++axis)
+            {
+                for(int i = 0; i < MAX_SAH_BIN_COUNT; ++i)
+                {
+                    bins[axis][i].bound |= rhs.bins[axis][i].bound;
+                    bins[axis][i].count += rhs.bins[axis][i].count;
+                }
+            }
+            return *this;
+        }
+    };
+
+    struct RangeBound
+    {
+        AABB all_bound;
+        AABB centroid_bound;
+
+        RangeBound &operator|=(const RangeBound &rhs) noexcept
+        {
+            all_bound      |= rhs.all_bound;
+            centroid_bound |= rhs.centroid_bound;
+            return *this;
+        }
+    };
+
+    /**
+     * @brief binned sah bvh builder
+     *
+     * nodes near the root are divided on the calling thread with parallel
+     * binning. once there are enough independent subtrees, they are built
+     * parallelly with one arena per worker thread.
+     */
+    class SAHBVHBuilder
     {
         struct BuildingTask
         {
@@ -130,34 +209,135 @@ namespace
             uint32_t depth;
         };
 
-        BuildingResult ret = { nullptr, 0 };
+        BuildingTriangle *triangles_;
+        const TriangleBVHParams &params_;
 
-        std::queue<BuildingTask> tasks;
-        tasks.push({ &ret.root, 0, triangle_count, 0 });
+        int bin_count_;
+        uint32_t leaf_size_threshold_;
+        uint32_t max_leaf_size_;
+        uint32_t depth_threshold_;
 
-        while(!tasks.empty())
+        int thread_count_;
+        thread::thread_group_t threads_;
+
+        RangeBound compute_range_bound(
+            uint32_t start, uint32_t end, bool parallel)
         {
-            const BuildingTask task = tasks.front();
-            tasks.pop();
+            auto compute = [&](uint32_t beg, uint32_t last)
+            {
+                RangeBound ret;
+                for(uint32_t i = beg; i < last; ++i)
+                {
+                    ret.all_bound      |= triangles_[i].bound;
+                    ret.centroid_bound |= triangles_[i].centroid;
+                }
+                return ret;
+            };
 
-            assert(task.start < task.end);
+            if(!parallel)
+                return compute(start, end);
+
+            std::vector<RangeBound> perthread_bound(thread_count_);
+            parallel_for_1d_grid(
+                thread_count_, static_cast<int>(end - start),
+                PARALLEL_BINNING_GRID_SIZE, threads_,
+                [&](int thread_index, int beg, int last)
+            {
+                perthread_bound[thread_index] |= compute(
+                    start + static_cast<uint32_t>(beg),
+                    start + static_cast<uint32_t>(last));
+            });
+
+            RangeBound ret;
+            for(auto &b : perthread_bound)
+                ret |= b;
+            return ret;
+        }
+
+        int bin_index(real centroid, real low, real scale) const noexcept
+        {
+            const int idx = static_cast<int>((centroid - low) * scale);
+            return math::clamp(idx, 0, bin_count_ - 1);
+        }
+
+        void compute_bins(
+            uint32_t start, uint32_t end, const AABB &centroid_bound,
+            const real *scale, const bool *axis_enabled,
+            bool parallel, SAHBins *output)
+        {
+            auto compute = [&](uint32_t beg, uint32_t last, SAHBins &bins)
+            {
+                for(uint32_t i = beg; i < last; ++i)
+                {
+                    const BuildingTriangle &tri = triangles_[i];
+                    for(int axis = 0; axis < 3; ++axis)
+                    {
+                        if(!axis_enabled[axis])
+                            continue;
+                        const int idx = bin_index(
+                            tri.centroid[axis], centroid_bound.low[axis],
+                            scale[axis]);
+                        bins.bins[axis][idx].bound |= tri.bound;
+                        ++bins.bins[axis][idx].count;
+                    }
+                }
+            };
 
-            AABB all_bound, centroid_bound;
-            for(uint32_t i = task.start; i < task.end; ++i)
+            if(!parallel)
             {
-                auto &tri = triangles[i];
-                all_bound |= tri.vtx[0].position;
-                all_bound |= tri.vtx[1].position;
-                all_bound |= tri.vtx[2].position;
-                centroid_bound |= tri.centroid;
+                compute(start, end, *output);
+                return;
             }
 
-            // construct leaf node when triangle count is sufficiently low
-            const uint32_t n = task.end - task.start;
-            if(n <= leaf_size_threshold)
+            std::vector<SAHBins> perthread_bins(thread_count_);
+            parallel_for_1d_grid(
+                thread_count_, static_cast<int>(end - start),
+                PARALLEL_BINNING_GRID_SIZE, threads_,
+                [&](int thread_index, int beg, int last)
+            {
+                compute(
+                    start + static_cast<uint32_t>(beg),
+                    start + static_cast<uint32_t>(last),
+                    perthread_bins[thread_index]);
+            });
+
+            for(auto &b : perthread_bins)
+                *output += b;
+        }
+
+        // split [start, end) at the median centroid along the given axis
+        uint32_t median_split(uint32_t start, uint32_t end, int axis)
+        {
+            const uint32_t middle = start + (end - start) / 2;
+            std::nth_element(
+                triangles_ + start, triangles_ + middle, triangles_ + end,
+                [axis](const BuildingTriangle &L, const BuildingTriangle &R)
             {
-                ++ret.node_count;
+                return L.centroid[axis] < R.centroid[axis];
+            });
+            return middle;
+        }
 
+        /**
+         * @brief create node for given task
+         *
+         * @return true when an interior node is created and its two children
+         *  are filled into 'children'
+         */
+        bool process_task(
+            const BuildingTask &task, Arena &arena, bool parallel,
+            BuildingTask children[2], uint32_t *node_count)
+        {
+            assert(task.start < task.end);
+
+            const uint32_t n = task.end - task.start;
+            const RangeBound range_bound = compute_range_bound(
+                task.start, task.end, parallel);
+            const AABB &all_bound      = range_bound.all_bound;
+            const AABB &centroid_bound = range_bound.centroid_bound;
+
+            auto create_leaf = [&]
+            {
                 auto leaf = arena.create<BuildingNode>();
                 leaf->bounding = all_bound;
                 leaf->left     = nullptr;
@@ -166,43 +346,131 @@ namespace
                 leaf->end      = task.end;
 
                 *task.fillback_ptr = leaf;
+                ++*node_count;
+            };
 
-                continue;
+            // construct leaf node when triangle count is sufficiently low
+            if(n <= leaf_size_threshold_)
+            {
+                create_leaf();
+                return false;
             }
 
-            // select the split axis with max extent
             const FVec3 centroid_delta = centroid_bound.high - centroid_bound.low;
-            const int split_axis = centroid_delta[0] > centroid_delta[1] ?
+            const int max_extent_axis = centroid_delta[0] > centroid_delta[1] ?
                 (centroid_delta[0] > centroid_delta[2] ? 0 : 2) :
                 (centroid_delta[1] > centroid_delta[2] ? 1 : 2);
 
-            // divide the axis with centroid position when recursive depth is
-            // small. otherwise, divide with triangle count
-            uint32_t split_middle;
-            if(task.depth < depth_threshold)
+            uint32_t split_middle = task.start;
+
+            if(task.depth >= depth_threshold_ ||
+               centroid_delta[max_extent_axis] <= 0)
             {
-                const real split_pos = real(0.5) * (
-                    centroid_bound.high[split_axis] + centroid_bound.low[split_axis]);
-                split_middle = task.start;
-                for(uint32_t i = task.start; i < task.end; ++i)
+                // sah is meaningless when all centroids coincide, and deep
+                // trees are balanced to bound the traversal stack size
+
+                if(n <= max_leaf_size_)
                 {
-                    if(triangles[i].centroid[split_axis] < split_pos)
-                        std::swap(triangles[i], triangles[split_middle++]);
+                    create_leaf();
+                    return false;
                 }
 
-                if(split_middle == task.start || split_middle == task.end)
-                    split_middle = task.start + n / 2;
+                split_middle = median_split(
+                    task.start, task.end, max_extent_axis);
             }
             else
             {
-                std::sort(
-                    triangles + task.start, triangles + task.end,
-                    [axis = split_axis]
-                    (const BuildingTriangle &L, const BuildingTriangle &R)
+                bool axis_enabled[3];
+                real scale[3];
+                for(int axis = 0; axis < 3; ++axis)
+                {
+                    axis_enabled[axis] =
+                        centroid_delta[axis] > 0 &&
+                        (params_.sah_all_axes || axis == max_extent_axis);
+                    scale[axis] = axis_enabled[axis] ?
+                        bin_count_ / centroid_delta[axis] : real(0);
+                }
+
+                SAHBins bins;
+                compute_bins(
+                    task.start, task.end, centroid_bound,
+                    scale, axis_enabled, parallel, &bins);
+
+                // find the split with min sah cost
+
+                const real inv_parent_area = 1 / (std::max)(
+                    aabb_surface_area(all_bound),
+                    std::numeric_limits<real>::min());
+
+                int best_axis = -1, best_bin = -1;
+                real best_cost = REAL_INF;
+
+                for(int axis = 0; axis < 3; ++axis)
+                {
+                    if(!axis_enabled[axis])
+                        continue;
+
+                    const SAHBin *axis_bins = bins.bins[axis];
+
+                    // right_cost[i]: area * count of bins (i, bin_count)
+                    real right_cost[MAX_SAH_BIN_COUNT];
+                    AABB right_bound;
+                    uint32_t right_count = 0;
+                    for(int i = bin_count_ - 1; i > 0; --i)
+                    {
+                        right_bound |= axis_bins[i].bound;
+                        right_count += axis_bins[i].count;
+                        right_cost[i - 1] =
+                            aabb_surface_area(right_bound) * right_count;
+                    }
+
+                    AABB left_bound;
+                    uint32_t left_count = 0;
+                    for(int i = 0; i < bin_count_ - 1; ++i)
+                    {
+                        left_bound |= axis_bins[i].bound;
+                        left_count += axis_bins[i].count;
+                        if(!left_count || left_count == n)
+                            continue;
+
+                        const real cost = params_.traversal_cost +
+                            inv_parent_area * (
+                                aabb_surface_area(left_bound) * left_count +
+                                right_cost[i]);
+                        if(cost < best_cost)
+                        {
+                            best_cost = cost;
+                            best_axis = axis;
+                            best_bin  = i;
+                        }
+                    }
+                }
+
+                const real leaf_cost = static_cast<real>(n);
+                if(n <= max_leaf_size_ && (best_axis < 0 || best_cost >= leaf_cost))
+                {
+                    create_leaf();
+                    return false;
+                }
+
+                if(best_axis >= 0)
+                {
+                    const real low = centroid_bound.low[best_axis];
+                    const real axis_scale = scale[best_axis];
+                    split_middle = static_cast<uint32_t>(std::partition(
+                        triangles_ + task.start, triangles_ + task.end,
+                        [&](const BuildingTriangle &tri)
+                    {
+                        return bin_index(
+                            tri.centroid[best_axis], low, axis_scale) <= best_bin;
+                    }) - triangles_);
+                }
+
+                if(split_middle == task.start || split_middle == task.end)
                 {
-                    return L.centroid[axis] < R.centroid[axis];
-                });
-                split_middle = task.start + n / 2;
+                    split_middle = median_split(
+                        task.start, task.end, max_extent_axis);
+                }
             }
 
             auto interior = arena.create<BuildingNode>();
@@ -213,10 +481,179 @@ namespace
             interior->end      = 0;
 
             *task.fillback_ptr = interior;
+            ++*node_count;
+
+            children[0] = {
+                &interior->left, task.start, split_middle, task.depth + 1 };
+            children[1] = {
+                &interior->right, split_middle, task.end, task.depth + 1 };
+
+            return true;
+        }
+
+        uint32_t build_subtree(const BuildingTask &root_task, Arena &arena)
+        {
+            uint32_t node_count = 0;
+
+            std::vector<BuildingTask> tasks = { root_task };
+            while(!tasks.empty())
+            {
+                const BuildingTask task = tasks.back();
+                tasks.pop_back();
+
+                BuildingTask children[2];
+                if(process_task(task, arena, false, children, &node_count))
+                {
+                    tasks.push_back(children[1]);
+                    tasks.push_back(children[0]);
+                }
+            }
+
+            return node_count;
+        }
+
+    public:
+
+        SAHBVHBuilder(
+            BuildingTriangle *triangles, const TriangleBVHParams &params,
+            uint32_t depth_threshold)
+            : triangles_(triangles), params_(params)
+        {
+            bin_count_ = math::clamp(params.sah_bin_count, 2, MAX_SAH_BIN_COUNT);
+            leaf_size_threshold_ = static_cast<uint32_t>(
+                (std::max)(1, params.leaf_size_threshold));
+            max_leaf_size_ = (std::max)(
+                leaf_size_threshold_,
+                static_cast<uint32_t>((std::max)(1, params.max_leaf_size)));
+            depth_threshold_ = depth_threshold;
+
+            thread_count_ = thread::actual_worker_count(params.worker_count);
+        }
+
+        /**
+         * @brief build bvh on triangles
+         *
+         * building nodes are allocated from arenas in 'arenas'
+         */
+        BuildingResult build(
+            uint32_t triangle_count, std::vector<Box<Arena>> &arenas)
+        {
+            BuildingResult ret = { nullptr, 0 };
+
+            arenas.push_back(newBox<Arena>());
+            Arena &top_arena = *arenas.back();
+
+            // divide nodes near the root until there are enough subtrees
+
+            const size_t expected_subtree_count =
+                thread_count_ > 1 ? size_t(4) * thread_count_ : 1;
+
+            std::vector<BuildingTask> subtree_tasks;
+            std::queue<BuildingTask> tasks;
+            tasks.push({ &ret.root, 0, triangle_count, 0 });
+
+            while(!tasks.empty())
+            {
+                const BuildingTask task = tasks.front();
+                tasks.pop();
+
+                const uint32_t n = task.end - task.start;
+                if(n < PARALLEL_SUBTREE_THRESHOLD ||
+                   subtree_tasks.size() + tasks.size() + 1 >= expected_subtree_count)
+                {
+                    subtree_tasks.push_back(task);
+                    continue;
+                }
+
+                const bool parallel = n >= PARALLEL_BINNING_THRESHOLD;
+
+                BuildingTask children[2];
+                if(process_task(task, top_arena, parallel, children, &ret.node_count))
+                {
+                    tasks.push(children[0]);
+                    tasks.push(children[1]);
+                }
+            }
+
+            // build subtrees parallelly. larger ones are scheduled first
+
+            std::sort(subtree_tasks.begin(), subtree_tasks.end(),
+                [](const BuildingTask &L, const BuildingTask &R)
+            {
+                return L.end - L.start > R.end - R.start;
+            });
+
+            const size_t first_arena = arenas.size();
+            for(int i = 0; i < thread_count_; ++i)
+                arenas.push_back(newBox<Arena>());
+
+            std::vector<uint32_t> perthread_node_count(thread_count_, 0);
+
+            parallel_for_1d_grid(
+                thread_count_, static_cast<int>(subtree_tasks.size()), 1,
+                threads_, [&](int thread_index, int beg, int end)
+            {
+                Arena &arena = *arenas[first_arena + thread_index];
+                for(int i = beg; i < end; ++i)
+                {
+                    perthread_node_count[thread_index] +=
+                        build_subtree(subtree_tasks[i], arena);
+                }
+            });
+
+            for(uint32_t c : perthread_node_count)
+                ret.node_count += c;
+
+            return ret;
+        }
+    };
+
+    struct BVHStatistics
+    {
+        uint32_t node_count = 0;
+        uint32_t leaf_count = 0;
+        uint32_t max_depth  = 0;
+        real sah_cost       = 0;
+    };
+
+    /**
+     * @brief collect statistics of built bvh tree
+     *
+     * sah cost is the expected cost of a ray hitting the root bounding box,
+     * measured in the cost of one ray-triangle test
+     */
+    BVHStatistics compute_bvh_statistics(
+        const BuildingNode *root, real traversal_cost)
+    {
+        BVHStatistics ret;
+
+        const real inv_root_area = 1 / (std::max)(
+            aabb_surface_area(root->bounding),
+            std::numeric_limits<real>::min());
+
+        std::stack<std::pair<const BuildingNode *, uint32_t>> tasks;
+        tasks.push({ root, 0 });
+
+        while(!tasks.empty())
+        {
+            const auto [node, depth] = tasks.top();
+            tasks.pop();
+
             ++ret.node_count;
+            ret.max_depth = (std::max)(ret.max_depth, depth);
 
-            tasks.push({ &interior->left, task.start, split_middle, task.depth + 1 });
-            tasks.push({ &interior->right, split_middle, task.end, task.depth + 1 });
+            const real area_ratio = aabb_surface_area(node->bounding) * inv_root_area;
+            if(node->left && node->right)
+            {
+                ret.sah_cost += area_ratio * traversal_cost;
+                tasks.push({ node->left, depth + 1 });
+                tasks.push({ node->right, depth + 1 });
+            }
+            else
+            {
+                ++ret.leaf_count;
+                ret.sah_cost += area_ratio * (node->end - node->start);
+            }
         }
 
         return ret;
@@ -303,239 +740,1195 @@ namespace
         }
     }
 
-    // local triangle bvh
-    class UntransformedTriangleBVH
+    // read-only array owned by a vector or a mapped file
+    template<typename T>
+    class ArrayView
     {
-        std::vector<Primitive> prims_;
-        std::vector<PrimitiveInfo> prim_info_;
-        std::vector<Node> nodes_;
-
-        math::distribution::alias_sampler_t<real> prim_sampler_;
-
-        real surface_area_ = 0;
-        AABB local_bound_;
+        const T *data_ = nullptr;
+        size_t size_ = 0;
 
     public:
 
-        void initialize(const mesh::triangle_t *triangles, uint32_t triangle_count)
-        {
-            assert(triangles && triangle_count);
-
-            surface_area_ = 0;
-            local_bound_ = AABB();
-
-            std::vector<BuildingTriangle> build_triangles(triangle_count);
-            for(uint32_t i = 0; i < triangle_count; ++i)
-            {
-                build_triangles[i].vtx = triangles[i].vertices;
-                build_triangles[i].centroid = (
-                    triangles[i].vertices[0].position +
-                    triangles[i].vertices[1].position +
-                    triangles[i].vertices[2].position) / real(3);
-                surface_area_ += triangle_area(
-                    triangles[i].vertices[1].position - triangles[i].vertices[0].position,
-                    triangles[i].vertices[2].position - triangles[i].vertices[0].position);
-                local_bound_ |= triangles[i].vertices[0].position;
-                local_bound_ |= triangles[i].vertices[1].position;
-                local_bound_ |= triangles[i].vertices[2].position;
-            }
+        ArrayView() = default;
 
-            Arena arena;
-            auto [root, node_count] = build_bvh(
-                build_triangles.data(), triangle_count, 5, TRAVERSAL_STACK_SIZE / 2, arena);
-
-            nodes_.resize(node_count);
-            prims_.resize(triangle_count);
-            prim_info_.resize(triangle_count);
+        ArrayView(const T *data, size_t size) noexcept
+            : data_(data), size_(size)
+        {
 
-            compact_bvh(
-                root, build_triangles.data(),
-                nodes_.data(), prims_.data(), prim_info_.data());
+        }
 
-            std::vector<real> area_arr(triangle_count);
-            for(uint32_t i = 0; i < triangle_count; ++i)
-                area_arr[i] = triangle_area(prims_[i].b_a_, prims_[i].c_a_);
+        explicit ArrayView(const std::vector<T> &vec) noexcept
+            : ArrayView(vec.data(), vec.size())
+        {
 
-            prim_sampler_.initialize(
-                area_arr.data(), static_cast<int>(triangle_count));
         }
 
-        bool has_intersection(const Ray &r) const noexcept
+        const T &operator[](size_t i) const noexcept
         {
-            const real inv_dir[3] = { 1 / r.d.x, 1 / r.d.y, 1 / r.d.z };
-            real t;
+            assert(i < size_);
+            return data_[i];
+        }
 
-            if(!nodes_[0].has_intersection(&r.o[0], inv_dir, r.t_min, r.t_max, &t))
-                return false;
+        const T *data()  const noexcept { return data_; }
+        size_t   size()  const noexcept { return size_; }
+        const T *begin() const noexcept { return data_; }
+        const T *end()   const noexcept { return data_ + size_; }
+    };
 
-            int top = 0;
-            traversal_stack[top++] = 0;
+    /**
+     * @brief n-wide bvh collapsed from binary bvh
+     *
+     * children of each wide node are collected by repeatedly opening the
+     * interior child with max surface area. triangles of each binary leaf are
+     * packed into soa packets of n triangles.
+     */
+    template<int N>
+    class WideTriangleBVH
+    {
+        std::vector<wide_bvh::Node<N>> nodes_;
+        std::vector<wide_bvh::TrianglePacket<N>> packets_;
 
-            while(top)
-            {
-                const uint32_t task_node_idx = traversal_stack[--top];
-                const Node &node = nodes_[task_node_idx];
+        void init_leaf_child(
+            const Node &leaf, const ArrayView<Primitive> &prims,
+            wide_bvh::Node<N> &wide_node, int slot)
+        {
+            const uint32_t first_packet = static_cast<uint32_t>(packets_.size());
 
-                if(node.is_leaf())
+            for(uint32_t i = leaf.start; i < leaf.end_or_right_offset; i += N)
+            {
+                wide_bvh::TrianglePacket<N> packet = {};
+                for(int lane = 0; lane < N; ++lane)
                 {
-                    for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                    const uint32_t prim_idx = i + lane;
+                    if(prim_idx >= leaf.end_or_right_offset)
                     {
-                        const Primitive &prim = prims_[i];
-                        if(has_intersection_with_triangle(r, prim.a_, prim.b_a_, prim.c_a_))
-                            return true;
+                        // degenerate triangle never intersects with any ray
+                        packet.prim_idx[lane] = std::numeric_limits<uint32_t>::max();
+                        continue;
                     }
+
+                    const Primitive &prim = prims[prim_idx];
+                    for(int k = 0; k < 3; ++k)
+                    {
+                        packet.a  [k][lane] = prim.a_[k];
+                        packet.b_a[k][lane] = prim.b_a_[k];
+                        packet.c_a[k][lane] = prim.c_a_[k];
+                    }
+                    packet.prim_idx[lane] = prim_idx;
                 }
-                else
-                {
-                    assert(top + 2 < TRAVERSAL_STACK_SIZE);
-                    if(nodes_[task_node_idx + 1].has_intersection(
-                        &r.o[0], inv_dir, r.t_min, r.t_max, &t))
-                        traversal_stack[top++] = task_node_idx + 1;
-                    if(nodes_[node.end_or_right_offset].has_intersection(
-                        &r.o[0], inv_dir, r.t_min, r.t_max, &t))
-                        traversal_stack[top++] = node.end_or_right_offset;
-                }
+                packets_.push_back(packet);
             }
 
-            return false;
+            wide_node.child[slot]        = first_packet;
+            wide_node.packet_count[slot] =
+                static_cast<uint32_t>(packets_.size()) - first_packet;
         }
 
-        bool closest_intersection(Ray r, GeometryIntersection *inct) const noexcept
+    public:
+
+        WideTriangleBVH(
+            const ArrayView<Node> &nodes, const ArrayView<Primitive> &prims)
         {
-            const real ori[3]     = { r.o.x,     r.o.y,     r.o.z };
-            const real inv_dir[3] = { 1 / r.d.x, 1 / r.d.y, 1 / r.d.z };
+            struct CollapsingTask
+            {
+                uint32_t binary_node;
+                uint32_t wide_node;
+            };
 
-            int top = 0;
-            real tmp_t;
-            if(!nodes_[0].has_intersection(ori, inv_dir, r.t_min, r.t_max, &tmp_t))
-                return false;
+            auto area_of = [&](uint32_t idx)
+            {
+                const Node &node = nodes[idx];
+                return aabb_surface_area(AABB(
+                    FVec3(node.low[0],  node.low[1],  node.low[2]),
+                    FVec3(node.high[0], node.high[1], node.high[2])));
+            };
 
-            traversal_stack[top++] = 0;
+            nodes_.emplace_back();
 
-            TriangleIntersectionRecord rcd, tmp_rcd;
-            rcd.t_ray = std::numeric_limits<real>::infinity();
-            uint32_t final_prim_idx = 0;
+            std::stack<CollapsingTask> tasks;
+            tasks.push({ 0, 0 });
 
-            while(top)
+            while(!tasks.empty())
             {
-                const uint32_t task_node_idx = traversal_stack[--top];
-                const Node &node = nodes_[task_node_idx];
+                const CollapsingTask task = tasks.top();
+                tasks.pop();
+
+                // collect children of the wide node
+
+                uint32_t children[N];
+                int child_count = 0;
+
+                const Node &binary_node = nodes[task.binary_node];
+                if(binary_node.is_leaf())
+                    children[child_count++] = task.binary_node;
+                else
+                {
+                    children[child_count++] = task.binary_node + 1;
+                    children[child_count++] = binary_node.end_or_right_offset;
+                }
 
-                if(node.is_leaf())
+                while(child_count < N)
                 {
-                    for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                    int open_idx = -1;
+                    real max_area = -1;
+                    for(int i = 0; i < child_count; ++i)
                     {
-                        const Primitive &prim = prims_[i];
-                        if(closest_intersection_with_triangle(
-                            r, prim.a_, prim.b_a_, prim.c_a_, &tmp_rcd))
+                        if(nodes[children[i]].is_leaf())
+                            continue;
+                        const real area = area_of(children[i]);
+                        if(area > max_area)
                         {
-                            rcd = tmp_rcd;
-                            r.t_max = tmp_rcd.t_ray;
-                            final_prim_idx = i;
+                            max_area = area;
+                            open_idx = i;
                         }
                     }
-                }
-                else
-                {
-                    real t_left, t_right;
 
-                    const bool add_left  = nodes_[task_node_idx + 1]
-                        .has_intersection(ori, inv_dir, r.t_min, r.t_max, &t_left);
-                    const bool add_right = nodes_[node.end_or_right_offset]
-                        .has_intersection(ori, inv_dir, r.t_min, r.t_max, &t_right);
+                    if(open_idx < 0)
+                        break;
+
+                    const uint32_t opened = children[open_idx];
+                    children[open_idx]        = opened + 1;
+                    children[child_count++] = nodes[opened].end_or_right_offset;
+                }
 
-                    assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+                // fill the wide node
 
-                    if(add_left && add_right)
+                wide_bvh::Node<N> wide_node;
+                for(int i = 0; i < N; ++i)
+                {
+                    for(int k = 0; k < 3; ++k)
                     {
-                        if(t_left < t_right)
-                        {
-                            traversal_stack[top++] = node.end_or_right_offset;
-                            traversal_stack[top++] = task_node_idx + 1;
-                        }
-                        else
-                        {
-                            traversal_stack[top++] = task_node_idx + 1;
-                            traversal_stack[top++] = node.end_or_right_offset;
-                        }
+                        wide_node.bounds[k][i]     = REAL_INF;
+                        wide_node.bounds[k + 3][i] = -REAL_INF;
                     }
-                    else if(add_left)
-                        traversal_stack[top++] = task_node_idx + 1;
-                    else
-                        traversal_stack[top++] = node.end_or_right_offset;
+                    wide_node.child[i]        = 0;
+                    wide_node.packet_count[i] = 0;
                 }
-            }
-
-            if(std::isinf(rcd.t_ray))
-                return false;
 
-            const PrimitiveInfo &prim_info = prim_info_[final_prim_idx];
+                for(int i = 0; i < child_count; ++i)
+                {
+                    const Node &child = nodes[children[i]];
+                    for(int k = 0; k < 3; ++k)
+                    {
+                        wide_node.bounds[k][i]     = child.low[k];
+                        wide_node.bounds[k + 3][i] = child.high[k];
+                    }
 
-            inct->pos            = r.at(rcd.t_ray);
-            inct->geometry_coord = FCoord(prim_info.x_, cross(
-                prim_info.z_, prim_info.x_), prim_info.z_);
-            inct->uv             = prim_info.t_a_ + rcd.uv.x * prim_info.t_b_a_
-                                                  + rcd.uv.y * prim_info.t_c_a_;
-            inct->t              = rcd.t_ray;
+                    if(child.is_leaf())
+                    {
+                        init_leaf_child(child, prims, wide_node, i);
+                        continue;
+                    }
 
-            const FVec3 user_z = prim_info.n_a_ + rcd.uv.x * FVec3(prim_info.n_b_a_)
-                                               + rcd.uv.y * FVec3(prim_info.n_c_a_);
-            inct->user_coord = inct->geometry_coord.rotate_to_new_z(user_z);
+                    const uint32_t wide_child = static_cast<uint32_t>(nodes_.size());
+                    nodes_.emplace_back();
+                    wide_node.child[i] = wide_child;
+                    tasks.push({ children[i], wide_child });
+                }
 
-            inct->wr = -r.d;
+                nodes_[task.wide_node] = wide_node;
+            }
+        }
 
-            return true;
+        bool has_intersection(const wide_bvh::RayData &ray) const noexcept
+        {
+            return wide_bvh::has_intersection(
+                nodes_.data(), packets_.data(), ray);
         }
 
-        real surface_area() const noexcept
+        bool closest_intersection(
+            const wide_bvh::RayData &ray, wide_bvh::Hit *hit) const noexcept
         {
-            return surface_area_;
+            return wide_bvh::closest_intersection(
+                nodes_.data(), packets_.data(), ray, hit);
         }
+    };
+
+    // on-disk cache of flattened bvh arrays
+    //
+    // cache files are named by a hash of the triangles and building
+    // parameters. since TriangleBVH bakes its transform into the triangles,
+    // the transform is covered by the hash as well.
+    //
+    // prebuilt bvhs stored with meshes use the same format as cache files
+    namespace bvh_cache
+    {
 
-        SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept
+        constexpr char     CACHE_MAGIC[8] = { 'A', 'G', 'Z', 'B', 'V', 'H', 'C', '\0' };
+        constexpr uint32_t CACHE_VERSION  = 2;
+
+        // triangle count of each parallel hashing task
+        constexpr int HASH_GRID_SIZE = 1 << 14;
+
+        struct CacheHeader
         {
-            const int prim_idx = prim_sampler_.sample(sam.u);
-            assert(0 <= prim_idx && static_cast<size_t>(prim_idx) < prims_.size());
-            const Primitive &prim = prims_[prim_idx];
-            const PrimitiveInfo &prim_info = prim_info_[prim_idx];
+            char magic[8];
+            uint32_t version;
 
-            const Vec2 uv = math::distribution::uniform_on_triangle(sam.v, sam.w);
+            uint32_t node_size;
+            uint32_t prim_size;
+            uint32_t prim_info_size;
 
-            SurfacePoint spt;
-            spt.pos            = prim.a_ + uv.x * prim.b_a_ + uv.y * prim.c_a_;
-            spt.geometry_coord = FCoord(
-                prim_info.x_, cross(prim_info.z_, prim_info.x_), prim_info.z_);
-            spt.uv             = prim_info.t_a_ + uv.x * prim_info.t_b_a_
-                                                + uv.y * prim_info.t_c_a_;
+            uint32_t node_count;
+            uint32_t prim_count;
 
-            const FVec3 user_z = prim_info.n_a_ + uv.x * FVec3(prim_info.n_b_a_)
-                                               + uv.y * FVec3(prim_info.n_c_a_);
-            spt.user_coord = spt.geometry_coord.rotate_to_new_z(user_z);
+            // time of building the cached bvh
+            uint32_t build_ms;
+            uint32_t reserved;
 
-            *pdf = 1 / surface_area_;
+            uint64_t key;
+        };
 
-            return spt;
-        }
+        std::atomic<int>     hit_count      { 0 };
+        std::atomic<int>     miss_count     { 0 };
+        std::atomic<int64_t> total_saved_ms { 0 };
 
-        const std::vector<Primitive> &get_prims() const noexcept
+        // 64-bit hash consuming a 32-bit word per step
+        class Hasher
         {
-            return prims_;
-        }
-    };
+            uint64_t value_ = 0xcbf29ce484222325ull;
 
-} // namespace anonymous
+            void update_word(uint32_t word) noexcept
+            {
+                value_ ^= word * 0xff51afd7ed558ccdull;
+                value_ = ((value_ << 27) | (value_ >> 37)) * 0xc4ceb9fe1a85ec53ull;
+            }
 
-class TriangleBVH : public Geometry
-{
-    Box<const UntransformedTriangleBVH> untransformed_;
-    AABB world_bound_;
+        public:
 
-    static Box<const UntransformedTriangleBVH> load(
-        std::vector<mesh::triangle_t> build_triangles, const FTransform3 &local_to_world)
-    {
-        for(auto &tri : build_triangles)
+            template<typename T>
+            void update(const T &value) noexcept
+            {
+                static_assert(std::is_arithmetic_v<T> && sizeof(T) <= 8);
+                uint64_t bits = 0;
+                std::memcpy(&bits, &value, sizeof(T));
+                update_word(static_cast<uint32_t>(bits));
+                if constexpr(sizeof(T) > 4)
+                    update_word(static_cast<uint32_t>(bits >> 32));
+            }
+
+            uint64_t value() const noexcept
+            {
+                uint64_t ret = value_;
+                ret ^= ret >> 33;
+                ret *= 0xff51afd7ed558ccdull;
+                ret ^= ret >> 33;
+                return ret;
+            }
+        };
+
+        uint64_t compute_key(
+            const mesh::triangle_t *triangles, uint32_t triangle_count,
+            const TriangleBVHParams &params)
         {
-            tri.vertices[0].position = local_to_world.apply_to_point(
+            // triangles are hashed parallelly in fixed-size chunks, whose
+            // hashes are then combined in order. so the key does not depend
+            // on the worker count
+
+            const int chunk_count = static_cast<int>(
+                (triangle_count + HASH_GRID_SIZE - 1) / HASH_GRID_SIZE);
+            std::vector<uint64_t> chunk_hashes(chunk_count);
+
+            parallel_for_1d_grid(
+                thread::actual_worker_count(params.worker_count),
+                static_cast<int>(triangle_count), HASH_GRID_SIZE,
+                [&](int thread_index, int beg, int end)
+            {
+                Hasher chunk_hasher;
+                for(int i = beg; i < end; ++i)
+                {
+                    for(auto &vtx : triangles[i].vertices)
+                    {
+                        chunk_hasher.update(vtx.position.x);
+                        chunk_hasher.update(vtx.position.y);
+                        chunk_hasher.update(vtx.position.z);
+                        chunk_hasher.update(vtx.normal.x);
+                        chunk_hasher.update(vtx.normal.y);
+                        chunk_hasher.update(vtx.normal.z);
+                        chunk_hasher.update(vtx.tex_coord.x);
+                        chunk_hasher.update(vtx.tex_coord.y);
+                    }
+                }
+                chunk_hashes[beg / HASH_GRID_SIZE] = chunk_hasher.value();
+            });
+
+            Hasher hasher;
+
+            // layout and worker count have no effect on the binary bvh
+
+            hasher.update(CACHE_VERSION);
+            hasher.update(static_cast<uint32_t>(sizeof(Node)));
+            hasher.update(static_cast<uint32_t>(sizeof(Primitive)));
+            hasher.update(static_cast<uint32_t>(sizeof(PrimitiveInfo)));
+            hasher.update(static_cast<int>(params.quality));
+            hasher.update(params.sah_bin_count);
+            hasher.update(params.sah_all_axes);
+            hasher.update(params.leaf_size_threshold);
+            hasher.update(params.max_leaf_size);
+            hasher.update(params.traversal_cost);
+            hasher.update(triangle_count);
+
+            for(uint64_t chunk_hash : chunk_hashes)
+                hasher.update(chunk_hash);
+
+            return hasher.value();
+        }
+
+        std::string cache_filename(
+            const std::string &cache_directory, uint64_t key)
+        {
+            char name[32];
+            std::snprintf(
+                name, sizeof(name), "%016llx.bvh",
+                static_cast<unsigned long long>(key));
+            return (std::filesystem::path(cache_directory) / name).string();
+        }
+
+        // bvh arrays stored in mapped memory
+        struct CachedBVH
+        {
+            // keeps the arrays alive
+            RC<const void> owner;
+
+            ArrayView<Node>          nodes;
+            ArrayView<Primitive>     prims;
+            ArrayView<PrimitiveInfo> prim_info;
+
+            uint32_t build_ms = 0;
+        };
+
+        CacheHeader make_header(
+            uint64_t key, uint32_t build_ms,
+            uint32_t node_count, uint32_t prim_count) noexcept
+        {
+            CacheHeader header = {};
+            std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+            header.version        = CACHE_VERSION;
+            header.node_size      = sizeof(Node);
+            header.prim_size      = sizeof(Primitive);
+            header.prim_info_size = sizeof(PrimitiveInfo);
+            header.node_count     = node_count;
+            header.prim_count     = prim_count;
+            header.build_ms       = build_ms;
+            header.key            = key;
+            return header;
+        }
+
+        /**
+         * @brief find bvh arrays in serialized bytes
+         *
+         * arrays are used in place. output->owner is not set
+         *
+         * @return false when the bytes are not a valid bvh of given key
+         */
+        bool parse(
+            const unsigned char *data, size_t size,
+            uint64_t key, uint32_t triangle_count, CachedBVH *output) noexcept
+        {
+            if(size < sizeof(CacheHeader))
+                return false;
+
+            CacheHeader header;
+            std::memcpy(&header, data, sizeof(header));
+
+            if(std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+               header.version        != CACHE_VERSION ||
+               header.node_size      != sizeof(Node) ||
+               header.prim_size      != sizeof(Primitive) ||
+               header.prim_info_size != sizeof(PrimitiveInfo) ||
+               header.prim_count     != triangle_count ||
+               header.key            != key ||
+               !header.node_count)
+                return false;
+
+            const size_t node_bytes      = sizeof(Node) * header.node_count;
+            const size_t prim_bytes      = sizeof(Primitive) * header.prim_count;
+            const size_t prim_info_bytes = sizeof(PrimitiveInfo) * header.prim_count;
+            if(size != sizeof(CacheHeader) + node_bytes + prim_bytes + prim_info_bytes)
+                return false;
+
+            static_assert(sizeof(CacheHeader) % alignof(Node) == 0);
+            static_assert(sizeof(Node) % alignof(Primitive) == 0);
+            static_assert(sizeof(Primitive) % alignof(PrimitiveInfo) == 0);
+
+            data += sizeof(CacheHeader);
+            if(reinterpret_cast<uintptr_t>(data) % alignof(Node))
+                return false;
+
+            output->nodes = ArrayView<Node>(
+                reinterpret_cast<const Node *>(data), header.node_count);
+            data += node_bytes;
+
+            output->prims = ArrayView<Primitive>(
+                reinterpret_cast<const Primitive *>(data), header.prim_count);
+            data += prim_bytes;
+
+            output->prim_info = ArrayView<PrimitiveInfo>(
+                reinterpret_cast<const PrimitiveInfo *>(data), header.prim_count);
+
+            output->build_ms = header.build_ms;
+            return true;
+        }
+
+        /**
+         * @brief serialize bvh arrays in the format of cache files
+         */
+        std::vector<unsigned char> serialize(
+            uint64_t key, uint32_t build_ms,
+            const ArrayView<Node> &nodes,
+            const ArrayView<Primitive> &prims,
+            const ArrayView<PrimitiveInfo> &prim_info)
+        {
+            const CacheHeader header = make_header(
+                key, build_ms,
+                static_cast<uint32_t>(nodes.size()),
+                static_cast<uint32_t>(prims.size()));
+
+            std::vector<unsigned char> ret;
+            ret.reserve(
+                sizeof(CacheHeader) + sizeof(Node) * nodes.size() +
+                sizeof(Primitive) * prims.size() +
+                sizeof(PrimitiveInfo) * prim_info.size());
+
+            auto append = [&](const void *data, size_t bytes)
+            {
+                auto p = static_cast<const unsigned char *>(data);
+                ret.insert(ret.end(), p, p + bytes);
+            };
+
+            append(&header, sizeof(header));
+            append(nodes.data(), sizeof(Node) * nodes.size());
+            append(prims.data(), sizeof(Primitive) * prims.size());
+            append(prim_info.data(), sizeof(PrimitiveInfo) * prim_info.size());
+
+            return ret;
+        }
+
+        /**
+         * @brief load cached bvh arrays
+         *
+         * arrays are used in place in the mapped file
+         *
+         * @return false when the cache file does not exist or is invalid
+         */
+        bool load(
+            const std::string &filename, uint64_t key, uint32_t triangle_count,
+            CachedBVH *output)
+        {
+            std::error_code ec;
+            if(!std::filesystem::is_regular_file(filename, ec))
+                return false;
+
+            try
+            {
+                auto file = newRC<const MappedFile>(filename);
+                if(!parse(file->data(), file->size(), key, triangle_count, output))
+                    return false;
+                output->owner = std::move(file);
+            }
+            catch(const std::exception &)
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * @brief store bvh arrays into cache directory
+         *
+         * the file is written to a temporary path first and then renamed,
+         * so that concurrent renderers never see a partial cache file.
+         * failures are logged and otherwise ignored.
+         */
+        void store(
+            const std::string &cache_directory, const std::string &filename,
+            uint64_t key, uint32_t build_ms,
+            const ArrayView<Node> &nodes,
+            const ArrayView<Primitive> &prims,
+            const ArrayView<PrimitiveInfo> &prim_info)
+        {
+            const CacheHeader header = make_header(
+                key, build_ms,
+                static_cast<uint32_t>(nodes.size()),
+                static_cast<uint32_t>(prims.size()));
+
+            std::error_code ec;
+            std::filesystem::create_directories(cache_directory, ec);
+
+            const std::string tmp_filename = filename + "." + std::to_string(
+                std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+
+            {
+                std::ofstream fout(tmp_filename, std::ios::binary | std::ios::trunc);
+                if(!fout)
+                {
+                    AGZ_INFO("failed to create triangle bvh cache file: {}", tmp_filename);
+                    return;
+                }
+
+                fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                fout.write(reinterpret_cast<const char*>(nodes.data()),
+                           sizeof(Node) * nodes.size());
+                fout.write(reinterpret_cast<const char*>(prims.data()),
+                           sizeof(Primitive) * prims.size());
+                fout.write(reinterpret_cast<const char*>(prim_info.data()),
+                           sizeof(PrimitiveInfo) * prim_info.size());
+
+                if(!fout)
+                {
+                    fout.close();
+                    std::filesystem::remove(tmp_filename, ec);
+                    AGZ_INFO("failed to write triangle bvh cache file: {}", tmp_filename);
+                    return;
+                }
+            }
+
+            std::filesystem::rename(tmp_filename, filename, ec);
+            if(ec)
+            {
+                std::filesystem::remove(tmp_filename, ec);
+                AGZ_INFO("failed to write triangle bvh cache file: {}", filename);
+            }
+        }
+
+    } // namespace bvh_cache
+
+
+} // namespace anonymous
+
+// local triangle bvh
+class UntransformedTriangleBVH : public misc::uncopyable_t
+{
+    // arrays of a newly built bvh
+    std::vector<Primitive> owned_prims_;
+    std::vector<PrimitiveInfo> owned_prim_info_;
+    std::vector<Node> owned_nodes_;
+
+    // keeps cached or prebuilt arrays alive
+    RC<const void> mapped_owner_;
+
+    // point to either the owned arrays or the mapped arrays
+    ArrayView<Primitive> prims_;
+    ArrayView<PrimitiveInfo> prim_info_;
+    ArrayView<Node> nodes_;
+
+    // at most one of them is non-null
+    Box<WideTriangleBVH<4>> bvh4_;
+    Box<WideTriangleBVH<8>> bvh8_;
+
+    math::distribution::alias_sampler_t<real> prim_sampler_;
+
+    // built on the first sampling w.r.t. a reference point
+    mutable std::once_flag emitter_bvh_once_;
+    mutable Box<const TriangleEmitterBVH> emitter_bvh_;
+
+    real surface_area_ = 0;
+    AABB local_bound_;
+
+    const TriangleEmitterBVH &emitter_bvh() const
+    {
+        std::call_once(emitter_bvh_once_, [&]
+        {
+            std::vector<TriangleEmitterBVH::Triangle> triangles(prims_.size());
+            for(size_t i = 0; i < prims_.size(); ++i)
+            {
+                triangles[i] = {
+                    FVec3(prims_[i].a_),
+                    FVec3(prims_[i].b_a_),
+                    FVec3(prims_[i].c_a_)
+                };
+            }
+            emitter_bvh_ = newBox<TriangleEmitterBVH>(std::move(triangles));
+        });
+        return *emitter_bvh_;
+    }
+
+    SurfacePoint surface_point(int prim_idx, const Vec2 &uv) const noexcept
+    {
+        const Primitive &prim = prims_[prim_idx];
+        const PrimitiveInfo &prim_info = prim_info_[prim_idx];
+
+        SurfacePoint spt;
+        spt.pos            = prim.a_ + uv.x * prim.b_a_ + uv.y * prim.c_a_;
+        spt.geometry_coord = FCoord(
+            prim_info.x_, cross(prim_info.z_, prim_info.x_), prim_info.z_);
+        spt.uv             = prim_info.t_a_ + uv.x * prim_info.t_b_a_
+                                            + uv.y * prim_info.t_c_a_;
+
+        const FVec3 user_z = prim_info.n_a_ + uv.x * FVec3(prim_info.n_b_a_)
+                                           + uv.y * FVec3(prim_info.n_c_a_);
+        spt.user_coord = spt.geometry_coord.rotate_to_new_z(user_z);
+
+        return spt;
+    }
+
+    // pdf w.r.t. area of a point on given triangle
+    real triangle_pdf(
+        const FVec3 &ref, const FVec3 &pos,
+        uint32_t prim_idx, real solid_angle) const noexcept
+    {
+        if(solid_angle)
+        {
+            return solid_angle_sample_area_pdf(
+                ref, pos, FVec3(prim_info_[prim_idx].z_), solid_angle);
+        }
+        const Primitive &prim = prims_[prim_idx];
+        return 1 / triangle_area(prim.b_a_, prim.c_a_);
+    }
+
+public:
+
+    void initialize(
+        const mesh::triangle_t *triangles, uint32_t triangle_count,
+        const TriangleBVHParams &params)
+    {
+        assert(triangles && triangle_count);
+
+        const auto build_start_time = std::chrono::steady_clock::now();
+
+        uint64_t cache_key = 0;
+        if(params.prebuilt.data || !params.cache_directory.empty())
+        {
+            cache_key = bvh_cache::compute_key(
+                triangles, triangle_count, params);
+        }
+
+        if(params.prebuilt.data)
+        {
+            bvh_cache::CachedBVH prebuilt;
+            if(bvh_cache::parse(
+                params.prebuilt.data, params.prebuilt.size,
+                cache_key, triangle_count, &prebuilt))
+            {
+                prebuilt.owner = params.prebuilt.owner;
+                init_from_cache(
+                    triangles, triangle_count, std::move(prebuilt), params.layout);
+
+                const auto load_ms = std::chrono::duration_cast<
+                    std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - build_start_time);
+                AGZ_INFO("use prebuilt triangle bvh, loaded in {}ms",
+                         load_ms.count());
+
+                return;
+            }
+
+            AGZ_INFO("prebuilt triangle bvh does not match the triangles "
+                     "or building parameters. rebuild it");
+        }
+
+        std::string cache_filename;
+        if(!params.cache_directory.empty())
+        {
+            cache_filename = bvh_cache::cache_filename(
+                params.cache_directory, cache_key);
+
+            bvh_cache::CachedBVH cached;
+            if(bvh_cache::load(
+                cache_filename, cache_key, triangle_count, &cached))
+            {
+                const uint32_t cached_build_ms = cached.build_ms;
+                init_from_cache(
+                    triangles, triangle_count, std::move(cached), params.layout);
+
+                const auto load_ms = std::chrono::duration_cast<
+                    std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - build_start_time);
+                const int64_t saved_ms = (std::max<int64_t>)(
+                    0, int64_t(cached_build_ms) - load_ms.count());
+
+                const int hits = ++bvh_cache::hit_count;
+                const int64_t total_saved_ms =
+                    bvh_cache::total_saved_ms += saved_ms;
+
+                AGZ_INFO(
+                    "triangle bvh cache hit: {}, loaded in {}ms, saved {}ms",
+                    cache_filename, load_ms.count(), saved_ms);
+                AGZ_INFO(
+                    "triangle bvh cache: {} hit(s), {} miss(es), "
+                    "{}ms saved in total",
+                    hits, bvh_cache::miss_count.load(), total_saved_ms);
+
+                return;
+            }
+        }
+
+        surface_area_ = 0;
+        local_bound_ = AABB();
+
+        std::vector<BuildingTriangle> build_triangles(triangle_count);
+        for(uint32_t i = 0; i < triangle_count; ++i)
+        {
+            const auto &vtx = triangles[i].vertices;
+
+            auto &tri = build_triangles[i];
+            tri.vtx = vtx;
+            tri.bound = AABB(vtx[0].position, vtx[0].position);
+            tri.bound |= vtx[1].position;
+            tri.bound |= vtx[2].position;
+            tri.centroid = (
+                vtx[0].position + vtx[1].position + vtx[2].position) / real(3);
+
+            surface_area_ += triangle_area(
+                vtx[1].position - vtx[0].position,
+                vtx[2].position - vtx[0].position);
+            local_bound_ |= tri.bound;
+        }
+
+        std::vector<Box<Arena>> arenas;
+        SAHBVHBuilder builder(
+            build_triangles.data(), params, TRAVERSAL_STACK_SIZE / 2);
+        auto [root, node_count] = builder.build(triangle_count, arenas);
+
+        owned_nodes_.resize(node_count);
+        owned_prims_.resize(triangle_count);
+        owned_prim_info_.resize(triangle_count);
+
+        compact_bvh(
+            root, build_triangles.data(),
+            owned_nodes_.data(), owned_prims_.data(), owned_prim_info_.data());
+
+        nodes_     = ArrayView<Node>(owned_nodes_);
+        prims_     = ArrayView<Primitive>(owned_prims_);
+        prim_info_ = ArrayView<PrimitiveInfo>(owned_prim_info_);
+
+        std::vector<real> area_arr(triangle_count);
+        for(uint32_t i = 0; i < triangle_count; ++i)
+            area_arr[i] = triangle_area(prims_[i].b_a_, prims_[i].c_a_);
+
+        prim_sampler_.initialize(
+            area_arr.data(), static_cast<int>(triangle_count));
+
+        init_wide_bvh(params.layout);
+
+        const auto build_end_time = std::chrono::steady_clock::now();
+        const auto build_ms = std::chrono::duration_cast<
+            std::chrono::milliseconds>(build_end_time - build_start_time);
+
+        const BVHStatistics stat = compute_bvh_statistics(
+            root, params.traversal_cost);
+
+        AGZ_INFO(
+            "triangle bvh built in {}ms with {} thread(s)",
+            build_ms.count(), thread::actual_worker_count(params.worker_count));
+        AGZ_INFO(
+            "triangle bvh: {} nodes, {} leaves, avg leaf size: {:.2f}, "
+            "max depth: {}, sah cost: {:.2f}",
+            stat.node_count, stat.leaf_count,
+            real(triangle_count) / stat.leaf_count,
+            stat.max_depth, stat.sah_cost);
+
+        if(!cache_filename.empty())
+        {
+            bvh_cache::store(
+                params.cache_directory, cache_filename, cache_key,
+                static_cast<uint32_t>(build_ms.count()),
+                nodes_, prims_, prim_info_);
+
+            const int misses = ++bvh_cache::miss_count;
+            AGZ_INFO(
+                "triangle bvh cache miss: {}", cache_filename);
+            AGZ_INFO(
+                "triangle bvh cache: {} hit(s), {} miss(es), "
+                "{}ms saved in total",
+                bvh_cache::hit_count.load(), misses,
+                bvh_cache::total_saved_ms.load());
+        }
+    }
+
+    void init_from_cache(
+        const mesh::triangle_t *triangles, uint32_t triangle_count,
+        bvh_cache::CachedBVH cached, TriangleBVHParams::Layout layout)
+    {
+        mapped_owner_ = std::move(cached.owner);
+        nodes_        = cached.nodes;
+        prims_        = cached.prims;
+        prim_info_    = cached.prim_info;
+
+        surface_area_ = 0;
+        local_bound_ = AABB();
+
+        for(uint32_t i = 0; i < triangle_count; ++i)
+        {
+            const auto &vtx = triangles[i].vertices;
+            local_bound_ |= vtx[0].position;
+            local_bound_ |= vtx[1].position;
+            local_bound_ |= vtx[2].position;
+        }
+
+        std::vector<real> area_arr(triangle_count);
+        for(uint32_t i = 0; i < triangle_count; ++i)
+        {
+            area_arr[i] = triangle_area(prims_[i].b_a_, prims_[i].c_a_);
+            surface_area_ += area_arr[i];
+        }
+
+        prim_sampler_.initialize(
+            area_arr.data(), static_cast<int>(triangle_count));
+
+        init_wide_bvh(layout);
+    }
+
+    void init_wide_bvh(TriangleBVHParams::Layout layout)
+    {
+        bvh4_.reset();
+        bvh8_.reset();
+
+        using Layout = TriangleBVHParams::Layout;
+
+        if(layout == Layout::Auto)
+            layout = wide_bvh::is_avx_supported() ? Layout::BVH8 : Layout::BVH4;
+
+        if(layout == Layout::BVH8 && !wide_bvh::is_avx_supported())
+        {
+            AGZ_INFO("avx is unavailable. use bvh4 instead of bvh8");
+            layout = Layout::BVH4;
+        }
+
+        if(layout == Layout::BVH4)
+        {
+            bvh4_ = newBox<WideTriangleBVH<4>>(nodes_, prims_);
+            AGZ_INFO("triangle bvh layout: bvh4 (sse)");
+        }
+        else if(layout == Layout::BVH8)
+        {
+            bvh8_ = newBox<WideTriangleBVH<8>>(nodes_, prims_);
+            AGZ_INFO("triangle bvh layout: bvh8 (avx)");
+        }
+        else
+            AGZ_INFO("triangle bvh layout: binary");
+    }
+
+    static wide_bvh::RayData to_wide_ray(const Ray &r) noexcept
+    {
+        return {
+            { r.o.x, r.o.y, r.o.z },
+            { r.d.x, r.d.y, r.d.z },
+            { 1 / r.d.x, 1 / r.d.y, 1 / r.d.z },
+            r.t_min, r.t_max
+        };
+    }
+
+    bool has_intersection(const Ray &r) const noexcept
+    {
+        if(bvh8_)
+            return bvh8_->has_intersection(to_wide_ray(r));
+        if(bvh4_)
+            return bvh4_->has_intersection(to_wide_ray(r));
+        return has_intersection_binary(r);
+    }
+
+    bool has_intersection_binary(const Ray &r) const noexcept
+    {
+        const real inv_dir[3] = { 1 / r.d.x, 1 / r.d.y, 1 / r.d.z };
+        real t;
+
+        if(!nodes_[0].has_intersection(&r.o[0], inv_dir, r.t_min, r.t_max, &t))
+            return false;
+
+        int top = 0;
+        traversal_stack[top++] = 0;
+
+        while(top)
+        {
+            const uint32_t task_node_idx = traversal_stack[--top];
+            const Node &node = nodes_[task_node_idx];
+
+            if(node.is_leaf())
+            {
+                for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                {
+                    const Primitive &prim = prims_[i];
+                    if(has_intersection_with_triangle(r, prim.a_, prim.b_a_, prim.c_a_))
+                        return true;
+                }
+            }
+            else
+            {
+                assert(top + 2 < TRAVERSAL_STACK_SIZE);
+                if(nodes_[task_node_idx + 1].has_intersection(
+                    &r.o[0], inv_dir, r.t_min, r.t_max, &t))
+                    traversal_stack[top++] = task_node_idx + 1;
+                if(nodes_[node.end_or_right_offset].has_intersection(
+                    &r.o[0], inv_dir, r.t_min, r.t_max, &t))
+                    traversal_stack[top++] = node.end_or_right_offset;
+            }
+        }
+
+        return false;
+    }
+
+    bool closest_intersection(
+        const Ray &r, GeometryIntersection *inct) const noexcept
+    {
+        TriangleIntersectionRecord rcd;
+        uint32_t prim_idx;
+
+        if(bvh8_ || bvh4_)
+        {
+            wide_bvh::Hit hit;
+            const bool found = bvh8_ ?
+                bvh8_->closest_intersection(to_wide_ray(r), &hit) :
+                bvh4_->closest_intersection(to_wide_ray(r), &hit);
+            if(!found)
+                return false;
+
+            rcd.t_ray = hit.t;
+            rcd.uv    = Vec2(hit.u, hit.v);
+            prim_idx  = hit.prim_idx;
+        }
+        else if(!closest_intersection_binary(r, &rcd, &prim_idx))
+            return false;
+
+        fill_intersection(r, rcd, prim_idx, inct);
+        return true;
+    }
+
+    /**
+     * @brief select one of all intersections in a single traversal
+     *
+     * the binary bvh is traversed even when a wide bvh is available
+     */
+    int random_intersection(
+        const Ray &r, real u, GeometryIntersection *inct) const noexcept
+    {
+        const real ori[3]     = { r.o.x,     r.o.y,     r.o.z };
+        const real inv_dir[3] = { 1 / r.d.x, 1 / r.d.y, 1 / r.d.z };
+
+        real t;
+        if(!nodes_[0].has_intersection(ori, inv_dir, r.t_min, r.t_max, &t))
+            return 0;
+
+        int top = 0;
+        traversal_stack[top++] = 0;
+
+        IntersectionReservoir reservoir(u);
+        TriangleIntersectionRecord rcd, tmp_rcd;
+        uint32_t selected_prim_idx = 0;
+
+        while(top)
+        {
+            const uint32_t task_node_idx = traversal_stack[--top];
+            const Node &node = nodes_[task_node_idx];
+
+            if(node.is_leaf())
+            {
+                for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                {
+                    const Primitive &prim = prims_[i];
+                    if(closest_intersection_with_triangle(
+                        r, prim.a_, prim.b_a_, prim.c_a_, &tmp_rcd) &&
+                       reservoir.add())
+                    {
+                        rcd = tmp_rcd;
+                        selected_prim_idx = i;
+                    }
+                }
+            }
+            else
+            {
+                assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+                if(nodes_[task_node_idx + 1].has_intersection(
+                    ori, inv_dir, r.t_min, r.t_max, &t))
+                    traversal_stack[top++] = task_node_idx + 1;
+                if(nodes_[node.end_or_right_offset].has_intersection(
+                    ori, inv_dir, r.t_min, r.t_max, &t))
+                    traversal_stack[top++] = node.end_or_right_offset;
+            }
+        }
+
+        if(reservoir.count())
+            fill_intersection(r, rcd, selected_prim_idx, inct);
+        return reservoir.count();
+    }
+
+    void fill_intersection(
+        const Ray &r, const TriangleIntersectionRecord &rcd,
+        uint32_t prim_idx, GeometryIntersection *inct) const noexcept
+    {
+        const PrimitiveInfo &prim_info = prim_info_[prim_idx];
+
+        inct->pos            = r.at(rcd.t_ray);
+        inct->geometry_coord = FCoord(prim_info.x_, cross(
+            prim_info.z_, prim_info.x_), prim_info.z_);
+        inct->uv             = prim_info.t_a_ + rcd.uv.x * prim_info.t_b_a_
+                                              + rcd.uv.y * prim_info.t_c_a_;
+        inct->t              = rcd.t_ray;
+
+        const Primitive &prim = prims_[prim_idx];
+        triangle_dpduv(
+            prim.b_a_, prim.c_a_, prim_info.t_b_a_, prim_info.t_c_a_,
+            &inct->dpdu, &inct->dpdv);
+
+        const FVec3 user_z = prim_info.n_a_ + rcd.uv.x * FVec3(prim_info.n_b_a_)
+                                           + rcd.uv.y * FVec3(prim_info.n_c_a_);
+        inct->user_coord = inct->geometry_coord.rotate_to_new_z(user_z);
+
+        inct->wr = -r.d;
+    }
+
+    bool closest_intersection_binary(
+        Ray r, TriangleIntersectionRecord *output_rcd,
+        uint32_t *output_prim_idx) const noexcept
+    {
+        const real ori[3]     = { r.o.x,     r.o.y,     r.o.z };
+        const real inv_dir[3] = { 1 / r.d.x, 1 / r.d.y, 1 / r.d.z };
+
+        int top = 0;
+        real tmp_t;
+        if(!nodes_[0].has_intersection(ori, inv_dir, r.t_min, r.t_max, &tmp_t))
+            return false;
+
+        traversal_stack[top++] = 0;
+
+        TriangleIntersectionRecord rcd, tmp_rcd;
+        rcd.t_ray = std::numeric_limits<real>::infinity();
+        uint32_t final_prim_idx = 0;
+
+        while(top)
+        {
+            const uint32_t task_node_idx = traversal_stack[--top];
+            const Node &node = nodes_[task_node_idx];
+
+            if(node.is_leaf())
+            {
+                for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                {
+                    const Primitive &prim = prims_[i];
+                    if(closest_intersection_with_triangle(
+                        r, prim.a_, prim.b_a_, prim.c_a_, &tmp_rcd))
+                    {
+                        rcd = tmp_rcd;
+                        r.t_max = tmp_rcd.t_ray;
+                        final_prim_idx = i;
+                    }
+                }
+            }
+            else
+            {
+                real t_left, t_right;
+
+                const bool add_left  = nodes_[task_node_idx + 1]
+                    .has_intersection(ori, inv_dir, r.t_min, r.t_max, &t_left);
+                const bool add_right = nodes_[node.end_or_right_offset]
+                    .has_intersection(ori, inv_dir, r.t_min, r.t_max, &t_right);
+
+                assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+
+                if(add_left && add_right)
+                {
+                    if(t_left < t_right)
+                    {
+                        traversal_stack[top++] = node.end_or_right_offset;
+                        traversal_stack[top++] = task_node_idx + 1;
+                    }
+                    else
+                    {
+                        traversal_stack[top++] = task_node_idx + 1;
+                        traversal_stack[top++] = node.end_or_right_offset;
+                    }
+                }
+                else if(add_left)
+                    traversal_stack[top++] = task_node_idx + 1;
+                else
+                    traversal_stack[top++] = node.end_or_right_offset;
+            }
+        }
+
+        if(std::isinf(rcd.t_ray))
+            return false;
+
+        *output_rcd      = rcd;
+        *output_prim_idx = final_prim_idx;
+
+        return true;
+    }
+
+    real surface_area() const noexcept
+    {
+        return surface_area_;
+    }
+
+    SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept
+    {
+        const int prim_idx = prim_sampler_.sample(sam.u);
+        assert(0 <= prim_idx && static_cast<size_t>(prim_idx) < prims_.size());
+
+        const Vec2 uv = math::distribution::uniform_on_triangle(sam.v, sam.w);
+
+        *pdf = 1 / surface_area_;
+
+        return surface_point(prim_idx, uv);
+    }
+
+    /**
+     * @brief select a triangle with the emitter bvh and sample it w.r.t.
+     *        solid angle seen from ref
+     */
+    SurfacePoint sample(
+        const FVec3 &ref, real *pdf, const Sample3 &sam) const noexcept
+    {
+        const auto [prim_idx, select_prob] = emitter_bvh().sample(ref, sam.u);
+        const Primitive &prim = prims_[prim_idx];
+
+        const FVec3 a = prim.a_, b_a = prim.b_a_, c_a = prim.c_a_;
+        const real solid_angle = triangle_sampling_solid_angle(ref, a, b_a, c_a);
+
+        const Vec2 uv = solid_angle ?
+            sample_triangle_solid_angle(
+                ref, a, b_a, c_a, solid_angle, sam.v, sam.w) :
+            math::distribution::uniform_on_triangle(sam.v, sam.w);
+
+        SurfacePoint spt = surface_point(static_cast<int>(prim_idx), uv);
+        *pdf = select_prob * triangle_pdf(ref, spt.pos, prim_idx, solid_angle);
+
+        return spt;
+    }
+
+    real pdf(const FVec3 &ref, const FVec3 &pos) const noexcept
+    {
+        uint32_t prim_idx;
+        const real select_prob = emitter_bvh().pdf(ref, pos, &prim_idx);
+        if(!select_prob)
+            return 0;
+
+        const Primitive &prim = prims_[prim_idx];
+        const real solid_angle = triangle_sampling_solid_angle(
+            ref, prim.a_, prim.b_a_, prim.c_a_);
+
+        return select_prob * triangle_pdf(ref, pos, prim_idx, solid_angle);
+    }
+
+    const ArrayView<Primitive> &get_prims() const noexcept
+    {
+        return prims_;
+    }
+
+    std::vector<unsigned char> serialize(
+        uint64_t key, uint32_t build_ms) const
+    {
+        return bvh_cache::serialize(key, build_ms, nodes_, prims_, prim_info_);
+    }
+
+    const AABB &local_bound() const noexcept
+    {
+        return local_bound_;
+    }
+};
+
+class TriangleBVH : public Geometry
+{
+    Box<const UntransformedTriangleBVH> untransformed_;
+    AABB world_bound_;
+
+    static Box<const UntransformedTriangleBVH> load(
+        std::vector<mesh::triangle_t> build_triangles,
+        const FTransform3 &local_to_world, const TriangleBVHParams &params)
+    {
+        for(auto &tri : build_triangles)
+        {
+            tri.vertices[0].position = local_to_world.apply_to_point(
                 tri.vertices[0].position);
             tri.vertices[1].position = local_to_world.apply_to_point(
                 tri.vertices[1].position);
@@ -552,7 +1945,7 @@ class TriangleBVH : public Geometry
         auto ret = newBox<UntransformedTriangleBVH>();
         ret->initialize(
             build_triangles.data(),
-            static_cast<uint32_t>(build_triangles.size()));
+            static_cast<uint32_t>(build_triangles.size()), params);
 
         return ret;
     }
@@ -561,11 +1954,12 @@ public:
 
     TriangleBVH(
         std::vector<mesh::triangle_t> build_triangles,
-        const FTransform3 &local_to_world)
+        const FTransform3 &local_to_world, const TriangleBVHParams &params)
     {
         AGZ_HIERARCHY_TRY
 
-        untransformed_ = load(std::move(build_triangles), local_to_world);
+        untransformed_ = load(
+            std::move(build_triangles), local_to_world, params);
 
         world_bound_ = AABB();
         for(auto &prim : untransformed_->get_prims())
@@ -596,6 +1990,12 @@ public:
         return untransformed_->closest_intersection(r, inct);
     }
 
+    int random_intersection(
+        const Ray &r, real u, GeometryIntersection *inct) const noexcept override
+    {
+        return untransformed_->random_intersection(r, u, inct);
+    }
+
     AABB world_bound() const noexcept override
     {
         return world_bound_;
@@ -612,9 +2012,9 @@ public:
     }
 
     SurfacePoint sample(
-        const FVec3 &, real *pdf, const Sample3 &sam) const noexcept override
+        const FVec3 &ref, real *pdf, const Sample3 &sam) const noexcept override
     {
-        return sample(pdf, sam);
+        return untransformed_->sample(ref, pdf, sam);
     }
 
     real pdf(const FVec3 &) const noexcept override
@@ -622,27 +2022,200 @@ public:
         return 1 / surface_area();
     }
 
-    real pdf(const FVec3 &, const FVec3 &sample) const noexcept override
+    real pdf(const FVec3 &ref, const FVec3 &sample) const noexcept override
     {
-        return pdf(sample);
+        return untransformed_->pdf(ref, sample);
     }
 };
 
-RC<Geometry> create_triangle_bvh_noembree(
+/**
+ * @brief instance of a shared local-space triangle bvh
+ *
+ * only the transform is stored per instance. rays are transformed into the
+ * local space of the shared bvh.
+ */
+class TriangleBVHInstance : public TransformedGeometry
+{
+    RC<const UntransformedTriangleBVH> mesh_;
+    AABB world_bound_;
+
+public:
+
+    TriangleBVHInstance(
+        RC<const UntransformedTriangleBVH> mesh,
+        const FTransform3 &local_to_world)
+        : mesh_(std::move(mesh))
+    {
+        AGZ_HIERARCHY_TRY
+
+        init_transform(local_to_world);
+
+        world_bound_ = to_world(mesh_->local_bound());
+        for(int i = 0; i != 3; ++i)
+        {
+            if(world_bound_.low[i] >= world_bound_.high[i])
+                world_bound_.low[i] = world_bound_.high[i] -
+                                      real(0.1) * std::abs(world_bound_.high[i]);
+        }
+
+        AGZ_HIERARCHY_WRAP("in initializing triangle_bvh instance")
+    }
+
+    bool has_intersection(const Ray &r) const noexcept override
+    {
+        return mesh_->has_intersection(to_local(r));
+    }
+
+    bool closest_intersection(
+        const Ray &r, GeometryIntersection *inct) const noexcept override
+    {
+        if(!mesh_->closest_intersection(to_local(r), inct))
+            return false;
+        to_world(inct);
+        return true;
+    }
+
+    int random_intersection(
+        const Ray &r, real u, GeometryIntersection *inct) const noexcept override
+    {
+        const int count = mesh_->random_intersection(to_local(r), u, inct);
+        if(count)
+            to_world(inct);
+        return count;
+    }
+
+    AABB world_bound() const noexcept override
+    {
+        return world_bound_;
+    }
+
+    real surface_area() const noexcept override
+    {
+        return mesh_->surface_area()
+             * local_to_world_ratio_ * local_to_world_ratio_;
+    }
+
+    SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept override
+    {
+        SurfacePoint spt = mesh_->sample(pdf, sam);
+        to_world(&spt);
+        *pdf /= local_to_world_ratio_ * local_to_world_ratio_;
+        return spt;
+    }
+
+    SurfacePoint sample(
+        const FVec3 &ref, real *pdf, const Sample3 &sam) const noexcept override
+    {
+        SurfacePoint spt = mesh_->sample(
+            local_to_world_.apply_inverse_to_point(ref), pdf, sam);
+        to_world(&spt);
+        *pdf /= local_to_world_ratio_ * local_to_world_ratio_;
+        return spt;
+    }
+
+    real pdf(const FVec3 &) const noexcept override
+    {
+        return 1 / surface_area();
+    }
+
+    real pdf(const FVec3 &ref, const FVec3 &sample) const noexcept override
+    {
+        const real local_pdf = mesh_->pdf(
+            local_to_world_.apply_inverse_to_point(ref),
+            local_to_world_.apply_inverse_to_point(sample));
+        return local_pdf / (local_to_world_ratio_ * local_to_world_ratio_);
+    }
+};
+
+TriangleBVHParams TriangleBVHParams::from_quality(Quality quality) noexcept
+{
+    TriangleBVHParams ret;
+    ret.quality = quality;
+
+    switch(quality)
+    {
+    case Quality::Fast:
+        ret.sah_bin_count = 8;
+        ret.sah_all_axes  = false;
+        ret.max_leaf_size = 12;
+        break;
+    case Quality::Medium:
+        ret.sah_bin_count = 16;
+        ret.sah_all_axes  = true;
+        ret.max_leaf_size = 8;
+        break;
+    case Quality::High:
+        ret.sah_bin_count = 32;
+        ret.sah_all_axes  = true;
+        ret.max_leaf_size = 4;
+        break;
+    }
+
+    return ret;
+}
+
+RC<const UntransformedTriangleBVH> create_untransformed_triangle_bvh(
     std::vector<mesh::triangle_t> build_triangles,
+    const TriangleBVHParams &params)
+{
+    auto ret = newRC<UntransformedTriangleBVH>();
+    ret->initialize(
+        build_triangles.data(),
+        static_cast<uint32_t>(build_triangles.size()), params);
+    return ret;
+}
+
+std::vector<unsigned char> serialize_triangle_bvh(
+    const std::vector<mesh::triangle_t> &triangles,
+    const TriangleBVHParams &params)
+{
+    assert(!triangles.empty());
+
+    TriangleBVHParams build_params = params;
+    build_params.cache_directory.clear();
+    build_params.prebuilt = {};
+
+    const auto build_start_time = std::chrono::steady_clock::now();
+
+    UntransformedTriangleBVH bvh;
+    bvh.initialize(
+        triangles.data(), static_cast<uint32_t>(triangles.size()), build_params);
+
+    const auto build_ms = std::chrono::duration_cast<
+        std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - build_start_time);
+
+    const uint64_t key = bvh_cache::compute_key(
+        triangles.data(), static_cast<uint32_t>(triangles.size()), params);
+
+    return bvh.serialize(key, static_cast<uint32_t>(build_ms.count()));
+}
+
+RC<Geometry> create_triangle_bvh_instance(
+    RC<const UntransformedTriangleBVH> mesh,
     const FTransform3 &local_to_world)
 {
-    return newRC<TriangleBVH>(std::move(build_triangles), local_to_world);
+    return newRC<TriangleBVHInstance>(std::move(mesh), local_to_world);
+}
+
+RC<Geometry> create_triangle_bvh_noembree(
+    std::vector<mesh::triangle_t> build_triangles,
+    const FTransform3 &local_to_world,
+    const TriangleBVHParams &params)
+{
+    return newRC<TriangleBVH>(
+        std::move(build_triangles), local_to_world, params);
 }
 
 #ifndef USE_EMBREE
 
 RC<Geometry> create_triangle_bvh(
     std::vector<mesh::triangle_t> build_triangles,
-    const Transform3 &local_to_world)
+    const FTransform3 &local_to_world,
+    const TriangleBVHParams &params)
 {
     return create_triangle_bvh_noembree(
-        std::move(build_triangles), local_to_world);
+        std::move(build_triangles), local_to_world, params);
 }
 
 #endif
@@ -1,10 +1,13 @@
 #ifdef USE_EMBREE
 
+#include <algorithm>
+
 #include <embree3/rtcore.h>
 #include <embree3/rtcore_ray.h>
 
 #include <agz/tracer/core/geometry.h>
 #include <agz/tracer/core/intersection.h>
+#include <agz/tracer/create/geometry.h>
 #include <agz/tracer/utility/embree.h>
 #include <agz/tracer/utility/logger.h>
 #include <agz/tracer/utility/triangle_aux.h>
@@ -62,6 +65,54 @@ namespace tri_bvh_embree_ws
         throw ObjectConstructionException(embree_err_str(err));
     }
 
+    /**
+     * @brief intersection context for visiting all hits in one traversal
+     */
+    struct AllHitsContext
+    {
+        // must be the first member
+        RTCIntersectContext context;
+
+        IntersectionReservoir *reservoir = nullptr;
+
+        // a hit may be reported more than once with spatial splits.
+        // primitives of the first hits are recorded to skip duplicates
+        static constexpr int RECORDED_PRIM_COUNT = 64;
+        unsigned recorded_prims[RECORDED_PRIM_COUNT];
+        int recorded_prim_count = 0;
+
+        real t = 0, u = 0, v = 0;
+        unsigned prim_id = 0;
+    };
+
+    void collect_hit(const RTCFilterFunctionNArguments *args)
+    {
+        assert(args->N == 1);
+        if(!args->valid[0])
+            return;
+
+        // reject the hit so that the traversal continues
+        args->valid[0] = 0;
+
+        auto ctx = reinterpret_cast<AllHitsContext*>(args->context);
+        const unsigned prim_id = RTCHitN_primID(args->hit, 1, 0);
+
+        const unsigned *recorded_end =
+            ctx->recorded_prims + ctx->recorded_prim_count;
+        if(std::find(ctx->recorded_prims, recorded_end, prim_id) != recorded_end)
+            return;
+        if(ctx->recorded_prim_count < AllHitsContext::RECORDED_PRIM_COUNT)
+            ctx->recorded_prims[ctx->recorded_prim_count++] = prim_id;
+
+        if(ctx->reservoir->add())
+        {
+            ctx->t       = RTCRayN_tfar(args->ray, 1, 0);
+            ctx->u       = RTCHitN_u(args->hit, 1, 0);
+            ctx->v       = RTCHitN_v(args->hit, 1, 0);
+            ctx->prim_id = prim_id;
+        }
+    }
+
     class UntransformedTriangleBVH : public misc::uncopyable_t
     {
         RTCScene scene_ = nullptr;
@@ -83,7 +134,9 @@ namespace tri_bvh_embree_ws
                 rtcReleaseScene(scene_);
         }
 
-        void initialize(const mesh::triangle_t *triangles, size_t triangle_count)
+        void initialize(
+            const mesh::triangle_t *triangles, size_t triangle_count,
+            RTCBuildQuality build_quality)
         {
             assert(triangles && triangle_count > 0);
             assert(!scene_);
@@ -179,12 +232,13 @@ namespace tri_bvh_embree_ws
 
             prim_sampler_.initialize(areas.data(), static_cast<int>(areas.size()));
 
-            rtcSetGeometryBuildQuality(mesh, RTC_BUILD_QUALITY_HIGH);
+            rtcSetGeometryBuildQuality(mesh, build_quality);
             rtcCommitGeometry(mesh);
 
             geo_id_ = rtcAttachGeometry(scene_, mesh);
             
-            rtcSetSceneBuildQuality(scene_, RTC_BUILD_QUALITY_HIGH);
+            rtcSetSceneFlags(scene_, RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION);
+            rtcSetSceneBuildQuality(scene_, build_quality);
             rtcCommitScene(scene_);
         }
 
@@ -228,24 +282,65 @@ namespace tri_bvh_embree_ws
             if(rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
                 return false;
 
-            const real t_val = rayhit.ray.tfar;
-            const real u = rayhit.hit.u;
-            const real v = rayhit.hit.v;
-            const PrimitiveInfo &info = prim_info_[rayhit.hit.primID];
+            fill_intersection(
+                r, rayhit.ray.tfar, rayhit.hit.u, rayhit.hit.v,
+                rayhit.hit.primID, inct);
+            return true;
+        }
+
+        int random_intersection(
+            const Ray &r, real u, GeometryIntersection *inct) const noexcept
+        {
+            alignas(16) RTCRayHit rayhit = {
+            {
+                r.o.x, r.o.y, r.o.z,
+                r.t_min,
+                r.d.x, r.d.y, r.d.z,
+                0,
+                r.t_max,
+                static_cast<unsigned>(-1), 0, 0
+            }, { } };
+
+            rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+            rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+            rayhit.hit.primID = RTC_INVALID_GEOMETRY_ID;
+
+            IntersectionReservoir reservoir(u);
+
+            AllHitsContext ctx;
+            rtcInitIntersectContext(&ctx.context);
+            ctx.context.filter = &collect_hit;
+            ctx.reservoir = &reservoir;
+
+            rtcIntersect1(scene_, &ctx.context, &rayhit);
+
+            if(reservoir.count())
+                fill_intersection(r, ctx.t, ctx.u, ctx.v, ctx.prim_id, inct);
+            return reservoir.count();
+        }
+
+        void fill_intersection(
+            const Ray &r, real t_val, real u, real v, unsigned prim_id,
+            GeometryIntersection *inct) const noexcept
+        {
+            const PrimitiveInfo &info = prim_info_[prim_id];
 
             inct->pos = r.at(t_val);
             inct->geometry_coord = FCoord(info.x, cross(info.z, info.x), info.z);
             inct->uv = info.t_a + u * info.t_b_a + v * info.t_c_a;
             inct->t = t_val;
 
+            const Primitive &prim = prims_[prim_id];
+            triangle_dpduv(
+                prim.b_a, prim.c_a, info.t_b_a, info.t_c_a,
+                &inct->dpdu, &inct->dpdv);
+
             const FVec3 user_z = FVec3(info.n_a) +
                                  u * FVec3(info.n_b_a) +
                                  v * FVec3(info.n_c_a);
             inct->user_coord = inct->geometry_coord.rotate_to_new_z(user_z);
 
             inct->wr = -r.d;
-
-            return true;
         }
 
         SurfacePoint uniformly_sample(const Sample3 &sam) const noexcept
@@ -299,9 +394,20 @@ class TriangleBVHEmbree : public Geometry
 
     real surface_area_ = 0;
 
+    static RTCBuildQuality to_embree_build_quality(
+        TriangleBVHParams::Quality quality) noexcept
+    {
+        switch(quality)
+        {
+        case TriangleBVHParams::Quality::Fast:   return RTC_BUILD_QUALITY_LOW;
+        case TriangleBVHParams::Quality::Medium: return RTC_BUILD_QUALITY_MEDIUM;
+        default:                                 return RTC_BUILD_QUALITY_HIGH;
+        }
+    }
+
     static Box<const tri_bvh_embree_ws::UntransformedTriangleBVH> load(
         std::vector<mesh::triangle_t> build_triangles,
-        const FTransform3 &local_to_world)
+        const FTransform3 &local_to_world, const TriangleBVHParams &params)
     {
         for(auto &tri : build_triangles)
         {
@@ -320,7 +426,9 @@ class TriangleBVHEmbree : public Geometry
         }
 
         auto ret = newBox<tri_bvh_embree_ws::UntransformedTriangleBVH>();
-        ret->initialize(build_triangles.data(), build_triangles.size());
+        ret->initialize(
+            build_triangles.data(), build_triangles.size(),
+            to_embree_build_quality(params.quality));
 
         return ret;
     }
@@ -329,11 +437,12 @@ public:
 
     TriangleBVHEmbree(
         std::vector<mesh::triangle_t> build_triangles,
-        const FTransform3 &local_to_world)
+        const FTransform3 &local_to_world, const TriangleBVHParams &params)
     {
         AGZ_HIERARCHY_TRY
 
-        untransformed_ = load(std::move(build_triangles), local_to_world);
+        untransformed_ = load(
+            std::move(build_triangles), local_to_world, params);
 
         world_bound_ = AABB();
         surface_area_ = 0;
@@ -366,6 +475,12 @@ public:
         return untransformed_->closest_intersection(r, inct);
     }
 
+    int random_intersection(
+        const Ray &r, real u, GeometryIntersection *inct) const noexcept override
+    {
+        return untransformed_->random_intersection(r, u, inct);
+    }
+
     AABB world_bound() const noexcept override
     {
         return world_bound_;
@@ -401,16 +516,20 @@ public:
 
 RC<Geometry> create_triangle_bvh_embree(
     std::vector<mesh::triangle_t> build_triangles,
-    const FTransform3 &local_to_world)
+    const FTransform3 &local_to_world,
+    const TriangleBVHParams &params)
 {
-    return newRC<TriangleBVHEmbree>(std::move(build_triangles), local_to_world);
+    return newRC<TriangleBVHEmbree>(
+        std::move(build_triangles), local_to_world, params);
 }
 
 RC<Geometry> create_triangle_bvh(
     std::vector<mesh::triangle_t> build_triangles,
-    const FTransform3 &local_to_world)
+    const FTransform3 &local_to_world,
+    const TriangleBVHParams &params)
 {
-    return create_triangle_bvh_embree(std::move(build_triangles), local_to_world);
+    return create_triangle_bvh_embree(
+        std::move(build_triangles), local_to_world, params);
 }
 
 AGZ_TRACER_END
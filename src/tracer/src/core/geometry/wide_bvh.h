@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+
+// this header is also included by the avx translation unit, which must not
+// contain any inline function shared with other translation units.
+// so only plain data types are used here.
+
+namespace agz::tracer::wide_bvh
+{
+
+    /**
+     * @brief node of n-wide bvh
+     *
+     * bounds of children are stored in soa layout:
+     *  bounds[0..2][i]: low  x/y/z of child i
+     *  bounds[3..5][i]: high x/y/z of child i
+     *
+     * empty slots have low = +inf and high = -inf, which never pass the slab test
+     */
+    template<int N>
+    struct alignas(4 * N) Node
+    {
+        float bounds[6][N];
+
+        // interior child: index of child node
+        // leaf child:     index of the first triangle packet
+        uint32_t child[N];
+
+        // 0 for interior child. otherwise, number of triangle packets in leaf
+        uint32_t packet_count[N];
+    };
+
+    /**
+     * @brief n triangles stored in soa layout
+     *
+     * unused lanes are filled with degenerate triangles
+     */
+    template<int N>
+    struct alignas(4 * N) TrianglePacket
+    {
+        float a  [3][N];
+        float b_a[3][N];
+        float c_a[3][N];
+
+        // index of triangle in the primitive array of original bvh
+        uint32_t prim_idx[N];
+    };
+
+    struct RayData
+    {
+        float o[3];
+        float d[3];
+        float inv_dir[3];
+        float t_min;
+        float t_max;
+    };
+
+    struct Hit
+    {
+        float t;
+        float u, v; // barycentric coordinate w.r.t. b_a and c_a
+        uint32_t prim_idx;
+    };
+
+    // 4-wide bvh with sse
+
+    bool has_intersection(
+        const Node<4> *nodes, const TrianglePacket<4> *packets,
+        const RayData &ray) noexcept;
+
+    bool closest_intersection(
+        const Node<4> *nodes, const TrianglePacket<4> *packets,
+        const RayData &ray, Hit *hit) noexcept;
+
+    // 8-wide bvh with avx. only available when is_avx_supported() is true
+
+    bool has_intersection(
+        const Node<8> *nodes, const TrianglePacket<8> *packets,
+        const RayData &ray) noexcept;
+
+    bool closest_intersection(
+        const Node<8> *nodes, const TrianglePacket<8> *packets,
+        const RayData &ray, Hit *hit) noexcept;
+
+    /**
+     * @brief can avx instructions be executed on current cpu
+     */
+    bool is_avx_supported() noexcept;
+
+} // namespace agz::tracer::wide_bvh
@@ -0,0 +1,66 @@
+// this file is compiled with avx enabled. see CMakeLists.txt of tracer.
+// functions here must only be called when is_avx_supported() returns true.
+
+#include <immintrin.h>
+
+#include "./wide_bvh.h"
+
+namespace agz::tracer::wide_bvh
+{
+
+namespace
+{
+
+    struct SIMD8
+    {
+        static constexpr int N = 8;
+
+        using F = __m256;
+
+        static F set1(float v) noexcept { return _mm256_set1_ps(v); }
+
+        static F load(const float *p) noexcept { return _mm256_load_ps(p); }
+
+        static void store(float *p, F v) noexcept { _mm256_store_ps(p, v); }
+
+        static F add(F a, F b) noexcept { return _mm256_add_ps(a, b); }
+        static F sub(F a, F b) noexcept { return _mm256_sub_ps(a, b); }
+        static F mul(F a, F b) noexcept { return _mm256_mul_ps(a, b); }
+        static F div(F a, F b) noexcept { return _mm256_div_ps(a, b); }
+
+        static F min(F a, F b) noexcept { return _mm256_min_ps(a, b); }
+        static F max(F a, F b) noexcept { return _mm256_max_ps(a, b); }
+
+        static F cmp_le(F a, F b) noexcept { return _mm256_cmp_ps(a, b, _CMP_LE_OQ);  }
+        static F cmp_ge(F a, F b) noexcept { return _mm256_cmp_ps(a, b, _CMP_GE_OQ);  }
+        static F cmp_ne(F a, F b) noexcept { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+
+        static F and_(F a, F b) noexcept { return _mm256_and_ps(a, b); }
+
+        static int movemask(F v) noexcept { return _mm256_movemask_ps(v); }
+    };
+
+} // namespace anonymous
+
+} // namespace agz::tracer::wide_bvh
+
+#include "./wide_bvh_traversal.inl"
+
+namespace agz::tracer::wide_bvh
+{
+
+bool has_intersection(
+    const Node<8> *nodes, const TrianglePacket<8> *packets,
+    const RayData &ray) noexcept
+{
+    return has_intersection_impl<SIMD8>(nodes, packets, ray);
+}
+
+bool closest_intersection(
+    const Node<8> *nodes, const TrianglePacket<8> *packets,
+    const RayData &ray, Hit *hit) noexcept
+{
+    return closest_intersection_impl<SIMD8>(nodes, packets, ray, hit);
+}
+
+} // namespace agz::tracer::wide_bvh
@@ -0,0 +1,84 @@
+#include <xmmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "./wide_bvh.h"
+
+namespace agz::tracer::wide_bvh
+{
+
+namespace
+{
+
+    struct SIMD4
+    {
+        static constexpr int N = 4;
+
+        using F = __m128;
+
+        static F set1(float v) noexcept { return _mm_set1_ps(v); }
+
+        static F load(const float *p) noexcept { return _mm_load_ps(p); }
+
+        static void store(float *p, F v) noexcept { _mm_store_ps(p, v); }
+
+        static F add(F a, F b) noexcept { return _mm_add_ps(a, b); }
+        static F sub(F a, F b) noexcept { return _mm_sub_ps(a, b); }
+        static F mul(F a, F b) noexcept { return _mm_mul_ps(a, b); }
+        static F div(F a, F b) noexcept { return _mm_div_ps(a, b); }
+
+        static F min(F a, F b) noexcept { return _mm_min_ps(a, b); }
+        static F max(F a, F b) noexcept { return _mm_max_ps(a, b); }
+
+        static F cmp_le(F a, F b) noexcept { return _mm_cmple_ps (a, b); }
+        static F cmp_ge(F a, F b) noexcept { return _mm_cmpge_ps (a, b); }
+        static F cmp_ne(F a, F b) noexcept { return _mm_cmpneq_ps(a, b); }
+
+        static F and_(F a, F b) noexcept { return _mm_and_ps(a, b); }
+
+        static int movemask(F v) noexcept { return _mm_movemask_ps(v); }
+    };
+
+} // namespace anonymous
+
+} // namespace agz::tracer::wide_bvh
+
+#include "./wide_bvh_traversal.inl"
+
+namespace agz::tracer::wide_bvh
+{
+
+bool has_intersection(
+    const Node<4> *nodes, const TrianglePacket<4> *packets,
+    const RayData &ray) noexcept
+{
+    return has_intersection_impl<SIMD4>(nodes, packets, ray);
+}
+
+bool closest_intersection(
+    const Node<4> *nodes, const TrianglePacket<4> *packets,
+    const RayData &ray, Hit *hit) noexcept
+{
+    return closest_intersection_impl<SIMD4>(nodes, packets, ray, hit);
+}
+
+bool is_avx_supported() noexcept
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    const bool os_uses_xsave = (info[2] & (1 << 27)) != 0;
+    const bool cpu_has_avx   = (info[2] & (1 << 28)) != 0;
+    if(!os_uses_xsave || !cpu_has_avx)
+        return false;
+    // os must save the ymm registers on context switch
+    return (_xgetbv(0) & 0x6) == 0x6;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx") != 0;
+#endif
+}
+
+} // namespace agz::tracer::wide_bvh
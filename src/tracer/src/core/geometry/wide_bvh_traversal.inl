@@ -0,0 +1,325 @@
+#pragma once
+
+// generic traversal of n-wide bvh
+//
+// included by wide_bvh_sse.cpp and wide_bvh_avx.cpp after defining a simd
+// wrapper. everything here lives in an anonymous namespace so that code
+// compiled with different instruction sets is never merged by the linker.
+//
+// simd wrapper interface:
+//
+//  struct SIMD
+//  {
+//      static constexpr int N;
+//      using F;
+//      static F set1(float); static F load(const float*); static void store(float*, F);
+//      static F add(F, F); static F sub(F, F); static F mul(F, F); static F div(F, F);
+//      static F min(F, F); static F max(F, F);
+//      static F cmp_le(F, F); static F cmp_ge(F, F); static F cmp_ne(F, F);
+//      static F and_(F, F);
+//      static int movemask(F);
+//  };
+
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace agz::tracer::wide_bvh
+{
+
+namespace
+{
+
+    constexpr int TRAVERSAL_STACK_SIZE = 1024;
+
+    inline int first_bit_index(uint32_t mask) noexcept
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward(&idx, mask);
+        return static_cast<int>(idx);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    struct StackEntry
+    {
+        uint32_t node;
+        float t;
+    };
+
+    template<typename SIMD>
+    struct SIMDRay
+    {
+        using F = typename SIMD::F;
+
+        F o[3], d[3], inv_dir[3];
+
+        // indices of near/far planes in Node::bounds
+        int near_idx[3], far_idx[3];
+
+        explicit SIMDRay(const RayData &ray) noexcept
+        {
+            for(int i = 0; i < 3; ++i)
+            {
+                o[i]       = SIMD::set1(ray.o[i]);
+                d[i]       = SIMD::set1(ray.d[i]);
+                inv_dir[i] = SIMD::set1(ray.inv_dir[i]);
+
+                near_idx[i] = ray.inv_dir[i] >= 0 ? i : i + 3;
+                far_idx[i]  = ray.inv_dir[i] >= 0 ? i + 3 : i;
+            }
+        }
+    };
+
+    /**
+     * @brief slab test with all children of a node
+     *
+     * @return mask of intersected children
+     */
+    template<typename SIMD>
+    int intersect_children(
+        const Node<SIMD::N> &node, const SIMDRay<SIMD> &ray,
+        float t_min, float t_max, typename SIMD::F *t_near) noexcept
+    {
+        using F = typename SIMD::F;
+
+        F tn = SIMD::set1(t_min);
+        F tf = SIMD::set1(t_max);
+
+        for(int i = 0; i < 3; ++i)
+        {
+            const F n = SIMD::mul(
+                SIMD::sub(SIMD::load(node.bounds[ray.near_idx[i]]), ray.o[i]),
+                ray.inv_dir[i]);
+            const F f = SIMD::mul(
+                SIMD::sub(SIMD::load(node.bounds[ray.far_idx[i]]), ray.o[i]),
+                ray.inv_dir[i]);
+            tn = SIMD::max(tn, n);
+            tf = SIMD::min(tf, f);
+        }
+
+        *t_near = tn;
+        return SIMD::movemask(SIMD::cmp_le(tn, tf));
+    }
+
+    /**
+     * @brief moller-trumbore test with all triangles in a packet
+     *
+     * @return mask of intersected triangles
+     */
+    template<typename SIMD>
+    int intersect_packet(
+        const TrianglePacket<SIMD::N> &packet, const SIMDRay<SIMD> &ray,
+        float t_min, float t_max,
+        typename SIMD::F *t_out,
+        typename SIMD::F *u_out,
+        typename SIMD::F *v_out) noexcept
+    {
+        using F = typename SIMD::F;
+
+        const F e1x = SIMD::load(packet.b_a[0]);
+        const F e1y = SIMD::load(packet.b_a[1]);
+        const F e1z = SIMD::load(packet.b_a[2]);
+        const F e2x = SIMD::load(packet.c_a[0]);
+        const F e2y = SIMD::load(packet.c_a[1]);
+        const F e2z = SIMD::load(packet.c_a[2]);
+
+        // s1 = cross(d, e2)
+        const F s1x = SIMD::sub(SIMD::mul(ray.d[1], e2z), SIMD::mul(ray.d[2], e2y));
+        const F s1y = SIMD::sub(SIMD::mul(ray.d[2], e2x), SIMD::mul(ray.d[0], e2z));
+        const F s1z = SIMD::sub(SIMD::mul(ray.d[0], e2y), SIMD::mul(ray.d[1], e2x));
+
+        const F div = SIMD::add(
+            SIMD::add(SIMD::mul(s1x, e1x), SIMD::mul(s1y, e1y)),
+            SIMD::mul(s1z, e1z));
+        const F zero = SIMD::set1(0);
+        const F inv_div = SIMD::div(SIMD::set1(1), div);
+
+        // o_a = o - a
+        const F oax = SIMD::sub(ray.o[0], SIMD::load(packet.a[0]));
+        const F oay = SIMD::sub(ray.o[1], SIMD::load(packet.a[1]));
+        const F oaz = SIMD::sub(ray.o[2], SIMD::load(packet.a[2]));
+
+        const F alpha = SIMD::mul(inv_div, SIMD::add(
+            SIMD::add(SIMD::mul(oax, s1x), SIMD::mul(oay, s1y)),
+            SIMD::mul(oaz, s1z)));
+
+        // s2 = cross(o_a, e1)
+        const F s2x = SIMD::sub(SIMD::mul(oay, e1z), SIMD::mul(oaz, e1y));
+        const F s2y = SIMD::sub(SIMD::mul(oaz, e1x), SIMD::mul(oax, e1z));
+        const F s2z = SIMD::sub(SIMD::mul(oax, e1y), SIMD::mul(oay, e1x));
+
+        const F beta = SIMD::mul(inv_div, SIMD::add(
+            SIMD::add(SIMD::mul(ray.d[0], s2x), SIMD::mul(ray.d[1], s2y)),
+            SIMD::mul(ray.d[2], s2z)));
+
+        const F t = SIMD::mul(inv_div, SIMD::add(
+            SIMD::add(SIMD::mul(e2x, s2x), SIMD::mul(e2y, s2y)),
+            SIMD::mul(e2z, s2z)));
+
+        F mask = SIMD::cmp_ne(div, zero);
+        mask = SIMD::and_(mask, SIMD::cmp_ge(alpha, zero));
+        mask = SIMD::and_(mask, SIMD::cmp_ge(beta, zero));
+        mask = SIMD::and_(mask, SIMD::cmp_le(SIMD::add(alpha, beta), SIMD::set1(1)));
+        mask = SIMD::and_(mask, SIMD::cmp_ge(t, SIMD::set1(t_min)));
+        mask = SIMD::and_(mask, SIMD::cmp_le(t, SIMD::set1(t_max)));
+
+        *t_out = t;
+        *u_out = alpha;
+        *v_out = beta;
+
+        return SIMD::movemask(mask);
+    }
+
+    template<typename SIMD>
+    bool has_intersection_impl(
+        const Node<SIMD::N> *nodes, const TrianglePacket<SIMD::N> *packets,
+        const RayData &ray) noexcept
+    {
+        using F = typename SIMD::F;
+
+        thread_local uint32_t stack[TRAVERSAL_STACK_SIZE];
+
+        const SIMDRay<SIMD> simd_ray(ray);
+
+        int top = 0;
+        stack[top++] = 0;
+
+        while(top)
+        {
+            const Node<SIMD::N> &node = nodes[stack[--top]];
+
+            F t_near;
+            uint32_t mask = static_cast<uint32_t>(intersect_children(
+                node, simd_ray, ray.t_min, ray.t_max, &t_near));
+
+            while(mask)
+            {
+                const int i = first_bit_index(mask);
+                mask &= mask - 1;
+
+                if(!node.packet_count[i])
+                {
+                    assert(top < TRAVERSAL_STACK_SIZE);
+                    stack[top++] = node.child[i];
+                    continue;
+                }
+
+                const uint32_t packet_end = node.child[i] + node.packet_count[i];
+                for(uint32_t p = node.child[i]; p < packet_end; ++p)
+                {
+                    F t, u, v;
+                    if(intersect_packet(
+                        packets[p], simd_ray, ray.t_min, ray.t_max, &t, &u, &v))
+                        return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    template<typename SIMD>
+    bool closest_intersection_impl(
+        const Node<SIMD::N> *nodes, const TrianglePacket<SIMD::N> *packets,
+        const RayData &ray, Hit *hit) noexcept
+    {
+        using F = typename SIMD::F;
+        constexpr int N = SIMD::N;
+
+        thread_local StackEntry stack[TRAVERSAL_STACK_SIZE];
+
+        const SIMDRay<SIMD> simd_ray(ray);
+
+        float t_max = ray.t_max;
+        bool found = false;
+
+        int top = 0;
+        stack[top++] = { 0, ray.t_min };
+
+        while(top)
+        {
+            const StackEntry entry = stack[--top];
+            if(entry.t > t_max)
+                continue;
+
+            const Node<N> &node = nodes[entry.node];
+
+            F t_near_vec;
+            uint32_t mask = static_cast<uint32_t>(intersect_children(
+                node, simd_ray, ray.t_min, t_max, &t_near_vec));
+            if(!mask)
+                continue;
+
+            alignas(4 * N) float t_near[N];
+            SIMD::store(t_near, t_near_vec);
+
+            // interior children sorted by t_near in descending order
+            StackEntry interior[N];
+            int interior_count = 0;
+
+            while(mask)
+            {
+                const int i = first_bit_index(mask);
+                mask &= mask - 1;
+
+                if(!node.packet_count[i])
+                {
+                    int j = interior_count++;
+                    while(j > 0 && interior[j - 1].t < t_near[i])
+                    {
+                        interior[j] = interior[j - 1];
+                        --j;
+                    }
+                    interior[j] = { node.child[i], t_near[i] };
+                    continue;
+                }
+
+                const uint32_t packet_end = node.child[i] + node.packet_count[i];
+                for(uint32_t p = node.child[i]; p < packet_end; ++p)
+                {
+                    F t_vec, u_vec, v_vec;
+                    uint32_t tri_mask = static_cast<uint32_t>(intersect_packet(
+                        packets[p], simd_ray, ray.t_min, t_max,
+                        &t_vec, &u_vec, &v_vec));
+                    if(!tri_mask)
+                        continue;
+
+                    alignas(4 * N) float t_arr[N], u_arr[N], v_arr[N];
+                    SIMD::store(t_arr, t_vec);
+                    SIMD::store(u_arr, u_vec);
+                    SIMD::store(v_arr, v_vec);
+
+                    while(tri_mask)
+                    {
+                        const int k = first_bit_index(tri_mask);
+                        tri_mask &= tri_mask - 1;
+
+                        if(t_arr[k] <= t_max)
+                        {
+                            t_max         = t_arr[k];
+                            hit->t        = t_arr[k];
+                            hit->u        = u_arr[k];
+                            hit->v        = v_arr[k];
+                            hit->prim_idx = packets[p].prim_idx[k];
+                            found = true;
+                        }
+                    }
+                }
+            }
+
+            assert(top + interior_count <= TRAVERSAL_STACK_SIZE);
+            for(int j = 0; j < interior_count; ++j)
+                stack[top++] = interior[j];
+        }
+
+        return found;
+    }
+
+} // namespace anonymous
+
+} // namespace agz::tracer::wide_bvh
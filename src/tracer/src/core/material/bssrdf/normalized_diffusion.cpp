@@ -416,9 +416,9 @@ public:
 
     BSSRDF *create(const EntityIntersection &inct, Arena &arena) const override
     {
-        const FSpectrum A    = A_->sample_spectrum(inct.uv);
-        const FSpectrum dmfp = dmfp_->sample_spectrum(inct.uv);
-        const real eta       = eta_->sample_real(inct.uv);
+        const FSpectrum A    = A_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const FSpectrum dmfp = dmfp_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const real eta       = eta_->sample_real(inct.uv, inct.duvdx, inct.duvdy);
         return arena.create<NormalizedDiffusionBSSRDF>(inct, eta, A, dmfp);
     }
 };
@@ -180,68 +180,26 @@ BSSRDFSamplePiResult SeparableBSSRDF::sample_pi(
         -proj_coord.z,
         EPS(), std::max(EPS(), inct_ray_len));
 
-    // find all incts
-
-    struct InctListNode
-    {
-        EntityIntersection inct;
-        InctListNode *next = nullptr;
-
-    } *inct_list_entry = nullptr;
-
-    int inct_cnt = 0;
-
-    for(;;)
-    {
-        if(inct_ray.t_min >= inct_ray.t_max)
-            break;
-
-        EntityIntersection new_inct;
-        if(!po_.entity->closest_intersection(inct_ray, &new_inct))
-            break;
-
-        if(new_inct.material == po_.material)
-        {
-            static_assert(std::is_trivially_destructible_v<InctListNode>);
-            auto nNode = arena.create<InctListNode>();
-            nNode->inct = new_inct;
-            nNode->next = inct_list_entry;
-            inct_list_entry = nNode;
-            ++inct_cnt;
-        }
-
-        inct_ray.o = inct_ray.at(new_inct.t + EPS());
-        inct_ray.t_max -= new_inct.t + EPS();
-    }
+    // uniformly select one of all incts in a single traversal
 
+    EntityIntersection inct;
+    const int inct_cnt = po_.entity->random_intersection(inct_ray, sam.w, &inct);
     if(!inct_cnt)
         return BSSRDF_SAMPLE_PI_RESULT_INVALID;
 
-    // select an inct
-
-    auto [inct_idx, sample_w] = math::distribution::extract_uniform_int(
-        sam.w, 0, inct_cnt);
-    for(int i = 0; i < inct_idx; ++i)
-    {
-        assert(inct_list_entry);
-        inct_list_entry = inct_list_entry->next;
-        assert(inct_list_entry);
-    }
-
-    if(inct_list_entry->inct.material != po_.material)
+    if(inct.material != po_.material)
         return BSSRDF_SAMPLE_PI_RESULT_INVALID;
 
     // construct ret
 
-    const real pdf_radius = pdf_pi(inct_list_entry->inct);
+    const real pdf_radius = pdf_pi(inct);
 
     const BSDF *bsdf = arena.create_nodestruct<SeparableBSDF>(
-        inct_list_entry->inct.geometry_coord, eta_);
+        inct.geometry_coord, eta_);
 
     const real cos_theta_o = cos(po_.wr, po_.geometry_coord.z);
     const real fro = 1 - refl_aux::dielectric_fresnel(eta_, 1, cos_theta_o);
 
-    EntityIntersection inct = inct_list_entry->inct;
     inct.material = arena.create_nodestruct<SeparableBSDFMaterial>(bsdf);
 
     const FSpectrum coef = fro * eval_r(distance(inct.pos, po_.pos));
@@ -755,19 +755,21 @@ public:
     ShadingPoint shade(const EntityIntersection &inct, Arena &arena) const override
     {
         const Vec2 uv = inct.uv;
-        const FSpectrum base_color             = base_color_      ->sample_spectrum(uv);
-        const real     metallic               = metallic_        ->sample_real(uv);
-        const real     roughness              = roughness_       ->sample_real(uv);
-        const real     transmission           = transmission_    ->sample_real(uv);
-        const real     transmission_roughness = transmission_roughness_->sample_real(uv);
-        const real     ior                    = IOR_             ->sample_real(uv);
-        const FSpectrum specular_scale         = specular_scale_  ->sample_spectrum(uv);
-        const real     specular_tint          = specular_tint_   ->sample_real(uv);
-        const real     anisotropic            = anisotropic_     ->sample_real(uv);
-        const real     sheen                  = sheen_           ->sample_real(uv);
-        const real     sheen_tint             = sheen_tint_      ->sample_real(uv);
-        const real     clearcoat              = clearcoat_       ->sample_real(uv);
-        const real     clearcoat_gloss        = clearcoat_gloss_ ->sample_real(uv);
+        const Vec2 &duvdx = inct.duvdx;
+        const Vec2 &duvdy = inct.duvdy;
+        const FSpectrum base_color             = base_color_      ->sample_spectrum(uv, duvdx, duvdy);
+        const real     metallic               = metallic_        ->sample_real(uv, duvdx, duvdy);
+        const real     roughness              = roughness_       ->sample_real(uv, duvdx, duvdy);
+        const real     transmission           = transmission_    ->sample_real(uv, duvdx, duvdy);
+        const real     transmission_roughness = transmission_roughness_->sample_real(uv, duvdx, duvdy);
+        const real     ior                    = IOR_             ->sample_real(uv, duvdx, duvdy);
+        const FSpectrum specular_scale         = specular_scale_  ->sample_spectrum(uv, duvdx, duvdy);
+        const real     specular_tint          = specular_tint_   ->sample_real(uv, duvdx, duvdy);
+        const real     anisotropic            = anisotropic_     ->sample_real(uv, duvdx, duvdy);
+        const real     sheen                  = sheen_           ->sample_real(uv, duvdx, duvdy);
+        const real     sheen_tint             = sheen_tint_      ->sample_real(uv, duvdx, duvdy);
+        const real     clearcoat              = clearcoat_       ->sample_real(uv, duvdx, duvdy);
+        const real     clearcoat_gloss        = clearcoat_gloss_ ->sample_real(uv, duvdx, duvdy);
 
         const FCoord shading_coord = normal_mapper_->reorient(uv, inct.user_coord);
         const BSDF *bsdf = arena.create_nodestruct<disney_impl::DisneyBSDF>(
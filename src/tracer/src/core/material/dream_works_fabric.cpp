@@ -191,8 +191,8 @@ public:
         const FCoord shading_coord = normal_mapper_->reorient(
             inct.uv, inct.user_coord);
 
-        const FSpectrum color = color_->sample_spectrum(inct.uv);
-        const real roughness = math::saturate(roughness_->sample_real(inct.uv));
+        const FSpectrum color = color_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const real roughness = math::saturate(roughness_->sample_real(inct.uv, inct.duvdx, inct.duvdy));
 
         const auto bsdf = arena.create_nodestruct<AggregateBSDF<1>>(
             inct.geometry_coord, shading_coord, color);
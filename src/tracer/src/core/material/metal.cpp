@@ -42,11 +42,11 @@ public:
         const FCoord shading_coord = normal_mapper_->reorient(
             inct.uv, inct.user_coord);
 
-        const FSpectrum color   = color_->sample_spectrum(inct.uv);
-        const FSpectrum k       = k_->sample_spectrum(inct.uv);
-        const FSpectrum eta     = eta_->sample_spectrum(inct.uv);
-        const real roughness   = roughness_->sample_real(inct.uv);
-        const real anisotropic = anisotropic_->sample_real(inct.uv);
+        const FSpectrum color   = color_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const FSpectrum k       = k_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const FSpectrum eta     = eta_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const real roughness   = roughness_->sample_real(inct.uv, inct.duvdx, inct.duvdy);
+        const real anisotropic = anisotropic_->sample_real(inct.uv, inct.duvdx, inct.duvdy);
 
         const auto fresnel = arena.create_nodestruct<ColoredConductorPoint>(
             color, FSpectrum(1), eta, k);
@@ -98,9 +98,9 @@ public:
 
     ShadingPoint shade(const EntityIntersection &inct, Arena &arena) const override
     {
-        const FSpectrum rc  = rc_map_->sample_spectrum(inct.uv);
-        const FSpectrum ior = ior_   ->sample_spectrum(inct.uv);
-        const FSpectrum k   = k_     ->sample_spectrum(inct.uv);
+        const FSpectrum rc  = rc_map_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const FSpectrum ior = ior_   ->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const FSpectrum k   = k_     ->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
 
         const ConductorPoint *fresnel = arena.create_nodestruct<ConductorPoint>(
                                             ior, FSpectrum(1), k);
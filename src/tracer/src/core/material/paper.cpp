@@ -645,7 +645,7 @@ public:
         const Coord shading_coord = normal_mapper_->reorient(
             inct.uv, inct.user_coord);
 
-        const FSpectrum color = color_->sample_spectrum(inct.uv);
+        const FSpectrum color = color_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
 
         if(inct.geometry_coord.in_positive_z_hemisphere(inct.wr))
         {
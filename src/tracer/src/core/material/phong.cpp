@@ -32,9 +32,9 @@ public:
 
     ShadingPoint shade(const EntityIntersection &inct, Arena &arena) const override
     {
-        FSpectrum d = d_->sample_spectrum(inct.uv);
-        FSpectrum s = s_->sample_spectrum(inct.uv);
-        const real ns = ns_->sample_real(inct.uv);
+        FSpectrum d = d_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        FSpectrum s = s_->sample_spectrum(inct.uv, inct.duvdx, inct.duvdy);
+        const real ns = ns_->sample_real(inct.uv, inct.duvdx, inct.duvdy);
 
         // ensure energy conservation
 
@@ -1,9 +1,15 @@
+#include <atomic>
+
 #include <agz/tracer/core/medium.h>
 #include <agz/tracer/core/texture3d.h>
+#include <agz/tracer/create/medium.h>
+#include <agz/tracer/utility/logger.h>
 #include <agz/tracer/utility/phase_function.h>
 #include <agz/utility/misc.h>
 #include <agz/utility/texture.h>
 
+#include "./majorant_grid.h"
+
 AGZ_TRACER_BEGIN
 
 class HeterogeneousMedium : public Medium
@@ -14,11 +20,80 @@ class HeterogeneousMedium : public Medium
     RC<const Texture3D> albedo_;
     RC<const Texture3D> g_;
 
-    real max_density_;
-    real inv_max_density_;
+    MajorantGrid majorant_grid_;
 
     int max_scattering_count_;
 
+    bool ratio_tracking_;
+
+    // statistics of density lookups
+
+    bool report_cost_;
+
+    mutable std::atomic<uint64_t> tracking_count_ = 0;
+    mutable std::atomic<uint64_t> lookup_count_   = 0;
+
+    // expected lookup count when using the global majorant
+    mutable std::atomic<double> global_lookup_count_ = 0;
+
+    void record_cost(int lookups, real t_max) const noexcept
+    {
+        if(!report_cost_)
+            return;
+
+        ++tracking_count_;
+        lookup_count_ += lookups;
+
+        const double delta = double(majorant_grid_.global_majorant()) * t_max;
+        double old = global_lookup_count_.load();
+        while(!global_lookup_count_.compare_exchange_weak(old, old + delta))
+            ;
+    }
+
+    /**
+     * @brief delta tracking with local majorants along [a, b]
+     *
+     * func(t, unit_pos, density, inv_majorant) is called at each tentative
+     * collision and returns false to stop the tracking
+     */
+    template<typename Func>
+    void track(
+        const FVec3 &a, const FVec3 &b, real t_max,
+        Sampler &sampler, Func &&func) const
+    {
+        const FVec3 local_a = local_to_world_.apply_inverse_to_point(a);
+        const FVec3 local_b = local_to_world_.apply_inverse_to_point(b);
+
+        int lookups = 0;
+
+        majorant_grid_.traverse(local_a, local_b,
+            [&](real s_beg, real s_end, real majorant)
+        {
+            if(majorant <= 0)
+                return true;
+
+            const real inv_majorant = 1 / majorant;
+            const real t_end = s_end * t_max;
+            real t = s_beg * t_max;
+
+            for(;;)
+            {
+                t += -std::log(1 - sampler.sample1().u) * inv_majorant;
+                if(t >= t_end)
+                    return true;
+
+                const FVec3 unit_pos = lerp(local_a, local_b, t / t_max);
+                const real density = density_->sample_real(unit_pos);
+                ++lookups;
+
+                if(!func(t, unit_pos, density, inv_majorant))
+                    return false;
+            }
+        });
+
+        record_cost(lookups, t_max);
+    }
+
 public:
 
     HeterogeneousMedium(
@@ -26,7 +101,8 @@ public:
         RC<const Texture3D> density,
         RC<const Texture3D> albedo,
         RC<const Texture3D> g,
-        int max_scattering_count)
+        int max_scattering_count,
+        const HeterogeneousTrackingParams &tracking_params)
     {
         local_to_world_ = local_to_world;
 
@@ -34,11 +110,25 @@ public:
         albedo_  = std::move(albedo);
         g_       = std::move(g);
 
-        max_density_ = density_->max_real();
-        max_density_ = (std::max)(max_density_, EPS());
-        inv_max_density_ = 1 / max_density_;
+        majorant_grid_.build(*density_, tracking_params.majorant_grid_res);
 
         max_scattering_count_ = max_scattering_count;
+
+        ratio_tracking_ = tracking_params.ratio_tracking;
+        report_cost_    = tracking_params.report_cost;
+    }
+
+    ~HeterogeneousMedium()
+    {
+        if(!report_cost_ || !tracking_count_)
+            return;
+
+        const double count = double(tracking_count_);
+        AGZ_INFO(
+            "heterogeneous medium: {} trackings, density lookups per ray: "
+            "{:.2f} (global majorant: {:.2f})",
+            tracking_count_.load(), lookup_count_ / count,
+            global_lookup_count_ / count);
     }
 
     int get_max_scattering_count() const noexcept override
@@ -49,23 +139,29 @@ public:
     FSpectrum tr(
         const FVec3 &a, const FVec3 &b, Sampler &sampler) const noexcept override
     {
-        real result = 1;
-        real t = 0;
         const real t_max = distance(a, b);
+        if(t_max <= 0)
+            return FSpectrum(1);
+
+        real result = 1;
 
-        for(;;)
+        track(a, b, t_max, sampler,
+            [&](real, const FVec3&, real density, real inv_majorant)
         {
-            const real delta_t = -std::log(1 - sampler.sample1().u)
-                               * inv_max_density_;
-            t += delta_t;
-            if(t >= t_max)
-                break;
-
-            const FVec3 pos = lerp(a, b, t / t_max);
-            const FVec3 unit_pos = local_to_world_.apply_inverse_to_point(pos);
-            const real density = density_->sample_real(unit_pos);
-            result *= 1 - density / max_density_;
-        }
+            if(ratio_tracking_)
+            {
+                result *= 1 - density * inv_majorant;
+                return true;
+            }
+
+            if(sampler.sample1().u < density * inv_majorant)
+            {
+                result = 0;
+                return false;
+            }
+
+            return true;
+        });
 
         return FSpectrum(result);
     }
@@ -82,39 +178,43 @@ public:
         Sampler &sampler, Arena &arena) const noexcept override
     {
         const real t_max = distance(a, b);
-        real t = 0;
+        if(t_max <= 0)
+            return SampleOutScatteringResult({}, FSpectrum(1), nullptr);
+
+        bool scattered = false;
+        real scattering_t = 0;
+        FVec3 scattering_unit_pos;
 
-        for(;;)
+        track(a, b, t_max, sampler,
+            [&](real t, const FVec3 &unit_pos, real density, real inv_majorant)
         {
-            const real delta_t = -std::log(1 - sampler.sample1().u)
-                               * inv_max_density_;
-            t += delta_t;
-            if(t >= t_max)
-                break;
-
-            const FVec3 pos = lerp(a, b, t / t_max);
-            const FVec3 unit_pos = local_to_world_.apply_inverse_to_point(pos);
-            const real density = density_->sample_real(unit_pos);
-            if(sampler.sample1().u < density / max_density_)
+            if(sampler.sample1().u < density * inv_majorant)
             {
-                const FSpectrum albedo = albedo_->sample_spectrum(unit_pos);
-                const real     g      = g_->sample_real(unit_pos);
+                scattered           = true;
+                scattering_t        = t;
+                scattering_unit_pos = unit_pos;
+                return false;
+            }
+            return true;
+        });
 
-                MediumScattering scattering;
-                scattering.pos    = pos;
-                scattering.medium = this;
-                scattering.wr     = (a - b) / t_max;
+        if(!scattered)
+            return SampleOutScatteringResult({}, FSpectrum(1), nullptr);
 
-                auto phase_function =
-                    arena.create<HenyeyGreensteinPhaseFunction>(
-                        g, FSpectrum(albedo));
+        const FSpectrum albedo = albedo_->sample_spectrum(scattering_unit_pos);
+        const real     g      = g_->sample_real(scattering_unit_pos);
 
-                return SampleOutScatteringResult(
-                    scattering, FSpectrum(albedo), phase_function);
-            }
-        }
+        MediumScattering scattering;
+        scattering.pos    = lerp(a, b, scattering_t / t_max);
+        scattering.medium = this;
+        scattering.wr     = (a - b) / t_max;
+
+        auto phase_function =
+            arena.create<HenyeyGreensteinPhaseFunction>(
+                g, FSpectrum(albedo));
 
-        return SampleOutScatteringResult({}, FSpectrum(1), nullptr);
+        return SampleOutScatteringResult(
+            scattering, FSpectrum(albedo), phase_function);
     }
 };
 
@@ -123,11 +223,13 @@ RC<Medium> create_heterogeneous_medium(
     RC<const Texture3D> density,
     RC<const Texture3D> albedo,
     RC<const Texture3D> g,
-    int max_scattering_count)
+    int max_scattering_count,
+    const HeterogeneousTrackingParams &tracking_params)
 {
     return newRC<HeterogeneousMedium>(
         local_to_world, std::move(density),
-        std::move(albedo), std::move(g), max_scattering_count);
+        std::move(albedo), std::move(g), max_scattering_count,
+        tracking_params);
 }
 
 AGZ_TRACER_END
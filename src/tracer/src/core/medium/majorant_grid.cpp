@@ -0,0 +1,32 @@
+#include <algorithm>
+
+#include "./majorant_grid.h"
+
+AGZ_TRACER_BEGIN
+
+void MajorantGrid::build(const Texture3D &density, int res)
+{
+    global_majorant_ = density.max_real();
+
+    res_ = (std::max)(res, 0);
+    majorants_.assign(size_t(res_) * res_ * res_, real(0));
+
+    for(int z = 0; z < res_; ++z)
+    {
+        for(int y = 0; y < res_; ++y)
+        {
+            for(int x = 0; x < res_; ++x)
+            {
+                const FVec3 low  = FVec3(real(x),     real(y),     real(z))     / real(res_);
+                const FVec3 high = FVec3(real(x + 1), real(y + 1), real(z + 1)) / real(res_);
+
+                const real max_density = density.max_real_in(low, high);
+
+                majorants_[(size_t(z) * res_ + y) * res_ + x] = max_density;
+                global_majorant_ = (std::max)(global_majorant_, max_density);
+            }
+        }
+    }
+}
+
+AGZ_TRACER_END
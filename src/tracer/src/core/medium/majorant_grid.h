@@ -0,0 +1,164 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include <agz/tracer/core/texture3d.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief grid of local density majorants in texture space [0, 1]^3
+ *
+ * the majorant of each cell is given by Texture3D::max_real_in, which bounds
+ * the density in the cell with the texels it may access (or with brick maxima
+ * for sparse volumes).
+ *
+ * outside [0, 1]^3, the global majorant is used.
+ */
+class MajorantGrid
+{
+public:
+
+    /**
+     * @brief build majorant grid with res^3 cells
+     */
+    void build(const Texture3D &density, int res);
+
+    real global_majorant() const noexcept;
+
+    /**
+     * @brief traverse the segment a + s * (b - a), s in [0, 1]
+     *
+     * calls func(s_beg, s_end, majorant) for each sub-segment in order.
+     * func can return false to stop the traversal
+     */
+    template<typename Func>
+    void traverse(const FVec3 &a, const FVec3 &b, Func &&func) const;
+
+private:
+
+    real majorant(int x, int y, int z) const noexcept
+    {
+        return majorants_[(z * res_ + y) * res_ + x];
+    }
+
+    int res_ = 0;
+    real global_majorant_ = 0;
+
+    std::vector<real> majorants_;
+};
+
+inline real MajorantGrid::global_majorant() const noexcept
+{
+    return global_majorant_;
+}
+
+template<typename Func>
+void MajorantGrid::traverse(const FVec3 &a, const FVec3 &b, Func &&func) const
+{
+    const FVec3 d = b - a;
+
+    // clip the segment with [0, 1]^3
+
+    real s_in = 0, s_out = 1;
+    for(int i = 0; i < 3; ++i)
+    {
+        if(d[i] == 0)
+        {
+            if(a[i] < 0 || a[i] > 1)
+            {
+                s_in = 1;
+                s_out = 0;
+                break;
+            }
+            continue;
+        }
+
+        const real inv_d = 1 / d[i];
+        real s0 = (0 - a[i]) * inv_d;
+        real s1 = (1 - a[i]) * inv_d;
+        if(s0 > s1)
+            std::swap(s0, s1);
+
+        s_in  = (std::max)(s_in, s0);
+        s_out = (std::min)(s_out, s1);
+    }
+
+    if(res_ <= 0 || s_in >= s_out)
+    {
+        func(real(0), real(1), global_majorant_);
+        return;
+    }
+
+    if(s_in > 0 && !func(real(0), s_in, global_majorant_))
+        return;
+
+    // 3d dda in grid space
+
+    const FVec3 ga = a * real(res_);
+    const FVec3 gd = d * real(res_);
+
+    int cell[3], step[3];
+    real next_s[3], delta_s[3];
+
+    for(int i = 0; i < 3; ++i)
+    {
+        const real p = ga[i] + s_in * gd[i];
+        cell[i] = math::clamp(static_cast<int>(std::floor(p)), 0, res_ - 1);
+
+        if(gd[i] > 0)
+        {
+            step[i]    = 1;
+            next_s[i]  = (cell[i] + 1 - ga[i]) / gd[i];
+            delta_s[i] = 1 / gd[i];
+        }
+        else if(gd[i] < 0)
+        {
+            step[i]    = -1;
+            next_s[i]  = (cell[i] - ga[i]) / gd[i];
+            delta_s[i] = -1 / gd[i];
+        }
+        else
+        {
+            step[i]    = 0;
+            next_s[i]  = std::numeric_limits<real>::infinity();
+            delta_s[i] = 0;
+        }
+    }
+
+    real s = s_in;
+    for(;;)
+    {
+        int axis = 0;
+        if(next_s[1] < next_s[axis]) axis = 1;
+        if(next_s[2] < next_s[axis]) axis = 2;
+
+        const real s_next = (std::min)(next_s[axis], s_out);
+        if(s_next > s)
+        {
+            if(!func(s, s_next, majorant(cell[0], cell[1], cell[2])))
+                return;
+        }
+
+        if(s_next >= s_out)
+            break;
+
+        s = s_next;
+        cell[axis]   += step[axis];
+        next_s[axis] += delta_s[axis];
+
+        if(cell[axis] < 0 || cell[axis] >= res_)
+        {
+            // left the grid earlier than expected due to rounding errors
+            if(!func(s, s_out, global_majorant_))
+                return;
+            break;
+        }
+    }
+
+    if(s_out < 1)
+        func(s_out, real(1), global_majorant_);
+}
+
+AGZ_TRACER_END
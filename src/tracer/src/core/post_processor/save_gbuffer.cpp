@@ -10,6 +10,7 @@ class SaveGBufferToPNG : public PostProcessor
 {
     std::string albedo_filename_;
     std::string normal_filename_;
+    std::string sample_count_filename_;
 
     static void save_albedo(const std::string &filename, Image2D<Spectrum> &albedo)
     {
@@ -39,14 +40,45 @@ class SaveGBufferToPNG : public PostProcessor
                                     math::to_color3b<real>));
     }
 
+    // sample counts are normalized by the max count
+    static void save_sample_count(
+        const std::string &filename, Image2D<real> &sample_count)
+    {
+        file::create_directory_for_file(filename);
+
+        real max_count = 0;
+        for(int y = 0; y < sample_count.height(); ++y)
+        {
+            for(int x = 0; x < sample_count.width(); ++x)
+                max_count = (std::max)(max_count, sample_count(y, x));
+        }
+        const real scale = max_count > 0 ? 1 / max_count : real(1);
+
+        texture::texture2d_t<Spectrum> imgf(
+            sample_count.height(), sample_count.width());
+        for(int y = 0; y < imgf.height(); ++y)
+        {
+            for(int x = 0; x < imgf.width(); ++x)
+                imgf(y, x) = Spectrum(scale * sample_count(y, x));
+        }
+
+        AGZ_INFO("saving sample count to {} (max count: {})",
+                 filename, max_count);
+        img::save_rgb_to_png_file(
+            filename, imgf.flip_vertically().get_data().map(
+                                    math::to_color3b<real>));
+    }
+
 public:
 
     SaveGBufferToPNG(
         std::string albedo_filename,
-        std::string normal_filename)
+        std::string normal_filename,
+        std::string sample_count_filename)
     {
-        albedo_filename_ = std::move(albedo_filename);
-        normal_filename_ = std::move(normal_filename);
+        albedo_filename_       = std::move(albedo_filename);
+        normal_filename_       = std::move(normal_filename);
+        sample_count_filename_ = std::move(sample_count_filename);
     }
 
     void process(RenderTarget &render_target) override
@@ -55,16 +87,21 @@ public:
             save_albedo(albedo_filename_, render_target.albedo);
         if(!normal_filename_.empty() && render_target.normal.is_available())
             save_normal(normal_filename_, render_target.normal);
+        if(!sample_count_filename_.empty() &&
+           render_target.sample_count.is_available())
+            save_sample_count(sample_count_filename_, render_target.sample_count);
     }
 };
 
 RC<PostProcessor> create_saving_gbuffer_to_png(
     std::string albedo_filename,
-    std::string normal_filename)
+    std::string normal_filename,
+    std::string sample_count_filename)
 {
     return newRC<SaveGBufferToPNG>(
         std::move(albedo_filename),
-        std::move(normal_filename));
+        std::move(normal_filename),
+        std::move(sample_count_filename));
 }
 
 AGZ_TRACER_END
@@ -15,6 +15,7 @@
 #include <agz/tracer/render/particle_tracing.h>
 #include <agz/tracer/utility/parallel_grid.h>
 #include <agz/tracer/utility/perthread_samplers.h>
+#include <agz/tracer/utility/preview_surface.h>
 #include <agz/utility/thread.h>
 
 AGZ_TRACER_BEGIN
@@ -123,8 +124,8 @@ private:
 
         auto sampler_prototype = newRC<NativeSampler >(42, false);
 
-        PerThreadNativeSamplers perthread_sampler(
-            thread_count, *sampler_prototype);
+        PerThreadSamplers perthread_sampler(
+            thread_count, params_.sampler, *sampler_prototype);
 
         std::mutex reporter_mutex;
         int finished_pixel_count = 0;
@@ -132,6 +133,13 @@ private:
         ImageBufferTemplate<true, true, true, true, true> image_buffer(
             filter.width(), filter.height());
 
+        Box<PreviewSurface> preview_surface;
+        if constexpr(REPORTER_WITH_PREVIEW)
+        {
+            preview_surface = newBox<PreviewSurface>(
+                filter.width(), filter.height(), reporter.preview_max_size());
+        }
+
         parallel_for_2d_grid(
             thread_count, filter.width(), filter.height(),
             params_.forward_task_grid_size, params_.forward_task_grid_size,
@@ -152,11 +160,18 @@ private:
             {
                 for(int px = sam_pixels.low.x; px <= sam_pixels.high.x; ++px)
                 {
+                    const uint32_t pixel_stream = static_cast<uint32_t>(
+                        py * filter.width() + px);
+
                     for(int i = 0; i < params_.forward_spp; ++i)
                     {
-                        const Sample2 film_sam = sampler->sample2();
-                        const real pixel_x = px + film_sam.u;
-                        const real pixel_y = py + film_sam.v;
+                        sampler->start_sample(
+                            pixel_stream, static_cast<uint32_t>(i));
+
+                        const Vec2 pixel_pos = film_grid.sample_pixel(
+                            px, py, sampler->sample2());
+                        const real pixel_x = pixel_pos.x;
+                        const real pixel_y = pixel_pos.y;
                         const real film_x = pixel_x / filter.width();
                         const real film_y = pixel_y / filter.height();
 
@@ -166,8 +181,8 @@ private:
                         const Ray ray(cam_ray.pos_on_cam, cam_ray.pos_to_out);
                         auto pixel = trace_camera_ray(scene, ray, arena);
 
-                        film_grid.apply(
-                            pixel_x, pixel_y,
+                        film_grid.apply_pixel_sample(
+                            px, py, pixel_x, pixel_y,
                             cam_ray.throughput * pixel.value, 1,
                             pixel.albedo, pixel.normal, pixel.denoise);
 
@@ -181,21 +196,24 @@ private:
 
             if constexpr(REPORTER_WITH_PREVIEW)
             {
-                std::lock_guard lk(reporter_mutex);
+                // tiles are disjoint, so merging needs no lock
+
                 film_grid.merge_into(
                     image_buffer.value, image_buffer.weight,
                     image_buffer.albedo, image_buffer.normal,
                     image_buffer.denoise);
 
+                preview_surface->update(
+                    { rect.low, rect.high - Vec2i(1) },
+                    image_buffer.value, image_buffer.weight, &backward);
+
                 auto get_img = [&]()
                 {
-                    auto ratio = image_buffer.weight.map([](real w)
-                    {
-                        return w > 0 ? 1 / w : real(1);
-                    });
-                    return image_buffer.value * ratio + backward;
+                    return preview_surface->snapshot();
                 };
 
+                std::lock_guard lk(reporter_mutex);
+
                 finished_pixel_count += (rect.high - rect.low).product();
                 const real percent = real(100) * finished_pixel_count
                                    / real(filter.width() * filter.height());
@@ -269,6 +287,13 @@ private:
                 int task_particle_count = 0;
                 for(int j = 0; j < params_.particles_per_task; ++j)
                 {
+                    // particles of a task form a sequence, whose stream
+                    // is kept away from pixel streams
+
+                    sampler->start_sample(
+                        ~static_cast<uint32_t>(task_id),
+                        static_cast<uint32_t>(j));
+
                     ++task_particle_count;
                     trace_vol_particle(
                         particle_params_, scene, *sampler, film_grid, arena);
@@ -338,8 +363,8 @@ private:
 
         auto particle_sampler_prototype = newRC<NativeSampler>(42, false);
 
-        PerThreadNativeSamplers perthread_sampler(
-            worker_count, *particle_sampler_prototype);;
+        PerThreadSamplers perthread_sampler(
+            worker_count, params_.sampler, *particle_sampler_prototype);
 
         for(int i = 0; i < worker_count; ++i)
         {
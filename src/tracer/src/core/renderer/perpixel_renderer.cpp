@@ -1,56 +1,136 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+
 #include <agz/tracer/core/camera.h>
 #include <agz/tracer/core/renderer_interactor.h>
 #include <agz/tracer/core/sampler.h>
 #include <agz/tracer/core/scene.h>
+#include <agz/tracer/utility/logger.h>
 #include <agz/tracer/utility/parallel_grid.h>
 #include <agz/tracer/utility/perthread_samplers.h>
+#include <agz/tracer/utility/preview_surface.h>
 #include <agz/utility/thread.h>
 
 #include "perpixel_renderer.h"
 
 AGZ_TRACER_BEGIN
 
-void PerPixelRenderer::render_grid(
+bool PerPixelRenderer::render_grid(
     const Scene &scene, Sampler &sampler,
-    Grid &grid, const Vec2i &full_res, int spp) const
+    Grid &grid, const Vec2i &full_res, int spp, int sample_index_beg,
+    const Rect2i &pixel_range, PixelStats *stats) const
 {
     Arena arena;
     const Camera *camera = scene.get_camera();
     auto sam_bound = grid.sample_pixels();
 
+    const Vec2 pixel_size = { real(1) / full_res.x, real(1) / full_res.y };
+
     for(int py = sam_bound.low.y; py <= sam_bound.high.y; ++py)
     {
         for(int px = sam_bound.low.x; px <= sam_bound.high.x; ++px)
         {
+            PixelStat *stat = nullptr;
+            if(stats &&
+               pixel_range.low.x <= px && px <= pixel_range.high.x &&
+               pixel_range.low.y <= py && py <= pixel_range.high.y)
+                stat = &(*stats)[py * full_res.x + px];
+
+            // samples splatted into neighbouring tiles are regenerated
+            // identically, as pixel sample streams do not depend on tiles.
+            // with filter importance sampling, tiles take no such samples
+
+            const uint32_t pixel_stream =
+                static_cast<uint32_t>(py) * static_cast<uint32_t>(full_res.x)
+              + static_cast<uint32_t>(px);
+
             for(int i = 0; i < spp; ++i)
             {
-                const Sample2 film_sam = sampler.sample2();
-                const real pixel_x = px + film_sam.u;
-                const real pixel_y = py + film_sam.v;
+                if(stop_rendering_)
+                    return false;
+
+                sampler.start_sample(
+                    pixel_stream, static_cast<uint32_t>(sample_index_beg + i));
+
+                const Vec2 pixel_pos = grid.sample_pixel(
+                    px, py, sampler.sample2());
+                const real pixel_x = pixel_pos.x;
+                const real pixel_y = pixel_pos.y;
                 const real film_x = pixel_x / full_res.x;
                 const real film_y = pixel_y / full_res.y;
 
+                const Sample2 aperture_sam = sampler.sample2();
                 auto cam_ray = camera->sample_we(
-                    { film_x, film_y }, sampler.sample2());
+                    { film_x, film_y }, aperture_sam);
+
+                RayDifferential ray_diff;
+                const bool has_ray_diff = camera->sample_we_differential(
+                    { film_x, film_y }, pixel_size, aperture_sam, &ray_diff);
 
                 const Ray ray(cam_ray.pos_on_cam, cam_ray.pos_to_out);
                 const render::Pixel pixel = eval_pixel(
-                    scene, ray, sampler, arena);
+                    scene, ray, has_ray_diff ? &ray_diff : nullptr,
+                    sampler, arena);
 
                 if(pixel.value.is_finite())
                 {
-                    grid.apply(
-                        pixel_x, pixel_y, cam_ray.throughput * pixel.value, 1,
+                    const Spectrum value = cam_ray.throughput * pixel.value;
+                    grid.apply_pixel_sample(
+                        px, py, pixel_x, pixel_y, value, 1,
                         pixel.albedo, pixel.normal, pixel.denoise);
+
+                    if(stat)
+                    {
+                        const double lum = value.lum();
+                        stat->sum  += lum;
+                        stat->sum2 += lum * lum;
+                        ++stat->count;
+                    }
                 }
 
                 arena.release();
-
-                if(stop_rendering_)
-                    return;
             }
         }
     }
+
+    return true;
+}
+
+real PerPixelRenderer::estimate_relative_error(
+    const PixelStats &stats, int width, const Rect2i &pixel_range)
+{
+    // std error of pixel means (rms over the range) relative to
+    // the average pixel luminance
+
+    double mean_sum = 0, var_sum = 0;
+    int pixel_count = 0;
+
+    for(int y = pixel_range.low.y; y <= pixel_range.high.y; ++y)
+    {
+        for(int x = pixel_range.low.x; x <= pixel_range.high.x; ++x)
+        {
+            const PixelStat &stat = stats[y * width + x];
+            if(stat.count < 2)
+                return std::numeric_limits<real>::max();
+
+            const double mean = stat.sum / stat.count;
+            const double var = (std::max)(
+                0.0, (stat.sum2 - stat.count * mean * mean) / (stat.count - 1));
+
+            mean_sum += mean;
+            var_sum  += var / stat.count;
+            ++pixel_count;
+        }
+    }
+
+    if(!pixel_count)
+        return 0;
+
+    const double mean    = mean_sum / pixel_count;
+    const double std_err = std::sqrt(var_sum / pixel_count);
+    return static_cast<real>(std_err / (std::max)(mean, 1e-3));
 }
 
 template<bool REPORTER_WITH_PREVIEW>
@@ -59,25 +139,41 @@ RenderTarget PerPixelRenderer::render_impl(
 {
     const int thread_count = thread::actual_worker_count(worker_count_);
 
+    const auto start_time = std::chrono::steady_clock::now();
+
     // prepare image buffer
 
     ImageBuffer image_buffer(filter.width(), filter.height());
 
+    // per-pixel statistics for adaptive sampling
+
+    PixelStats stats;
+    if(adaptive_.enabled)
+        stats.resize(size_t(filter.width()) * size_t(filter.height()));
+    PixelStats *stats_ptr = adaptive_.enabled ? &stats : nullptr;
+
+    // tiles own disjoint pixel ranges of image_buffer, so they are merged
+    // concurrently without locks. each tile updates its part of the preview
+    // surface after merging, and previews are snapshots of the surface.
+
+    Box<PreviewSurface> preview_surface;
+    if constexpr(REPORTER_WITH_PREVIEW)
+    {
+        preview_surface = newBox<PreviewSurface>(
+            filter.width(), filter.height(), reporter.preview_max_size());
+    }
+
     auto get_img = std::function<Image2D<Spectrum>()>([&]()
     {
-        auto ratio = image_buffer.weight.map([](real w)
-        {
-            return w > 0 ? 1 / w : real(1);
-        });
-        return image_buffer.value * ratio;
+        return preview_surface->snapshot();
     });
 
     // create per-thread samplers
 
     auto sampler_prototype = newRC<NativeSampler>(42, false);
 
-    PerThreadNativeSamplers perthread_sampler(
-        thread_count, *sampler_prototype);
+    PerThreadSamplers perthread_sampler(
+        thread_count, sampler_type_, *sampler_prototype);
 
     std::mutex reporter_mutex;
 
@@ -88,58 +184,69 @@ RenderTarget PerPixelRenderer::render_impl(
 
     thread::thread_group_t thread_group(thread_count);
 
-    auto run_iter = [&](double prog_beg, double prog_end, int spp)
+    // render a tile and merge it into image buffer
+    // progress is reported by finished pixel count in the iteration
+    // returns false when the tile is interrupted by stop_rendering_
+    auto render_tile = [&](
+        int thread_index, const Rect2i &rect, int spp, int sample_index_beg,
+        double prog_beg, double prog_end,
+        std::atomic<int> &finished_pixel_count, int total_pixel_count)
     {
-        int finished_pixel_count = 0;
+        auto sampler = perthread_sampler.get_sampler(thread_index);
 
-        parallel_for_2d_grid(
-            thread_count, filter.width(), filter.height(),
-            task_grid_size_, task_grid_size_, thread_group,
-            [&] (int thread_index, const Rect2i &rect)
-        {
-            auto sampler = perthread_sampler.get_sampler(thread_index);
+        const Rect2i pixel_range = { rect.low, rect.high - Vec2i(1) };
 
-            auto grid = filter.create_subgrid<
-                Spectrum, real, Spectrum, Vec3, real>(
-                    { rect.low, rect.high - Vec2i(1) });
+        auto grid = filter.create_subgrid<
+            Spectrum, real, Spectrum, Vec3, real>(pixel_range);
 
-            render_grid(
-                scene, *sampler, grid,
-                { filter.width(), filter.height() }, spp);
+        const bool finished = render_grid(
+            scene, *sampler, grid,
+            { filter.width(), filter.height() }, spp, sample_index_beg,
+            pixel_range, stats_ptr);
 
-            const int total_pixel_count = filter.width() * filter.height();
+        grid.merge_into(
+            image_buffer.value, image_buffer.weight,
+            image_buffer.albedo, image_buffer.normal,
+            image_buffer.denoise);
 
-            if constexpr(REPORTER_WITH_PREVIEW)
-            {
-                std::lock_guard lk(reporter_mutex);
-                grid.merge_into(
-                    image_buffer.value, image_buffer.weight,
-                    image_buffer.albedo, image_buffer.normal,
-                    image_buffer.denoise);
-
-                finished_pixel_count += (rect.high - rect.low).product();
-                const double percent = math::lerp(
-                    prog_beg, prog_end,
-                    double(finished_pixel_count) / total_pixel_count);
-                reporter.progress(percent, get_img);
-            }
-            else
-            {
-                AGZ_UNACCESSED(get_img);
+        if constexpr(REPORTER_WITH_PREVIEW)
+        {
+            preview_surface->update(
+                pixel_range, image_buffer.value, image_buffer.weight);
+        }
+        else
+            AGZ_UNACCESSED(get_img);
 
-                grid.merge_into(
-                    image_buffer.value, image_buffer.weight,
-                    image_buffer.albedo, image_buffer.normal,
-                    image_buffer.denoise);
+        const int finished_pixels = finished_pixel_count +=
+            (rect.high - rect.low).product();
+        const double percent = math::lerp(
+            prog_beg, prog_end, double(finished_pixels) / total_pixel_count);
 
-                std::lock_guard lk(reporter_mutex);
+        // reporter is not thread-safe
 
-                finished_pixel_count += (rect.high - rect.low).product();
-                const double percent = math::lerp(
-                    prog_beg, prog_end,
-                    double(finished_pixel_count) / total_pixel_count);
-                reporter.progress(percent, {});
-            }
+        std::lock_guard lk(reporter_mutex);
+        if constexpr(REPORTER_WITH_PREVIEW)
+            reporter.progress(percent, get_img);
+        else
+            reporter.progress(percent, {});
+
+        return finished;
+    };
+
+    auto run_iter = [&](
+        double prog_beg, double prog_end, int spp, int sample_index_beg)
+    {
+        std::atomic<int> finished_pixel_count = 0;
+        const int total_pixel_count = filter.width() * filter.height();
+
+        parallel_for_2d_grid(
+            thread_count, filter.width(), filter.height(),
+            task_grid_size_, task_grid_size_, thread_group,
+            [&] (int thread_index, const Rect2i &rect)
+        {
+            render_tile(
+                thread_index, rect, spp, sample_index_beg, prog_beg, prog_end,
+                finished_pixel_count, total_pixel_count);
 
             return !stop_rendering_;
         });
@@ -147,10 +254,14 @@ RenderTarget PerPixelRenderer::render_impl(
 
     // start rendering
 
+    // with adaptive sampling, the uniform pass takes the first half of
+    // the progress bar and the adaptive rounds take the rest
+    const double uniform_prog_end = adaptive_.enabled ? 50.0 : 100.0;
+
     if(reporter.need_image_preview())
     {
-        const double first_iter_prog_end = 100.0 / spp_;
-        run_iter(0, first_iter_prog_end, 1);
+        const double first_iter_prog_end = uniform_prog_end / spp_;
+        run_iter(0, first_iter_prog_end, 1, 0);
 
         const int per_iter_spp = (std::max)(6, spp_ / 20);
         int finished_spp = 1;
@@ -163,16 +274,186 @@ RenderTarget PerPixelRenderer::render_impl(
                 spp_, finished_spp + per_iter_spp);
             const int delta_spp = new_finished_spp - finished_spp;
 
-            const double prog_beg = 100.0 * finished_spp / spp_;
-            const double prog_end = 100.0 * new_finished_spp / spp_;
+            const double prog_beg = uniform_prog_end * finished_spp / spp_;
+            const double prog_end = uniform_prog_end * new_finished_spp / spp_;
 
-            run_iter(prog_beg, prog_end, delta_spp);
+            run_iter(prog_beg, prog_end, delta_spp, finished_spp);
 
             finished_spp = new_finished_spp;
         }
     }
     else
-        run_iter(0, 100, spp_);
+        run_iter(0, uniform_prog_end, spp_, 0);
+
+    // adaptive sampling
+
+    std::vector<Rect2i> tiles;
+    std::vector<int> tile_spp;
+
+    if(adaptive_.enabled)
+    {
+        for(int y = 0; y < filter.height(); y += task_grid_size_)
+        {
+            for(int x = 0; x < filter.width(); x += task_grid_size_)
+            {
+                tiles.push_back({
+                    { x, y },
+                    {
+                        (std::min)(filter.width(),  x + task_grid_size_),
+                        (std::min)(filter.height(), y + task_grid_size_)
+                    }
+                });
+            }
+        }
+        tile_spp.resize(tiles.size(), spp_);
+
+        const int max_spp   = (std::max)(spp_, adaptive_.max_spp);
+        const int batch_spp = (std::max)(1, adaptive_.batch_spp);
+
+        const double total_pixel_count =
+            double(filter.width()) * filter.height();
+        const double sample_budget = adaptive_.budget_spp > 0 ?
+            adaptive_.budget_spp * total_pixel_count :
+            std::numeric_limits<double>::infinity();
+        double sample_count = spp_ * total_pixel_count;
+
+        auto time_fraction = [&]
+        {
+            if(adaptive_.time_limit <= 0)
+                return 0.0;
+            const std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start_time;
+            return elapsed.count() / adaptive_.time_limit;
+        };
+
+        struct ActiveTile
+        {
+            int tile_index;
+            int spp;
+            real error;
+        };
+
+        std::vector<ActiveTile> active_tiles;
+        std::vector<char> tile_finished;
+
+        int round_count = 0;
+        double progress = uniform_prog_end;
+
+        while(!stop_rendering_ && time_fraction() < 1)
+        {
+            // collect tiles whose error is above the threshold
+
+            active_tiles.clear();
+            for(size_t i = 0; i < tiles.size(); ++i)
+            {
+                if(tile_spp[i] >= max_spp)
+                    continue;
+
+                const Rect2i pixel_range = {
+                    tiles[i].low, tiles[i].high - Vec2i(1)
+                };
+                const real error = estimate_relative_error(
+                    stats, filter.width(), pixel_range);
+                if(error > adaptive_.error_threshold)
+                {
+                    active_tiles.push_back({
+                        static_cast<int>(i),
+                        (std::min)(batch_spp, max_spp - tile_spp[i]),
+                        error
+                    });
+                }
+            }
+
+            // tiles with larger error come first. trim those
+            // exceeding the sample budget
+
+            std::sort(active_tiles.begin(), active_tiles.end(),
+                [](const ActiveTile &a, const ActiveTile &b)
+            {
+                return a.error > b.error;
+            });
+
+            size_t active_count = 0;
+            double round_sample_count = 0;
+            for(auto &t : active_tiles)
+            {
+                const double t_sample_count =
+                    double(t.spp) * (tiles[t.tile_index].high -
+                                     tiles[t.tile_index].low).product();
+                if(sample_count + round_sample_count + t_sample_count >
+                   sample_budget)
+                    break;
+                round_sample_count += t_sample_count;
+                ++active_count;
+            }
+            active_tiles.resize(active_count);
+
+            if(active_tiles.empty())
+                break;
+
+            // render active tiles
+
+            const int converged_count = static_cast<int>(
+                tiles.size() - active_tiles.size());
+            const double prog_beg = progress;
+            const double prog_end = (std::max)(prog_beg, math::lerp(
+                uniform_prog_end, 100.0,
+                (std::min)(1.0, (std::max)({
+                    double(converged_count) / tiles.size(),
+                    time_fraction(),
+                    (sample_count + round_sample_count) / sample_budget
+                }))));
+
+            std::atomic<int> finished_pixel_count = 0;
+            int round_pixel_count = 0;
+            for(auto &t : active_tiles)
+            {
+                round_pixel_count +=
+                    (tiles[t.tile_index].high - tiles[t.tile_index].low).product();
+            }
+
+            tile_finished.assign(active_tiles.size(), 0);
+
+            parallel_for_1d_grid(
+                thread_count, static_cast<int>(active_tiles.size()), 1,
+                thread_group, [&](int thread_index, int beg, int)
+            {
+                if(time_fraction() >= 1)
+                    return false;
+
+                // samples of interrupted tiles are merged into the image,
+                // but the tiles are not credited with them
+
+                const ActiveTile &t = active_tiles[beg];
+                tile_finished[beg] = render_tile(
+                    thread_index, tiles[t.tile_index], t.spp,
+                    tile_spp[t.tile_index], prog_beg, prog_end,
+                    finished_pixel_count, round_pixel_count);
+
+                return !stop_rendering_;
+            });
+
+            for(size_t i = 0; i < active_tiles.size(); ++i)
+            {
+                if(!tile_finished[i])
+                    continue;
+                const ActiveTile &t = active_tiles[i];
+                tile_spp[t.tile_index] += t.spp;
+                sample_count += double(t.spp) *
+                    (tiles[t.tile_index].high - tiles[t.tile_index].low).product();
+            }
+
+            progress = prog_end;
+            ++round_count;
+        }
+
+        AGZ_INFO(
+            "adaptive sampling: {} round(s), average spp: {:.2f}, "
+            "time: {:.2f}s",
+            round_count, sample_count / total_pixel_count,
+            std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start_time).count());
+    }
 
     reporter.end_stage();
     reporter.end();
@@ -188,12 +469,28 @@ RenderTarget PerPixelRenderer::render_impl(
     render_target.normal  = image_buffer.normal  * ratio;
     render_target.denoise = image_buffer.denoise * ratio;
 
+    if(adaptive_.enabled)
+    {
+        render_target.sample_count.initialize(
+            filter.height(), filter.width());
+        for(size_t i = 0; i < tiles.size(); ++i)
+        {
+            for(int y = tiles[i].low.y; y < tiles[i].high.y; ++y)
+            {
+                for(int x = tiles[i].low.x; x < tiles[i].high.x; ++x)
+                    render_target.sample_count(y, x) = real(tile_spp[i]);
+            }
+        }
+    }
+
     return render_target;
 }
 
 PerPixelRenderer::PerPixelRenderer(
-    int worker_count, int task_grid_size, int spp)
-    : worker_count_(worker_count), task_grid_size_(task_grid_size), spp_(spp)
+    int worker_count, int task_grid_size, int spp,
+    const AdaptiveSamplingParams &adaptive, SamplerType sampler_type)
+    : worker_count_(worker_count), task_grid_size_(task_grid_size), spp_(spp),
+      adaptive_(adaptive), sampler_type_(sampler_type)
 {
     
 }
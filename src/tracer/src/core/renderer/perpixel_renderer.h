@@ -2,21 +2,61 @@
 
 #include <agz/tracer/core/renderer.h>
 #include <agz/tracer/core/render_target.h>
+#include <agz/tracer/create/renderer.h>
 #include <agz/tracer/render/path_tracing.h>
 
 AGZ_TRACER_BEGIN
 
 class PerPixelRenderer : public Renderer
 {
-    using ImageBuffer = ImageBufferTemplate<true, true, true, true, true>;
+protected:
+
+    using Pixel = render::Pixel;
 
     // image value, weight, albedo, normal, denoise
     using Grid = FilmFilterApplier::FilmGrid<
         Spectrum, real, Spectrum, Vec3, real>;
 
-    void render_grid(
+    // running luminance statistics of samples generated in a pixel
+    struct PixelStat
+    {
+        double sum  = 0;
+        double sum2 = 0;
+        int count   = 0;
+    };
+
+    // statistics of all pixels. width * height
+    using PixelStats = std::vector<PixelStat>;
+
+    // render samples of pixels in grid.sample_pixels() into grid.
+    // the default implementation evaluates samples one by one with eval_pixel
+    //
+    // spp:          samples per pixel, with indices
+    //               [sample_index_beg, sample_index_beg + spp)
+    // pixel_range:  pixels owned by the grid. samples in other pixels
+    //               are not recorded into stats
+    // stats:        nullptr when adaptive sampling is disabled
+    //
+    // returns false when rendering is stopped before all samples are taken
+    virtual bool render_grid(
         const Scene &scene, Sampler &sampler,
-        Grid &grid, const Vec2i &full_res, int spp) const;
+        Grid &grid, const Vec2i &full_res, int spp, int sample_index_beg,
+        const Rect2i &pixel_range, PixelStats *stats) const;
+
+    SamplerType sampler_type() const noexcept { return sampler_type_; }
+
+    // ray_diff: differentials of the camera ray. nullptr when unsupported
+    virtual Pixel eval_pixel(
+        const Scene &scene, const Ray &ray, const RayDifferential *ray_diff,
+        Sampler &sampler, Arena &arena) const = 0;
+
+private:
+
+    using ImageBuffer = ImageBufferTemplate<true, true, true, true, true>;
+
+    // relative error of mean luminance in given pixel range
+    static real estimate_relative_error(
+        const PixelStats &stats, int width, const Rect2i &pixel_range);
 
     template<bool REPORTER_WITH_PREVIEW>
     RenderTarget render_impl(
@@ -27,17 +67,16 @@ class PerPixelRenderer : public Renderer
 
     int spp_;
 
-protected:
+    AdaptiveSamplingParams adaptive_;
 
-    using Pixel = render::Pixel;
-
-    virtual Pixel eval_pixel(
-        const Scene &scene, const Ray &ray,
-        Sampler &sampler, Arena &arena) const = 0;
+    SamplerType sampler_type_;
 
 public:
 
-    PerPixelRenderer(int worker_count, int task_grid_size, int spp);
+    PerPixelRenderer(
+        int worker_count, int task_grid_size, int spp,
+        const AdaptiveSamplingParams &adaptive = {},
+        SamplerType sampler_type = SamplerType::Native);
 
     RenderTarget render(
         FilmFilterApplier filter, Scene &scene,
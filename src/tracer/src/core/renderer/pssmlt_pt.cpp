@@ -46,7 +46,7 @@ class PSSMLTPTRenderer : public Renderer
 
     render::Pixel (*trace_func_)(
         const render::TraceParams&, const Scene&,
-        const Ray&, Sampler&, Arena&);
+        const Ray&, Sampler&, Arena&, const RayDifferential*);
 
     render::TraceParams trace_params_;
 
@@ -77,7 +77,7 @@ FSpectrum PSSMLTPTRenderer::eval_path(
     const Ray ray(cam_sam.pos_on_cam, cam_sam.pos_to_out);
 
     const FSpectrum radiance = trace_func_(
-        trace_params_, scene, ray, sampler, arena).value;
+        trace_params_, scene, ray, sampler, arena, nullptr).value;
 
     return cam_sam.throughput * radiance;
 }
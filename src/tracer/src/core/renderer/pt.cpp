@@ -11,14 +11,15 @@ class PathTracingRenderer : public PerPixelRenderer
 
     render::Pixel(*eval_func_)(
         const render::TraceParams &, const Scene &,
-        const Ray &, Sampler &, Arena &);
+        const Ray &, Sampler &, Arena &, const RayDifferential *);
 
 public:
 
     explicit PathTracingRenderer(const PTRendererParams &params)
         : PerPixelRenderer(
             params.worker_count,
-            params.task_grid_size, params.spp)
+            params.task_grid_size, params.spp, params.adaptive,
+            params.sampler)
     {
         params_.min_depth = params.min_depth;
         params_.max_depth = params.max_depth;
@@ -34,10 +35,10 @@ public:
 protected:
 
     Pixel eval_pixel(
-        const Scene &scene, const Ray &ray,
+        const Scene &scene, const Ray &ray, const RayDifferential *ray_diff,
         Sampler &sampler, Arena &arena) const override
     {
-        return eval_func_(params_, scene, ray, sampler, arena);
+        return eval_func_(params_, scene, ray, sampler, arena, ray_diff);
     }
 };
 
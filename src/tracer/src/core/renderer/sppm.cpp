@@ -1,3 +1,5 @@
+#include <chrono>
+
 #include <agz/tracer/core/camera.h>
 #include <agz/tracer/core/renderer_interactor.h>
 #include <agz/tracer/core/sampler.h>
@@ -69,12 +71,17 @@ RenderTarget SPPMRenderer::render(
 
     auto sampler_prototype = newRC<NativeSampler>(42, false);
 
-    PerThreadNativeSamplers perthread_sampler(thread_count, *sampler_prototype);
+    PerThreadSamplers perthread_sampler(
+        thread_count, params_.sampler, *sampler_prototype);
 
     // vp arenas
 
     std::vector<Arena> perthread_vp_arena(thread_count);
 
+    // photon buffers
+
+    std::vector<render::sppm::PhotonBuffer> perthread_photons(thread_count);
+
     // how to compute the final image
 
     auto compute_image = [&](int iter_cnt, uint64_t photon_cnt)
@@ -113,15 +120,14 @@ RenderTarget SPPMRenderer::render(
 
         reporter.progress(progress_beg, {});
 
-        // clear visible points
-
-        const real grid_sidelen = real(1.05) * max_radius;
-        render::sppm::VisiblePointSearcher vp_searcher(
-            world_bound, grid_sidelen, 40960);
+        // clear visible points & photons
 
         for(auto &a : perthread_vp_arena)
             a.release();
 
+        for(auto &p : perthread_photons)
+            p.clear();
+
         // find new visible points
 
         int finished_pixel_count = 0;
@@ -140,6 +146,10 @@ RenderTarget SPPMRenderer::render(
             {
                 for(int x = grid.low.x; x < grid.high.x; ++x)
                 {
+                    sampler->start_sample(
+                        static_cast<uint32_t>(y * filter.width() + x),
+                        static_cast<uint32_t>(iter));
+
                     const Sample2 film_sam = sampler->sample2();
                     const Vec2 film_coord = {
                         (x + film_sam.u) / filter.width(),
@@ -159,9 +169,6 @@ RenderTarget SPPMRenderer::render(
                         scene, ray, cam_sam.throughput,
                         vp_arena, *sampler, &gpixel, pixel.direct_illum);
 
-                    if(pixel.vp.is_valid())
-                        vp_searcher.add_vp(pixel, vp_arena);
-
                     albedo_buffer(y, x) += gpixel.albedo;
                     normal_buffer(y, x) += gpixel.normal;
                     denoise_buffer(y, x) += gpixel.denoise;
@@ -186,6 +193,8 @@ RenderTarget SPPMRenderer::render(
 
         // trace photons
 
+        const auto photon_pass_start = std::chrono::steady_clock::now();
+
         int finished_photon_count = 0;
         parallel_for_1d_grid(
             thread_count,
@@ -194,15 +203,22 @@ RenderTarget SPPMRenderer::render(
             thread_group,
             [&](int thread_index, int beg, int end)
         {
-            auto sampler = perthread_sampler.get_sampler(thread_index);
+            auto sampler  = perthread_sampler.get_sampler(thread_index);
+            auto &photons = perthread_photons[thread_index];
             Arena local_arena;
             for(int i = beg; i < end; ++i)
             {
+                // photons of an iteration form a sequence, whose stream
+                // is kept away from pixel streams
+
+                sampler->start_sample(
+                    ~static_cast<uint32_t>(iter), static_cast<uint32_t>(i));
+
                 trace_photon(
                     params_.photon_min_depth,
                     params_.photon_max_depth,
                     params_.photon_cont_prob,
-                    vp_searcher, scene, local_arena, *sampler);
+                    photons, scene, local_arena, *sampler);
 
                 if(local_arena.used_bytes() > 4 * 1024 * 1024)
                     local_arena.release();
@@ -222,7 +238,14 @@ RenderTarget SPPMRenderer::render(
             return true;
         });
 
-        // update pixel params
+        // sort photons by grid cell
+
+        const real grid_sidelen = real(1.05) * max_radius;
+        render::sppm::PhotonSearcher photon_searcher(world_bound, grid_sidelen);
+        photon_searcher.build(perthread_photons, thread_count, thread_group);
+
+        // compute max radius for next iteration
+        // radii can only shrink after updating, so this is an upper bound
 
         max_radius = 0;
         for(int y = 0; y < filter.height(); ++y)
@@ -240,23 +263,41 @@ RenderTarget SPPMRenderer::render(
         if(max_radius == 0)
             max_radius = init_radius;
 
+        // gather photons & update pixel params
+        //
+        // each row is processed by exactly one task, so flux of pixels can
+        // be accumulated without synchronization
+
         parallel_for_1d_grid(
-            thread_count, filter.height(), 128, thread_group,
+            thread_count, filter.height(), 16, thread_group,
             [&](int thread_index, int beg, int end)
         {
             for(int y = beg; y < end; ++y)
             {
                 for(int x = 0; x < filter.width(); ++x)
                 {
-                    if(sppm_pixels(y, x).vp.is_valid())
+                    auto &pixel = sppm_pixels(y, x);
+                    if(pixel.vp.is_valid())
                     {
-                        update_pixel_params(
-                            params_.update_alpha, sppm_pixels(y, x));
+                        photon_searcher.gather(pixel);
+                        update_pixel_params(params_.update_alpha, pixel);
                     }
                 }
             }
         });
 
+        if(reporter.need_image_preview())
+        {
+            const double photon_pass_seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - photon_pass_start).count();
+            const double photons_per_second = photon_pass_seconds > 0 ?
+                params_.photons_per_iteration / photon_pass_seconds : 0.0;
+            reporter.message(
+                "photon pass: " + std::to_string(
+                    static_cast<int64_t>(photons_per_second)) +
+                " photons/s with " + std::to_string(thread_count) + " threads");
+        }
+
         // report progress
 
         if(reporter.need_image_preview())
@@ -0,0 +1,405 @@
+#include <agz/tracer/core/camera.h>
+#include <agz/tracer/core/render_target.h>
+#include <agz/tracer/core/renderer.h>
+#include <agz/tracer/core/renderer_interactor.h>
+#include <agz/tracer/core/sampler.h>
+#include <agz/tracer/core/scene.h>
+#include <agz/tracer/create/renderer.h>
+#include <agz/tracer/render/vertex_connection_merging.h>
+#include <agz/tracer/utility/parallel_grid.h>
+#include <agz/tracer/utility/perthread_samplers.h>
+#include <agz/utility/thread.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+    struct AtomicSpectrum
+    {
+        std::atomic<real> channels[SPECTRUM_COMPONENT_COUNT];
+
+        AtomicSpectrum() noexcept
+        {
+            for(auto &c : channels)
+                c = real(0);
+        }
+
+        AtomicSpectrum(const AtomicSpectrum &s) noexcept
+        {
+            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
+                channels[i] = s.channels[i].load();
+        }
+
+        void add(const FSpectrum &s) noexcept
+        {
+            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
+                math::atomic_add(channels[i], s[i]);
+        }
+
+        Spectrum to_spectrum() const noexcept
+        {
+            Spectrum ret;
+            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
+                ret[i] = channels[i];
+            return ret;
+        }
+    };
+}
+
+class VCMRenderer : public Renderer
+{
+public:
+
+    explicit VCMRenderer(const VCMRendererParams &params);
+
+    RenderTarget render(
+        FilmFilterApplier filter, Scene &scene,
+        RendererInteractor &reporter) override;
+
+private:
+
+    using ImageBuffer = ImageBufferTemplate<true, true, true, true, true>;
+
+    using ParticleImage = Image2D<AtomicSpectrum>;
+
+    // where is the light subpath in its thread-local vertex array
+    struct LightSubpathRange
+    {
+        int thread_index = 0;
+        uint32_t beg     = 0;
+        uint32_t end     = 0;
+    };
+
+    VCMRendererParams params_;
+};
+
+VCMRenderer::VCMRenderer(const VCMRendererParams &params)
+    : params_(params)
+{
+
+}
+
+RenderTarget VCMRenderer::render(
+    FilmFilterApplier filter, Scene &scene, RendererInteractor &reporter)
+{
+    using namespace render::vcm;
+
+    const int thread_count = thread::actual_worker_count(params_.worker_count);
+    thread::thread_group_t threads(thread_count);
+
+    std::mutex reporter_mutex;
+
+    reporter.begin();
+    reporter.new_stage();
+
+    // one light subpath for each pixel in each iteration
+
+    const int width            = filter.width();
+    const int height           = filter.height();
+    const int pixel_count      = width * height;
+    const int light_path_count = pixel_count;
+
+    // determine initial merging radius
+
+    AABB world_bound = scene.world_bound();
+
+    real init_radius = params_.init_radius;
+    if(init_radius < 0)
+        init_radius = (world_bound.high - world_bound.low).length() / 1000;
+
+    world_bound.low  -= FVec3(init_radius);
+    world_bound.high += FVec3(init_radius);
+
+    const TraceParams trace_params = {
+        params_.min_depth, params_.max_depth, params_.cont_prob
+    };
+
+    // image buffers
+
+    ImageBuffer image_buffer(width, height);
+    ParticleImage particle_image(height, width);
+
+    uint64_t finished_light_path_count = 0;
+
+    // samplers
+
+    auto sampler_prototype = newRC<NativeSampler>(42, false);
+
+    PerThreadNativeSamplers perthread_sampler(thread_count, *sampler_prototype);
+
+    // light subpaths of current iteration
+    //
+    // bsdfs of light vertices live in perthread_light_arena and are
+    // released before tracing light subpaths of next iteration
+
+    std::vector<Arena> perthread_light_arena(thread_count);
+    std::vector<std::vector<Vertex>> perthread_light_vertices(thread_count);
+    std::vector<std::vector<CameraSplat>> perthread_splats(thread_count);
+
+    std::vector<LightSubpathRange> light_subpath_ranges(light_path_count);
+    std::vector<uint32_t> thread_vertex_offsets(thread_count);
+    std::vector<Vertex> light_vertices;
+
+    VCMRangeSearchAccelerator accel;
+
+    // how to compute the final image
+
+    auto compute_image = [&]
+    {
+        const auto fwd_ratio = image_buffer.weight.map([](real w)
+        {
+            return w > 0 ? 1 / w : real(0);
+        });
+        const auto fwd_img = fwd_ratio * image_buffer.value;
+
+        const real bwd_ratio = real(pixel_count) *
+            (finished_light_path_count > 0 ?
+                real(1) / finished_light_path_count : real(0));
+        const auto bwd_img = particle_image.map([&](const AtomicSpectrum &as)
+        {
+            return bwd_ratio * as.to_spectrum();
+        });
+
+        return fwd_img + bwd_img;
+    };
+
+    const Rect2i particle_pixel_range = { { 0, 0 }, { width - 1, height - 1 } };
+
+    auto apply_splats = [&](std::vector<CameraSplat> &splats)
+    {
+        for(auto &s : splats)
+        {
+            const Vec2 pixel_coord = {
+                s.film_coord.x * width,
+                s.film_coord.y * height
+            };
+
+            apply_image_filter(
+                particle_pixel_range, filter.radius(), pixel_coord,
+                [&](int pix, int piy, real rel_x, real rel_y)
+            {
+                const real weight = filter.eval_filter(rel_x, rel_y);
+                particle_image(piy, pix).add(weight * s.radiance);
+            });
+        }
+        splats.clear();
+    };
+
+    // run vcm iterations
+
+    int finished_iter_count = 0;
+
+    for(int iter = 0; iter < params_.iteration_count; ++iter)
+    {
+        if(stop_rendering_)
+            break;
+
+        if(reporter.need_image_preview())
+            reporter.message("start iter " + std::to_string(iter + 1));
+
+        const real progress_beg = 100 * real(iter)     / params_.iteration_count;
+        const real progress_end = 100 * real(iter + 1) / params_.iteration_count;
+        const real progress_mid = (progress_beg + progress_end) / 2;
+
+        reporter.progress(progress_beg, {});
+
+        const real radius = init_radius * std::pow(
+            real(iter + 1), (params_.radius_alpha - 1) / 2);
+
+        const IterationParams iter_params = create_iteration_params(
+            radius, light_path_count, pixel_count);
+
+        // trace light subpaths
+
+        for(int i = 0; i < thread_count; ++i)
+        {
+            perthread_light_arena[i].release();
+            perthread_light_vertices[i].clear();
+        }
+
+        parallel_for_1d_grid(
+            thread_count, light_path_count, 1024, threads,
+            [&](int thread_index, int beg, int end)
+        {
+            auto sampler   = perthread_sampler.get_sampler(thread_index);
+            auto &arena    = perthread_light_arena[thread_index];
+            auto &vertices = perthread_light_vertices[thread_index];
+            auto &splats   = perthread_splats[thread_index];
+
+            for(int i = beg; i < end; ++i)
+            {
+                auto &range = light_subpath_ranges[i];
+                range.thread_index = thread_index;
+                range.beg          = static_cast<uint32_t>(vertices.size());
+
+                vcm_trace_light_subpath(
+                    trace_params, iter_params, scene,
+                    *sampler, arena, vertices, splats);
+
+                range.end = static_cast<uint32_t>(vertices.size());
+            }
+
+            apply_splats(splats);
+
+            return !stop_rendering_;
+        });
+
+        if(stop_rendering_)
+            break;
+
+        finished_light_path_count += light_path_count;
+
+        // gather light vertices & build range search accelerator
+
+        size_t light_vertex_count = 0;
+        for(int i = 0; i < thread_count; ++i)
+        {
+            thread_vertex_offsets[i] = static_cast<uint32_t>(light_vertex_count);
+            light_vertex_count += perthread_light_vertices[i].size();
+        }
+
+        light_vertices.resize(light_vertex_count);
+
+        parallel_for_1d_grid(
+            thread_count, thread_count, 1, threads,
+            [&](int, int beg, int end)
+        {
+            for(int i = beg; i < end; ++i)
+            {
+                std::copy(
+                    perthread_light_vertices[i].begin(),
+                    perthread_light_vertices[i].end(),
+                    light_vertices.begin() + thread_vertex_offsets[i]);
+            }
+        });
+
+        accel.build(
+            light_vertices.data(), light_vertices.size(),
+            world_bound, radius, thread_count, threads);
+
+        reporter.progress(progress_mid, {});
+
+        // trace eye subpaths
+
+        int finished_pixel_count = 0;
+
+        parallel_for_2d_grid(
+            thread_count, width, height,
+            params_.task_grid_size, params_.task_grid_size, threads,
+            [&](int thread_index, const Rect2i &grid)
+        {
+            auto camera  = scene.get_camera();
+            auto sampler = perthread_sampler.get_sampler(thread_index);
+
+            auto view = filter.create_subgrid_view({
+                grid.low, grid.high - Vec2i(1) },
+                image_buffer.value, image_buffer.weight,
+                image_buffer.albedo,
+                image_buffer.normal,
+                image_buffer.denoise);
+
+            Arena arena;
+
+            const Rect2i sample_pixels = view.sample_pixels();
+
+            for(int y = sample_pixels.low.y; y <= sample_pixels.high.y; ++y)
+            {
+                for(int x = sample_pixels.low.x; x <= sample_pixels.high.x; ++x)
+                {
+                    const Sample2 film_sam = sampler->sample2();
+                    const Vec2 pixel_coord = {
+                        x + film_sam.u,
+                        y + film_sam.v
+                    };
+                    const Vec2 film_coord = {
+                        pixel_coord.x / width,
+                        pixel_coord.y / height
+                    };
+
+                    const CameraSampleWeResult cam_sam = camera->sample_we(
+                        film_coord, sampler->sample2());
+
+                    const Ray ray(cam_sam.pos_on_cam, cam_sam.pos_to_out);
+
+                    // sample pixels of edge tiles may lie outside the image.
+                    // they reuse light subpaths of the nearest image pixel
+
+                    const int subpath_x = math::clamp(x, 0, width - 1);
+                    const int subpath_y = math::clamp(y, 0, height - 1);
+                    const auto &range = light_subpath_ranges[
+                        subpath_y * width + subpath_x];
+                    const Vertex *light_subpath = light_vertices.data()
+                        + thread_vertex_offsets[range.thread_index]
+                        + range.beg;
+
+                    const render::Pixel pixel = vcm_trace_eye_subpath(
+                        trace_params, iter_params, scene,
+                        ray, cam_sam.throughput,
+                        light_subpath, int(range.end - range.beg),
+                        accel, *sampler, arena);
+
+                    if(pixel.value.is_finite())
+                    {
+                        view.apply(
+                            pixel_coord.x, pixel_coord.y,
+                            pixel.value, 1,
+                            pixel.albedo, pixel.normal, pixel.denoise);
+                    }
+
+                    if(arena.used_bytes() >= 4 * 1024 * 1024)
+                        arena.release();
+                }
+
+                if(stop_rendering_)
+                    return false;
+            }
+
+            std::lock_guard lk(reporter_mutex);
+            finished_pixel_count += (grid.high - grid.low).product();
+
+            const real t = real(finished_pixel_count) / pixel_count;
+            reporter.progress(
+                math::lerp(progress_mid, progress_end, t), {});
+
+            return true;
+        });
+
+        ++finished_iter_count;
+
+        // report progress
+
+        if(reporter.need_image_preview())
+            reporter.progress(progress_end, compute_image);
+        else
+            reporter.progress(progress_end, {});
+    }
+
+    reporter.end_stage();
+    reporter.end();
+
+    if(!finished_iter_count)
+        return {};
+
+    // compute final image
+
+    RenderTarget render_target;
+
+    const auto fwd_ratio = image_buffer.weight.map([](real w)
+    {
+        return w > 0 ? 1 / w : real(0);
+    });
+
+    render_target.image   = compute_image();
+    render_target.albedo  = image_buffer.albedo  * fwd_ratio;
+    render_target.normal  = image_buffer.normal  * fwd_ratio;
+    render_target.denoise = image_buffer.denoise * fwd_ratio;
+
+    return render_target;
+}
+
+RC<Renderer> create_vcm_renderer(const VCMRendererParams &params)
+{
+    return newRC<VCMRenderer>(params);
+}
+
+AGZ_TRACER_END
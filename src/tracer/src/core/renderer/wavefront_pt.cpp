@@ -0,0 +1,178 @@
+#include <agz/tracer/core/camera.h>
+#include <agz/tracer/core/sampler.h>
+#include <agz/tracer/core/scene.h>
+#include <agz/tracer/create/renderer.h>
+#include <agz/tracer/render/wavefront_path_tracing.h>
+
+#include "./perpixel_renderer.h"
+
+AGZ_TRACER_BEGIN
+
+class WavefrontPathTracingRenderer : public PerPixelRenderer
+{
+    render::TraceParams params_;
+
+    int batch_size_;
+
+    // sampler used only by one path, starting at the current state of
+    // the thread sampler
+    Sampler *fork_sampler(Sampler &sampler, Arena &arena) const
+    {
+        // low-discrepancy samples only depend on (stream, index, dimension),
+        // so a copy continues the sample exactly as the thread sampler would
+        if(sampler_type() != SamplerType::Native)
+        {
+            return arena.create<LowDiscrepancySampler>(
+                static_cast<LowDiscrepancySampler&>(sampler));
+        }
+
+        auto &native = static_cast<NativeSampler&>(sampler);
+        return native.clone(static_cast<int>(native.rng()()), arena);
+    }
+
+protected:
+
+    bool render_grid(
+        const Scene &scene, Sampler &sampler,
+        Grid &grid, const Vec2i &full_res, int spp, int sample_index_beg,
+        const Rect2i &pixel_range, PixelStats *stats) const override
+    {
+        // camera samples are generated in the same order as the per-pixel
+        // renderer, traced in batches, and added to the grid in that order
+
+        struct CameraSample
+        {
+            Vec2i pixel;
+            Vec2 pixel_pos;
+            FSpectrum throughput;
+        };
+
+        Arena path_arena, shading_arena;
+        render::WavefrontPathTracer tracer(params_);
+        std::vector<CameraSample> camera_samples;
+
+        const Camera *camera = scene.get_camera();
+        const auto sam_bound = grid.sample_pixels();
+
+        const Vec2 pixel_size = { real(1) / full_res.x, real(1) / full_res.y };
+
+        auto flush = [&]
+        {
+            tracer.trace(scene, shading_arena);
+
+            for(int i = 0; i < tracer.path_count(); ++i)
+            {
+                const CameraSample &cam_sam = camera_samples[i];
+                const render::Pixel &pixel = tracer.get_pixel(i);
+                if(!pixel.value.is_finite())
+                    continue;
+
+                const Spectrum value = cam_sam.throughput * pixel.value;
+                grid.apply_pixel_sample(
+                    cam_sam.pixel.x, cam_sam.pixel.y,
+                    cam_sam.pixel_pos.x, cam_sam.pixel_pos.y, value, 1,
+                    pixel.albedo, pixel.normal, pixel.denoise);
+
+                const int px = cam_sam.pixel.x, py = cam_sam.pixel.y;
+                if(stats &&
+                   pixel_range.low.x <= px && px <= pixel_range.high.x &&
+                   pixel_range.low.y <= py && py <= pixel_range.high.y)
+                {
+                    PixelStat &stat = (*stats)[py * full_res.x + px];
+                    const double lum = value.lum();
+                    stat.sum  += lum;
+                    stat.sum2 += lum * lum;
+                    ++stat.count;
+                }
+            }
+
+            tracer.clear();
+            camera_samples.clear();
+            path_arena.release();
+        };
+
+        for(int py = sam_bound.low.y; py <= sam_bound.high.y; ++py)
+        {
+            for(int px = sam_bound.low.x; px <= sam_bound.high.x; ++px)
+            {
+                const uint32_t pixel_stream =
+                    static_cast<uint32_t>(py) * static_cast<uint32_t>(full_res.x)
+                  + static_cast<uint32_t>(px);
+
+                for(int i = 0; i < spp; ++i)
+                {
+                    // paths not traced yet are dropped
+                    if(stop_rendering_)
+                        return false;
+
+                    sampler.start_sample(
+                        pixel_stream, static_cast<uint32_t>(sample_index_beg + i));
+
+                    const Vec2 pixel_pos = grid.sample_pixel(
+                        px, py, sampler.sample2());
+                    const real film_x = pixel_pos.x / full_res.x;
+                    const real film_y = pixel_pos.y / full_res.y;
+
+                    const Sample2 aperture_sam = sampler.sample2();
+                    auto cam_ray = camera->sample_we(
+                        { film_x, film_y }, aperture_sam);
+
+                    RayDifferential ray_diff;
+                    const bool has_ray_diff = camera->sample_we_differential(
+                        { film_x, film_y }, pixel_size, aperture_sam, &ray_diff);
+
+                    tracer.add_path(
+                        Ray(cam_ray.pos_on_cam, cam_ray.pos_to_out),
+                        has_ray_diff ? &ray_diff : nullptr,
+                        fork_sampler(sampler, path_arena));
+
+                    camera_samples.push_back(
+                        { { px, py }, pixel_pos, cam_ray.throughput });
+
+                    if(tracer.path_count() >= batch_size_)
+                        flush();
+                }
+            }
+        }
+
+        flush();
+        return true;
+    }
+
+    Pixel eval_pixel(
+        const Scene &scene, const Ray &ray, const RayDifferential *ray_diff,
+        Sampler &sampler, Arena &arena) const override
+    {
+        return render::trace_std(params_, scene, ray, sampler, arena, ray_diff);
+    }
+
+public:
+
+    explicit WavefrontPathTracingRenderer(
+        const WavefrontPTRendererParams &params)
+        : PerPixelRenderer(
+            params.worker_count,
+            params.task_grid_size, params.spp, params.adaptive,
+            params.sampler)
+    {
+        params_.min_depth = params.min_depth;
+        params_.max_depth = params.max_depth;
+        params_.cont_prob = params.cont_prob;
+        params_.specular_depth = params.specular_depth;
+
+        batch_size_ = params.batch_size;
+        if(batch_size_ <= 0)
+        {
+            throw ObjectConstructionException(
+                "invalid batch size: " + std::to_string(batch_size_));
+        }
+    }
+};
+
+RC<Renderer> create_wavefront_pt_renderer(
+    const WavefrontPTRendererParams &params)
+{
+    return newRC<WavefrontPathTracingRenderer>(params);
+}
+
+AGZ_TRACER_END
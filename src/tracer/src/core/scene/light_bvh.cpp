@@ -0,0 +1,270 @@
+#include <agz/tracer/utility/logger.h>
+
+#include "./light_bvh.h"
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    constexpr int SPLIT_BIN_COUNT = 12;
+
+    real aabb_surface_area(const AABB &bound) noexcept
+    {
+        const FVec3 ext = bound.high - bound.low;
+        if(ext.x < 0 || ext.y < 0 || ext.z < 0)
+            return 0;
+        return 2 * (ext.x * ext.y + ext.y * ext.z + ext.z * ext.x);
+    }
+
+} // namespace anonymous
+
+uint32_t LightBVH::build_aux(
+    BuildingLight *lights, size_t count, uint32_t parent)
+{
+    assert(count);
+
+    const uint32_t node_idx = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+
+    AABB all_bound, centroid_bound;
+    real power = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        all_bound      |= lights[i].bound;
+        centroid_bound |= lights[i].centroid;
+        power          += lights[i].power;
+    }
+
+    if(count == 1)
+    {
+        const uint32_t light_idx = static_cast<uint32_t>(lights_.size());
+        lights_.push_back(lights[0].light);
+        light_to_leaf_[lights[0].light->index()] = node_idx;
+
+        Node &node = nodes_[node_idx];
+        node.bound    = all_bound;
+        node.power    = power;
+        node.child[0] = light_idx;
+        node.parent   = parent;
+        node.is_leaf  = true;
+        return node_idx;
+    }
+
+    // find the split minimizing sum of power * surface area of children
+
+    int split_axis = -1, split_bin = 0;
+    real best_cost = std::numeric_limits<real>::max();
+
+    for(int axis = 0; axis < 3; ++axis)
+    {
+        const real axis_low = centroid_bound.low[axis];
+        const real axis_len = centroid_bound.high[axis] - axis_low;
+        if(axis_len <= 0)
+            continue;
+        const real bin_scale = SPLIT_BIN_COUNT / axis_len;
+
+        AABB bin_bound[SPLIT_BIN_COUNT];
+        real bin_power[SPLIT_BIN_COUNT] = { 0 };
+        size_t bin_count[SPLIT_BIN_COUNT] = { 0 };
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            const int b = (std::min)(SPLIT_BIN_COUNT - 1, static_cast<int>(
+                (lights[i].centroid[axis] - axis_low) * bin_scale));
+            bin_bound[b] |= lights[i].bound;
+            bin_power[b] += lights[i].power;
+            ++bin_count[b];
+        }
+
+        for(int b = 1; b < SPLIT_BIN_COUNT; ++b)
+        {
+            AABB left_bound, right_bound;
+            real left_power = 0, right_power = 0;
+            size_t left_count = 0, right_count = 0;
+
+            for(int i = 0; i < b; ++i)
+            {
+                left_bound  |= bin_bound[i];
+                left_power  += bin_power[i];
+                left_count  += bin_count[i];
+            }
+            for(int i = b; i < SPLIT_BIN_COUNT; ++i)
+            {
+                right_bound |= bin_bound[i];
+                right_power += bin_power[i];
+                right_count += bin_count[i];
+            }
+
+            if(!left_count || !right_count)
+                continue;
+
+            const real cost =
+                left_power  * aabb_surface_area(left_bound) +
+                right_power * aabb_surface_area(right_bound);
+            if(cost < best_cost)
+            {
+                best_cost  = cost;
+                split_axis = axis;
+                split_bin  = b;
+            }
+        }
+    }
+
+    size_t split_idx;
+    if(split_axis >= 0)
+    {
+        const real axis_low = centroid_bound.low[split_axis];
+        const real bin_scale = SPLIT_BIN_COUNT /
+            (centroid_bound.high[split_axis] - axis_low);
+        BuildingLight *mid = std::partition(
+            lights, lights + count, [&](const BuildingLight &l)
+        {
+            const int b = (std::min)(SPLIT_BIN_COUNT - 1, static_cast<int>(
+                (l.centroid[split_axis] - axis_low) * bin_scale));
+            return b < split_bin;
+        });
+        split_idx = static_cast<size_t>(mid - lights);
+    }
+    else
+    {
+        // all centroids coincide
+        split_idx = count / 2;
+    }
+
+    const uint32_t left  = build_aux(lights, split_idx, node_idx);
+    const uint32_t right = build_aux(
+        lights + split_idx, count - split_idx, node_idx);
+
+    Node &node = nodes_[node_idx];
+    node.bound    = all_bound;
+    node.power    = power;
+    node.child[0] = left;
+    node.child[1] = right;
+    node.parent   = parent;
+    node.is_leaf  = false;
+
+    return node_idx;
+}
+
+real LightBVH::importance(const Node &node, const FVec3 &ref) const noexcept
+{
+    if(node.power <= 0)
+        return 0;
+
+    // squared distance to bounding box centre, clamped by squared radius of
+    // the box so that nearby or enclosing nodes do not get unbounded weights
+
+    const FVec3 centre = real(0.5) * (node.bound.low + node.bound.high);
+    const real radius2 = real(0.25) *
+        (node.bound.high - node.bound.low).length_square();
+    const real dist2 = (ref - centre).length_square();
+
+    return node.power / (std::max)((std::max)(dist2, radius2), EPS());
+}
+
+real LightBVH::left_prob(const Node &interior, const FVec3 &ref) const noexcept
+{
+    const real l = importance(nodes_[interior.child[0]], ref);
+    const real r = importance(nodes_[interior.child[1]], ref);
+    const real sum = l + r;
+    return sum > 0 ? l / sum : real(-1);
+}
+
+void LightBVH::build(
+    const std::vector<const AreaLight*> &lights, int light_index_count)
+{
+    nodes_.clear();
+    lights_.clear();
+    light_to_leaf_.clear();
+
+    if(lights.empty())
+        return;
+
+    light_to_leaf_.resize(light_index_count, NO_LEAF);
+
+    std::vector<BuildingLight> building_lights;
+    building_lights.reserve(lights.size());
+    for(auto light : lights)
+    {
+        const AABB bound = light->world_bound();
+        building_lights.push_back({
+            light, bound, real(0.5) * (bound.low + bound.high),
+            light->power().lum()
+        });
+    }
+
+    nodes_.reserve(2 * lights.size());
+    lights_.reserve(lights.size());
+    build_aux(building_lights.data(), building_lights.size(), 0);
+
+    AGZ_INFO("light bvh: {} lights, {} nodes", lights_.size(), nodes_.size());
+}
+
+bool LightBVH::empty() const noexcept
+{
+    return nodes_.empty();
+}
+
+SceneSampleLightResult LightBVH::sample(
+    const FVec3 &ref, real u) const noexcept
+{
+    if(nodes_.empty() || nodes_[0].power <= 0)
+        return { nullptr, 0 };
+
+    real pdf = 1;
+    uint32_t node_idx = 0;
+    while(!nodes_[node_idx].is_leaf)
+    {
+        const Node &node = nodes_[node_idx];
+        const real p_left = left_prob(node, ref);
+        if(p_left < 0)
+            return { nullptr, 0 };
+
+        // reuse u for the following selections
+
+        if(u < p_left)
+        {
+            u = (std::min)(u / p_left, real(1) - EPS());
+            pdf *= p_left;
+            node_idx = node.child[0];
+        }
+        else
+        {
+            u = (std::min)((u - p_left) / (1 - p_left), real(1) - EPS());
+            pdf *= 1 - p_left;
+            node_idx = node.child[1];
+        }
+    }
+
+    return { lights_[nodes_[node_idx].child[0]], pdf };
+}
+
+real LightBVH::pdf(int light_index, const FVec3 &ref) const noexcept
+{
+    if(light_index < 0 ||
+       static_cast<size_t>(light_index) >= light_to_leaf_.size())
+        return 0;
+
+    uint32_t node_idx = light_to_leaf_[light_index];
+    if(node_idx == NO_LEAF)
+        return 0;
+
+    real pdf = 1;
+    while(node_idx != 0)
+    {
+        const uint32_t parent_idx = nodes_[node_idx].parent;
+        const Node &parent = nodes_[parent_idx];
+
+        const real p_left = left_prob(parent, ref);
+        if(p_left < 0)
+            return 0;
+        pdf *= parent.child[0] == node_idx ? p_left : 1 - p_left;
+
+        node_idx = parent_idx;
+    }
+
+    return pdf;
+}
+
+AGZ_TRACER_END
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include <agz/tracer/core/light.h>
+#include <agz/tracer/core/scene.h>
+#include <agz/utility/misc.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief spatial hierarchy of area lights for many-light sampling
+ *
+ * each leaf contains exactly one light. when sampling lights for a reference
+ * point, children are chosen in proportion to their estimated contribution,
+ * which is the total power divided by the squared distance to the node.
+ */
+class LightBVH : public misc::uncopyable_t
+{
+    struct Node
+    {
+        AABB bound;
+        real power = 0;
+
+        // for interior nodes: left/right child indices
+        // for leaf nodes: child[0] is index of the light
+        uint32_t child[2] = { 0, 0 };
+        uint32_t parent   = 0;
+
+        bool is_leaf = false;
+    };
+
+    struct BuildingLight
+    {
+        const AreaLight *light;
+        AABB bound;
+        FVec3 centroid;
+        real power;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<const AreaLight*> lights_;
+
+    // light->index() to leaf node index. NO_LEAF for lights not in bvh
+    static constexpr uint32_t NO_LEAF = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> light_to_leaf_;
+
+    uint32_t build_aux(BuildingLight *lights, size_t count, uint32_t parent);
+
+    real importance(const Node &node, const FVec3 &ref) const noexcept;
+
+    real left_prob(const Node &interior, const FVec3 &ref) const noexcept;
+
+public:
+
+    /**
+     * @brief build light bvh
+     *
+     * index of each light must have been assigned
+     *
+     * @param lights area lights to be organized
+     * @param light_index_count all light indices are less than this value
+     */
+    void build(
+        const std::vector<const AreaLight*> &lights, int light_index_count);
+
+    bool empty() const noexcept;
+
+    /**
+     * @brief select a light for illuminating ref
+     *
+     * ret.light is nullptr when no light can contribute to ref
+     */
+    SceneSampleLightResult sample(const FVec3 &ref, real u) const noexcept;
+
+    /**
+     * @brief pdf of selecting given light with sample(ref, u)
+     */
+    real pdf(int light_index, const FVec3 &ref) const noexcept;
+};
+
+AGZ_TRACER_END
@@ -1,5 +1,4 @@
 ﻿#include <memory>
-#include <unordered_map>
 #include <vector>
 
 #include <agz/tracer/core/aggregate.h>
@@ -12,6 +11,8 @@
 #include <agz/tracer/create/scene.h>
 #include <agz/utility/misc.h>
 
+#include "./light_bvh.h"
+
 AGZ_TRACER_BEGIN
 
 class DefaultScene : public Scene
@@ -28,13 +29,21 @@ class DefaultScene : public Scene
     RC<const Aggregate> aggregate_;
     
     math::distribution::alias_sampler_t<real, size_t> light_selector_;
+
+    // indexed by Light::index()
     std::vector<real> light_pdf_table_;
-    std::unordered_map<const Light*, real> light_ptr_to_pdf_;
+
+    DefaultSceneParams::LightSampler light_sampler_type_;
+
+    // used only when light_sampler_type_ is BVH
+    Box<LightBVH> light_bvh_;
+    real envir_light_select_prob_ = 0;
 
     void construct_light_sampler()
     {
         light_selector_.destroy();
         light_pdf_table_.clear();
+        light_bvh_.reset();
 
         if(lights_.empty())
             return;
@@ -52,13 +61,27 @@ class DefaultScene : public Scene
         light_selector_.initialize(
             light_pdf_table_.data(), light_pdf_table_.size());
 
-        light_ptr_to_pdf_.clear();
-        for(size_t i = 0; i < light_pdf_table_.size(); ++i)
+        if(light_sampler_type_ != DefaultSceneParams::LightSampler::BVH)
+            return;
+
+        std::vector<const AreaLight*> area_lights;
+        for(auto light : lights_)
         {
-            const Light *light = lights_[i];
-            const real pdf = light_pdf_table_[i];
-            light_ptr_to_pdf_.insert(std::make_pair(light, pdf));
+            if(auto area = light->as_area())
+                area_lights.push_back(area);
         }
+
+        light_bvh_ = newBox<LightBVH>();
+        light_bvh_->build(area_lights, static_cast<int>(lights_.size()));
+
+        // envir light is selected in proportion to its power
+
+        if(!envir_light_)
+            envir_light_select_prob_ = 0;
+        else if(light_bvh_->empty())
+            envir_light_select_prob_ = 1;
+        else
+            envir_light_select_prob_ = light_pdf_table_[envir_light_->index()];
     }
 
 public:
@@ -79,6 +102,8 @@ public:
 
         aggregate_ = params.aggregate;
         entities_ = params.entities;
+
+        light_sampler_type_ = params.light_sampler;
     }
 
     void set_camera(RC<const Camera> camera) override
@@ -124,8 +149,55 @@ public:
 
     real light_pdf(const Light *light) const noexcept override
     {
-        const auto it = light_ptr_to_pdf_.find(light);
-        return it != light_ptr_to_pdf_.end() ? it->second : real(0);
+        return light_pdf_by_index(light->index());
+    }
+
+    real light_pdf_by_index(int light_index) const noexcept override
+    {
+        assert(light_index < 0 ||
+               static_cast<size_t>(light_index) < light_pdf_table_.size());
+        return light_index >= 0 ? light_pdf_table_[light_index] : real(0);
+    }
+
+    SceneSampleLightResult sample_light(
+        const FVec3 &ref, const Sample1 &sam) const noexcept override
+    {
+        if(!light_bvh_)
+            return sample_light(sam);
+
+        real u = sam.u;
+        if(envir_light_)
+        {
+            if(u < envir_light_select_prob_)
+                return { envir_light_.get(), envir_light_select_prob_ };
+            u = (u - envir_light_select_prob_) / (1 - envir_light_select_prob_);
+        }
+
+        auto ret = light_bvh_->sample(ref, u);
+        ret.pdf *= 1 - envir_light_select_prob_;
+        return ret;
+    }
+
+    real light_pdf(const Light *light, const FVec3 &ref) const noexcept override
+    {
+        return light_pdf_by_index(light->index(), ref);
+    }
+
+    real light_pdf_by_index(
+        int light_index, const FVec3 &ref) const noexcept override
+    {
+        if(!light_bvh_)
+            return light_pdf_by_index(light_index);
+
+        if(envir_light_ && light_index == envir_light_->index())
+            return envir_light_select_prob_;
+        return (1 - envir_light_select_prob_)
+             * light_bvh_->pdf(light_index, ref);
+    }
+
+    bool is_light_sampling_spatial() const noexcept override
+    {
+        return light_bvh_ != nullptr;
     }
 
     bool has_intersection(const Ray &r) const noexcept override
@@ -168,6 +240,9 @@ public:
         if(envir_light_)
             envir_light_->preprocess(world_bound);
 
+        for(size_t i = 0; i < lights_.size(); ++i)
+            lights_[i]->set_index(static_cast<int>(i));
+
         construct_light_sampler();
     }
 };
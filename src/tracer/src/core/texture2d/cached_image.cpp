@@ -0,0 +1,131 @@
+#include <agz/tracer/core/texture2d.h>
+#include <agz/tracer/create/texture2d.h>
+#include <agz/tracer/utility/texture_cache.h>
+#include <agz/utility/texture.h>
+
+AGZ_TRACER_BEGIN
+
+class CachedImageTexture : public Texture2D
+{
+    static constexpr int TILE_SIZE_LOG2 = TextureCache::TILE_SIZE_LOG2;
+    static constexpr int TILE_MASK      = TextureCache::TILE_SIZE - 1;
+
+    RC<const TextureTileSource> source_;
+
+    TextureCache *cache_;
+    uint32_t texture_id_;
+
+    bool linear_ = true;
+
+    FSpectrum texel(int level, int x, int y) const noexcept
+    {
+        const math::color3b *tile = cache_->lookup(
+            texture_id_, *source_, level,
+            x >> TILE_SIZE_LOG2, y >> TILE_SIZE_LOG2);
+        return math::from_color3b<real>(
+            tile[((y & TILE_MASK) << TILE_SIZE_LOG2) + (x & TILE_MASK)]);
+    }
+
+    FSpectrum sample_level(int level, const Vec2 &uv) const noexcept
+    {
+        const auto tex = [&](int x, int y) { return texel(level, x, y); };
+        const int w = source_->width(level), h = source_->height(level);
+        if(linear_)
+            return texture::linear_sample2d(uv, tex, w, h);
+        return texture::nearest_sample2d(uv, tex, w, h);
+    }
+
+    FSpectrum trilinear_sample(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept
+    {
+        auto texel_len = [&](const Vec2 &d)
+        {
+            const real du = d.x * source_->width(0);
+            const real dv = d.y * source_->height(0);
+            return std::sqrt(du * du + dv * dv);
+        };
+        const real footprint = (std::max)(texel_len(duvdx), texel_len(duvdy));
+
+        const int level_count = source_->level_count();
+        const real lod = math::clamp<real>(
+            std::log2((std::max)(footprint, real(1e-8))),
+            0, real(level_count - 1));
+        const int lod0 = static_cast<int>(lod);
+        const int lod1 = (std::min)(lod0 + 1, level_count - 1);
+
+        const FSpectrum v0 = sample_level(lod0, uv);
+        if(lod1 == lod0)
+            return v0;
+        const FSpectrum v1 = sample_level(lod1, uv);
+        return math::lerp(v0, v1, lod - lod0);
+    }
+
+protected:
+
+    FSpectrum sample_spectrum_impl(const Vec2 &uv) const noexcept override
+    {
+        return sample_level(0, uv.saturate());
+    }
+
+    FSpectrum sample_spectrum_filtered_impl(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept override
+    {
+        return trilinear_sample(uv.saturate(), duvdx, duvdy);
+    }
+
+public:
+
+    CachedImageTexture(
+        const Texture2DCommonParams &common_params,
+        RC<const TextureTileSource> source,
+        const std::string &sampler,
+        const std::string &filter)
+    {
+        init_common_params(common_params);
+
+        assert(source && source->level_count() > 0);
+        source_ = std::move(source);
+
+        cache_      = &TextureCache::instance();
+        texture_id_ = TextureCache::new_texture_id();
+
+        if(sampler == "nearest")
+            linear_ = false;
+        else if(sampler == "linear")
+            linear_ = true;
+        else
+            throw ObjectConstructionException("invalid sample method");
+
+        if(filter == "none")
+            filtered_ = false;
+        else if(filter == "trilinear")
+            filtered_ = source_->level_count() > 1;
+        else
+        {
+            throw ObjectConstructionException(
+                "invalid filter method of cached image texture: " + filter +
+                " (expect none/trilinear)");
+        }
+    }
+
+    int width() const noexcept override
+    {
+        return source_->width(0);
+    }
+
+    int height() const noexcept override
+    {
+        return source_->height(0);
+    }
+};
+
+RC<Texture2D> create_cached_image_texture(
+    const Texture2DCommonParams &common_params,
+    RC<const TextureTileSource> source, const std::string &sampler,
+    const std::string &filter)
+{
+    return newRC<CachedImageTexture>(
+        common_params, std::move(source), sampler, filter);
+}
+
+AGZ_TRACER_END
@@ -1,3 +1,4 @@
+#include <array>
 #include <memory>
 #include <unordered_map>
 
@@ -9,10 +10,80 @@
 
 AGZ_TRACER_BEGIN
 
+namespace
+{
+    using ImageLevel = texture::texture2d_t<math::color3b>;
+
+    // gaussian weights of ewa filter indexed by squared radius in [0, 1)
+    constexpr int EWA_WEIGHT_TABLE_SIZE = 128;
+
+    const real *ewa_weight_table() noexcept
+    {
+        static const auto table = []
+        {
+            std::array<real, EWA_WEIGHT_TABLE_SIZE> ret = {};
+            constexpr real alpha = 2;
+            for(int i = 0; i < EWA_WEIGHT_TABLE_SIZE; ++i)
+            {
+                const real r2 = real(i) / (EWA_WEIGHT_TABLE_SIZE - 1);
+                ret[i] = std::exp(-alpha * r2) - std::exp(-alpha);
+            }
+            return ret;
+        }();
+        return table.data();
+    }
+
+    // box filtered level with half resolution
+    ImageLevel downsample(const ImageLevel &src)
+    {
+        const int src_w = src.width(), src_h = src.height();
+        const int w = (std::max)(1, (src_w + 1) / 2);
+        const int h = (std::max)(1, (src_h + 1) / 2);
+
+        ImageLevel ret(h, w);
+        for(int y = 0; y < h; ++y)
+        {
+            const int y0 = (std::min)(2 * y,     src_h - 1);
+            const int y1 = (std::min)(2 * y + 1, src_h - 1);
+
+            for(int x = 0; x < w; ++x)
+            {
+                const int x0 = (std::min)(2 * x,     src_w - 1);
+                const int x1 = (std::min)(2 * x + 1, src_w - 1);
+
+                const math::color3b &a = src(y0, x0), &b = src(y0, x1);
+                const math::color3b &c = src(y1, x0), &d = src(y1, x1);
+
+                auto avg = [](int i, int j, int k, int l)
+                {
+                    return static_cast<uint8_t>((i + j + k + l + 2) / 4);
+                };
+
+                ret(y, x) = math::color3b(
+                    avg(a.r, b.r, c.r, d.r),
+                    avg(a.g, b.g, c.g, d.g),
+                    avg(a.b, b.b, c.b, d.b));
+            }
+        }
+
+        return ret;
+    }
+
+} // namespace anonymous
+
 class ImageTexture : public Texture2D
 {
     RC<const Image2D<math::color3b>> data_;
 
+    // coarser mip levels. mip_levels_[i] is level i + 1
+    std::vector<ImageLevel> mip_levels_;
+
+    enum class Filter { None, Trilinear, EWA };
+
+    Filter filter_ = Filter::None;
+
+    real max_anisotropy_ = 8;
+
     static FSpectrum nearest_sample_impl(
         const texture::texture2d_t<math::color3b> *data, const Vec2 &uv) noexcept
     {
@@ -33,6 +104,150 @@ class ImageTexture : public Texture2D
         const texture::texture2d_t<math::color3b>*, const Vec2&);
     SampleImplFuncPtr sample_impl_ = linear_sample_impl;
 
+    int level_count() const noexcept
+    {
+        return static_cast<int>(mip_levels_.size()) + 1;
+    }
+
+    const ImageLevel &level(int i) const noexcept
+    {
+        return i ? mip_levels_[i - 1] : *data_;
+    }
+
+    // level of detail whose texel size matches given footprint,
+    // which is measured in base level texels
+    real footprint_to_lod(real footprint) const noexcept
+    {
+        const real lod = std::log2((std::max)(footprint, real(1e-8)));
+        return math::clamp<real>(lod, 0, real(level_count() - 1));
+    }
+
+    FSpectrum trilinear_sample(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept
+    {
+        auto texel_len = [&](const Vec2 &d)
+        {
+            const real du = d.x * data_->width();
+            const real dv = d.y * data_->height();
+            return std::sqrt(du * du + dv * dv);
+        };
+        const real lod = footprint_to_lod(
+            (std::max)(texel_len(duvdx), texel_len(duvdy)));
+        const int lod0 = static_cast<int>(lod);
+        const int lod1 = (std::min)(lod0 + 1, level_count() - 1);
+
+        const FSpectrum v0 = linear_sample_impl(&level(lod0), uv);
+        if(lod1 == lod0)
+            return v0;
+        const FSpectrum v1 = linear_sample_impl(&level(lod1), uv);
+        return math::lerp(v0, v1, lod - lod0);
+    }
+
+    FSpectrum ewa_sample_level(
+        int level_idx, const Vec2 &uv, Vec2 d0, Vec2 d1) const noexcept
+    {
+        const ImageLevel &img = level(level_idx);
+        const int w = img.width(), h = img.height();
+
+        // ellipse in texel space of this level
+
+        const real s = uv.x * w - real(0.5);
+        const real t = uv.y * h - real(0.5);
+        d0 = Vec2(d0.x * w, d0.y * h);
+        d1 = Vec2(d1.x * w, d1.y * h);
+
+        real A = d0.y * d0.y + d1.y * d1.y + 1;
+        real B = -2 * (d0.x * d0.y + d1.x * d1.y);
+        real C = d0.x * d0.x + d1.x * d1.x + 1;
+        const real inv_f = 1 / (A * C - B * B * real(0.25));
+        A *= inv_f;
+        B *= inv_f;
+        C *= inv_f;
+
+        const real det     = -B * B + 4 * A * C;
+        const real inv_det = 1 / det;
+        const real u_sqrt  = std::sqrt(det * C);
+        const real v_sqrt  = std::sqrt(A * det);
+
+        const int s0 = static_cast<int>(std::ceil (s - 2 * inv_det * u_sqrt));
+        const int s1 = static_cast<int>(std::floor(s + 2 * inv_det * u_sqrt));
+        const int t0 = static_cast<int>(std::ceil (t - 2 * inv_det * v_sqrt));
+        const int t1 = static_cast<int>(std::floor(t + 2 * inv_det * v_sqrt));
+
+        // texels are fetched through nearest sampling at texel centers,
+        // so that the uv to texel mapping matches other lookups
+
+        const real *weights = ewa_weight_table();
+        FSpectrum sum;
+        real weight_sum = 0;
+
+        for(int it = t0; it <= t1; ++it)
+        {
+            const real tt = it - t;
+            for(int is = s0; is <= s1; ++is)
+            {
+                const real ss = is - s;
+                const real r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+                if(r2 >= 1)
+                    continue;
+
+                const int weight_idx = (std::min)(
+                    static_cast<int>(r2 * EWA_WEIGHT_TABLE_SIZE),
+                    EWA_WEIGHT_TABLE_SIZE - 1);
+                const real weight = weights[weight_idx];
+
+                const Vec2 texel_uv(
+                    math::clamp<real>((is + real(0.5)) / w, 0, 1),
+                    math::clamp<real>((it + real(0.5)) / h, 0, 1));
+                sum += weight * nearest_sample_impl(&img, texel_uv);
+                weight_sum += weight;
+            }
+        }
+
+        if(weight_sum <= 0)
+            return linear_sample_impl(&img, uv);
+        return sum / weight_sum;
+    }
+
+    FSpectrum ewa_sample(
+        const Vec2 &uv, Vec2 d0, Vec2 d1) const noexcept
+    {
+        auto texel_len_sq = [&](const Vec2 &d)
+        {
+            const real du = d.x * data_->width();
+            const real dv = d.y * data_->height();
+            return du * du + dv * dv;
+        };
+
+        if(texel_len_sq(d0) < texel_len_sq(d1))
+            std::swap(d0, d1);
+
+        const real major_len = std::sqrt(texel_len_sq(d0));
+        real minor_len = std::sqrt(texel_len_sq(d1));
+
+        // clamp eccentricity to bound the number of texels in the ellipse
+
+        if(minor_len > 0 && minor_len * max_anisotropy_ < major_len)
+        {
+            const real scale = major_len / (minor_len * max_anisotropy_);
+            d1 = scale * d1;
+            minor_len *= scale;
+        }
+
+        if(minor_len <= 0)
+            return linear_sample_impl(data_.get(), uv);
+
+        const real lod = footprint_to_lod(minor_len);
+        const int lod0 = static_cast<int>(lod);
+        const int lod1 = (std::min)(lod0 + 1, level_count() - 1);
+
+        const FSpectrum v0 = ewa_sample_level(lod0, uv, d0, d1);
+        if(lod1 == lod0)
+            return v0;
+        const FSpectrum v1 = ewa_sample_level(lod1, uv, d0, d1);
+        return math::lerp(v0, v1, lod - lod0);
+    }
+
 protected:
 
     FSpectrum sample_spectrum_impl(const Vec2 &uv) const noexcept override
@@ -40,12 +255,22 @@ protected:
         return sample_impl_(data_.get(), uv.saturate());
     }
 
+    FSpectrum sample_spectrum_filtered_impl(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept override
+    {
+        if(filter_ == Filter::EWA)
+            return ewa_sample(uv.saturate(), duvdx, duvdy);
+        return trilinear_sample(uv.saturate(), duvdx, duvdy);
+    }
+
 public:
 
     ImageTexture(
         const Texture2DCommonParams &common_params,
         RC<const Image2D<math::color3b>> data,
-        const std::string &sampler)
+        const std::string &sampler,
+        const std::string &filter,
+        real max_anisotropy)
     {
         init_common_params(common_params);
 
@@ -59,6 +284,31 @@ public:
             sample_impl_ = linear_sample_impl;
         else
             throw ObjectConstructionException("invalid sample method");
+
+        if(filter == "none")
+            filter_ = Filter::None;
+        else if(filter == "trilinear")
+            filter_ = Filter::Trilinear;
+        else if(filter == "ewa")
+            filter_ = Filter::EWA;
+        else
+            throw ObjectConstructionException("invalid filter method: " + filter);
+
+        max_anisotropy_ = (std::max)(max_anisotropy, real(1));
+
+        if(filter_ == Filter::None)
+            return;
+
+        // build mip pyramid
+
+        const ImageLevel *last = data_.get();
+        while(last->width() > 1 || last->height() > 1)
+        {
+            mip_levels_.push_back(downsample(*last));
+            last = &mip_levels_.back();
+        }
+
+        filtered_ = true;
     }
 
     int width() const noexcept override
@@ -74,9 +324,11 @@ public:
 
 RC<Texture2D> create_image_texture(
     const Texture2DCommonParams &common_params,
-    RC<const Image2D<math::color3b>> data, const std::string &sampler)
+    RC<const Image2D<math::color3b>> data, const std::string &sampler,
+    const std::string &filter, real max_anisotropy)
 {
-    return newRC<ImageTexture>(common_params, std::move(data), sampler);
+    return newRC<ImageTexture>(
+        common_params, std::move(data), sampler, filter, max_anisotropy);
 }
 
 AGZ_TRACER_END
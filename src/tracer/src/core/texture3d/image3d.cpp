@@ -1,4 +1,7 @@
+#include <vector>
+
 #include <agz/tracer/core/texture3d.h>
+#include <agz/tracer/utility/sparse_volume.h>
 #include <agz/utility/texture.h>
 
 AGZ_TRACER_BEGIN
@@ -22,33 +25,142 @@ AGZ_TRACER_BEGIN
             ET_UINT24                                    \
     } while(false)
 
-template<bool USE_LINEAR_INTERP, typename ElemType>
+template<bool USE_LINEAR_INTERP, typename ElemType,
+         typename Data = Image3D<ElemType>>
 class ImageTexture3D : public Texture3D
 {
-    RC<const Image3D<ElemType>> data_;
+    static constexpr bool IS_SPARSE =
+        std::is_same_v<Data, SparseVolume<ElemType>>;
+
+    RC<const Data> data_;
 
     FSpectrum max_spec_;
     real max_real_;
 
+    // maximal real value of each brick. only used by sparse volume
+    std::vector<real> brick_max_real_;
+
+    static real to_real(const ElemType &texel) noexcept
+    {
+        SWITCH_ET(
+        {
+            return texel;
+        },
+        {
+            return texel / real(255);
+        },
+        {
+            return texel.r;
+        },
+        {
+            return math::from_color3b<real>(texel).r;
+        });
+    }
+
+    static FSpectrum to_spectrum(const ElemType &texel) noexcept
+    {
+        SWITCH_ET(
+        {
+            return FSpectrum(texel);
+        },
+        {
+            return FSpectrum(texel / real(255));
+        },
+        {
+            return texel;
+        },
+        {
+            return math::from_color3b<real>(texel);
+        });
+    }
+
+    void update_max(const ElemType &texel) noexcept
+    {
+        const FSpectrum e = to_spectrum(texel);
+        max_spec_.r = (std::max)(max_spec_.r, e.r);
+        max_spec_.g = (std::max)(max_spec_.g, e.g);
+        max_spec_.b = (std::max)(max_spec_.b, e.b);
+    }
+
+    void init_dense_max()
+    {
+        for(int z = 0; z < data_->depth(); ++z)
+        {
+            for(int y = 0; y < data_->height(); ++y)
+            {
+                for(int x = 0; x < data_->width(); ++x)
+                    update_max(data_->at(z, y, x));
+            }
+        }
+    }
+
+    void init_sparse_max()
+    {
+        constexpr int BRICK_SIZE = SparseVolume<ElemType>::BRICK_SIZE;
+
+        const Vec3i &brick_count = data_->brick_count();
+        brick_max_real_.resize(
+            size_t(brick_count.x) * brick_count.y * brick_count.z);
+
+        const real background_real = to_real(data_->background());
+        bool has_empty_brick = false;
+
+        for(int bz = 0, brick_idx = 0; bz < brick_count.z; ++bz)
+        {
+            for(int by = 0; by < brick_count.y; ++by)
+            {
+                for(int bx = 0; bx < brick_count.x; ++bx, ++brick_idx)
+                {
+                    const ElemType *brick = data_->brick(bz, by, bx);
+                    if(!brick)
+                    {
+                        brick_max_real_[brick_idx] = background_real;
+                        has_empty_brick = true;
+                        continue;
+                    }
+
+                    // only texels inside the volume are taken into account
+
+                    const int z_end = (std::min)(BRICK_SIZE, data_->depth()  - bz * BRICK_SIZE);
+                    const int y_end = (std::min)(BRICK_SIZE, data_->height() - by * BRICK_SIZE);
+                    const int x_end = (std::min)(BRICK_SIZE, data_->width()  - bx * BRICK_SIZE);
+
+                    real brick_max = REAL_MIN;
+                    for(int lz = 0; lz < z_end; ++lz)
+                    {
+                        for(int ly = 0; ly < y_end; ++ly)
+                        {
+                            for(int lx = 0; lx < x_end; ++lx)
+                            {
+                                const ElemType &texel =
+                                    brick[(lz * BRICK_SIZE + ly) * BRICK_SIZE + lx];
+                                brick_max = (std::max)(brick_max, to_real(texel));
+                                update_max(texel);
+                            }
+                        }
+                    }
+
+                    brick_max_real_[brick_idx] = brick_max;
+                }
+            }
+        }
+
+        if(has_empty_brick)
+            update_max(data_->background());
+    }
+
+    real apply_inv_gamma(real value) const noexcept
+    {
+        return inv_gamma_ != 1 ? std::pow(value, inv_gamma_) : value;
+    }
+
 protected:
 
     real sample_real_impl(const FVec3 &uvw) const noexcept override
     {
         auto access_texel = [&](int x, int y, int z)
         {
-            SWITCH_ET(
-            {
-                return data_->at(z, y, x);
-            },
-            {
-                return data_->at(z, y, x) / real(255);
-            },
-            {
-                return data_->at(z, y, x).r;
-            },
-            {
-                return math::from_color3b<real>(data_->at(z, y, x)).r;
-            });
+            return to_real(data_->at(z, y, x));
         };
 
         if constexpr(USE_LINEAR_INTERP)
@@ -69,19 +181,7 @@ protected:
     {
         auto access_texel = [&](int x, int y, int z)
         {
-            SWITCH_ET(
-            {
-                return FSpectrum(data_->at(z, y, x));
-            },
-            {
-                return FSpectrum(data_->at(z, y, x) / real(255));
-            },
-            {
-                return data_->at(z, y, x);
-            },
-            {
-                return math::from_color3b<real>(data_->at(z, y, x));
-            });
+            return to_spectrum(data_->at(z, y, x));
         };
 
         if constexpr(USE_LINEAR_INTERP)
@@ -102,48 +202,19 @@ public:
 
     ImageTexture3D(
         const Texture3DCommonParams &common_params,
-        RC<const Image3D<ElemType>> data)
+        RC<const Data> data)
     {
         init_common_params(common_params);
         data_ = std::move(data);
 
         max_spec_ = FSpectrum(REAL_MIN);
-        max_real_ = REAL_MIN;
 
-        for(int z = 0; z < data_->depth(); ++z)
-        {
-            for(int y = 0; y < data_->height(); ++y)
-            {
-                for(int x = 0; x < data_->width(); ++x)
-                {
-                    SWITCH_ET(
-                    {
-                        max_real_ = (std::max)(max_real_, data_->at(z, y, x));
-                    },
-                    {
-                        max_real_ = (std::max)(max_real_, data_->at(z, y, x) / real(255));
-                    },
-                    {
-                        const FSpectrum e = data_->at(z, y, x);
-                        max_spec_.r = (std::max)(max_spec_.r, e.r);
-                        max_spec_.g = (std::max)(max_spec_.g, e.g);
-                        max_spec_.b = (std::max)(max_spec_.b, e.b);
-                    },
-                    {
-                        const FSpectrum e = math::from_color3b<real>(data_->at(z, y, x));
-                        max_spec_.r = (std::max)(max_spec_.r, e.r);
-                        max_spec_.g = (std::max)(max_spec_.g, e.g);
-                        max_spec_.b = (std::max)(max_spec_.b, e.b);
-                    });
-                }
-            }
-        }
+        if constexpr(IS_SPARSE)
+            init_sparse_max();
+        else
+            init_dense_max();
 
-        SWITCH_ET(
-            { max_spec_ = FSpectrum(max_real_); },
-            { max_spec_ = FSpectrum(max_real_); },
-            { max_real_ = max_spec_.r; },
-            { max_real_ = max_spec_.r; });
+        max_real_ = max_spec_.r;
     }
 
     int width() const noexcept override
@@ -170,6 +241,47 @@ public:
     {
         return max_real_;
     }
+
+    real max_real_in(const FVec3 &low, const FVec3 &high) const noexcept override
+    {
+        Vec3i beg, end;
+        if(!texel_range(low, high, { width(), height(), depth() }, beg, end))
+            return apply_inv_gamma(max_real_);
+
+        real ret = REAL_MIN;
+
+        if constexpr(IS_SPARSE)
+        {
+            constexpr int LOG2 = SparseVolume<ElemType>::BRICK_SIZE_LOG2;
+
+            const Vec3i &brick_count = data_->brick_count();
+            for(int bz = beg.z >> LOG2; bz <= end.z >> LOG2; ++bz)
+            {
+                for(int by = beg.y >> LOG2; by <= end.y >> LOG2; ++by)
+                {
+                    for(int bx = beg.x >> LOG2; bx <= end.x >> LOG2; ++bx)
+                    {
+                        const int brick_idx =
+                            (bz * brick_count.y + by) * brick_count.x + bx;
+                        ret = (std::max)(ret, brick_max_real_[brick_idx]);
+                    }
+                }
+            }
+        }
+        else
+        {
+            for(int z = beg.z; z <= end.z; ++z)
+            {
+                for(int y = beg.y; y <= end.y; ++y)
+                {
+                    for(int x = beg.x; x <= end.x; ++x)
+                        ret = (std::max)(ret, to_real(data_->at(z, y, x)));
+                }
+            }
+        }
+
+        return apply_inv_gamma(ret);
+    }
 };
 
 RC<Texture3D> create_image3d(
@@ -232,4 +344,72 @@ RC<Texture3D> create_image3d(
         common_params, std::move(data));
 }
 
+RC<Texture3D> create_image3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseVolume<real>> data,
+    bool use_linear_sampler)
+{
+    using Data = SparseVolume<real>;
+
+    if(use_linear_sampler)
+    {
+        return newRC<ImageTexture3D<true, real, Data>>(
+            common_params, std::move(data));
+    }
+
+    return newRC<ImageTexture3D<false, real, Data>>(
+        common_params, std::move(data));
+}
+
+RC<Texture3D> create_image3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseVolume<uint8_t>> data,
+    bool use_linear_sampler)
+{
+    using Data = SparseVolume<uint8_t>;
+
+    if(use_linear_sampler)
+    {
+        return newRC<ImageTexture3D<true, uint8_t, Data>>(
+            common_params, std::move(data));
+    }
+
+    return newRC<ImageTexture3D<false, uint8_t, Data>>(
+        common_params, std::move(data));
+}
+
+RC<Texture3D> create_image3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseVolume<Spectrum>> data,
+    bool use_linear_sampler)
+{
+    using Data = SparseVolume<Spectrum>;
+
+    if(use_linear_sampler)
+    {
+        return newRC<ImageTexture3D<true, Spectrum, Data>>(
+            common_params, std::move(data));
+    }
+
+    return newRC<ImageTexture3D<false, Spectrum, Data>>(
+        common_params, std::move(data));
+}
+
+RC<Texture3D> create_image3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseVolume<math::color3b>> data,
+    bool use_linear_sampler)
+{
+    using Data = SparseVolume<math::color3b>;
+
+    if(use_linear_sampler)
+    {
+        return newRC<ImageTexture3D<true, math::color3b, Data>>(
+            common_params, std::move(data));
+    }
+
+    return newRC<ImageTexture3D<false, math::color3b, Data>>(
+        common_params, std::move(data));
+}
+
 AGZ_TRACER_END
@@ -902,7 +902,7 @@ real mis_weight_sx_t0(
         if(!light)
             return 0;
 
-        select_light_pdf = scene.light_pdf(light);
+        select_light_pdf = scene.light_pdf_by_index(light->index());
         const auto light_pdf = light->emit_pdf(
             b.surface.pos, b.surface.wr, b.surface.nor);
 
@@ -921,7 +921,7 @@ real mis_weight_sx_t0(
         auto env = scene.envir_light();
         assert(env);
 
-        select_light_pdf = scene.light_pdf(env);
+        select_light_pdf = scene.light_pdf_by_index(env->index());
         const auto light_pdf = env->emit_pdf({}, b.env_light.light_to_out, {});
 
         assign_b_pdf_bwd = {
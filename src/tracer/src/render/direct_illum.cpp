@@ -8,10 +8,36 @@
 
 AGZ_TRACER_BEGIN
 
+namespace
+{
+
+    /**
+     * @brief pdf of selecting light for illuminating ref
+     *
+     * all lights are accounted when light sampling of scene is not spatial
+     */
+    real select_light_pdf(
+        const Scene &scene, const Light *light, const FVec3 &ref) noexcept
+    {
+        if(!scene.is_light_sampling_spatial())
+            return 1;
+        return scene.light_pdf_by_index(light->index(), ref);
+    }
+
+} // namespace anonymous
+
 FSpectrum mis_sample_area_light(
     const Scene &scene, const AreaLight *light,
     const EntityIntersection &inct, const ShadingPoint &shd,
     Sampler &sampler)
+{
+    return mis_sample_area_light(scene, light, 1, inct, shd, sampler);
+}
+
+FSpectrum mis_sample_area_light(
+    const Scene &scene, const AreaLight *light, real select_pdf,
+    const EntityIntersection &inct, const ShadingPoint &shd,
+    Sampler &sampler)
 {
     const Sample5 sam = sampler.sample5();
 
@@ -38,13 +64,22 @@ FSpectrum mis_sample_area_light(
                      * std::abs(cos(inct_to_light, inct.geometry_coord.z));
     const real bsdf_pdf = shd.bsdf->pdf_all(inct_to_light, inct.wr);
 
-    return f / (light_sample.pdf + bsdf_pdf);
+    return f / (select_pdf * light_sample.pdf + bsdf_pdf);
 }
 
 FSpectrum mis_sample_area_light(
     const Scene &scene, const AreaLight *light,
     const MediumScattering &scattering, const BSDF *phase_function,
     Sampler &sampler)
+{
+    return mis_sample_area_light(
+        scene, light, 1, scattering, phase_function, sampler);
+}
+
+FSpectrum mis_sample_area_light(
+    const Scene &scene, const AreaLight *light, real select_pdf,
+    const MediumScattering &scattering, const BSDF *phase_function,
+    Sampler &sampler)
 {
     const Sample5 sam = sampler.sample5();
 
@@ -66,17 +101,26 @@ FSpectrum mis_sample_area_light(
                      * light_sample.radiance * bsdf_f;
     const real bsdf_pdf = phase_function->pdf_all(inct_to_light, scattering.wr);
 
-    return f / (light_sample.pdf + bsdf_pdf);
+    return f / (select_pdf * light_sample.pdf + bsdf_pdf);
 }
 
 FSpectrum mis_sample_envir_light(
     const Scene &scene, const EnvirLight *light,
     const EntityIntersection &inct, const ShadingPoint &shd,
     Sampler &sampler)
+{
+    return mis_sample_envir_light(scene, light, 1, inct, shd, sampler);
+}
+
+FSpectrum mis_sample_envir_light(
+    const Scene &scene, const EnvirLight *light, real select_pdf,
+    const EntityIntersection &inct, const ShadingPoint &shd,
+    Sampler &sampler)
 {
     const Sample5 sam = sampler.sample5();
 
-    const auto light_sample = light->sample(inct.pos, sam);
+    const auto light_sample = light->sample_with_normal(
+        inct.pos, inct.geometry_coord.z, sam);
     if(!light_sample.radiance)
         return {};
 
@@ -95,7 +139,7 @@ FSpectrum mis_sample_envir_light(
                      * bsdf_f * std::abs(cos(ref_to_light, inct.geometry_coord.z));
     const real bsdf_pdf = shd.bsdf->pdf_all(ref_to_light, inct.wr);
 
-    return f / (light_sample.pdf + bsdf_pdf);
+    return f / (select_pdf * light_sample.pdf + bsdf_pdf);
 }
 
 FSpectrum mis_sample_envir_light(
@@ -107,6 +151,14 @@ FSpectrum mis_sample_envir_light(
     return {};
 }
 
+FSpectrum mis_sample_envir_light(
+    const Scene &scene, const EnvirLight *light, real select_pdf,
+    const MediumScattering &scattering, const BSDF *phase_function,
+    Sampler &sampler)
+{
+    return {};
+}
+
 FSpectrum mis_sample_light(
     const Scene &scene, const Light *lht,
     const EntityIntersection &inct, const ShadingPoint &shd,
@@ -127,6 +179,65 @@ FSpectrum mis_sample_light(
     return mis_sample_envir_light(scene, lht->as_envir(), scattering, phase_function, sampler);
 }
 
+FSpectrum mis_sample_scene_lights(
+    const Scene &scene,
+    const EntityIntersection &inct, const ShadingPoint &shd,
+    Sampler &sampler)
+{
+    if(!scene.is_light_sampling_spatial())
+    {
+        FSpectrum ret;
+        for(auto light : scene.lights())
+            ret += mis_sample_light(scene, light, inct, shd, sampler);
+        return ret;
+    }
+
+    const auto [light, select_pdf] = scene.sample_light(
+        inct.pos, sampler.sample1());
+    if(!light)
+        return {};
+
+    if(light->is_area())
+    {
+        return mis_sample_area_light(
+            scene, light->as_area(), select_pdf, inct, shd, sampler);
+    }
+    return mis_sample_envir_light(
+        scene, light->as_envir(), select_pdf, inct, shd, sampler);
+}
+
+FSpectrum mis_sample_scene_lights(
+    const Scene &scene,
+    const MediumScattering &scattering, const BSDF *phase_function,
+    Sampler &sampler)
+{
+    if(!scene.is_light_sampling_spatial())
+    {
+        FSpectrum ret;
+        for(auto light : scene.lights())
+        {
+            ret += mis_sample_light(
+                scene, light, scattering, phase_function, sampler);
+        }
+        return ret;
+    }
+
+    const auto [light, select_pdf] = scene.sample_light(
+        scattering.pos, sampler.sample1());
+    if(!light)
+        return {};
+
+    if(light->is_area())
+    {
+        return mis_sample_area_light(
+            scene, light->as_area(), select_pdf,
+            scattering, phase_function, sampler);
+    }
+    return mis_sample_envir_light(
+        scene, light->as_envir(), select_pdf,
+        scattering, phase_function, sampler);
+}
+
 FSpectrum mis_sample_bsdf(
     const Scene &scene, const EntityIntersection &inct, const ShadingPoint &shd, Sampler &sampler,
     BSDFSampleResult &bsdf_sample, bool &has_ent_inct, EntityIntersection &ent_inct)
@@ -162,7 +273,9 @@ FSpectrum mis_sample_bsdf(
                 envir_illum += f / bsdf_sample.pdf;
             else
             {
-                real light_pdf = light->pdf(new_ray.o, new_ray.d);
+                const real light_pdf = select_light_pdf(scene, light, inct.pos)
+                                     * light->pdf_with_normal(
+                                         new_ray.o, inct.geometry_coord.z, new_ray.d);
                 envir_illum += f / (bsdf_sample.pdf + light_pdf);
             }
         }
@@ -186,8 +299,8 @@ FSpectrum mis_sample_bsdf(
     if(bsdf_sample.is_delta)
         return f / bsdf_sample.pdf;
 
-    const real light_pdf = light->pdf(
-        new_ray.o, ent_inct.pos, ent_inct.geometry_coord.z);
+    const real light_pdf = select_light_pdf(scene, light, inct.pos)
+                         * light->pdf(new_ray.o, ent_inct.pos, ent_inct.geometry_coord.z);
     return f / (bsdf_sample.pdf + light_pdf);
 }
 
@@ -224,7 +337,8 @@ FSpectrum mis_sample_bsdf(
                 envir_illum += f / bsdf_sample.pdf;
             else
             {
-                const real light_pdf = light->pdf(new_ray.o, new_ray.d);
+                const real light_pdf = select_light_pdf(scene, light, scattering.pos)
+                                     * light->pdf(new_ray.o, new_ray.d);
                 envir_illum += f / (bsdf_sample.pdf + light_pdf);
             }
         }
@@ -247,8 +361,8 @@ FSpectrum mis_sample_bsdf(
     if(bsdf_sample.is_delta)
         return f / bsdf_sample.pdf;
 
-    const real light_pdf = light->pdf(
-        new_ray.o, ent_inct.pos, ent_inct.geometry_coord.z);
+    const real light_pdf = select_light_pdf(scene, light, scattering.pos)
+                         * light->pdf(new_ray.o, ent_inct.pos, ent_inct.geometry_coord.z);
     return f / (bsdf_sample.pdf + light_pdf);
 }
 
@@ -14,7 +14,7 @@ AGZ_TRACER_RENDER_BEGIN
 
 Pixel trace_std(
     const TraceParams &params, const Scene &scene, const Ray &ray,
-    Sampler &sampler, Arena &arena)
+    Sampler &sampler, Arena &arena, const RayDifferential *ray_diff)
 {
     FSpectrum coef(1);
     Ray r = ray;
@@ -48,6 +48,11 @@ Pixel trace_std(
             return pixel;
         }
 
+        // texture footprint of the camera ray
+
+        if(depth == 1 && ray_diff)
+            ent_inct.compute_uv_differential(*ray_diff);
+
         // fill gbuffer
 
         const ShadingPoint ent_shd = ent_inct.material->shade(ent_inct, arena);
@@ -85,11 +90,8 @@ Pixel trace_std(
                 FSpectrum direct_illum;
                 for(int i = 0; i < params.direct_illum_sample_count; ++i)
                 {
-                    for(auto light : scene.lights())
-                    {
-                        direct_illum += coef * mis_sample_light(
-                            scene, light, scattering_point, phase_function, sampler);
-                    }
+                    direct_illum += coef * mis_sample_scene_lights(
+                        scene, scattering_point, phase_function, sampler);
                     direct_illum += coef * mis_sample_bsdf(
                         scene, scattering_point, phase_function, sampler);
                 }
@@ -134,11 +136,8 @@ Pixel trace_std(
         FSpectrum direct_illum;
         for(int i = 0; i < params.direct_illum_sample_count; ++i)
         {
-            for(auto light : scene.lights())
-            {
-                direct_illum += coef * mis_sample_light(
-                    scene, light, ent_inct, ent_shd, sampler);
-            }
+            direct_illum += coef * mis_sample_scene_lights(
+                scene, ent_inct, ent_shd, sampler);
             direct_illum += coef * mis_sample_bsdf(
                 scene, ent_inct, ent_shd, sampler);
         }
@@ -193,11 +192,8 @@ Pixel trace_std(
             FSpectrum new_direct_illum;
             for(int i = 0; i < params.direct_illum_sample_count; ++i)
             {
-                for(auto light : scene.lights())
-                {
-                    new_direct_illum += coef * mis_sample_light(
-                        scene, light, new_inct, new_shd, sampler);
-                }
+                new_direct_illum += coef * mis_sample_scene_lights(
+                    scene, new_inct, new_shd, sampler);
                 new_direct_illum += coef * mis_sample_bsdf(
                     scene, new_inct, new_shd, sampler);
             }
@@ -226,7 +222,7 @@ Pixel trace_std(
 
 Pixel trace_nomis(
     const TraceParams &params, const Scene &scene, const Ray &ray,
-    Sampler &sampler, Arena &arena)
+    Sampler &sampler, Arena &arena, const RayDifferential *ray_diff)
 {
     FSpectrum coef(1);
     Ray r = ray;
@@ -257,6 +253,11 @@ Pixel trace_nomis(
             return pixel;
         }
 
+        // texture footprint of the camera ray
+
+        if(depth == 1 && ray_diff)
+            ent_inct.compute_uv_differential(*ray_diff);
+
         // fill gbuffer
 
         const auto ent_shd = ent_inct.material->shade(ent_inct, arena);
@@ -6,76 +6,140 @@
 #include <agz/tracer/core/scene.h>
 #include <agz/tracer/render/direct_illum.h>
 #include <agz/tracer/render/photon_mapping.h>
+#include <agz/tracer/utility/parallel_grid.h>
 
 AGZ_TRACER_RENDER_BEGIN
 
 namespace sppm
 {
 
-VisiblePointSearcher::VisiblePointSearcher(
-    const AABB &world_bound,
-    real grid_sidelen,
-    size_t entry_count)
-    : hashed_grid_aux_(world_bound, grid_sidelen, entry_count)
+PhotonSearcher::PhotonSearcher(const AABB &world_bound, real grid_sidelen)
+    : world_bound_(world_bound), grid_sidelen_(grid_sidelen)
 {
-    node_entry_count_ = entry_count;
-    node_entries_ = newBox<std::atomic<VPNode*>[]>(node_entry_count_);
-    
-    clear();
-}
 
-void VisiblePointSearcher::clear()
-{
-    for(size_t i = 0; i < node_entry_count_; ++i)
-        node_entries_[i] = nullptr;
 }
 
-void VisiblePointSearcher::add_vp(Pixel &pixel, Arena &vp_node_arena)
+void PhotonSearcher::build(
+    const std::vector<PhotonBuffer> &photon_buffers,
+    int thread_count, thread::thread_group_t &threads)
 {
-    const Vec3i &min_grid = hashed_grid_aux_.pos_to_grid(
-        pixel.vp.pos - FVec3(pixel.radius));
-    const Vec3i &max_grid = hashed_grid_aux_.pos_to_grid(
-        pixel.vp.pos + FVec3(pixel.radius));
+    const int buffer_count = static_cast<int>(photon_buffers.size());
 
-    for(int z = min_grid.z; z <= max_grid.z; ++z)
+    size_t photon_count = 0;
+    for(auto &b : photon_buffers)
+        photon_count += b.size();
+
+    const size_t entry_count = (std::max<size_t>)(
+        8, (photon_count + 7) / 8 * 8);
+    hashed_grid_aux_ = newBox<HashedGridAux>(
+        world_bound_, grid_sidelen_, entry_count);
+
+    // counting sort of photons by entry
+
+    std::vector<std::vector<uint32_t>> photon_entries(buffer_count);
+    std::vector<std::atomic<uint32_t>> entry_sizes(entry_count);
+    for(auto &s : entry_sizes)
+        s = 0;
+
+    parallel_for_1d_grid(
+        thread_count, buffer_count, 1, threads,
+        [&](int, int beg, int end)
     {
-        for(int y = min_grid.y; y <= max_grid.y; ++y)
+        for(int b = beg; b < end; ++b)
         {
-            for(int x = min_grid.x; x <= max_grid.x; ++x)
+            auto &buffer  = photon_buffers[b];
+            auto &entries = photon_entries[b];
+
+            entries.resize(buffer.size());
+            for(size_t i = 0; i < buffer.size(); ++i)
             {
-                const size_t entry_idx = hashed_grid_aux_.grid_to_entry({ x, y, z });
-                auto &entry = node_entries_[entry_idx];
+                const size_t entry = hashed_grid_aux_->pos_to_entry(
+                    buffer[i].pos);
+                entries[i] = static_cast<uint32_t>(entry);
+                entry_sizes[entry].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    entry_beg_.resize(entry_count + 1);
+    entry_beg_[0] = 0;
+    for(size_t i = 0; i < entry_count; ++i)
+        entry_beg_[i + 1] = entry_beg_[i] + entry_sizes[i];
+
+    // reuse sizes as insertion cursors
+
+    for(size_t i = 0; i < entry_count; ++i)
+        entry_sizes[i] = entry_beg_[i];
+
+    photons_.resize(photon_count);
 
-                VPNode *new_node = vp_node_arena.create<VPNode>();
-                new_node->pixel = &pixel;
-                new_node->next  = entry;
+    parallel_for_1d_grid(
+        thread_count, buffer_count, 1, threads,
+        [&](int, int beg, int end)
+    {
+        for(int b = beg; b < end; ++b)
+        {
+            auto &buffer  = photon_buffers[b];
+            auto &entries = photon_entries[b];
 
-                while(!entry.compare_exchange_weak(new_node->next, new_node))
-                    ;
+            for(size_t i = 0; i < buffer.size(); ++i)
+            {
+                const uint32_t pos = entry_sizes[entries[i]].fetch_add(
+                    1, std::memory_order_relaxed);
+                photons_[pos] = buffer[i];
             }
         }
-    }
+    });
 }
 
-void VisiblePointSearcher::add_photon(
-    const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr)
+void PhotonSearcher::gather(Pixel &pixel) const
 {
-    const size_t entry_index = hashed_grid_aux_.pos_to_entry(photon_pos);
-    for(VPNode *node = node_entries_[entry_index]; node; node = node->next)
-    {
-        auto &pixel = *node->pixel;
-        if(distance2(pixel.vp.pos, photon_pos) > pixel.radius * pixel.radius)
-            continue;
+    if(!hashed_grid_aux_)
+        return;
 
-        const FSpectrum delta_phi = phi * pixel.vp.bsdf->eval_all(
-            wr, pixel.vp.wr, TransMode::Radiance);
+    const real radius2 = pixel.radius * pixel.radius;
 
-        if(!delta_phi.is_finite())
-            continue;
+    const Vec3i min_grid = hashed_grid_aux_->pos_to_grid(
+        pixel.vp.pos - FVec3(pixel.radius));
+    const Vec3i max_grid = hashed_grid_aux_->pos_to_grid(
+        pixel.vp.pos + FVec3(pixel.radius));
 
-        for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-            math::atomic_add(pixel.phi[i], delta_phi[i]);
-        ++pixel.M;
+    for(int z = min_grid.z; z <= max_grid.z; ++z)
+    {
+        for(int y = min_grid.y; y <= max_grid.y; ++y)
+        {
+            for(int x = min_grid.x; x <= max_grid.x; ++x)
+            {
+                const size_t entry = hashed_grid_aux_->grid_to_entry(
+                    { x, y, z });
+
+                for(uint32_t i = entry_beg_[entry];
+                    i < entry_beg_[entry + 1]; ++i)
+                {
+                    const Photon &photon = photons_[i];
+                    if(distance2(pixel.vp.pos, photon.pos) > radius2)
+                        continue;
+
+                    // different cells may share the same entry.
+                    // only count the photon when visiting its own cell
+                    const Vec3i photon_grid = hashed_grid_aux_->pos_to_grid(
+                        photon.pos);
+                    if(photon_grid.x != x || photon_grid.y != y ||
+                       photon_grid.z != z)
+                        continue;
+
+                    const FSpectrum delta_phi = photon.phi
+                        * pixel.vp.bsdf->eval_all(
+                            photon.wr, pixel.vp.wr, TransMode::Radiance);
+
+                    if(!delta_phi.is_finite())
+                        continue;
+
+                    pixel.phi += delta_phi;
+                    ++pixel.M;
+                }
+            }
+        }
     }
 }
 
@@ -131,8 +195,7 @@ Pixel::VisiblePoint tracer_vp(
         FSpectrum sum_di;
         for(int i = 0; i < direct_illum_spv; ++i)
         {
-            for(auto l : scene.lights())
-                sum_di += mis_sample_light(scene, l, inct, shd, sampler);
+            sum_di += mis_sample_scene_lights(scene, inct, shd, sampler);
             sum_di += mis_sample_bsdf(scene, inct, shd, sampler);
         }
         direct_illum += coef * sum_di / real(direct_illum_spv);
@@ -171,7 +234,7 @@ Pixel::VisiblePoint tracer_vp(
 
 void trace_photon(
     int min_depth, int max_depth, real cont_prob,
-    VisiblePointSearcher &vp_searcher,
+    PhotonBuffer &photons,
     const Scene &scene, Arena &arena, Sampler &sampler)
 {
     // emit a photon
@@ -211,7 +274,7 @@ void trace_photon(
         // accumulate flux at visible points
         // ignore direct illumination
         if(depth > 1)
-            vp_searcher.add_photon(inct.pos, coef, inct.wr);
+            photons.push_back({ inct.pos, inct.wr, coef });
 
         // sample bsdf to create next ray
 
@@ -237,19 +300,13 @@ void update_pixel_params(real alpha, Pixel &pixel)
         real new_N = pixel.N + alpha * pixel.M;
         real new_R = pixel.radius * std::sqrt(new_N / (pixel.N + pixel.M));
 
-        FSpectrum phi;
-        for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-            phi[i] = pixel.phi[i];
-
-        pixel.tau = (pixel.tau + pixel.vp.coef * phi) * (new_R * new_R)
+        pixel.tau = (pixel.tau + pixel.vp.coef * pixel.phi) * (new_R * new_R)
                   / (pixel.radius * pixel.radius);
 
         pixel.N      = new_N;
         pixel.radius = new_R;
         pixel.M      = 0;
-
-        for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-            pixel.phi[i] = 0;
+        pixel.phi    = FSpectrum(0);
     }
 
     pixel.vp.coef = FSpectrum(0);
@@ -0,0 +1,617 @@
+#include <agz/tracer/core/bsdf.h>
+#include <agz/tracer/core/camera.h>
+#include <agz/tracer/core/entity.h>
+#include <agz/tracer/core/light.h>
+#include <agz/tracer/core/material.h>
+#include <agz/tracer/core/medium.h>
+#include <agz/tracer/core/sampler.h>
+#include <agz/tracer/core/scene.h>
+#include <agz/tracer/render/vertex_connection_merging.h>
+#include <agz/tracer/utility/parallel_grid.h>
+
+AGZ_TRACER_RENDER_BEGIN
+
+namespace vcm
+{
+
+namespace
+{
+    /*
+    pdfs of russian roulette are not accounted in mis weights.
+    all strategies evaluate their weights with the same pdf functions,
+    so the weights still sum to one for any full path.
+    */
+
+    // sample next direction of a subpath and update its mis quantities
+    bool sample_scattering(
+        const IterationParams &iter_params,
+        const EntityIntersection &inct, const BSDF *bsdf, TransMode mode,
+        Sampler &sampler, RayPayload &payload)
+    {
+        const auto bsdf_sample = bsdf->sample_all(
+            inct.wr, mode, sampler.sample3());
+        if(!bsdf_sample.f || bsdf_sample.pdf <= 0)
+            return false;
+
+        const real abscos = std::abs(cos(
+            inct.geometry_coord.z, bsdf_sample.dir));
+
+        if(bsdf_sample.is_delta)
+        {
+            payload.dVCM  = 0;
+            payload.dVC  *= abscos;
+            payload.dVM  *= abscos;
+        }
+        else
+        {
+            const real pdf_rev = bsdf->pdf_all(inct.wr, bsdf_sample.dir);
+            const real ratio   = abscos / bsdf_sample.pdf;
+
+            payload.dVC = ratio * (
+                payload.dVC * pdf_rev + payload.dVCM + iter_params.vm_weight);
+            payload.dVM = ratio * (
+                payload.dVM * pdf_rev + payload.dVCM * iter_params.vc_weight + 1);
+            payload.dVCM = 1 / bsdf_sample.pdf;
+
+            payload.all_specular = false;
+        }
+
+        payload.accu_coef *= bsdf_sample.f * abscos / bsdf_sample.pdf;
+        payload.ray = Ray(inct.eps_offset(bsdf_sample.dir), bsdf_sample.dir);
+
+        return !payload.accu_coef.is_black();
+    }
+
+    // update mis quantities with the segment ending at inct
+    void update_mis_at_hit(
+        const EntityIntersection &inct, bool mul_dist2, RayPayload &payload)
+    {
+        const real abscos = std::abs(cos(inct.geometry_coord.z, inct.wr));
+        if(abscos <= 0)
+        {
+            payload.accu_coef = {};
+            return;
+        }
+
+        if(mul_dist2)
+            payload.dVCM *= distance2(payload.ray.o, inct.pos);
+
+        payload.dVCM /= abscos;
+        payload.dVC  /= abscos;
+        payload.dVM  /= abscos;
+    }
+
+    // splat light vertex to camera
+    void connect_to_camera(
+        const IterationParams &iter_params,
+        const Scene &scene, const EntityIntersection &inct, const BSDF *bsdf,
+        const RayPayload &payload, Sampler &sampler,
+        std::vector<CameraSplat> &splats)
+    {
+        const Camera *camera = scene.get_camera();
+
+        const auto cam_sam = camera->sample_wi(inct.pos, sampler.sample2());
+        if(cam_sam.we.is_black() || cam_sam.pdf <= 0)
+            return;
+
+        const FVec3 to_cam = cam_sam.ref_to_pos.normalize();
+
+        const FSpectrum bsdf_f = bsdf->eval_all(
+            to_cam, inct.wr, TransMode::Importance);
+        if(bsdf_f.is_black())
+            return;
+
+        if(!scene.visible(cam_sam.pos_on_cam, inct.pos))
+            return;
+
+        const real abscos = std::abs(cos(inct.geometry_coord.z, to_cam));
+        const real dist2  = distance2(cam_sam.pos_on_cam, inct.pos);
+
+        // pdf of generating inct.pos with an eye subpath of its pixel,
+        // w.r.t. the surface area at inct.pos
+
+        const auto cam_pdf = camera->pdf_we(cam_sam.pos_on_cam, -to_cam);
+        const real camera_pdf_a = cam_pdf.pdf_dir * iter_params.pixel_count
+                                * abscos / dist2;
+
+        const real pdf_rev = bsdf->pdf_all(inct.wr, to_cam);
+
+        const real w_light = camera_pdf_a / iter_params.light_path_count
+                           * (iter_params.vm_weight + payload.dVCM
+                                                    + payload.dVC * pdf_rev);
+        const real mis_weight = 1 / (w_light + 1);
+
+        const Medium *medium = inct.medium(to_cam);
+        const FSpectrum tr = medium->tr(cam_sam.pos_on_cam, inct.pos, sampler);
+
+        const FSpectrum radiance = mis_weight * payload.accu_coef * bsdf_f
+                                 * tr * abscos * cam_sam.we / cam_sam.pdf;
+        if(radiance.is_finite() && !radiance.is_black())
+            splats.push_back({ cam_sam.film_coord, radiance });
+    }
+
+    // radiance of area light with mis weight, when hit by an eye subpath
+    FSpectrum eye_hit_area_light(
+        const Scene &scene, const AreaLight *light,
+        const EntityIntersection &inct, const RayPayload &payload)
+    {
+        const FSpectrum radiance = light->radiance(
+            inct.pos, inct.geometry_coord.z, inct.uv, inct.wr);
+        if(radiance.is_black())
+            return {};
+
+        if(payload.seg_cnt == 1)
+            return radiance;
+
+        const real select_pdf = scene.light_pdf(light);
+
+        const real abscos = std::abs(cos(inct.geometry_coord.z, inct.wr));
+        const real dist2  = distance2(payload.ray.o, inct.pos);
+
+        const real direct_pdf_a = select_pdf * abscos / dist2 * light->pdf(
+            payload.ray.o, inct.pos, inct.geometry_coord.z);
+
+        const auto emit_pdf = light->emit_pdf(
+            inct.pos, inct.wr, inct.geometry_coord.z);
+        const real emit_pdf_w = select_pdf * emit_pdf.pdf_pos * emit_pdf.pdf_dir;
+
+        const real w_eye = direct_pdf_a * payload.dVCM + emit_pdf_w * payload.dVC;
+        return radiance / (1 + w_eye);
+    }
+
+    // radiance of environment light with mis weight, when hit by an eye subpath
+    FSpectrum eye_hit_envir_light(
+        const Scene &scene, const EnvirLight *light, const RayPayload &payload)
+    {
+        const FVec3 dir = payload.ray.d.normalize();
+
+        const FSpectrum radiance = light->radiance(payload.ray.o, dir);
+        if(radiance.is_black())
+            return {};
+
+        if(payload.seg_cnt == 1)
+            return radiance;
+
+        const real select_pdf = scene.light_pdf(light);
+
+        const real direct_pdf_w = select_pdf * light->pdf(payload.ray.o, dir);
+
+        const auto emit_pdf = light->emit_pdf({}, -dir, -dir);
+        const real emit_pdf_w = select_pdf * emit_pdf.pdf_pos * emit_pdf.pdf_dir;
+
+        const real w_eye = direct_pdf_w * payload.dVCM + emit_pdf_w * payload.dVC;
+        return radiance / (1 + w_eye);
+    }
+
+    // sample scene lights at an eye vertex
+    FSpectrum direct_illumination(
+        const IterationParams &iter_params,
+        const Scene &scene, const EntityIntersection &inct, const BSDF *bsdf,
+        const RayPayload &payload, Sampler &sampler)
+    {
+        const auto [light, select_pdf] = scene.sample_light(sampler.sample1());
+        if(!light)
+            return {};
+
+        const auto light_sample = light->sample(inct.pos, sampler.sample5());
+        if(light_sample.radiance.is_black() || light_sample.pdf <= 0)
+            return {};
+
+        const FVec3 to_light = (light_sample.pos - inct.pos).normalize();
+
+        const FSpectrum bsdf_f = bsdf->eval_all(
+            to_light, inct.wr, TransMode::Radiance);
+        if(bsdf_f.is_black())
+            return {};
+
+        const real cos_eye = std::abs(cos(inct.geometry_coord.z, to_light));
+
+        real cos_light = 1;
+        if(light->is_area())
+            cos_light = std::abs(cos(light_sample.nor, to_light));
+        if(cos_light <= 0)
+            return {};
+
+        const auto emit_pdf = light->emit_pdf(
+            light_sample.pos, -to_light, light_sample.nor);
+
+        const real direct_pdf_w = light_sample.pdf;
+        const real emit_pdf_w   = emit_pdf.pdf_pos * emit_pdf.pdf_dir;
+
+        const real bsdf_pdf_fwd = bsdf->pdf_all(to_light, inct.wr);
+        const real bsdf_pdf_rev = bsdf->pdf_all(inct.wr, to_light);
+
+        const real w_light = bsdf_pdf_fwd / (select_pdf * direct_pdf_w);
+        const real w_eye   = emit_pdf_w * cos_eye / (direct_pdf_w * cos_light)
+                           * (iter_params.vm_weight + payload.dVCM
+                                                    + payload.dVC * bsdf_pdf_rev);
+        const real mis_weight = 1 / (w_light + 1 + w_eye);
+
+        if(!scene.visible(inct.eps_offset(to_light), light_sample.pos))
+            return {};
+
+        const Medium *medium = inct.medium(to_light);
+        const FSpectrum tr = medium->tr(inct.pos, light_sample.pos, sampler);
+
+        return mis_weight * light_sample.radiance * bsdf_f * tr * cos_eye
+             / (select_pdf * direct_pdf_w);
+    }
+
+    // connect an eye vertex to a light vertex
+    FSpectrum connect_vertices(
+        const IterationParams &iter_params,
+        const Scene &scene, const EntityIntersection &inct, const BSDF *bsdf,
+        const RayPayload &payload, const Vertex &light_vtx, Sampler &sampler)
+    {
+        FVec3 to_light = light_vtx.pos - inct.pos;
+        const real dist2 = to_light.length_square();
+        if(dist2 <= 0)
+            return {};
+        to_light /= std::sqrt(dist2);
+
+        const FSpectrum eye_f = bsdf->eval_all(
+            to_light, inct.wr, TransMode::Radiance);
+        if(eye_f.is_black())
+            return {};
+
+        const FSpectrum light_f = light_vtx.bsdf->eval_all(
+            -to_light, light_vtx.wr, TransMode::Importance);
+        if(light_f.is_black())
+            return {};
+
+        const real cos_eye   = std::abs(cos(inct.geometry_coord.z, to_light));
+        const real cos_light = std::abs(cos(light_vtx.nor, to_light));
+        const real geometry  = cos_eye * cos_light / dist2;
+        if(geometry <= 0)
+            return {};
+
+        const real eye_pdf_fwd   = bsdf->pdf_all(to_light, inct.wr);
+        const real eye_pdf_rev   = bsdf->pdf_all(inct.wr, to_light);
+        const real light_pdf_fwd = light_vtx.bsdf->pdf_all(-to_light, light_vtx.wr);
+        const real light_pdf_rev = light_vtx.bsdf->pdf_all(light_vtx.wr, -to_light);
+
+        const real eye_pdf_a   = eye_pdf_fwd   * cos_light / dist2;
+        const real light_pdf_a = light_pdf_fwd * cos_eye   / dist2;
+
+        const real w_light = eye_pdf_a * (
+            iter_params.vm_weight + light_vtx.dVCM + light_vtx.dVC * light_pdf_rev);
+        const real w_eye = light_pdf_a * (
+            iter_params.vm_weight + payload.dVCM + payload.dVC * eye_pdf_rev);
+        const real mis_weight = 1 / (w_light + 1 + w_eye);
+
+        if(!scene.visible(inct.eps_offset(to_light), light_vtx.pos))
+            return {};
+
+        const Medium *medium = inct.medium(to_light);
+        const FSpectrum tr = medium->tr(inct.pos, light_vtx.pos, sampler);
+
+        return mis_weight * geometry * eye_f * light_f * tr * light_vtx.accu_coef;
+    }
+
+    // merge an eye vertex with neighboring light vertices
+    FSpectrum merge_vertices(
+        const TraceParams &trace_params, const IterationParams &iter_params,
+        const EntityIntersection &inct, const BSDF *bsdf,
+        const RayPayload &payload, const VCMRangeSearchAccelerator &accel)
+    {
+        FSpectrum ret;
+
+        accel.find_in_neighborhood(inct.pos, [&](const Vertex &light_vtx)
+        {
+            if(light_vtx.seg_cnt + payload.seg_cnt > trace_params.max_depth)
+                return;
+
+            const FSpectrum f = bsdf->eval_all(
+                light_vtx.wr, inct.wr, TransMode::Radiance);
+            if(f.is_black())
+                return;
+
+            const real eye_pdf_fwd = bsdf->pdf_all(light_vtx.wr, inct.wr);
+            const real eye_pdf_rev = bsdf->pdf_all(inct.wr, light_vtx.wr);
+
+            const real w_light = light_vtx.dVCM * iter_params.vc_weight
+                               + light_vtx.dVM  * eye_pdf_fwd;
+            const real w_eye   = payload.dVCM * iter_params.vc_weight
+                               + payload.dVM  * eye_pdf_rev;
+            const real mis_weight = 1 / (w_light + 1 + w_eye);
+
+            ret += mis_weight * f * light_vtx.accu_coef;
+        });
+
+        return iter_params.vm_normalization * ret;
+    }
+
+} // namespace anonymous
+
+IterationParams create_iteration_params(
+    real radius, int light_path_count, int pixel_count) noexcept
+{
+    const real eta = PI_r * radius * radius * light_path_count;
+
+    IterationParams ret;
+    ret.radius           = radius;
+    ret.light_path_count = real(light_path_count);
+    ret.pixel_count      = real(pixel_count);
+    ret.vm_normalization = 1 / eta;
+    ret.vm_weight        = eta;
+    ret.vc_weight        = 1 / eta;
+    return ret;
+}
+
+void VCMRangeSearchAccelerator::build(
+    const Vertex *vertices, size_t vertex_count,
+    const AABB &world_bound, real radius,
+    int thread_count, thread::thread_group_t &threads)
+{
+    radius_   = radius;
+    radius2_  = radius * radius;
+    vertices_ = vertices;
+
+    const size_t entry_count = (std::max<size_t>)(
+        8, (vertex_count + 7) / 8 * 8);
+    grid_aux_ = newBox<HashedGridAux>(world_bound, 2 * radius, entry_count);
+
+    // counting sort of vertex indices by entry
+
+    std::vector<uint32_t> vertex_entries(vertex_count);
+    std::vector<std::atomic<uint32_t>> entry_sizes(entry_count);
+    for(auto &s : entry_sizes)
+        s = 0;
+
+    parallel_for_1d_grid(
+        thread_count, static_cast<int>(vertex_count), 4096, threads,
+        [&](int, int beg, int end)
+    {
+        for(int i = beg; i < end; ++i)
+        {
+            const size_t entry = grid_aux_->pos_to_entry(vertices[i].pos);
+            vertex_entries[i] = static_cast<uint32_t>(entry);
+            entry_sizes[entry].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    entry_beg_.resize(entry_count + 1);
+    entry_beg_[0] = 0;
+    for(size_t i = 0; i < entry_count; ++i)
+        entry_beg_[i + 1] = entry_beg_[i] + entry_sizes[i];
+
+    // reuse sizes as insertion cursors
+
+    for(size_t i = 0; i < entry_count; ++i)
+        entry_sizes[i] = entry_beg_[i];
+
+    indices_.resize(vertex_count);
+
+    parallel_for_1d_grid(
+        thread_count, static_cast<int>(vertex_count), 4096, threads,
+        [&](int, int beg, int end)
+    {
+        for(int i = beg; i < end; ++i)
+        {
+            const uint32_t pos = entry_sizes[vertex_entries[i]].fetch_add(
+                1, std::memory_order_relaxed);
+            indices_[pos] = static_cast<uint32_t>(i);
+        }
+    });
+}
+
+void vcm_trace_light_subpath(
+    const TraceParams &trace_params, const IterationParams &iter_params,
+    const Scene &scene, Sampler &sampler, Arena &arena,
+    std::vector<Vertex> &light_vertices, std::vector<CameraSplat> &splats)
+{
+    // sample emission
+
+    const auto [light, select_pdf] = scene.sample_light(sampler.sample1());
+    if(!light)
+        return;
+
+    const auto emit = light->sample_emit(sampler.sample5());
+    if(!emit.radiance || emit.pdf_pos <= 0 || emit.pdf_dir <= 0)
+        return;
+
+    const real emit_pdf_w = select_pdf * emit.pdf_pos * emit.pdf_dir;
+    const real cos_emit   = light->is_area() ?
+                            std::abs(cos(emit.dir, emit.nor)) : real(1);
+
+    RayPayload payload;
+    payload.ray          = Ray(emit.pos, emit.dir);
+    payload.accu_coef    = emit.radiance * cos_emit / emit_pdf_w;
+    payload.seg_cnt      = 0;
+    payload.all_specular = true;
+
+    // dVCM needs the pdf of sampling the emitting point from the first hit,
+    // so it is evaluated after the first intersection
+
+    payload.dVC = cos_emit / emit_pdf_w;
+    payload.dVM = payload.dVC * iter_params.vc_weight;
+
+    for(;;)
+    {
+        // russian roulette
+
+        if(payload.seg_cnt >= trace_params.min_depth)
+        {
+            if(sampler.sample1().u > trace_params.cont_prob)
+                return;
+            payload.accu_coef /= trace_params.cont_prob;
+        }
+
+        EntityIntersection inct;
+        if(!scene.closest_intersection(payload.ray, &inct))
+            return;
+
+        const Medium *medium = inct.wr_medium();
+        payload.accu_coef *= medium->tr(payload.ray.o, inct.pos, sampler);
+
+        ++payload.seg_cnt;
+
+        if(payload.seg_cnt == 1)
+        {
+            // pdf of sampling the emitting point with light->sample
+
+            const FVec3 to_light = -emit.dir;
+
+            real direct_pdf_w;
+            if(auto area = light->as_area())
+                direct_pdf_w = area->pdf(inct.pos, emit.pos, emit.nor);
+            else
+                direct_pdf_w = light->as_envir()->pdf(inct.pos, to_light);
+
+            payload.dVCM = select_pdf * direct_pdf_w * cos_emit / emit_pdf_w;
+        }
+
+        update_mis_at_hit(inct, payload.seg_cnt > 1, payload);
+        if(payload.accu_coef.is_black())
+            return;
+
+        const ShadingPoint shd = inct.material->shade(inct, arena);
+        const bool is_delta = shd.bsdf->is_delta();
+
+        // store light vertex & connect to camera
+
+        if(!is_delta)
+        {
+            Vertex vtx;
+            vtx.pos       = inct.pos;
+            vtx.nor       = inct.geometry_coord.z;
+            vtx.wr        = inct.wr;
+            vtx.accu_coef = payload.accu_coef;
+            vtx.seg_cnt   = payload.seg_cnt;
+            vtx.bsdf      = shd.bsdf;
+            vtx.dVCM      = payload.dVCM;
+            vtx.dVC       = payload.dVC;
+            vtx.dVM       = payload.dVM;
+            light_vertices.push_back(vtx);
+
+            if(payload.seg_cnt + 1 <= trace_params.max_depth)
+            {
+                connect_to_camera(
+                    iter_params, scene, inct, shd.bsdf,
+                    payload, sampler, splats);
+            }
+        }
+
+        if(payload.seg_cnt + 2 > trace_params.max_depth)
+            return;
+
+        if(!sample_scattering(
+            iter_params, inct, shd.bsdf, TransMode::Importance,
+            sampler, payload))
+            return;
+    }
+}
+
+Pixel vcm_trace_eye_subpath(
+    const TraceParams &trace_params, const IterationParams &iter_params,
+    const Scene &scene, const Ray &ray, const FSpectrum &init_coef,
+    const Vertex *light_subpath, int light_vertex_count,
+    const VCMRangeSearchAccelerator &accel,
+    Sampler &sampler, Arena &arena)
+{
+    Pixel pixel;
+
+    const auto cam_pdf = scene.get_camera()->pdf_we(ray.o, ray.d);
+    if(cam_pdf.pdf_dir <= 0)
+        return pixel;
+
+    RayPayload payload;
+    payload.ray          = ray;
+    payload.accu_coef    = init_coef;
+    payload.seg_cnt      = 0;
+    payload.all_specular = true;
+    payload.dVCM         = iter_params.light_path_count
+                         / (iter_params.pixel_count * cam_pdf.pdf_dir);
+    payload.dVC          = 0;
+    payload.dVM          = 0;
+
+    for(;;)
+    {
+        // russian roulette
+
+        if(payload.seg_cnt >= trace_params.min_depth)
+        {
+            if(sampler.sample1().u > trace_params.cont_prob)
+                return pixel;
+            payload.accu_coef /= trace_params.cont_prob;
+        }
+
+        EntityIntersection inct;
+        if(!scene.closest_intersection(payload.ray, &inct))
+        {
+            ++payload.seg_cnt;
+            if(auto env = scene.envir_light())
+            {
+                pixel.value += payload.accu_coef
+                             * eye_hit_envir_light(scene, env, payload);
+            }
+            return pixel;
+        }
+
+        const Medium *medium = inct.wr_medium();
+        payload.accu_coef *= medium->tr(payload.ray.o, inct.pos, sampler);
+
+        ++payload.seg_cnt;
+
+        update_mis_at_hit(inct, true, payload);
+        if(payload.accu_coef.is_black())
+            return pixel;
+
+        const ShadingPoint shd = inct.material->shade(inct, arena);
+
+        // fill gbuffer
+
+        if(payload.seg_cnt == 1)
+        {
+            pixel.normal = shd.shading_normal;
+            pixel.albedo = shd.bsdf->albedo();
+            if(inct.entity->get_no_denoise_flag())
+                pixel.denoise = 0;
+        }
+
+        // hit area light
+
+        if(auto light = inct.entity->as_light())
+        {
+            pixel.value += payload.accu_coef
+                         * eye_hit_area_light(scene, light, inct, payload);
+        }
+
+        if(payload.seg_cnt >= trace_params.max_depth)
+            return pixel;
+
+        if(!shd.bsdf->is_delta())
+        {
+            // vertex connection
+
+            pixel.value += payload.accu_coef * direct_illumination(
+                iter_params, scene, inct, shd.bsdf, payload, sampler);
+
+            for(int i = 0; i < light_vertex_count; ++i)
+            {
+                const Vertex &light_vtx = light_subpath[i];
+                if(light_vtx.seg_cnt + 1 + payload.seg_cnt
+                    > trace_params.max_depth)
+                    break;
+
+                pixel.value += payload.accu_coef * connect_vertices(
+                    iter_params, scene, inct, shd.bsdf,
+                    payload, light_vtx, sampler);
+            }
+
+            // vertex merging
+
+            pixel.value += payload.accu_coef * merge_vertices(
+                trace_params, iter_params, inct, shd.bsdf, payload, accel);
+        }
+
+        if(!sample_scattering(
+            iter_params, inct, shd.bsdf, TransMode::Radiance,
+            sampler, payload))
+            return pixel;
+    }
+}
+
+} // namespace vcm
+
+AGZ_TRACER_RENDER_END
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <functional>
+
+#include <agz/tracer/core/bsdf.h>
+#include <agz/tracer/core/bssrdf.h>
+#include <agz/tracer/core/entity.h>
+#include <agz/tracer/core/material.h>
+#include <agz/tracer/core/medium.h>
+#include <agz/tracer/core/sampler.h>
+#include <agz/tracer/core/scene.h>
+#include <agz/tracer/render/direct_illum.h>
+#include <agz/tracer/render/wavefront_path_tracing.h>
+
+AGZ_TRACER_RENDER_BEGIN
+
+WavefrontPathTracer::WavefrontPathTracer(const TraceParams &params)
+    : params_(params)
+{
+
+}
+
+void WavefrontPathTracer::clear()
+{
+    ray_             .clear();
+    ray_diff_        .clear();
+    has_ray_diff_    .clear();
+    sampler_         .clear();
+    coef_            .clear();
+    depth_           .clear();
+    specular_depth_  .clear();
+    scattering_count_.clear();
+    inct_            .clear();
+    pixel_           .clear();
+}
+
+int WavefrontPathTracer::add_path(
+    const Ray &ray, const RayDifferential *ray_diff, Sampler *sampler)
+{
+    const int idx = path_count();
+
+    ray_             .push_back(ray);
+    ray_diff_        .push_back(ray_diff ? *ray_diff : RayDifferential{});
+    has_ray_diff_    .push_back(ray_diff != nullptr);
+    sampler_         .push_back(sampler);
+    coef_            .push_back(FSpectrum(1));
+    depth_           .push_back(1);
+    specular_depth_  .push_back(1);
+    scattering_count_.push_back(0);
+    inct_            .emplace_back();
+    pixel_           .emplace_back();
+
+    return idx;
+}
+
+void WavefrontPathTracer::trace(const Scene &scene, Arena &arena)
+{
+    active_.resize(ray_.size());
+    for(uint32_t i = 0; i < active_.size(); ++i)
+        active_[i] = i;
+
+    while(!active_.empty())
+    {
+        russian_roulette();
+        intersect(scene);
+        sort_hits();
+        shade(scene, arena);
+    }
+}
+
+int WavefrontPathTracer::path_count() const noexcept
+{
+    return static_cast<int>(ray_.size());
+}
+
+const Pixel &WavefrontPathTracer::get_pixel(int i) const noexcept
+{
+    return pixel_[i];
+}
+
+void WavefrontPathTracer::russian_roulette()
+{
+    next_active_.clear();
+
+    for(const uint32_t i : active_)
+    {
+        const int depth = depth_[i];
+        if(depth > params_.max_depth)
+            continue;
+
+        if(depth > params_.min_depth)
+        {
+            if(sampler_[i]->sample1().u > params_.cont_prob)
+                continue;
+            coef_[i] /= params_.cont_prob;
+        }
+
+        next_active_.push_back(i);
+    }
+}
+
+void WavefrontPathTracer::intersect(const Scene &scene)
+{
+    hits_.clear();
+
+    for(const uint32_t i : next_active_)
+    {
+        if(scene.closest_intersection(ray_[i], &inct_[i]))
+        {
+            hits_.push_back(i);
+            continue;
+        }
+
+        if(depth_[i] == 1)
+        {
+            if(auto light = scene.envir_light())
+                pixel_[i].value += coef_[i] * light->radiance(
+                    ray_[i].o, ray_[i].d);
+        }
+    }
+}
+
+void WavefrontPathTracer::sort_hits()
+{
+    // paths hitting the same material are adjacent after sorting.
+    // paths with the same material keep their order, so that consecutive
+    // paths (which are usually coherent) are still shaded consecutively
+
+    sort_keys_.resize(hits_.size());
+    for(size_t i = 0; i < hits_.size(); ++i)
+        sort_keys_[i] = { inct_[hits_[i]].material, hits_[i] };
+
+    std::sort(sort_keys_.begin(), sort_keys_.end(),
+        [](const SortKey &lhs, const SortKey &rhs)
+    {
+        if(lhs.material != rhs.material)
+            return std::less<const Material*>()(lhs.material, rhs.material);
+        return lhs.path < rhs.path;
+    });
+
+    for(size_t i = 0; i < hits_.size(); ++i)
+        hits_[i] = sort_keys_[i].path;
+}
+
+void WavefrontPathTracer::shade(const Scene &scene, Arena &arena)
+{
+    active_.clear();
+
+    for(const uint32_t i : hits_)
+    {
+        if(shade_path(scene, i, arena))
+            active_.push_back(i);
+    }
+
+    // restore the path order for coherent intersection tests
+
+    std::sort(active_.begin(), active_.end());
+
+    arena.release();
+}
+
+bool WavefrontPathTracer::shade_path(
+    const Scene &scene, uint32_t i, Arena &arena)
+{
+    Sampler &sampler = *sampler_[i];
+    EntityIntersection &ent_inct = inct_[i];
+    FSpectrum &coef = coef_[i];
+    Pixel &pixel = pixel_[i];
+    int &depth = depth_[i];
+
+    // texture footprint of the camera ray
+
+    if(depth == 1 && has_ray_diff_[i])
+        ent_inct.compute_uv_differential(ray_diff_[i]);
+
+    // fill gbuffer
+
+    const ShadingPoint ent_shd = ent_inct.material->shade(ent_inct, arena);
+    if(depth == 1)
+    {
+        pixel.normal = ent_shd.shading_normal;
+        pixel.albedo = ent_shd.bsdf->albedo();
+        if(ent_inct.entity->get_no_denoise_flag())
+            pixel.denoise = 0;
+    }
+
+    // sample medium scattering
+
+    const auto medium = ent_inct.wr_medium();
+
+    if(scattering_count_[i] < medium->get_max_scattering_count())
+    {
+        const auto medium_sample = medium->sample_scattering(
+            ray_[i].o, ent_inct.pos, sampler, arena);
+
+        // tr is accounted here
+        coef *= medium_sample.throughput;
+
+        // process medium scattering
+
+        if(medium_sample.is_scattering_happened())
+        {
+            ++scattering_count_[i];
+
+            const auto &scattering_point = medium_sample.scattering_point;
+            const auto phase_function = medium_sample.phase_function;
+
+            // compute direct illumination
+
+            FSpectrum direct_illum;
+            for(int j = 0; j < params_.direct_illum_sample_count; ++j)
+            {
+                direct_illum += coef * mis_sample_scene_lights(
+                    scene, scattering_point, phase_function, sampler);
+                direct_illum += coef * mis_sample_bsdf(
+                    scene, scattering_point, phase_function, sampler);
+            }
+
+            pixel.value += direct_illum / real(params_.direct_illum_sample_count);
+
+            // sample phase function
+
+            const auto bsdf_sample = phase_function->sample_all(
+                scattering_point.wr, TransMode::Radiance, sampler.sample3());
+            if(!bsdf_sample.f || bsdf_sample.pdf < EPS())
+                return false;
+
+            ray_[i] = Ray(scattering_point.pos, bsdf_sample.dir.normalize());
+            coef *= bsdf_sample.f / bsdf_sample.pdf;
+
+            ++depth;
+            return true;
+        }
+    }
+    else
+    {
+        // continus scattering count is too large
+        // only account absorbtion here
+        const FSpectrum ab = medium->ab(ray_[i].o, ent_inct.pos, sampler);
+        coef *= ab;
+    }
+
+    scattering_count_[i] = 0;
+
+    // process surface scattering
+
+    if(depth == 1)
+    {
+        if(auto light = ent_inct.entity->as_light())
+        {
+            pixel.value += coef * light->radiance(
+                ent_inct.pos, ent_inct.geometry_coord.z, ent_inct.uv, ent_inct.wr);
+        }
+    }
+
+    // direct illumination
+
+    FSpectrum direct_illum;
+    for(int j = 0; j < params_.direct_illum_sample_count; ++j)
+    {
+        direct_illum += coef * mis_sample_scene_lights(
+            scene, ent_inct, ent_shd, sampler);
+        direct_illum += coef * mis_sample_bsdf(
+            scene, ent_inct, ent_shd, sampler);
+    }
+
+    pixel.value += real(1) / params_.direct_illum_sample_count * direct_illum;
+
+    // sample bsdf
+
+    auto bsdf_sample = ent_shd.bsdf->sample_all(
+        ent_inct.wr, TransMode::Radiance, sampler.sample3());
+    if(!bsdf_sample.f || bsdf_sample.pdf < EPS())
+        return false;
+
+    bool is_new_sample_delta = bsdf_sample.is_delta;
+
+    const real abscos = std::abs(cos(
+        ent_inct.geometry_coord.z, bsdf_sample.dir));
+    coef *= bsdf_sample.f * abscos / bsdf_sample.pdf;
+
+    ray_[i] = Ray(ent_inct.eps_offset(bsdf_sample.dir),
+                  bsdf_sample.dir.normalize());
+
+    // bssrdf
+
+    const bool pos_in = ent_inct.geometry_coord.in_positive_z_hemisphere(
+        bsdf_sample.dir);
+    const bool pos_out = ent_inct.geometry_coord.in_positive_z_hemisphere(
+        ent_inct.wr);
+
+    if(ent_shd.bssrdf && !pos_in && pos_out)
+    {
+        const auto bssrdf_sample = ent_shd.bssrdf->sample_pi(
+            sampler.sample3(), arena);
+        if(!bssrdf_sample.coef)
+            return false;
+
+        coef *= bssrdf_sample.coef / bssrdf_sample.pdf;
+
+        auto &new_inct = bssrdf_sample.inct;
+        auto new_shd = new_inct.material->shade(new_inct, arena);
+
+        FSpectrum new_direct_illum;
+        for(int j = 0; j < params_.direct_illum_sample_count; ++j)
+        {
+            new_direct_illum += coef * mis_sample_scene_lights(
+                scene, new_inct, new_shd, sampler);
+            new_direct_illum += coef * mis_sample_bsdf(
+                scene, new_inct, new_shd, sampler);
+        }
+
+        pixel.value += real(1) / params_.direct_illum_sample_count
+                     * new_direct_illum;
+
+        const auto new_bsdf_sample = new_shd.bsdf->sample_all(
+            new_inct.wr, TransMode::Radiance, sampler.sample3());
+        if(!new_bsdf_sample.f)
+            return false;
+
+        const real new_abscos = std::abs(cos(
+            new_inct.geometry_coord.z, new_bsdf_sample.dir));
+        coef *= new_bsdf_sample.f * new_abscos / new_bsdf_sample.pdf;
+
+        ray_[i] = Ray(new_inct.eps_offset(new_bsdf_sample.dir),
+                      new_bsdf_sample.dir.normalize());
+
+        is_new_sample_delta = new_bsdf_sample.is_delta;
+    }
+
+    // specular scattering does not count into path depth
+
+    if(is_new_sample_delta && depth >= 2 &&
+       specular_depth_[i] <= params_.specular_depth)
+    {
+        --depth;
+        ++specular_depth_[i];
+    }
+
+    ++depth;
+    return true;
+}
+
+AGZ_TRACER_RENDER_END
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include <agz/tracer/utility/emitter_bvh.h>
+#include <agz/tracer/utility/triangle_aux.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+    // max depth of the bvh built by median splitting is about log2(n)
+    constexpr int PDF_STACK_SIZE = 64;
+
+    // lower bound of the orientation factor, so that no triangle has zero
+    // selection probability
+    constexpr real MIN_ORIENTATION_BOUND = real(0.01);
+
+    // barycentric tolerance when locating a point on triangles
+    constexpr real BARYCENTRIC_TOLERANCE = real(1e-3);
+
+    struct Cone
+    {
+        FVec3 axis;
+        real angle = 0;
+    };
+
+    // two-sided cone containing both cones, which bounds lines instead of
+    // directions. so its angle never exceeds pi / 2
+    Cone merge_cones(Cone c1, Cone c2) noexcept
+    {
+        if(dot(c1.axis, c2.axis) < 0)
+            c2.axis = -c2.axis;
+        if(c2.angle > c1.angle)
+            std::swap(c1, c2);
+
+        const real cos_d = math::clamp<real>(dot(c1.axis, c2.axis), -1, 1);
+        const real angle_d = std::acos(cos_d);
+        if(angle_d + c2.angle <= c1.angle)
+            return c1;
+
+        const real angle = (c1.angle + angle_d + c2.angle) / 2;
+        if(angle >= PI_r / 2)
+            return { c1.axis, PI_r / 2 };
+
+        const FVec3 rot_axis = cross(c1.axis, c2.axis);
+        if(rot_axis.length_square() <= 0)
+            return { c1.axis, angle };
+
+        // rotate c1.axis towards c2.axis
+        const real rot_angle = angle - c1.angle;
+        const FVec3 ortho = cross(rot_axis.normalize(), c1.axis);
+        const FVec3 axis = std::cos(rot_angle) * c1.axis
+                         + std::sin(rot_angle) * ortho;
+
+        return { axis.normalize(), angle };
+    }
+
+} // namespace anonymous
+
+TriangleEmitterBVH::TriangleEmitterBVH(std::vector<Triangle> triangles)
+    : triangles_(std::move(triangles))
+{
+    assert(!triangles_.empty());
+
+    const uint32_t count = static_cast<uint32_t>(triangles_.size());
+
+    std::vector<FVec3> centroids(count);
+    std::vector<uint32_t> indices(count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const Triangle &tri = triangles_[i];
+        centroids[i] = tri.a + (tri.b_a + tri.c_a) / 3;
+        indices[i] = i;
+    }
+
+    nodes_.reserve(2 * size_t(count) - 1);
+    build(indices.data(), count, centroids);
+
+    const AABB &root_bound = nodes_[0].bound;
+    tolerance_ = real(1e-4) * (root_bound.high - root_bound.low).length();
+}
+
+uint32_t TriangleEmitterBVH::build(
+    uint32_t *indices, uint32_t count, const std::vector<FVec3> &centroids)
+{
+    const uint32_t node_idx = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+
+    if(count == 1)
+    {
+        const Triangle &tri = triangles_[indices[0]];
+
+        Node leaf;
+        leaf.bound = AABB(tri.a, tri.a);
+        leaf.bound |= tri.a + tri.b_a;
+        leaf.bound |= tri.a + tri.c_a;
+
+        const FVec3 nor = cross(tri.b_a, tri.c_a);
+        if(nor.length_square() > 0)
+        {
+            leaf.axis      = nor.normalize();
+            leaf.cos_angle = 1;
+            leaf.sin_angle = 0;
+        }
+        else
+            leaf.axis = FVec3(0, 0, 1);
+
+        leaf.area              = triangle_area(tri.b_a, tri.c_a);
+        leaf.child_or_triangle = indices[0];
+        leaf.is_leaf           = true;
+
+        nodes_[node_idx] = leaf;
+        return node_idx;
+    }
+
+    // median split along the longest axis of centroid bound
+
+    AABB centroid_bound;
+    for(uint32_t i = 0; i < count; ++i)
+        centroid_bound |= centroids[indices[i]];
+
+    const FVec3 extent = centroid_bound.high - centroid_bound.low;
+    const int split_axis = extent.x > extent.y ?
+                           (extent.x > extent.z ? 0 : 2) :
+                           (extent.y > extent.z ? 1 : 2);
+
+    const uint32_t left_count = count / 2;
+    std::nth_element(
+        indices, indices + left_count, indices + count,
+        [&](uint32_t lhs, uint32_t rhs)
+    {
+        return centroids[lhs][split_axis] < centroids[rhs][split_axis];
+    });
+
+    const uint32_t left = build(indices, left_count, centroids);
+    const uint32_t right = build(
+        indices + left_count, count - left_count, centroids);
+
+    const Node &l = nodes_[left], &r = nodes_[right];
+
+    const Cone cone = merge_cones(
+        { l.axis, std::acos(math::clamp<real>(l.cos_angle, -1, 1)) },
+        { r.axis, std::acos(math::clamp<real>(r.cos_angle, -1, 1)) });
+
+    Node interior;
+    interior.bound             = l.bound | r.bound;
+    interior.axis              = cone.axis;
+    interior.cos_angle         = std::cos(cone.angle);
+    interior.sin_angle         = std::sin(cone.angle);
+    interior.area              = l.area + r.area;
+    interior.child_or_triangle = right;
+    interior.is_leaf           = false;
+
+    nodes_[node_idx] = interior;
+    return node_idx;
+}
+
+real TriangleEmitterBVH::importance(
+    const Node &node, const FVec3 &ref) const noexcept
+{
+    const FVec3 centre = (node.bound.low + node.bound.high) / 2;
+    const real radius2 = (node.bound.high - node.bound.low).length_square() / 4;
+
+    const FVec3 centre_to_ref = ref - centre;
+    const real dist2 = centre_to_ref.length_square();
+    if(dist2 <= radius2)
+        return node.area / (std::max)(radius2, EPS());
+
+    // max |cos| between normals in the cone and directions to ref.
+    // angle between axis and direction to ref is reduced by the cone angle
+    // and the angle subtended by the bounding sphere
+
+    const real cos_t = std::abs(dot(node.axis, centre_to_ref)) / std::sqrt(dist2);
+    const real sin_t = local_angle::cos_2_sin(cos_t);
+
+    real orientation = 1;
+    if(cos_t < node.cos_angle)
+    {
+        const real cos_x = cos_t * node.cos_angle + sin_t * node.sin_angle;
+        const real sin_x = sin_t * node.cos_angle - cos_t * node.sin_angle;
+
+        const real sin_u = std::sqrt(radius2 / dist2);
+        const real cos_u = local_angle::cos_2_sin(sin_u);
+
+        if(cos_x < cos_u)
+            orientation = cos_x * cos_u + sin_x * sin_u;
+    }
+
+    orientation = (std::max)(orientation, MIN_ORIENTATION_BOUND);
+    return node.area * orientation / dist2;
+}
+
+real TriangleEmitterBVH::barycentric_violation(
+    const Triangle &tri, const FVec3 &pos) const noexcept
+{
+    constexpr real INF = std::numeric_limits<real>::infinity();
+
+    const FVec3 nor = cross(tri.b_a, tri.c_a);
+    const real nor_len = nor.length();
+    if(!nor_len)
+        return INF;
+
+    const FVec3 p_a = pos - tri.a;
+    if(std::abs(dot(p_a, nor)) > tolerance_ * nor_len)
+        return INF;
+
+    const real d00 = dot(tri.b_a, tri.b_a);
+    const real d01 = dot(tri.b_a, tri.c_a);
+    const real d11 = dot(tri.c_a, tri.c_a);
+    const real d20 = dot(p_a, tri.b_a);
+    const real d21 = dot(p_a, tri.c_a);
+
+    const real inv_det = 1 / (d00 * d11 - d01 * d01);
+    const real beta  = (d11 * d20 - d01 * d21) * inv_det;
+    const real gamma = (d00 * d21 - d01 * d20) * inv_det;
+
+    return (std::max)({ real(0), -beta, -gamma, beta + gamma - 1 });
+}
+
+std::pair<uint32_t, real> TriangleEmitterBVH::sample(
+    const FVec3 &ref, real u) const noexcept
+{
+    constexpr real ONE_MINUS = real(1) - std::numeric_limits<real>::epsilon();
+
+    uint32_t node_idx = 0;
+    real prob = 1;
+
+    while(!nodes_[node_idx].is_leaf)
+    {
+        const uint32_t left  = node_idx + 1;
+        const uint32_t right = nodes_[node_idx].child_or_triangle;
+
+        real left_imp  = importance(nodes_[left],  ref);
+        real right_imp = importance(nodes_[right], ref);
+        if(left_imp + right_imp <= 0)
+        {
+            left_imp  = nodes_[left].area;
+            right_imp = nodes_[right].area;
+        }
+
+        const real left_prob = left_imp / (left_imp + right_imp);
+        if(u < left_prob)
+        {
+            u = (std::min)(u / left_prob, ONE_MINUS);
+            prob *= left_prob;
+            node_idx = left;
+        }
+        else
+        {
+            u = (std::min)((u - left_prob) / (1 - left_prob), ONE_MINUS);
+            prob *= 1 - left_prob;
+            node_idx = right;
+        }
+    }
+
+    return { nodes_[node_idx].child_or_triangle, prob };
+}
+
+real TriangleEmitterBVH::pdf(
+    const FVec3 &ref, const FVec3 &pos, uint32_t *triangle_idx) const noexcept
+{
+    const FVec3 tolerance(tolerance_);
+    auto contains = [&](const Node &node)
+    {
+        return AABB(node.bound.low - tolerance,
+                    node.bound.high + tolerance).contains(pos);
+    };
+
+    if(!contains(nodes_[0]))
+        return 0;
+
+    struct Entry
+    {
+        uint32_t node_idx;
+        real prob;
+    };
+
+    Entry stack[PDF_STACK_SIZE];
+    int top = 0;
+    stack[top++] = { 0, 1 };
+
+    // nearest triangle within the barycentric tolerance
+
+    real best_violation = BARYCENTRIC_TOLERANCE;
+    real best_prob = 0;
+    uint32_t best_triangle = 0;
+
+    while(top)
+    {
+        const Entry entry = stack[--top];
+        const Node &node = nodes_[entry.node_idx];
+
+        if(node.is_leaf)
+        {
+            const real violation = barycentric_violation(
+                triangles_[node.child_or_triangle], pos);
+
+            if(violation <= 0)
+            {
+                *triangle_idx = node.child_or_triangle;
+                return entry.prob;
+            }
+
+            if(violation <= best_violation)
+            {
+                best_violation = violation;
+                best_prob      = entry.prob;
+                best_triangle  = node.child_or_triangle;
+            }
+            continue;
+        }
+
+        const uint32_t left  = entry.node_idx + 1;
+        const uint32_t right = node.child_or_triangle;
+
+        real left_imp  = importance(nodes_[left],  ref);
+        real right_imp = importance(nodes_[right], ref);
+        if(left_imp + right_imp <= 0)
+        {
+            left_imp  = nodes_[left].area;
+            right_imp = nodes_[right].area;
+        }
+
+        const real left_prob = left_imp / (left_imp + right_imp);
+
+        if(top + 2 > PDF_STACK_SIZE)
+            continue;
+        if(contains(nodes_[right]))
+            stack[top++] = { right, entry.prob * (1 - left_prob) };
+        if(contains(nodes_[left]))
+            stack[top++] = { left, entry.prob * left_prob };
+    }
+
+    if(best_prob > 0)
+        *triangle_idx = best_triangle;
+    return best_prob;
+}
+
+AGZ_TRACER_END
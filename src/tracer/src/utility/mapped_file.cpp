@@ -0,0 +1,125 @@
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+
+#include <agz/tracer/utility/mapped_file.h>
+
+AGZ_TRACER_BEGIN
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &filename)
+{
+    HANDLE file = CreateFileA(
+        filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("failed to open file: " + filename);
+    file_handle_ = file;
+
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file, &file_size))
+    {
+        close();
+        throw std::runtime_error("failed to get size of file: " + filename);
+    }
+    size_ = static_cast<size_t>(file_size.QuadPart);
+
+    // empty files cannot be mapped
+    if(!size_)
+        return;
+
+    HANDLE mapping = CreateFileMappingA(
+        file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mapping)
+    {
+        close();
+        throw std::runtime_error("failed to map file: " + filename);
+    }
+    mapping_handle_ = mapping;
+
+    data_ = static_cast<const unsigned char*>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(!data_)
+    {
+        close();
+        throw std::runtime_error("failed to map file: " + filename);
+    }
+}
+
+void MappedFile::close() noexcept
+{
+    if(data_)
+        UnmapViewOfFile(data_);
+    if(mapping_handle_)
+        CloseHandle(mapping_handle_);
+    if(file_handle_)
+        CloseHandle(file_handle_);
+    data_           = nullptr;
+    mapping_handle_ = nullptr;
+    file_handle_    = nullptr;
+    size_           = 0;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filename)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("failed to get size of file: " + filename);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+
+    // empty files cannot be mapped
+    if(!size_)
+    {
+        ::close(fd);
+        return;
+    }
+
+    void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping keeps the file alive
+    ::close(fd);
+
+    if(addr == MAP_FAILED)
+    {
+        size_ = 0;
+        throw std::runtime_error("failed to map file: " + filename);
+    }
+    data_ = static_cast<const unsigned char*>(addr);
+}
+
+void MappedFile::close() noexcept
+{
+    if(data_)
+        munmap(const_cast<unsigned char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+AGZ_TRACER_END
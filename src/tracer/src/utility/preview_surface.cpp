@@ -0,0 +1,83 @@
+#include <vector>
+
+#include <agz/tracer/utility/preview_surface.h>
+
+AGZ_TRACER_BEGIN
+
+PreviewSurface::PreviewSurface(int width, int height, int max_size)
+    : width_(width), height_(height), factor_(1)
+{
+    const int size = (std::max)(width, height);
+    if(max_size > 0 && size > max_size)
+        factor_ = (size + max_size - 1) / max_size;
+
+    preview_.initialize(
+        (height + factor_ - 1) / factor_, (width + factor_ - 1) / factor_);
+}
+
+void PreviewSurface::update(
+    const Rect2i &pixel_range,
+    const Image2D<Spectrum> &value, const Image2D<real> &weight,
+    const Image2D<Spectrum> *background)
+{
+    // preview pixel i samples full-resolution pixel
+    // min(i * factor + factor / 2, size - 1)
+
+    const int half = factor_ / 2;
+
+    auto source = [&](int i, int size)
+    {
+        return (std::min)(i * factor_ + half, size - 1);
+    };
+
+    // first preview pixel whose source pixel is not less than low
+    auto preview_beg = [&](int low)
+    {
+        return (std::max)(0, (low - half + factor_ - 1) / factor_);
+    };
+
+    const int x_beg = preview_beg(pixel_range.low.x);
+    const int y_beg = preview_beg(pixel_range.low.y);
+
+    // resolve pixels without holding the lock
+
+    struct Texel { int x, y; Spectrum value; };
+    std::vector<Texel> texels;
+
+    for(int py = y_beg; py < preview_.height(); ++py)
+    {
+        const int y = source(py, height_);
+        if(y > pixel_range.high.y)
+            break;
+        if(y < pixel_range.low.y)
+            continue;
+
+        for(int px = x_beg; px < preview_.width(); ++px)
+        {
+            const int x = source(px, width_);
+            if(x > pixel_range.high.x)
+                break;
+            if(x < pixel_range.low.x)
+                continue;
+
+            const real w = weight(y, x);
+            Spectrum v = w > 0 ? value(y, x) / w : value(y, x);
+            if(background)
+                v += (*background)(y, x);
+
+            texels.push_back({ px, py, v });
+        }
+    }
+
+    std::lock_guard lk(mutex_);
+    for(auto &t : texels)
+        preview_(t.y, t.x) = t.value;
+}
+
+Image2D<Spectrum> PreviewSurface::snapshot() const
+{
+    std::lock_guard lk(mutex_);
+    return preview_;
+}
+
+AGZ_TRACER_END
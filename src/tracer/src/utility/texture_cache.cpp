@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cassert>
+
+#include <agz/tracer/utility/texture_cache.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+    constexpr uint64_t INVALID_KEY = ~uint64_t(0);
+
+    // local hits are added to the shared counter in batches
+    constexpr uint64_t LOCAL_HIT_FLUSH_COUNT = 1024;
+
+    struct LocalTileTable
+    {
+        static constexpr int SLOT_COUNT = 64;
+
+        struct Slot
+        {
+            uint64_t key = INVALID_KEY;
+            RC<const TextureCache::Tile> tile;
+        };
+
+        Slot slots[SLOT_COUNT];
+
+        uint64_t pending_hit_count = 0;
+
+        Slot &slot(uint64_t key) noexcept
+        {
+            // fibonacci hashing
+            const uint64_t h = key * 0x9e3779b97f4a7c15ull;
+            return slots[h >> 58];
+        }
+    };
+
+    static_assert(LocalTileTable::SLOT_COUNT == 64);
+
+    thread_local LocalTileTable local_table;
+
+    size_t shard_index(uint64_t key) noexcept
+    {
+        return static_cast<size_t>((key ^ (key >> 29)) * 0xbf58476d1ce4e5b9ull >> 59);
+    }
+
+} // namespace anonymous
+
+TextureCache::TextureCache()
+    : shard_budget_(DEFAULT_BUDGET_BYTES / SHARD_COUNT)
+{
+
+}
+
+TextureCache &TextureCache::instance()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+uint32_t TextureCache::new_texture_id() noexcept
+{
+    static std::atomic<uint32_t> next_id = 1;
+    return next_id++;
+}
+
+uint64_t TextureCache::make_key(
+    uint32_t texture_id, int level, int tile_x, int tile_y) noexcept
+{
+    // texture id: 32 bits, level: 5 bits, tile y: 13 bits, tile x: 14 bits
+    assert(0 <= level && level < (1 << 5));
+    assert(0 <= tile_y && tile_y < (1 << 13));
+    assert(0 <= tile_x && tile_x < (1 << 14));
+    return (uint64_t(texture_id) << 32) | (uint64_t(level) << 27)
+         | (uint64_t(tile_y) << 14) | uint64_t(tile_x);
+}
+
+void TextureCache::set_budget(size_t budget_bytes)
+{
+    // keep at least one tile in each shard
+    shard_budget_ = (std::max)(budget_bytes / SHARD_COUNT, TILE_BYTES);
+
+    for(auto &shard : shards_)
+    {
+        std::lock_guard lk(shard.mutex);
+        shrink(shard);
+    }
+}
+
+void TextureCache::shrink(Shard &shard)
+{
+    const size_t budget = shard_budget_;
+    while(shard.resident_bytes > budget && !shard.lru.empty())
+    {
+        shard.key2node.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        shard.resident_bytes -= TILE_BYTES;
+
+        resident_bytes_ -= TILE_BYTES;
+        ++evicted_count_;
+    }
+}
+
+void TextureCache::add_resident_bytes(size_t bytes) noexcept
+{
+    const size_t new_bytes = resident_bytes_ += bytes;
+
+    size_t peak = peak_resident_bytes_.load();
+    while(peak < new_bytes &&
+          !peak_resident_bytes_.compare_exchange_weak(peak, new_bytes))
+        ;
+}
+
+RC<const TextureCache::Tile> TextureCache::lookup_shared(
+    uint64_t key, const TextureTileSource &source,
+    int level, int tile_x, int tile_y)
+{
+    Shard &shard = shards_[shard_index(key)];
+
+    {
+        std::lock_guard lk(shard.mutex);
+        if(auto it = shard.key2node.find(key); it != shard.key2node.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            ++shared_hit_count_;
+            return it->second->second;
+        }
+    }
+
+    // decode without holding the lock. when another thread has inserted
+    // the same tile meanwhile, its copy is used
+
+    ++miss_count_;
+
+    auto tile = newRC<Tile>(TILE_TEXEL_COUNT);
+    source.load_tile(level, tile_x, tile_y, tile->data());
+
+    std::lock_guard lk(shard.mutex);
+
+    if(auto it = shard.key2node.find(key); it != shard.key2node.end())
+    {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->second;
+    }
+
+    shard.lru.emplace_front(key, tile);
+    shard.key2node[key] = shard.lru.begin();
+    shard.resident_bytes += TILE_BYTES;
+    add_resident_bytes(TILE_BYTES);
+
+    shrink(shard);
+
+    return tile;
+}
+
+const math::color3b *TextureCache::lookup(
+    uint32_t texture_id, const TextureTileSource &source,
+    int level, int tile_x, int tile_y)
+{
+    const uint64_t key = make_key(texture_id, level, tile_x, tile_y);
+
+    LocalTileTable &table = local_table;
+    LocalTileTable::Slot &slot = table.slot(key);
+
+    if(slot.key == key)
+    {
+        if(++table.pending_hit_count >= LOCAL_HIT_FLUSH_COUNT)
+        {
+            local_hit_count_ += table.pending_hit_count;
+            table.pending_hit_count = 0;
+        }
+        return slot.tile->data();
+    }
+
+    slot.tile = lookup_shared(key, source, level, tile_x, tile_y);
+    slot.key  = key;
+    return slot.tile->data();
+}
+
+TextureCacheStatistics TextureCache::statistics() const
+{
+    TextureCacheStatistics ret;
+    ret.local_hit_count     = local_hit_count_;
+    ret.shared_hit_count    = shared_hit_count_;
+    ret.miss_count          = miss_count_;
+    ret.evicted_count       = evicted_count_;
+    ret.resident_bytes      = resident_bytes_;
+    ret.peak_resident_bytes = peak_resident_bytes_;
+    ret.budget_bytes        = shard_budget_ * SHARD_COUNT;
+    return ret;
+}
+
+AGZ_TRACER_END